@@ -0,0 +1,191 @@
+// AAC 聚合的对比测试：同一个 .aac 文件按不同的聚合时延上限打包(和 main.c 的规则相同)，
+// 输出每秒报文数、相对每帧一个报文减少的比例、线上字节数(含 IP/UDP/RTP 头)和聚合带来的时延，
+// 并把所有报文发给本机一个不读取的 UDP 套接字，测出每秒音频的发送耗时
+// gcc -O2 -I../h264_rtsp_code aac_agg_bench.c ../h264_rtsp_code/rtp.c ../h264_rtsp_code/rtpheader.c ../h264_rtsp_code/adts.c -o aac_agg_bench
+// ./aac_agg_bench [-l 时延上限毫秒,逗号分隔] test.aac
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "rtp.h"
+#include "adts.h"
+
+// 一帧最长 8191 字节，最多拆成这么多个分片
+#define AAC_MAX_FRAGMENTS (8191 / (RTP_MAX_PKT_SIZE - 4) + 1)
+// IPv4 头 + UDP 头
+#define IP_UDP_HEADER_SIZE 28
+#define MAX_LATENCIES 16
+
+struct AggResult
+{
+    uint64_t packets;
+    uint64_t wireBytes;    // 含 IP/UDP/RTP 头和 AU header
+    uint64_t payloadBytes; // 只算 AAC 帧数据
+    uint32_t maxFrames;    // 一个报文中最多的帧数
+    double sendUs;         // 发送所有报文的耗时
+};
+
+static uint64_t getMonotonicUs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// 把攒下的帧打包发送，规则和 main.c 的 rtpSendAACFrames() 一样：一帧时不复制，超过 MTU 就分片
+static int flushFrames(int sockfd, int port, struct RtpHeader *rtpHeader, const uint8_t **frames,
+                       uint32_t *sizes, int count, uint32_t samples, struct AggResult *result)
+{
+    struct RtpPacketView views[AAC_MAX_FRAGMENTS];
+    uint8_t payload[RTP_MAX_PKT_SIZE];
+    uint64_t start;
+    int n, i;
+
+    if (count == 0)
+        return 0;
+
+    if (count == 1)
+        n = rtpPacketizeAAC(rtpHeader, frames[0], sizes[0], views, AAC_MAX_FRAGMENTS);
+    else
+        n = rtpPacketizeAACFrames(rtpHeader, frames, sizes, count, payload, views);
+    if (n < 0)
+        return -1;
+
+    start = getMonotonicUs();
+    rtpSendPacketViewsOverUdp(sockfd, "127.0.0.1", port, views, n);
+    result->sendUs += getMonotonicUs() - start;
+
+    result->packets += n;
+    for (i = 0; i < n; i++)
+        result->wireBytes += IP_UDP_HEADER_SIZE + views[i].headerSize + views[i].payloadSize;
+    for (i = 0; i < count; i++)
+        result->payloadBytes += sizes[i];
+    if ((uint32_t)count > result->maxFrames)
+        result->maxFrames = count;
+
+    rtpHeader->timestamp += samples;
+
+    return 0;
+}
+
+// 按时延上限 latencyMs 把整个文件打包发送一遍
+static int runLatency(struct AdtsSource *source, int latencyMs, int sockfd, int port, struct AggResult *result)
+{
+    const uint8_t *frames[RTP_AAC_MAX_AUS];
+    uint32_t sizes[RTP_AAC_MAX_AUS];
+    struct RtpHeader rtpHeader;
+    const uint8_t *frame;
+    uint32_t frameSize, frameSamples, bytes = 0, samples = 0;
+    int count = 0, maxCount;
+
+    memset(result, 0, sizeof(*result));
+    rtpHeaderInit(&rtpHeader, RTP_PAYLOAD_TYPE_AAC, 0, 0, 0x12345678);
+
+    maxCount = (uint64_t)latencyMs * source->sampleRate / (1000 * ADTS_SAMPLES_PER_FRAME) + 1;
+    if (maxCount > RTP_AAC_MAX_AUS)
+        maxCount = RTP_AAC_MAX_AUS;
+
+    adtsSeek(source, 0);
+    while (adtsNextFrame(source, &frame, &frameSize, &frameSamples) >= 0)
+    {
+        if (count > 0 && (count >= maxCount || rtpAACAggregateSize(count + 1, bytes + frameSize) > RTP_MAX_PKT_SIZE))
+        {
+            if (flushFrames(sockfd, port, &rtpHeader, frames, sizes, count, samples, result) < 0)
+                return -1;
+            count = 0;
+            bytes = 0;
+            samples = 0;
+        }
+
+        frames[count] = frame;
+        sizes[count] = frameSize;
+        count++;
+        bytes += frameSize;
+        samples += frameSamples;
+    }
+
+    return flushFrames(sockfd, port, &rtpHeader, frames, sizes, count, samples, result);
+}
+
+int main(int argc, char *argv[])
+{
+    int latencies[MAX_LATENCIES] = {0, 20, 50, 100, 200};
+    int latencyCount = 5;
+    struct AdtsSource source;
+    struct AggResult base, result;
+    struct sockaddr_in addr;
+    socklen_t addrLen = sizeof(addr);
+    uint64_t totalSamples = 0;
+    const uint8_t *frame;
+    uint32_t frameSize, frameSamples;
+    double seconds, frameMs;
+    int sinkfd, sockfd, opt, i;
+    char *p;
+
+    while ((opt = getopt(argc, argv, "l:")) != -1)
+    {
+        if (opt != 'l')
+            break;
+        latencyCount = 0;
+        for (p = strtok(optarg, ","); p && latencyCount < MAX_LATENCIES; p = strtok(NULL, ","))
+            latencies[latencyCount++] = atoi(p);
+    }
+    if (optind >= argc || latencyCount == 0)
+    {
+        printf("usage: %s [-l latency_ms,latency_ms,...] file.aac\n", argv[0]);
+        return -1;
+    }
+
+    if (adtsOpen(&source, argv[optind]) < 0)
+    {
+        printf("failed to open %s\n", argv[optind]);
+        return -1;
+    }
+    while (adtsNextFrame(&source, &frame, &frameSize, &frameSamples) >= 0)
+        totalSamples += frameSamples;
+    seconds = (double)totalSamples / source.sampleRate;
+    frameMs = 1000.0 * ADTS_SAMPLES_PER_FRAME / source.sampleRate;
+    printf("%s: %d frames, %.1fs, %d Hz, %d channels, %.1f ms per frame\n", argv[optind],
+           source.frameCount, seconds, source.sampleRate, source.channels, frameMs);
+
+    // 接收端只绑定不读取，缓冲区满了之后内核直接丢弃，发送端照常走完整个发送路径
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    sinkfd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sinkfd < 0 || sockfd < 0 || bind(sinkfd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        return -1;
+    getsockname(sinkfd, (struct sockaddr *)&addr, &addrLen);
+
+    // 每帧一个报文作为对比的基准
+    if (runLatency(&source, 0, sockfd, ntohs(addr.sin_port), &base) < 0)
+        return -1;
+
+    printf("%13s %9s %10s %10s %10s %9s %14s\n", "latency", "frames", "pkt/s", "reduction",
+           "kbit/s", "overhead", "send us/s");
+    for (i = 0; i < latencyCount; i++)
+    {
+        if (runLatency(&source, latencies[i], sockfd, ntohs(addr.sin_port), &result) < 0)
+            return -1;
+
+        // 聚合时第一帧要等到最后一帧编码出来才能发送，多出的时延是前面这些帧的时长
+        printf("%4d ms(+%3.0f) %5u max %10.1f %9.1f%% %10.1f %8.1f%% %14.1f\n", latencies[i],
+               (result.maxFrames - 1) * frameMs, result.maxFrames, result.packets / seconds,
+               100.0 * (1.0 - (double)result.packets / base.packets), result.wireBytes * 8 / seconds / 1000,
+               100.0 * (result.wireBytes - result.payloadBytes) / result.wireBytes, result.sendUs / seconds);
+    }
+
+    close(sockfd);
+    close(sinkfd);
+    adtsClose(&source);
+
+    return 0;
+}
@@ -1,6 +1,6 @@
 //
-// gcc main.c rtp.c rtp.h -o main
-// ./main test.aac
+// gcc -I../h264_rtsp_code main.c ../h264_rtsp_code/rtp.c ../h264_rtsp_code/rtpheader.c ../h264_rtsp_code/rtcp.c ../h264_rtsp_code/rtsp.c ../h264_rtsp_code/pacer.c ../h264_rtsp_code/adts.c -o main
+// ./main [-l 聚合时延毫秒] [test.aac]
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
@@ -14,6 +14,10 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 #include "rtp.h"
+#include "adts.h"
+#include "pacer.h"
+#include "rtcp.h"
+#include "rtsp.h"
 
 #define SERVER_IP "192.168.50.236"
 #define SERVER_PORT 8554
@@ -21,6 +25,15 @@
 #define SERVER_RTCP_PORT 55533
 #define BUF_MAX_SIZE (1024 * 1024)
 #define AAC_FILE_NAME "test.aac"
+// 多个 AAC 帧聚合成一个报文时，第一帧最多等待这么久才发送，0 表示每帧一个报文
+#define AAC_MAX_LATENCY_MS 100
+// 一帧最长 8191 字节，最多拆成这么多个分片
+#define AAC_MAX_FRAGMENTS (8191 / (RTP_MAX_PKT_SIZE - 4) + 1)
+
+static const char *aacFileName = AAC_FILE_NAME;
+static int maxLatencyMs = AAC_MAX_LATENCY_MS;
+// 启动时打开并建立索引，每个客户端 PLAY 时从头开始读
+static struct AdtsSource aacSource;
 
 static int createTcpSocket()
 {
@@ -64,99 +77,84 @@ static int bindSocketAddr(int sockfd, const char *ip, int port)
     return 0;
 }
 
-// Use to describe AAC audio data
-struct AdtsHeader
+// 等待聚合的 AAC 帧，攒满一个报文或者达到时延上限时一起发送
+// 帧数据仍在文件映射中，这里只记录指针
+struct AacAggregate
 {
-    unsigned int syncword;     // 12 bit 同步字 '1111 1111 1111'，一个ADTS帧的开始
-    uint8_t id;                // 1 bit 0代表MPEG-4, 1代表MPEG-2。
-    uint8_t layer;             // 2 bit 必须为0
-    uint8_t protectionAbsent;  // 1 bit 1代表没有CRC，0代表有CRC
-    uint8_t profile;           // 1 bit AAC级别（MPEG-2 AAC中定义了3种profile，MPEG-4 AAC中定义了6种profile）
-    uint8_t samplingFreqIndex; // 4 bit 采样率
-    uint8_t privateBit;        // 1bit 编码时设置为0，解码时忽略
-    uint8_t channelCfg;        // 3 bit 声道数量
-    uint8_t originalCopy;      // 1bit 编码时设置为0，解码时忽略
-    uint8_t home;              // 1 bit 编码时设置为0，解码时忽略
-
-    uint8_t copyrightIdentificationBit;   // 1 bit 编码时设置为0，解码时忽略
-    uint8_t copyrightIdentificationStart; // 1 bit 编码时设置为0，解码时忽略
-    unsigned int aacFrameLength;          // 13 bit 一个ADTS帧的长度包括ADTS头和AAC原始流
-    unsigned int adtsBufferFullness;      // 11 bit 缓冲区充满度，0x7FF说明是码率可变的码流，不需要此字段。CBR可能需要此字段，不同编码器使用情况不同。这个在使用音频编码的时候需要注意。
-
-    // number_of_raw_data_blocks_in_frame
-    // 表示ADTS帧中有number_of_raw_data_blocks_in_frame + 1个AAC原始帧
-    // 所以说number_of_raw_data_blocks_in_frame == 0
-    // 表示说ADTS帧中有一个AAC数据块并不是说没有。(一个AAC原始帧包含一段时间内1024个采样及相关数据)
-
-    uint8_t numberOfRawDataBlockInFrame; // 2 bit
+    const uint8_t *frames[RTP_AAC_MAX_AUS];
+    uint32_t sizes[RTP_AAC_MAX_AUS];
+    int count;
+    int maxCount;         // 由时延上限决定
+    uint32_t bytes;
+    uint32_t samples;     // 所有帧的采样数
+    uint32_t lastSamples; // 最后一帧的采样数
 };
 
-static int parseAdtsHeader(uint8_t *in, struct AdtsHeader *res)
+// 下一帧还能不能放进当前的报文
+static int aacAggregateFits(struct AacAggregate *agg, uint32_t frameSize)
 {
-    static int frame_number = 0;
-    memset(res, 0, sizeof(*res));
-
-    if ((in[0] == 0xFF) && ((in[1] & 0xF0) == 0xF0))
-    {
-        res->id = ((uint8_t)in[1] & 0x08) >> 3;    //第二个字节与0x08与运算之后，获得第13位bit对应的值ֵ
-        res->layer = ((uint8_t)in[1] & 0x06) >> 1; //第二个字节与0x06与运算之后，右移1位，获得第14,15位两个bit对应的值
-        res->protectionAbsent = (uint8_t)in[1] & 0x01;
-        res->profile = ((uint8_t)in[2] & 0xc0) >> 6;
-        res->samplingFreqIndex = ((uint8_t)in[2] & 0x3c) >> 2;
-        res->privateBit = ((uint8_t)in[2] & 0x02) >> 1;
-        res->channelCfg = ((((uint8_t)in[2] & 0x01) << 2) | (((unsigned int)in[3] & 0xc0) >> 6));
-        res->originalCopy = ((uint8_t)in[3] & 0x20) >> 5;
-        res->home = ((uint8_t)in[3] & 0x10) >> 4;
-        res->copyrightIdentificationBit = ((uint8_t)in[3] & 0x08) >> 3;
-        res->copyrightIdentificationStart = (uint8_t)in[3] & 0x04 >> 2;
-
-        res->aacFrameLength = (((((unsigned int)in[3]) & 0x03) << 11) |
-                               (((unsigned int)in[4] & 0xFF) << 3) |
-                               ((unsigned int)in[5] & 0xE0) >> 5);
-
-        res->adtsBufferFullness = (((unsigned int)in[5] & 0x1f) << 6 |
-                                   ((unsigned int)in[6] & 0xfc) >> 2);
-        res->numberOfRawDataBlockInFrame = ((uint8_t)in[6] & 0x03);
-
-        return 0;
-    }
-    else
-    {
-        printf("failed to parse adts header\n");
-        return -1;
-    }
+    return agg->count < agg->maxCount &&
+           rtpAACAggregateSize(agg->count + 1, agg->bytes + frameSize) <= RTP_MAX_PKT_SIZE;
 }
 
-static int rtpSendAACFrame(int socket, const char *ip, int16_t port,
-                           struct RtpPacket *rtpPacket, uint8_t *frame, uint32_t frameSize)
+// rtpChannel >= 0 时 socket 是 RTSP 连接，报文加上 '$' 帧头在这个连接上发送
+// 攒下的帧打包成一个报文，只有一帧时不复制，超过 MTU 就分片
+// 直播时最后一帧编码出来才能发送，所以等到最后一帧的时刻，聚合带来的时延就是前面这些帧的时长
+static int rtpSendAACFrames(int socket, const char *ip, int16_t port, int rtpChannel,
+                            struct RtpHeader *rtpHeader, struct AacAggregate *agg,
+                            struct RtpPacer *pacer, struct RtcpStats *rtcpStats)
 {
     //打包文档：https://blog.csdn.net/yangguoyu8023/article/details/106517251/
-    int ret;
+    struct RtpPacketView views[AAC_MAX_FRAGMENTS];
+    uint8_t payload[RTP_MAX_PKT_SIZE];
+    uint64_t scheduledUs, lateUs;
+    int count, i, ret;
+
+    if (agg->count == 0)
+        return 0;
 
-    rtpPacket->payload[0] = 0x00;
-    rtpPacket->payload[1] = 0x10;
-    rtpPacket->payload[2] = (frameSize & 0x1FE0) >> 5; //高8位
-    rtpPacket->payload[3] = (frameSize & 0x1F) << 3;   //低5位
+    // 按时间戳等到发送时刻，读文件和发送花费的时间不会累积
+    scheduledUs = pacerSchedule(pacer, rtpHeader->timestamp + agg->samples - agg->lastSamples);
+    lateUs = pacerLateUs(scheduledUs, getMonotonicUs());
+    if (lateUs > 0)
+    {
+        printf("pacer: %llu us behind schedule, resync\n", (unsigned long long)lateUs);
+        pacerShift(pacer, lateUs);
+        scheduledUs += lateUs;
+    }
+    sleepUntilUs(scheduledUs);
+    pacerRecordSend(pacer, scheduledUs, getMonotonicUs());
 
-    //将aac音频帧的数据复制到RTP包的有效负载(payload)部分的适当位置
-    memcpy(rtpPacket->payload + 4, frame, frameSize);
+    if (agg->count == 1)
+        count = rtpPacketizeAAC(rtpHeader, agg->frames[0], agg->sizes[0],
+                                views, AAC_MAX_FRAGMENTS);
+    else
+        count = rtpPacketizeAACFrames(rtpHeader, agg->frames, agg->sizes, agg->count,
+                                      payload, views);
+    if (count < 0)
+        return -1;
 
-    ret = rtpSendPacketOverUdp(socket, ip, port, rtpPacket, frameSize + 4);
+    if (rtpChannel >= 0)
+        ret = rtpSendPacketViewsOverTcp(socket, rtpChannel, views, count);
+    else
+        ret = rtpSendPacketViewsOverUdp(socket, ip, port, views, count);
     if (ret < 0)
     {
         printf("failed to send rtp packet\n");
         return -1;
     }
 
-    rtpPacket->rtpHeader.seq++;
+    // AU header 也是负载
+    for (i = 0; i < count; i++)
+        rtcpStatsOnSend(rtcpStats, views[i].headerSize - views[i].rtpHeaderSize + views[i].payloadSize);
 
-    // 如果采样频率是44100
-    // 一般AAC每个1024个采样为一帧
-    // 所以一秒就有 44100 / 1024 = 43帧
-    // 时间增量就是 44100 / 43 = 1025
-    // 一帧的时间为 1 / 43 = 23ms
+    // RTP 时钟频率等于采样率，时间戳增量就是这些帧的采样数
+    // 一般AAC每个1024个采样为一帧，44100 采样率时一帧为 23ms
+    rtpHeader->timestamp += agg->samples;
 
-    rtpPacket->rtpHeader.timestamp += 1025;
+    agg->count = 0;
+    agg->bytes = 0;
+    agg->samples = 0;
 
     return 0;
 }
@@ -220,12 +218,13 @@ static int handleCmd_DESCRIBE(char *result, int cseq, char *url)
                  "t=0 0\r\n"
                  "a=control:*\r\n"
                  "m=audio 0 RTP/AVP 97\r\n"
-                 "a=rtpmap:97 mpeg4-generic/44100/2\r\n"
-                 "a=fmtp:97 profile-level-id=1;mode=AAC-hbr;sizelength=13;indexlength=3;indexdeltalength=3;config=1210;\r\n"
+                 "a=rtpmap:97 mpeg4-generic/%d/%d\r\n"
+                 "a=fmtp:97 profile-level-id=1;mode=AAC-hbr;sizelength=13;indexlength=3;indexdeltalength=3;config=%04X;\r\n"
 
                  //"a=fmtp:97 SizeLength=13;\r\n"
                  "a=control:track0\r\n",
-            time(NULL), localIp);
+            time(NULL), localIp, aacSource.sampleRate, aacSource.channels,
+            adtsAudioSpecificConfig(&aacSource));
 
     sprintf(result, "RTSP/1.0 200 OK\r\nCSeq: %d\r\n"
                     "Content-Base: %s\r\n"
@@ -240,8 +239,72 @@ static int handleCmd_DESCRIBE(char *result, int cseq, char *url)
     return 0;
 }
 
-static int handleCmd_SETUP(char *result, int cseq, int clientRtpPort)
+// 发送 SR，interleaved 时在 RTSP 连接上使用 RTP 通道号 + 1
+static void sendSenderReport(int socket, const char *ip, int16_t port, int rtpChannel,
+                             uint32_t ssrc, uint32_t rtpTimestamp, struct RtcpStats *stats)
+{
+    uint8_t buf[RTP_INTERLEAVED_HEADER_SIZE + RTCP_MAX_PACKET_SIZE];
+    struct sockaddr_in addr;
+    int len;
+
+    len = rtcpBuildSenderReport(buf + RTP_INTERLEAVED_HEADER_SIZE, RTCP_MAX_PACKET_SIZE,
+                                ssrc, rtpTimestamp, stats, "aac@" SERVER_IP);
+    if (len < 0)
+        return;
+
+    if (rtpChannel >= 0)
+    {
+        rtpWriteInterleavedHeader(buf, rtpChannel + 1, len);
+        send(socket, buf, RTP_INTERLEAVED_HEADER_SIZE + len, MSG_NOSIGNAL);
+        return;
+    }
+
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr(ip);
+
+    sendto(socket, buf + RTP_INTERLEAVED_HEADER_SIZE, len, 0, (struct sockaddr *)&addr, sizeof(addr));
+}
+
+// 读出已经到达的接收报告，不阻塞
+static void readReceiverReports(int socket, uint32_t ssrc, uint32_t clockRate, struct RtcpStats *stats)
+{
+    struct RtcpReportBlock blocks[RTCP_MAX_REPORT_BLOCKS];
+    uint8_t buf[RTCP_MAX_PACKET_SIZE];
+    int len, count, i;
+
+    while ((len = recv(socket, buf, sizeof(buf), MSG_DONTWAIT)) > 0)
+    {
+        count = rtcpParseReportBlocks(buf, len, blocks, RTCP_MAX_REPORT_BLOCKS);
+        for (i = 0; i < count; i++)
+        {
+            if (blocks[i].ssrc != ssrc)
+                continue;
+
+            rtcpStatsOnReport(stats, &blocks[i], clockRate, getMonotonicUs() / 1000);
+            printf("rtcp: sent=%u/%uB loss=%.1f%% lost=%d jitter=%.1fms rtt=%.1fms\n",
+                   stats->packetCount, stats->octetCount, stats->fractionLost * 100,
+                   stats->cumulativeLost, stats->jitterMs, stats->rttMs);
+        }
+    }
+}
+
+static int handleCmd_SETUP(char *result, int cseq, int clientRtpPort, int rtpChannel)
 {
+    if (rtpChannel >= 0)
+    {
+        sprintf(result, "RTSP/1.0 200 OK\r\n"
+                        "CSeq: %d\r\n"
+                        "Transport: RTP/AVP/TCP;unicast;interleaved=%d-%d\r\n"
+                        "Session: 66334873\r\n"
+                        "\r\n",
+                cseq,
+                rtpChannel,
+                rtpChannel + 1);
+
+        return 0;
+    }
+
     sprintf(result, "RTSP/1.0 200 OK\r\n"
                     "CSeq: %d\r\n"
                     "Transport: RTP/AVP;unicast;client_port=%d-%d;server_port=%d-%d\r\n"
@@ -274,63 +337,80 @@ static void doClient(int clientSockfd, const char *clientIP, int clientPort)
 
     char method[40];
     char url[100];
-    char version[40];
     int CSeq;
 
     int clientRtpPort, clientRtcpPort;
+    int rtpChannel = -1, rtcpChannel; // interleaved 的通道号，-1 表示使用 UDP
     char *rBuf = (char *)malloc(BUF_MAX_SIZE);
     char *sBuf = (char *)malloc(BUF_MAX_SIZE);
+    int rLen = 0;
+    struct RtspParser parser;
+    struct RtspRequest request;
+    const struct RtspStr *transport;
+
+    rtspParserInit(&parser);
 
     while (1)
     {
-        int recvLen;
+        int recvLen, ret;
 
-        recvLen = recv(clientSockfd, rBuf, BUF_MAX_SIZE, 0);
-        if (recvLen <= 0)
+        // 一个请求可能分多次收到，一次也可能收到多个请求
+        ret = rtspParse(&parser, rBuf, rLen, &request);
+        if (ret == RTSP_PARSE_ERROR)
         {
+            printf("bad request\n");
             break;
         }
-
-        rBuf[recvLen] = '\0';
-        printf("%s rBuf = %s \n", __FUNCTION__, rBuf);
-
-        const char *sep = "\n";
-        char *line = strtok(rBuf, sep);
-        while (line)
+        if (ret == RTSP_PARSE_AGAIN)
         {
-            if (strstr(line, "OPTIONS") ||
-                strstr(line, "DESCRIBE") ||
-                strstr(line, "SETUP") ||
-                strstr(line, "PLAY"))
-            {
+            if (rLen >= BUF_MAX_SIZE)
+                break;
 
-                if (sscanf(line, "%s %s %s\r\n", method, url, version) != 3)
-                {
-                    // error
-                }
+            recvLen = recv(clientSockfd, rBuf + rLen, BUF_MAX_SIZE - rLen, 0);
+            if (recvLen <= 0)
+            {
+                break;
             }
-            else if (strstr(line, "CSeq"))
+
+            rLen += recvLen;
+            continue;
+        }
+
+        printf("%s request = %.*s \n", __FUNCTION__, request.length, rBuf);
+
+        rtspStrCopy(request.method, method, sizeof(method));
+        rtspStrCopy(request.url, url, sizeof(url));
+        CSeq = request.cseq;
+
+        if ((transport = rtspFindHeader(&request, "Transport")) != NULL)
+        {
+            // Transport: RTP/AVP/UDP;unicast;client_port=13358-13359
+            // Transport: RTP/AVP;unicast;client_port=13358-13359
+            // Transport: RTP/AVP/TCP;unicast;interleaved=0-1
+            char line[256];
+            char *param;
+
+            rtspStrCopy(*transport, line, sizeof(line));
+            if (strstr(line, "RTP/AVP/TCP"))
             {
-                if (sscanf(line, "CSeq: %d\r\n", &CSeq) != 1)
-                {
-                    // error
-                }
+                rtpChannel = 0;
+                if ((param = strstr(line, "interleaved=")) != NULL)
+                    sscanf(param, "interleaved=%d-%d", &rtpChannel, &rtcpChannel);
+                if (rtpChannel < 0 || rtpChannel > 254)
+                    rtpChannel = 0;
             }
-            else if (!strncmp(line, "Transport:", strlen("Transport:")))
+            else if ((param = strstr(line, "client_port=")) == NULL ||
+                     sscanf(param, "client_port=%d-%d", &clientRtpPort, &clientRtcpPort) != 2)
             {
-                // Transport: RTP/AVP/UDP;unicast;client_port=13358-13359
-                // Transport: RTP/AVP;unicast;client_port=13358-13359
-
-                if (sscanf(line, "Transport: RTP/AVP/UDP;unicast;client_port=%d-%d\r\n",
-                           &clientRtpPort, &clientRtcpPort) != 2)
-                {
-                    // error
-                    printf("parse Transport error \n");
-                }
+                // error
+                printf("parse Transport error \n");
             }
-            line = strtok(NULL, sep);
         }
 
+        // 请求已经解析完，从缓冲区中去掉
+        rLen -= request.length;
+        memmove(rBuf, rBuf + request.length, rLen);
+
         if (!strcmp(method, "OPTIONS"))
         {
             if (handleCmd_OPTIONS(sBuf, CSeq))
@@ -349,7 +429,7 @@ static void doClient(int clientSockfd, const char *clientIP, int clientPort)
         }
         else if (!strcmp(method, "SETUP"))
         {
-            if (handleCmd_SETUP(sBuf, CSeq, clientRtpPort))
+            if (handleCmd_SETUP(sBuf, CSeq, clientRtpPort, rtpChannel))
             {
                 printf("failed to handle setup\n");
                 break;
@@ -392,54 +472,93 @@ static void doClient(int clientSockfd, const char *clientIP, int clientPort)
         if (!strcmp(method, "PLAY"))
         {
 
-            struct AdtsHeader adtsHeader;
-            struct RtpPacket *rtpPacket;
-            uint8_t *frame;
+            struct RtpHeader rtpHeader;
+            struct RtpPacer pacer;
+            struct RtcpStats rtcpStats;
+            struct AacAggregate agg;
+            uint64_t nextRtcpUs;
+            const uint8_t *frame;
+            uint32_t frameSize, samples;
+            int sampleRate, index;
+            int sockfd = rtpChannel >= 0 ? clientSockfd : serverRtpSockfd;
             int ret;
 
-            FILE *fp = fopen(AAC_FILE_NAME, "rb");
-            if (!fp)
-            {
-                printf("read %s failed\n", AAC_FILE_NAME);
-                break;
-            }
+            // 索引已经建好，不需要重新读文件
+            adtsSeek(&aacSource, 0);
 
-            frame = (uint8_t *)malloc(5000);
-            rtpPacket = (struct RtpPacket *)malloc(5000);
+            memset(&agg, 0, sizeof(agg));
+            agg.maxCount = 1;
 
-            rtpHeaderInit(rtpPacket, 0, 0, 0, RTP_VESION, RTP_PAYLOAD_TYPE_AAC, 1, 0, 0, 0x32411);
+            rtpHeaderInit(&rtpHeader, RTP_PAYLOAD_TYPE_AAC, 0, 0, 0x32411);
+            // 时钟频率在读到第一帧后按采样率设置
+            pacerInit(&pacer, 0, 0);
+            rtcpStatsInit(&rtcpStats);
+            nextRtcpUs = getMonotonicUs() + RTCP_INTERVAL_MS * 1000;
 
             while (1)
             {
-                ret = fread(frame, 1, 7, fp);
-                if (ret <= 0)
+                index = adtsNextFrame(&aacSource, &frame, &frameSize, &samples);
+                if (index < 0)
                 {
-                    printf("fread err\n");
+                    // 文件读完，发出剩下的帧
+                    rtpSendAACFrames(sockfd, clientIP, clientRtpPort, rtpChannel,
+                                     &rtpHeader, &agg, &pacer, &rtcpStats);
                     break;
                 }
-                printf("fread ret=%d \n", ret);
+                sampleRate = adtsSampleRates[aacSource.frames[index].samplingFreqIndex];
 
-                if (parseAdtsHeader(frame, &adtsHeader) < 0)
+                // 放不下这一帧就先把攒下的帧发出去，采样率变化时也一样
+                if (agg.count > 0 && (!aacAggregateFits(&agg, frameSize) || pacer.clockRate != (uint32_t)sampleRate))
                 {
-                    printf("parseAdtsHeader err\n");
-                    break;
+                    ret = rtpSendAACFrames(sockfd, clientIP, clientRtpPort, rtpChannel,
+                                           &rtpHeader, &agg, &pacer, &rtcpStats);
+                    // TCP 连接断开说明客户端已经离开
+                    if (ret < 0 && rtpChannel >= 0)
+                        break;
                 }
-                ret = fread(frame, 1, adtsHeader.aacFrameLength - 7, fp);
-                if (ret <= 0)
+
+                // RTP 时钟就是采样率，采样率变化时重新开始计时
+                // 音频报文都很小，不需要令牌桶
+                if (pacer.clockRate != (uint32_t)sampleRate)
                 {
-                    printf("fread err\n");
-                    break;
+                    pacerInit(&pacer, sampleRate, 0);
+                    // 时延上限内能放下几帧，至少一帧
+                    agg.maxCount = (uint64_t)maxLatencyMs * sampleRate / (1000 * 1024) + 1;
+                    if (agg.maxCount > RTP_AAC_MAX_AUS)
+                        agg.maxCount = RTP_AAC_MAX_AUS;
                 }
 
-                rtpSendAACFrame(serverRtpSockfd, clientIP, clientRtpPort,
-                                rtpPacket, frame, adtsHeader.aacFrameLength - 7);
+                agg.frames[agg.count] = frame;
+                agg.sizes[agg.count] = frameSize;
+                agg.count++;
+                agg.bytes += frameSize;
+                agg.samples += samples;
+                agg.lastSamples = samples;
 
-                // Sleep(1);
-                usleep(23223); // 1000/43.06 * 1000
+                // 达到时延上限，或者这一帧本身就要分片
+                if (!aacAggregateFits(&agg, 0))
+                {
+                    ret = rtpSendAACFrames(sockfd, clientIP, clientRtpPort, rtpChannel,
+                                           &rtpHeader, &agg, &pacer, &rtcpStats);
+                    if (ret < 0 && rtpChannel >= 0)
+                        break;
+                }
+
+                // 每隔一段时间发送 SR，顺便读取客户端的 RR
+                // interleaved 时客户端的 RR 在 RTSP 连接上，这里不读取
+                if (getMonotonicUs() >= nextRtcpUs)
+                {
+                    uint64_t now = getMonotonicUs();
+
+                    sendSenderReport(rtpChannel >= 0 ? clientSockfd : serverRtcpSockfd,
+                                     clientIP, clientRtcpPort, rtpChannel,
+                                     rtpHeader.ssrc, pacerTimestampAt(&pacer, now), &rtcpStats);
+                    nextRtcpUs = now + (RTCP_INTERVAL_MS / 2 + rand() % RTCP_INTERVAL_MS) * 1000;
+                }
+                if (rtpChannel < 0)
+                    readReceiverReports(serverRtcpSockfd, rtpHeader.ssrc, sampleRate, &rtcpStats);
             }
 
-            free(frame);
-            free(rtpPacket);
 
             break;
         }
@@ -463,12 +582,31 @@ static void doClient(int clientSockfd, const char *clientIP, int clientPort)
     free(sBuf);
 }
 
-int main()
+int main(int argc, char *argv[])
 {
 
     int rtspServerSockfd;
 
-    int ret;
+    int ret, opt;
+
+    while ((opt = getopt(argc, argv, "l:")) != -1)
+    {
+        if (opt != 'l' || (maxLatencyMs = atoi(optarg)) < 0)
+        {
+            printf("usage: %s [-l max_latency_ms] [file.aac]\n", argv[0]);
+            return -1;
+        }
+    }
+    if (optind < argc)
+        aacFileName = argv[optind];
+
+    if (adtsOpen(&aacSource, aacFileName) < 0)
+    {
+        printf("failed to open %s\n", aacFileName);
+        return -1;
+    }
+    printf("%s: %d frames, %d Hz, %d channels\n", aacFileName, aacSource.frameCount,
+           aacSource.sampleRate, aacSource.channels);
 
     rtspServerSockfd = createTcpSocket();
     if (rtspServerSockfd < 0)
@@ -0,0 +1,159 @@
+/*
+ * This file is a small helper shared by the tutorials and demos that decode
+ * video: it opens a decoder with frame and/or slice threading switched on
+ * and reports how busy those threads were.
+ *
+ * The same file lives in code/tutorial and code/demo so that every example
+ * still builds on its own, e.g.
+ *     gcc decode_video.c -lavformat -lavcodec -lavutil
+ *
+ * Command line switches understood by decoder_threads_parse():
+ *     -threads N                 decoder threads, 0 (default) = one per core
+ *     -thread_type auto|frame|slice
+ */
+
+#ifndef DECODER_THREADS_H
+#define DECODER_THREADS_H
+
+#include <string.h>
+#include <stdlib.h>
+#include <inttypes.h>
+#include <time.h>
+#include <libavcodec/avcodec.h>
+#include <libavutil/avutil.h>
+#include <libavutil/cpu.h>
+#include <libavutil/time.h>
+
+// libavcodec does not auto-pick more than 16 threads either: past that,
+// frame threads only add latency and memory (one frame in flight each)
+#define DECODER_MAX_AUTO_THREADS 16
+
+// set from the command line, 0 = auto
+static int decoder_thread_count = 0;
+// FF_THREAD_FRAME and/or FF_THREAD_SLICE, narrowed by what the codec supports
+static int decoder_thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+
+typedef struct DecoderUsage{
+    int64_t wall_start;
+    clock_t cpu_start;
+    int64_t frames;
+}DecoderUsage;
+
+static inline const char *decoder_thread_type_name(int type)
+{
+    switch(type){
+    case FF_THREAD_FRAME:
+        return "frame";
+    case FF_THREAD_SLICE:
+        return "slice";
+    case FF_THREAD_FRAME | FF_THREAD_SLICE:
+        return "frame+slice";
+    default:
+        return "none";
+    }
+}
+
+// take -threads and -thread_type out of argv so the caller only
+// sees its own positional arguments, returns the new argc
+static inline int decoder_threads_parse(int argc, char *argv[])
+{
+    int i, n = 1;
+
+    for(i = 1; i < argc; i++){
+        if(!strcmp(argv[i], "-threads") && i + 1 < argc){
+            decoder_thread_count = atoi(argv[++i]);
+            if(decoder_thread_count < 0){
+                decoder_thread_count = 0;
+            }
+        }else if(!strcmp(argv[i], "-thread_type") && i + 1 < argc){
+            i++;
+            if(!strcmp(argv[i], "frame")){
+                decoder_thread_type = FF_THREAD_FRAME;
+            }else if(!strcmp(argv[i], "slice")){
+                decoder_thread_type = FF_THREAD_SLICE;
+            }else{
+                decoder_thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+            }
+        }else{
+            argv[n++] = argv[i];
+        }
+    }
+    argv[n] = NULL;
+
+    return n;
+}
+
+// drop-in replacement for avcodec_open2() on a decoder context
+static inline int decoder_open(AVCodecContext *ctx, const AVCodec *codec, AVDictionary **options)
+{
+    int ret;
+    int type = 0;
+    int count = decoder_thread_count;
+
+    if(codec->capabilities & AV_CODEC_CAP_FRAME_THREADS){
+        type |= FF_THREAD_FRAME;
+    }
+    if(codec->capabilities & AV_CODEC_CAP_SLICE_THREADS){
+        type |= FF_THREAD_SLICE;
+    }
+    type &= decoder_thread_type;
+
+    if(!count){
+        count = av_cpu_count();
+        if(count > DECODER_MAX_AUTO_THREADS){
+            count = DECODER_MAX_AUTO_THREADS;
+        }
+    }
+    // codecs with their own internal threads (libdav1d...) still take the count
+    if(!type && !(codec->capabilities & AV_CODEC_CAP_OTHER_THREADS)){
+        count = 1;
+    }
+
+    ctx->thread_count = count;
+    ctx->thread_type = type;
+
+    ret = avcodec_open2(ctx, codec, options);
+    if(ret < 0){
+        return ret;
+    }
+
+    // slice threading only kicks in when the stream has several slices, and
+    // frame threading can be refused (e.g. AV_CODEC_FLAG_LOW_DELAY), so log
+    // what the decoder actually chose rather than what was asked for
+    av_log(NULL, AV_LOG_INFO, "%s decoder: %d threads, %s threading (%d cores)\n",
+           codec->name, ctx->thread_count,
+           decoder_thread_type_name(ctx->active_thread_type), av_cpu_count());
+
+    return 0;
+}
+
+static inline void decoder_usage_start(DecoderUsage *usage)
+{
+    usage->wall_start = av_gettime_relative();
+    usage->cpu_start = clock();
+    usage->frames = 0;
+}
+
+// clock() is process cpu time summed over all threads, so dividing by the
+// wall time gives the average number of busy cores; spread over the decoder
+// threads that is how well they were kept fed on average. It includes the
+// demuxer and the caller's thread and says nothing about how evenly the work
+// was split, one thread can be saturated while the others idle
+static inline void decoder_usage_report(const DecoderUsage *usage, const AVCodecContext *ctx)
+{
+    double wall = (av_gettime_relative() - usage->wall_start) / 1000000.0;
+    double cpu = (double)(clock() - usage->cpu_start) / CLOCKS_PER_SEC;
+    int threads = ctx->thread_count > 0 ? ctx->thread_count : 1;
+
+    if(wall <= 0){
+        return;
+    }
+    av_log(NULL, AV_LOG_INFO,
+           "decoded %" PRId64 " frames in %.2fs: %.1f fps, cpu %.2fs, "
+           "%.2f cores busy, %.0f%% avg per decoder thread (%d %s)\n",
+           usage->frames, wall, usage->frames / wall, cpu,
+           cpu / wall, 100.0 * cpu / (wall * threads), threads,
+           decoder_thread_type_name(ctx->active_thread_type));
+}
+
+#endif
@@ -13,23 +13,56 @@
 #include <libavutil/avutil.h>
 #include <libavcodec/avcodec.h>
 #include <libswresample/swresample.h>
-#include <libavutil/fifo.h>
+#include <stdatomic.h>
+#include "decoder_threads.h"
 
 #define AUDIO_BUFFER_SIZE 1024
 
-typedef struct MyPacketEle{
-    AVPacket *pkt;
-}MyPacketEle;
-
+// must be a power of 2, the read/write indexes are free-running and masked
+#define PACKET_QUEUE_SLOTS 256
+#define MAX_QUEUE_SIZE (5 * 1024 * 1024)
+// in milliseconds
+#define MAX_QUEUE_DURATION 2000
+
+// Bounded single-producer/single-consumer ring of preallocated AVPacket slots.
+// Only the packet references move in and out, so putting a packet allocates nothing,
+// and the two sides only share atomics. A side sleeps on its semaphore after
+// announcing it through *_waiting, so the other side posts it only on the
+// empty-to-non-empty (or full-to-non-full) transition, never in steady state.
 typedef struct PacketQueue{
-    AVFifo *pkts;
-    int nb_packets;
-    int size;
-    int64_t duration;
-    SDL_mutex *mutex;
-    SDL_cond *cond;
+    AVPacket **pkts;
+    unsigned int mask;
+    atomic_uint windex;             // written only by the producer
+    atomic_uint rindex;             // written only by the consumer
+    atomic_int size;
+    atomic_int_fast64_t duration;
+    int max_size;
+    int64_t max_duration;           // in the time base of the stream
+    atomic_int reader_waiting;
+    atomic_int writer_waiting;
+    atomic_int abort_request;
+    SDL_sem *readable;
+    SDL_sem *writable;
 }PacketQueue;
 
+// must be a power of 2, a bit more than a second of 48 kHz stereo S16
+#define AUDIO_RING_SIZE (256 * 1024)
+
+// Single-producer/single-consumer ring of PCM bytes between the audio decode thread
+// and the SDL audio callback. The callback never decodes, locks or sleeps: it copies
+// what is there and plays silence for the rest. Only the decode thread sleeps, when
+// the ring is full, and the callback wakes it up the same way PacketQueue does.
+typedef struct AudioRing{
+    uint8_t *buf;
+    _Atomic uint64_t windex;        // bytes written so far, only by the decode thread
+    _Atomic uint64_t rindex;        // bytes read so far, only by the callback
+    atomic_int writer_waiting;
+    atomic_int abort_request;
+    atomic_int finished;
+    atomic_uint underruns;
+    SDL_sem *writable;
+}AudioRing;
+
 typedef struct VideoState{
     AVCodecContext *aCtx;
     AVCodecContext *vCtx;
@@ -40,13 +73,14 @@ typedef struct VideoState{
 
     struct SwrContext *swr_ctx;
 
-    uint8_t        *audio_buf;
+    uint8_t        *audio_buf;           // owned by the audio decode thread
     uint           audio_buf_size;
-    int            audio_buf_index;
 
     SDL_Texture    *texture;
 
     PacketQueue    audioQueue;
+    AudioRing      audioRing;
+    SDL_Thread     *audioThread;
 }VideoState;
 
 
@@ -58,124 +92,261 @@ static int w_height = 480;
 static SDL_Window *win = NULL;
 static SDL_Renderer *renderer = NULL;
 
-static int packet_queue_init(PacketQueue *q)
+static int packet_queue_init(PacketQueue *q, AVRational time_base)
 {
     memset(q, 0, sizeof(PacketQueue));
-    q->pkts = av_fifo_alloc2(1, sizeof(MyPacketEle), AV_FIFO_FLAG_AUTO_GROW);
+    q->pkts = av_calloc(PACKET_QUEUE_SLOTS, sizeof(*q->pkts));
     if(!q->pkts){
         av_log(NULL, AV_LOG_ERROR, "No Memory!\n");
         return AVERROR(ENOMEM);
     }
-    q->mutex = SDL_CreateMutex();
-    if(!q->mutex){
+    for(int i = 0; i < PACKET_QUEUE_SLOTS; i++){
+        q->pkts[i] = av_packet_alloc();
+        if(!q->pkts[i]){
+            av_log(NULL, AV_LOG_ERROR, "No Memory!\n");
+            return AVERROR(ENOMEM);
+        }
+    }
+    q->mask = PACKET_QUEUE_SLOTS - 1;
+    q->max_size = MAX_QUEUE_SIZE;
+    q->max_duration = av_rescale_q(MAX_QUEUE_DURATION, (AVRational){1, 1000}, time_base);
+    q->readable = SDL_CreateSemaphore(0);
+    if(!q->readable){
         av_log(NULL, AV_LOG_ERROR, "No Memory!\n");
         return AVERROR(ENOMEM);
     }
-    q->cond = SDL_CreateCond();
-    if(!q->cond){
+    q->writable = SDL_CreateSemaphore(0);
+    if(!q->writable){
         av_log(NULL, AV_LOG_ERROR, "No Memory!\n");
         return AVERROR(ENOMEM);
     }
     return 0;
 }
 
-static int packet_queue_put_priv(PacketQueue *q, AVPacket *pkt)
+// the limits are soft: an empty queue always takes the next packet, however big it is
+static int packet_queue_full(PacketQueue *q, unsigned int windex)
 {
-    MyPacketEle mypkt;
-    int ret = -1;
+    unsigned int count = windex - atomic_load(&q->rindex);
 
-    mypkt.pkt = pkt;
+    if(count == 0){
+        return 0;
+    }
+    return count > q->mask ||
+           atomic_load(&q->size) >= q->max_size ||
+           (q->max_duration > 0 && atomic_load(&q->duration) >= q->max_duration);
+}
 
-    ret = av_fifo_write(q->pkts, &mypkt, 1);
-    if(ret < 0){
-        return ret;
+// producer side, only the demux thread calls this; blocks while the queue is full
+static int packet_queue_put(PacketQueue *q, AVPacket *pkt)
+{
+    unsigned int windex = atomic_load_explicit(&q->windex, memory_order_relaxed);
+
+    while(packet_queue_full(q, windex) && !atomic_load(&q->abort_request)){
+        // announce first and check again, so either the consumer sees the flag
+        // or we see the slot it has just freed
+        atomic_store(&q->writer_waiting, 1);
+        if(packet_queue_full(q, windex) && !atomic_load(&q->abort_request)){
+            SDL_SemWait(q->writable);
+        }
+        atomic_store(&q->writer_waiting, 0);
+    }
+    if(atomic_load(&q->abort_request)){
+        av_packet_unref(pkt);
+        return -1;
     }
+
     //update the queue info
-    q->nb_packets++;
-    q->size += mypkt.pkt->size + sizeof(mypkt);
-    q->duration += mypkt.pkt->duration;
-    //
-    SDL_CondSignal(q->cond);
+    atomic_fetch_add(&q->size, pkt->size + (int)sizeof(*pkt));
+    atomic_fetch_add(&q->duration, pkt->duration);
+    av_packet_move_ref(q->pkts[windex & q->mask], pkt);
+    atomic_store(&q->windex, windex + 1);
 
-    return ret;
+    if(atomic_load(&q->reader_waiting) && atomic_exchange(&q->reader_waiting, 0)){
+        SDL_SemPost(q->readable);
+    }
+    return 0;
 }
 
+// consumer side, only one thread calls this
 static int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block)
 {
-    MyPacketEle mypkt;
-    int ret = -1;
+    unsigned int rindex = atomic_load_explicit(&q->rindex, memory_order_relaxed);
+    AVPacket *slot;
 
-    SDL_LockMutex(q->mutex);
-    for (;;){
-        if(av_fifo_read(q->pkts, &mypkt, 1)>=0){
-            q->nb_packets--;
-            q->size -= mypkt.pkt->size + sizeof(mypkt);
-            q->duration -= mypkt.pkt->duration;
-            av_packet_move_ref(pkt, mypkt.pkt);
-            av_packet_free(&mypkt.pkt);
-            ret = 1;
-            break;
-        }else if(!block){
-            ret = 0;
-            break;
-        }else{
-            SDL_CondWait(q->cond, q->mutex);
+    while(rindex == atomic_load(&q->windex)){
+        if(atomic_load(&q->abort_request)){
+            return -1;
         }
+        if(!block){
+            return 0;
+        }
+        atomic_store(&q->reader_waiting, 1);
+        if(rindex == atomic_load(&q->windex) && !atomic_load(&q->abort_request)){
+            SDL_SemWait(q->readable);
+        }
+        atomic_store(&q->reader_waiting, 0);
     }
-    SDL_UnlockMutex(q->mutex);
-    
-    return ret;
+
+    slot = q->pkts[rindex & q->mask];
+    atomic_fetch_sub(&q->size, slot->size + (int)sizeof(*slot));
+    atomic_fetch_sub(&q->duration, slot->duration);
+    av_packet_move_ref(pkt, slot);
+    atomic_store(&q->rindex, rindex + 1);
+
+    if(atomic_load(&q->writer_waiting) && atomic_exchange(&q->writer_waiting, 0)){
+        SDL_SemPost(q->writable);
+    }
+    return 1;
 }
 
+// wake up both sides for good, put and get fail from now on
+static void packet_queue_abort(PacketQueue *q)
+{
+    atomic_store(&q->abort_request, 1);
+    if(q->readable){
+        SDL_SemPost(q->readable);
+    }
+    if(q->writable){
+        SDL_SemPost(q->writable);
+    }
+}
+
+// drops what is queued, call it from the consumer side or when both sides have stopped
 static void packet_queue_flush(PacketQueue *q)
 {
-    MyPacketEle mypkt;
-    SDL_LockMutex(q->mutex);
+    unsigned int rindex = atomic_load(&q->rindex);
+    unsigned int windex = atomic_load(&q->windex);
 
-    while (av_fifo_read(q->pkts, &mypkt, 1) > 0){
-        av_packet_free(&mypkt.pkt);
+    if(!q->pkts){
+        return;
     }
-    q->nb_packets = 0;
-    q->size = 0;
-    q->duration = 0;
+    for(; rindex != windex; rindex++){
+        AVPacket *slot = q->pkts[rindex & q->mask];
 
-    SDL_UnlockMutex(q->mutex);
+        atomic_fetch_sub(&q->size, slot->size + (int)sizeof(*slot));
+        atomic_fetch_sub(&q->duration, slot->duration);
+        av_packet_unref(slot);
+    }
+    atomic_store(&q->rindex, rindex);
 }
 
 static void packet_queue_destroy(PacketQueue *q)
 {
     packet_queue_flush(q);
-    av_fifo_freep2(&q->pkts);
-    SDL_DestroyMutex(q->mutex);
-    SDL_DestroyCond(q->cond); 
+    if(q->pkts){
+        for(int i = 0; i < PACKET_QUEUE_SLOTS; i++){
+            av_packet_free(&q->pkts[i]);
+        }
+        av_freep(&q->pkts);
+    }
+    if(q->readable){
+        SDL_DestroySemaphore(q->readable);
+    }
+    if(q->writable){
+        SDL_DestroySemaphore(q->writable);
+    }
 }
 
-static int packet_queue_put(PacketQueue *q, AVPacket *pkt)
+static int audio_ring_init(AudioRing *r)
 {
-    AVPacket *pkt1;
-    int ret = -1;
+    memset(r, 0, sizeof(AudioRing));
+    r->buf = av_malloc(AUDIO_RING_SIZE);
+    if(!r->buf){
+        av_log(NULL, AV_LOG_ERROR, "No Memory!\n");
+        return AVERROR(ENOMEM);
+    }
+    r->writable = SDL_CreateSemaphore(0);
+    if(!r->writable){
+        av_log(NULL, AV_LOG_ERROR, "No Memory!\n");
+        return AVERROR(ENOMEM);
+    }
+    return 0;
+}
 
-    
-    
-    SDL_UnlockMutex(q->mutex);
+// decode thread side, blocks until all of data is in the ring
+static int audio_ring_write(AudioRing *r, const uint8_t *data, int size)
+{
+    uint64_t windex = atomic_load_explicit(&r->windex, memory_order_relaxed);
+    int space, len, offset, len1;
 
-    pkt1 = av_packet_alloc();
-    if(!pkt1){
-        av_packet_unref(pkt);
-        return -1;
+    while(size > 0){
+        if(atomic_load(&r->abort_request)){
+            return -1;
+        }
+        space = AUDIO_RING_SIZE - (int)(windex - atomic_load(&r->rindex));
+        if(space == 0){
+            atomic_store(&r->writer_waiting, 1);
+            if(windex - atomic_load(&r->rindex) == AUDIO_RING_SIZE && !atomic_load(&r->abort_request)){
+                SDL_SemWait(r->writable);
+            }
+            atomic_store(&r->writer_waiting, 0);
+            continue;
+        }
+
+        len = FFMIN(space, size);
+        offset = windex & (AUDIO_RING_SIZE - 1);
+        len1 = FFMIN(len, AUDIO_RING_SIZE - offset);
+        memcpy(r->buf + offset, data, len1);
+        memcpy(r->buf, data + len1, len - len1);
+        windex += len;
+        atomic_store(&r->windex, windex);
+
+        data += len;
+        size -= len;
     }
-    av_packet_move_ref(pkt1, pkt);
+    return 0;
+}
+
+// callback side, copies at most size bytes and returns how many
+static int audio_ring_read(AudioRing *r, uint8_t *data, int size)
+{
+    uint64_t rindex = atomic_load_explicit(&r->rindex, memory_order_relaxed);
+    int len, offset, len1;
+
+    len = (int)FFMIN((uint64_t)size, atomic_load(&r->windex) - rindex);
+    offset = rindex & (AUDIO_RING_SIZE - 1);
+    len1 = FFMIN(len, AUDIO_RING_SIZE - offset);
+    memcpy(data, r->buf + offset, len1);
+    memcpy(data + len1, r->buf, len - len1);
+    rindex += len;
+    atomic_store(&r->rindex, rindex);
+
+    //wake the decode thread only once a quarter of the ring is free, so it refills in
+    //big chunks instead of being woken from the callback every time
+    if(atomic_load(&r->writer_waiting) &&
+       AUDIO_RING_SIZE - (atomic_load(&r->windex) - rindex) >= AUDIO_RING_SIZE / 4 &&
+       atomic_exchange(&r->writer_waiting, 0)){
+        SDL_SemPost(r->writable);
+    }
+    return len;
+}
 
-    SDL_LockMutex(q->mutex);
+// decode thread side, the stream has ended, running dry from now on is not an underrun
+static void audio_ring_finish(AudioRing *r)
+{
+    atomic_store(&r->finished, 1);
+}
 
-    ret = packet_queue_put_priv(q, pkt1);
+// the decode thread has finished and the callback has taken every byte
+static int audio_ring_done(AudioRing *r)
+{
+    return atomic_load(&r->finished) && atomic_load(&r->rindex) == atomic_load(&r->windex);
+}
 
-    SDL_UnlockMutex(q->mutex);
+static void audio_ring_abort(AudioRing *r)
+{
+    atomic_store(&r->abort_request, 1);
+    if(r->writable){
+        SDL_SemPost(r->writable);
+    }
+}
 
-    if(ret < 0){
-        av_packet_free(&pkt1);
+static void audio_ring_destroy(AudioRing *r)
+{
+    av_freep(&r->buf);
+    if(r->writable){
+        SDL_DestroySemaphore(r->writable);
     }
-    return ret;
 }
 
 static void render(VideoState *is)
@@ -228,115 +399,104 @@ static int audio_decode_frame(VideoState *is)
     int len2 = 0;
 
     int data_size = 0;
-    AVPacket *pkt = av_packet_alloc();
+    AVPacket *pkt = is->aPkt;
     for(;;){
-        if(packet_queue_get(&is->audioQueue, pkt, 1)<0){
-            return -1;
+        //take what the decoder already has before feeding it another packet
+        ret = avcodec_receive_frame(is->aCtx, is->aFrame);
+        if(ret == AVERROR(EAGAIN)){
+            if(packet_queue_get(&is->audioQueue, pkt, 1)<0){
+                return -1;
+            }
+            //the empty packet queued at the end of file drains the decoder
+            ret = avcodec_send_packet(is->aCtx, pkt);
+            av_packet_unref(pkt);
+            if(ret < 0){
+                av_log(is->aCtx, AV_LOG_ERROR, "Failed to send pkt to audio decoder!\n");
+            }
+            continue;
+        }else if(ret == AVERROR_EOF){
+            return ret;
+        }else if(ret < 0){
+            av_log(is->aCtx, AV_LOG_ERROR, "Failed to receive frame from audio decoder!\n");
+            return ret;
         }
 
-        ret = avcodec_send_packet(is->aCtx, pkt);
-        if(ret < 0){
-            av_log(is->aCtx, AV_LOG_ERROR, "Failed to send pkt to audio decoder!\n");
-            goto end;
+        //re-sampling, always, so audio_buf is our own interleaved S16 copy
+        if(!is->swr_ctx){
+            AVChannelLayout in_ch_layout, out_ch_layout;
+            av_channel_layout_copy(&in_ch_layout, &is->aCtx->ch_layout);
+            av_channel_layout_copy(&out_ch_layout, &in_ch_layout);
+            swr_alloc_set_opts2(&is->swr_ctx, 
+                            &out_ch_layout, 
+                            AV_SAMPLE_FMT_S16,
+                            is->aCtx->sample_rate,
+                            &in_ch_layout,
+                            is->aCtx->sample_fmt,
+                            is->aCtx->sample_rate,
+                            0,
+                            NULL);
+
+            swr_init(is->swr_ctx);
         }
-        while (ret >= 0)
-        {
-            ret = avcodec_receive_frame(is->aCtx, is->aFrame);
-            if(ret == AVERROR(EAGAIN) || ret == AVERROR_EOF){
-                break;
-            }else if(ret < 0){
-                av_log(is->aCtx, AV_LOG_ERROR, "Failed to receive frame from audio decoder!\n");
-                goto end;
-            }
 
-            
-            //re-sampling
-            if(!is->swr_ctx){
-                AVChannelLayout in_ch_layout, out_ch_layout;
-                av_channel_layout_copy(&in_ch_layout, &is->aCtx->ch_layout);
-                av_channel_layout_copy(&out_ch_layout, &in_ch_layout);
-                if(is->aCtx->sample_fmt != AV_SAMPLE_FMT_S16){
-                    swr_alloc_set_opts2(&is->swr_ctx, 
-                                    &out_ch_layout, 
-                                    AV_SAMPLE_FMT_S16,
-                                    is->aCtx->sample_rate,
-                                    &in_ch_layout,
-                                    is->aCtx->sample_fmt,
-                                    is->aCtx->sample_rate,
-                                    0,
-                                    NULL);
-
-                    swr_init(is->swr_ctx);
-                }
-            }
+        const uint8_t **in = (const uint8_t **)is->aFrame->extended_data;
+        int in_count = is->aFrame->nb_samples;
+        uint8_t **out = &is->audio_buf;
+        int out_count = is->aFrame->nb_samples + 512;
 
-            if(is->swr_ctx){
-                const uint8_t **in = (const uint8_t **)is->aFrame->extended_data;
-                int in_count = is->aFrame->nb_samples;
-                uint8_t **out = &is->audio_buf;
-                int out_count = is->aFrame->nb_samples + 512;
-
-                int out_size = av_samples_get_buffer_size(NULL, is->aFrame->ch_layout.nb_channels, out_count, AV_SAMPLE_FMT_S16, 0);
-                av_fast_malloc(&is->audio_buf, &is->audio_buf_size, out_size);
-
-                int samples = swr_convert(is->swr_ctx,
-                            out,
-                            out_count,
-                            in,
-                            in_count);
-
-                //data_size = len2 * is->aFrame->ch_layout.nb_channels*av_get_bytes_per_sample(AV_SAMPLE_FMT_S16);
-                data_size = samples * 2 * 2; 
-            }else{
-                is->audio_buf = is->vFrame->data[0];
-                data_size = av_samples_get_buffer_size(NULL, is->aFrame->ch_layout.nb_channels, is->aFrame->nb_samples, is->aFrame->format, 1);
-            }
+        int out_size = av_samples_get_buffer_size(NULL, is->aFrame->ch_layout.nb_channels, out_count, AV_SAMPLE_FMT_S16, 0);
+        av_fast_malloc(&is->audio_buf, &is->audio_buf_size, out_size);
 
-            av_packet_unref(pkt);
-            av_frame_unref(is->aFrame);
+        len2 = swr_convert(is->swr_ctx,
+                    out,
+                    out_count,
+                    in,
+                    in_count);
+
+        data_size = len2 * is->aFrame->ch_layout.nb_channels * 2; 
 
-            return data_size;
+        av_frame_unref(is->aFrame);
+
+        return data_size;
+    }
+}
 
+// audio decode stage: packets from audioQueue in, PCM into audioRing
+static int audio_decode_thread(void *arg)
+{
+    VideoState *is = arg;
+
+    int audio_size = 0;
+
+    for(;;){
+        audio_size = audio_decode_frame(is);
+        if(audio_size < 0){
+            break;
+        }
+        if(audio_ring_write(&is->audioRing, is->audio_buf, audio_size) < 0){
+            break;
         }
-        
     }
-end:
-    return ret;
+    audio_ring_finish(&is->audioRing);
 
+    return 0;
 }
 
 static void sdl_audio_callback(void *userdata, Uint8 *stream, int len)
 {
     int len1 = 0;
-    int audio_size = 0;
     VideoState *is = (VideoState*)userdata;
 
-
-    if (len > 0){
-        if(is->audio_buf_index >= is->audio_buf_size){
-            audio_size = audio_decode_frame(is);
-            if(audio_size < 0){
-                is->audio_buf_size = AUDIO_BUFFER_SIZE;
-                is->audio_buf = NULL;
-            }else {
-                is->audio_buf_size = audio_size;
-            }
-            is->audio_buf_index = 0;
+    //only copy here, decoding happens on the audio decode thread
+    len1 = audio_ring_read(&is->audioRing, stream, len);
+    if(len1 < len){
+        //play silence rather than wait for the decoder, before the first data and
+        //after the end of the stream this is expected
+        memset(stream + len1, 0, len - len1);
+        if(atomic_load(&is->audioRing.windex) > 0 && !atomic_load(&is->audioRing.finished)){
+            atomic_fetch_add(&is->audioRing.underruns, 1);
         }
     }
-    len1 = is->audio_buf_size - is->audio_buf_index;
-    if(len1 > len){
-        len1 = len;
-    }
-    if(is->audio_buf){
-        memcpy(stream, (uint8_t*)(is->audio_buf + is->audio_buf_index), len1);
-    }else{
-        memset(stream, 0, len1);
-    }
-
-    len -= len1;
-    stream += len1;
-    is->audio_buf_index += len1;
 }
 
 
@@ -380,6 +540,8 @@ int main(int argc, char *argv[])
 
     av_log_set_level(AV_LOG_DEBUG);
 
+    //-threads N / -thread_type auto|frame|slice for the decoders
+    argc = decoder_threads_parse(argc, argv);
     if(argc < 2){
         av_log(NULL, AV_LOG_ERROR, "the arguments must be more than 2!\n");
         exit(-1);
@@ -461,8 +623,8 @@ int main(int argc, char *argv[])
         av_log(vCtx, AV_LOG_ERROR, "Couldn't copy codecpar to codecContext");
         goto end;
     }
-    //bind decoder and decoder context
-    ret = avcodec_open2(vCtx, vDecodec, NULL);
+    //bind decoder and decoder context, threaded as far as the codec allows
+    ret = decoder_open(vCtx, vDecodec, NULL);
     if(ret < 0){
         av_log(NULL, AV_LOG_ERROR, "Couldn't open the codec: %s\n", av_err2str(ret));
         goto end;
@@ -494,14 +656,19 @@ int main(int argc, char *argv[])
         av_log(aCtx, AV_LOG_ERROR, "Couldn't copy codecpar to codecContext");
         goto end;
     }
-    //bind decoder and decoder context
-    ret = avcodec_open2(aCtx, aDecodec, NULL);
+    //bind decoder and decoder context, threaded as far as the codec allows
+    ret = decoder_open(aCtx, aDecodec, NULL);
     if(ret < 0){
         av_log(NULL, AV_LOG_ERROR, "Couldn't open the codec: %s\n", av_err2str(ret));
         goto end;
     }
     //init
-    packet_queue_init(&is->audioQueue);
+    if(packet_queue_init(&is->audioQueue, aInStream->time_base) < 0){
+        goto end;
+    }
+    if(audio_ring_init(&is->audioRing) < 0){
+        goto end;
+    }
 
     aPkt = av_packet_alloc();
     aFrame = av_frame_alloc();
@@ -533,6 +700,11 @@ int main(int argc, char *argv[])
         av_log(NULL, AV_LOG_ERROR, "Failed to open audio device!\n");
         goto end;
     }
+    is->audioThread = SDL_CreateThread(audio_decode_thread, "audioThread", (void *)is);
+    if(!is->audioThread){
+        av_log(NULL, AV_LOG_ERROR, "Failed to create thread!\n");
+        goto end;
+    }
     SDL_PauseAudio(0);
     //decode video
     while(av_read_frame(fmtCtx, pkt) >= 0){
@@ -561,10 +733,38 @@ int main(int argc, char *argv[])
     }
     is->vPkt = NULL;
     decode(is);
+    //an empty packet makes the audio decoder output what it still holds
+    packet_queue_put(&is->audioQueue, pkt);
+
+    //let the audio play out before tearing down, the ring can hold a few seconds
+    while(!audio_ring_done(&is->audioRing)){
+        while(SDL_PollEvent(&event)){
+            if(event.type == SDL_QUIT){
+                goto quit;
+            }
+        }
+        SDL_Delay(10);
+    }
+    //and the last buffer the callback handed to the device
+    SDL_Delay(spec.samples * 1000 / spec.freq);
 
 quit:
     ret = 0;
 end:
+    //stop the audio callback before the queue and decoder go away
+    if(is){
+        packet_queue_abort(&is->audioQueue);
+        audio_ring_abort(&is->audioRing);
+        if(is->audioThread){
+            SDL_WaitThread(is->audioThread, NULL);
+        }
+        SDL_CloseAudio();
+        av_log(NULL, AV_LOG_INFO, "audio underruns: %u\n", atomic_load(&is->audioRing.underruns));
+        packet_queue_destroy(&is->audioQueue);
+        audio_ring_destroy(&is->audioRing);
+        swr_free(&is->swr_ctx);
+        av_freep(&is->audio_buf);
+    }
     if(vFrame){
         av_frame_free(&vFrame);
     }
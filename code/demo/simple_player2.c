@@ -13,33 +13,107 @@
 #include <libavutil/avutil.h>
 #include <libavcodec/avcodec.h>
 #include <libswresample/swresample.h>
-#include <libavutil/fifo.h>
+#include <libavutil/time.h>
+#include <stdatomic.h>
+#include <math.h>
 
 #include <time.h>
 #include <pthread.h>
+#include "decoder_threads.h"
 
 
 #define ONESECOND 1000
 #define AUDIO_BUFFER_SIZE 1024
 
-typedef struct MyPacketEle{
-    AVPacket *pkt;
-}MyPacketEle;
-
+// must be a power of 2, the read/write indexes are free-running and masked
+#define PACKET_QUEUE_SLOTS 256
+#define MAX_QUEUE_SIZE (5 * 1024 * 1024)
+// in milliseconds
+#define MAX_QUEUE_DURATION 2000
+
+// Bounded single-producer/single-consumer ring of preallocated AVPacket slots.
+// Only the packet references move in and out, so putting a packet allocates nothing,
+// and the two sides only share atomics. A side sleeps on its semaphore after
+// announcing it through *_waiting, so the other side posts it only on the
+// empty-to-non-empty (or full-to-non-full) transition, never in steady state.
 typedef struct PacketQueue{
-    AVFifo *pkts;
-    int nb_packets;
-    int size;
-    int64_t duration;
-    SDL_mutex *mutex;
-    SDL_cond *cond;
+    AVPacket **pkts;
+    unsigned int mask;
+    atomic_uint windex;             // written only by the producer
+    atomic_uint rindex;             // written only by the consumer
+    atomic_int size;
+    atomic_int_fast64_t duration;
+    int max_size;
+    int64_t max_duration;           // in the time base of the stream
+    atomic_int reader_waiting;
+    atomic_int writer_waiting;
+    atomic_int abort_request;
+    SDL_sem *readable;
+    SDL_sem *writable;
 }PacketQueue;
 
+// must be a power of 2, a bit more than a second of 48 kHz stereo S16
+#define AUDIO_RING_SIZE (256 * 1024)
+
+// Single-producer/single-consumer ring of PCM bytes between the audio decode thread
+// and the SDL audio callback. The callback never decodes, locks or sleeps: it copies
+// what is there and plays silence for the rest. Only the decode thread sleeps, when
+// the ring is full, and the callback wakes it up the same way PacketQueue does.
+typedef struct AudioRing{
+    uint8_t *buf;
+    _Atomic uint64_t windex;        // bytes written so far, only by the decode thread
+    _Atomic uint64_t rindex;        // bytes read so far, only by the callback
+    atomic_int writer_waiting;
+    atomic_int abort_request;
+    atomic_int finished;
+    atomic_uint underruns;
+    SDL_sem *writable;
+}AudioRing;
+
+enum {
+    AV_SYNC_AUDIO_MASTER,
+    AV_SYNC_VIDEO_MASTER,
+    AV_SYNC_EXTERNAL_CLOCK,
+};
+
+// the clocks are not corrected when they are this far apart, the timestamps are probably broken
+#define AV_NOSYNC_THRESHOLD 10.0
+// video is only corrected when it is off by more than this, between the two bounds
+// depending on the frame duration
+#define AV_SYNC_THRESHOLD_MIN 0.04
+#define AV_SYNC_THRESHOLD_MAX 0.1
+// frames longer than this are shown longer instead of being duplicated
+#define AV_SYNC_FRAMEDUP_THRESHOLD 0.1
+
+// A clock is stored as its offset from the system time, so reading it on another
+// thread needs only one atomic load, and it keeps running between updates.
+typedef struct Clock{
+    _Atomic double pts_drift;       // NAN until the clock has been set
+}Clock;
+
+// must be a power of 2 as well, a few frames are enough to absorb decode jitter
+#define FRAME_QUEUE_SIZE 4
+
+// Ring of decoded, refcounted frames between the video decode thread (writer)
+// and the presentation loop on the main thread (reader), same scheme as PacketQueue.
+typedef struct FrameQueue{
+    AVFrame *frames[FRAME_QUEUE_SIZE];
+    atomic_uint windex;
+    atomic_uint rindex;
+    atomic_int reader_waiting;
+    atomic_int writer_waiting;
+    atomic_int abort_request;
+    atomic_int finished;
+    SDL_sem *readable;
+    SDL_sem *writable;
+}FrameQueue;
+
 typedef struct VideoState{
     AVFormatContext *fmtCtx;
 
     AVCodecContext *aCtx;
     AVCodecContext *vCtx;
+    AVPacket       *pkt;
     AVPacket       *aPkt;
     AVPacket       *vPkt;
     AVFrame        *aFrame;
@@ -50,13 +124,35 @@ typedef struct VideoState{
 
     struct SwrContext *swr_ctx;
 
-    uint8_t        *audio_buf;
+    uint8_t        *audio_buf;           // owned by the audio decode thread
     uint           audio_buf_size;
-    int            audio_buf_index;
 
     SDL_Texture    *texture;
 
     PacketQueue    audioQueue;
+    AudioRing      audioRing;
+    SDL_Thread     *audioThread;
+    PacketQueue    videoQueue;
+    FrameQueue     pictq;
+
+    Clock          audclk;
+    Clock          vidclk;
+    Clock          extclk;
+    int            av_sync_type;
+
+    double         audio_clock;         // pts of the end of the last decoded audio chunk
+    _Atomic double audio_pts_base;      // pts of byte 0 of the audio ring, NAN until known
+    int            audio_hw_buf_size;
+    int            audio_bytes_per_sec;
+
+    double         frame_timer;         // system time the frame on screen was due at
+    double         frame_last_pts;
+    int            frame_drops;
+    int            frame_dups;
+
+    // demux -> videoQueue -> decode -> pictq -> presentation on the main thread
+    SDL_Thread     *demuxThread;
+    SDL_Thread     *videoThread;
 }VideoState;
 
 static int w_width = 640;
@@ -65,12 +161,6 @@ static int w_height = 480;
 static SDL_Window *win = NULL;
 static SDL_Renderer *renderer = NULL;
 
-// pthread_mutex_t mutex;
-// pthread_cond_t  cond;
-SDL_mutex       *videoMutex;
-SDL_cond        *videoCond;
-int             frame_decoded;
-
 // Define the function pointer type for the function to be measured
 typedef int (*FunctionPtr)(VideoState *is);
 
@@ -100,140 +190,405 @@ static void save_pgm(unsigned char* buffer, int linesize, int width, int height,
     
 }
 
-static int packet_queue_init(PacketQueue *q)
+static int packet_queue_init(PacketQueue *q, AVRational time_base)
 {
     memset(q, 0, sizeof(PacketQueue));
-    q->pkts = av_fifo_alloc2(1, sizeof(MyPacketEle), AV_FIFO_FLAG_AUTO_GROW);
+    q->pkts = av_calloc(PACKET_QUEUE_SLOTS, sizeof(*q->pkts));
     if(!q->pkts){
         av_log(NULL, AV_LOG_ERROR, "No Memory!\n");
         return AVERROR(ENOMEM);
     }
-    q->mutex = SDL_CreateMutex();
-    if(!q->mutex){
+    for(int i = 0; i < PACKET_QUEUE_SLOTS; i++){
+        q->pkts[i] = av_packet_alloc();
+        if(!q->pkts[i]){
+            av_log(NULL, AV_LOG_ERROR, "No Memory!\n");
+            return AVERROR(ENOMEM);
+        }
+    }
+    q->mask = PACKET_QUEUE_SLOTS - 1;
+    q->max_size = MAX_QUEUE_SIZE;
+    q->max_duration = av_rescale_q(MAX_QUEUE_DURATION, (AVRational){1, 1000}, time_base);
+    q->readable = SDL_CreateSemaphore(0);
+    if(!q->readable){
         av_log(NULL, AV_LOG_ERROR, "No Memory!\n");
         return AVERROR(ENOMEM);
     }
-    q->cond = SDL_CreateCond();
-    if(!q->cond){
+    q->writable = SDL_CreateSemaphore(0);
+    if(!q->writable){
         av_log(NULL, AV_LOG_ERROR, "No Memory!\n");
         return AVERROR(ENOMEM);
     }
     return 0;
 }
 
-static int packet_queue_put_priv(PacketQueue *q, AVPacket *pkt)
+// the limits are soft: an empty queue always takes the next packet, however big it is
+static int packet_queue_full(PacketQueue *q, unsigned int windex)
 {
-    MyPacketEle mypkt;
-    int ret = -1;
+    unsigned int count = windex - atomic_load(&q->rindex);
 
-    mypkt.pkt = pkt;
+    if(count == 0){
+        return 0;
+    }
+    return count > q->mask ||
+           atomic_load(&q->size) >= q->max_size ||
+           (q->max_duration > 0 && atomic_load(&q->duration) >= q->max_duration);
+}
 
-    ret = av_fifo_write(q->pkts, &mypkt, 1);
-    if(ret < 0){
-        return ret;
+// producer side, only the demux thread calls this; blocks while the queue is full
+static int packet_queue_put(PacketQueue *q, AVPacket *pkt)
+{
+    unsigned int windex = atomic_load_explicit(&q->windex, memory_order_relaxed);
+
+    while(packet_queue_full(q, windex) && !atomic_load(&q->abort_request)){
+        // announce first and check again, so either the consumer sees the flag
+        // or we see the slot it has just freed
+        atomic_store(&q->writer_waiting, 1);
+        if(packet_queue_full(q, windex) && !atomic_load(&q->abort_request)){
+            SDL_SemWait(q->writable);
+        }
+        atomic_store(&q->writer_waiting, 0);
+    }
+    if(atomic_load(&q->abort_request)){
+        av_packet_unref(pkt);
+        return -1;
     }
+
     //update the queue info
-    q->nb_packets++;
-    q->size += mypkt.pkt->size + sizeof(mypkt);
-    q->duration += mypkt.pkt->duration;
-    //
-    SDL_CondSignal(q->cond);
+    atomic_fetch_add(&q->size, pkt->size + (int)sizeof(*pkt));
+    atomic_fetch_add(&q->duration, pkt->duration);
+    av_packet_move_ref(q->pkts[windex & q->mask], pkt);
+    atomic_store(&q->windex, windex + 1);
 
-    return ret;
+    if(atomic_load(&q->reader_waiting) && atomic_exchange(&q->reader_waiting, 0)){
+        SDL_SemPost(q->readable);
+    }
+    return 0;
 }
 
+// consumer side, only one thread calls this
 static int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block)
 {
-    MyPacketEle mypkt;
-    int ret = -1;
+    unsigned int rindex = atomic_load_explicit(&q->rindex, memory_order_relaxed);
+    AVPacket *slot;
 
-    SDL_LockMutex(q->mutex);
-    for (;;){
-        if(av_fifo_read(q->pkts, &mypkt, 1)>=0){
-            q->nb_packets--;
-            q->size -= mypkt.pkt->size + sizeof(mypkt);
-            q->duration -= mypkt.pkt->duration;
-            av_packet_move_ref(pkt, mypkt.pkt);
-            av_packet_free(&mypkt.pkt);
-            ret = 1;
-            break;
-        }else if(!block){
-            ret = 0;
-            break;
-        }else{
-            SDL_CondWait(q->cond, q->mutex);
+    while(rindex == atomic_load(&q->windex)){
+        if(atomic_load(&q->abort_request)){
+            return -1;
         }
+        if(!block){
+            return 0;
+        }
+        atomic_store(&q->reader_waiting, 1);
+        if(rindex == atomic_load(&q->windex) && !atomic_load(&q->abort_request)){
+            SDL_SemWait(q->readable);
+        }
+        atomic_store(&q->reader_waiting, 0);
     }
-    SDL_UnlockMutex(q->mutex);
-    
-    return ret;
+
+    slot = q->pkts[rindex & q->mask];
+    atomic_fetch_sub(&q->size, slot->size + (int)sizeof(*slot));
+    atomic_fetch_sub(&q->duration, slot->duration);
+    av_packet_move_ref(pkt, slot);
+    atomic_store(&q->rindex, rindex + 1);
+
+    if(atomic_load(&q->writer_waiting) && atomic_exchange(&q->writer_waiting, 0)){
+        SDL_SemPost(q->writable);
+    }
+    return 1;
 }
 
+// wake up both sides for good, put and get fail from now on
+static void packet_queue_abort(PacketQueue *q)
+{
+    atomic_store(&q->abort_request, 1);
+    if(q->readable){
+        SDL_SemPost(q->readable);
+    }
+    if(q->writable){
+        SDL_SemPost(q->writable);
+    }
+}
+
+// drops what is queued, call it from the consumer side or when both sides have stopped
 static void packet_queue_flush(PacketQueue *q)
 {
-    MyPacketEle mypkt;
-    SDL_LockMutex(q->mutex);
+    unsigned int rindex = atomic_load(&q->rindex);
+    unsigned int windex = atomic_load(&q->windex);
 
-    while (av_fifo_read(q->pkts, &mypkt, 1) > 0){
-        av_packet_free(&mypkt.pkt);
+    if(!q->pkts){
+        return;
     }
-    q->nb_packets = 0;
-    q->size = 0;
-    q->duration = 0;
+    for(; rindex != windex; rindex++){
+        AVPacket *slot = q->pkts[rindex & q->mask];
 
-    SDL_UnlockMutex(q->mutex);
+        atomic_fetch_sub(&q->size, slot->size + (int)sizeof(*slot));
+        atomic_fetch_sub(&q->duration, slot->duration);
+        av_packet_unref(slot);
+    }
+    atomic_store(&q->rindex, rindex);
 }
 
 static void packet_queue_destroy(PacketQueue *q)
 {
     packet_queue_flush(q);
-    av_fifo_freep2(&q->pkts);
-    SDL_DestroyMutex(q->mutex);
-    SDL_DestroyCond(q->cond); 
+    if(q->pkts){
+        for(int i = 0; i < PACKET_QUEUE_SLOTS; i++){
+            av_packet_free(&q->pkts[i]);
+        }
+        av_freep(&q->pkts);
+    }
+    if(q->readable){
+        SDL_DestroySemaphore(q->readable);
+    }
+    if(q->writable){
+        SDL_DestroySemaphore(q->writable);
+    }
 }
 
-static int packet_queue_put(PacketQueue *q, AVPacket *pkt)
+static int frame_queue_init(FrameQueue *q)
 {
-    AVPacket *pkt1;
-    int ret = -1;
+    memset(q, 0, sizeof(FrameQueue));
+    for(int i = 0; i < FRAME_QUEUE_SIZE; i++){
+        q->frames[i] = av_frame_alloc();
+        if(!q->frames[i]){
+            av_log(NULL, AV_LOG_ERROR, "No Memory!\n");
+            return AVERROR(ENOMEM);
+        }
+    }
+    q->readable = SDL_CreateSemaphore(0);
+    if(!q->readable){
+        av_log(NULL, AV_LOG_ERROR, "No Memory!\n");
+        return AVERROR(ENOMEM);
+    }
+    q->writable = SDL_CreateSemaphore(0);
+    if(!q->writable){
+        av_log(NULL, AV_LOG_ERROR, "No Memory!\n");
+        return AVERROR(ENOMEM);
+    }
+    return 0;
+}
 
-    
-    
-    SDL_UnlockMutex(q->mutex);
+// writer side, takes over the reference of frame; blocks while all slots are in use
+static int frame_queue_push(FrameQueue *q, AVFrame *frame)
+{
+    unsigned int windex = atomic_load_explicit(&q->windex, memory_order_relaxed);
 
-    pkt1 = av_packet_alloc();
-    if(!pkt1){
-        av_packet_unref(pkt);
+    while(windex - atomic_load(&q->rindex) == FRAME_QUEUE_SIZE && !atomic_load(&q->abort_request)){
+        atomic_store(&q->writer_waiting, 1);
+        if(windex - atomic_load(&q->rindex) == FRAME_QUEUE_SIZE && !atomic_load(&q->abort_request)){
+            SDL_SemWait(q->writable);
+        }
+        atomic_store(&q->writer_waiting, 0);
+    }
+    if(atomic_load(&q->abort_request)){
+        av_frame_unref(frame);
         return -1;
     }
-    av_packet_move_ref(pkt1, pkt);
 
-    SDL_LockMutex(q->mutex);
+    av_frame_move_ref(q->frames[windex % FRAME_QUEUE_SIZE], frame);
+    atomic_store(&q->windex, windex + 1);
 
-    ret = packet_queue_put_priv(q, pkt1);
+    if(atomic_load(&q->reader_waiting) && atomic_exchange(&q->reader_waiting, 0)){
+        SDL_SemPost(q->readable);
+    }
+    return 0;
+}
 
-    SDL_UnlockMutex(q->mutex);
+// writer side, no more frames will come
+static void frame_queue_finish(FrameQueue *q)
+{
+    atomic_store(&q->finished, 1);
+    SDL_SemPost(q->readable);
+}
 
-    if(ret < 0){
-        av_packet_free(&pkt1);
+// reader side, returns the oldest frame without removing it, or NULL if none
+// arrives within timeout milliseconds
+static AVFrame *frame_queue_peek(FrameQueue *q, Uint32 timeout)
+{
+    unsigned int rindex = atomic_load_explicit(&q->rindex, memory_order_relaxed);
+
+    if(rindex == atomic_load(&q->windex) && timeout > 0 && !atomic_load(&q->finished)){
+        atomic_store(&q->reader_waiting, 1);
+        if(rindex == atomic_load(&q->windex) && !atomic_load(&q->finished) &&
+           !atomic_load(&q->abort_request)){
+            SDL_SemWaitTimeout(q->readable, timeout);
+        }
+        atomic_store(&q->reader_waiting, 0);
+    }
+    if(rindex == atomic_load(&q->windex)){
+        return NULL;
+    }
+    return q->frames[rindex % FRAME_QUEUE_SIZE];
+}
+
+// reader side, the frame after the one returned by frame_queue_peek(), NULL if it
+// has not been decoded yet
+static AVFrame *frame_queue_peek_next(FrameQueue *q)
+{
+    unsigned int rindex = atomic_load_explicit(&q->rindex, memory_order_relaxed);
+
+    if(atomic_load(&q->windex) - rindex < 2){
+        return NULL;
+    }
+    return q->frames[(rindex + 1) % FRAME_QUEUE_SIZE];
+}
+
+// reader side, releases the frame returned by frame_queue_peek()
+static void frame_queue_next(FrameQueue *q)
+{
+    unsigned int rindex = atomic_load_explicit(&q->rindex, memory_order_relaxed);
+
+    av_frame_unref(q->frames[rindex % FRAME_QUEUE_SIZE]);
+    atomic_store(&q->rindex, rindex + 1);
+
+    if(atomic_load(&q->writer_waiting) && atomic_exchange(&q->writer_waiting, 0)){
+        SDL_SemPost(q->writable);
+    }
+}
+
+// the writer has finished and every frame has been shown
+static int frame_queue_done(FrameQueue *q)
+{
+    return atomic_load(&q->finished) && atomic_load(&q->rindex) == atomic_load(&q->windex);
+}
+
+static void frame_queue_abort(FrameQueue *q)
+{
+    atomic_store(&q->abort_request, 1);
+    if(q->readable){
+        SDL_SemPost(q->readable);
+    }
+    if(q->writable){
+        SDL_SemPost(q->writable);
+    }
+}
+
+static void frame_queue_destroy(FrameQueue *q)
+{
+    for(int i = 0; i < FRAME_QUEUE_SIZE; i++){
+        av_frame_free(&q->frames[i]);
+    }
+    if(q->readable){
+        SDL_DestroySemaphore(q->readable);
+    }
+    if(q->writable){
+        SDL_DestroySemaphore(q->writable);
     }
-    return ret;
 }
 
-static void render(VideoState *is)
+static int audio_ring_init(AudioRing *r)
+{
+    memset(r, 0, sizeof(AudioRing));
+    r->buf = av_malloc(AUDIO_RING_SIZE);
+    if(!r->buf){
+        av_log(NULL, AV_LOG_ERROR, "No Memory!\n");
+        return AVERROR(ENOMEM);
+    }
+    r->writable = SDL_CreateSemaphore(0);
+    if(!r->writable){
+        av_log(NULL, AV_LOG_ERROR, "No Memory!\n");
+        return AVERROR(ENOMEM);
+    }
+    return 0;
+}
+
+// decode thread side, blocks until all of data is in the ring
+static int audio_ring_write(AudioRing *r, const uint8_t *data, int size)
+{
+    uint64_t windex = atomic_load_explicit(&r->windex, memory_order_relaxed);
+    int space, len, offset, len1;
+
+    while(size > 0){
+        if(atomic_load(&r->abort_request)){
+            return -1;
+        }
+        space = AUDIO_RING_SIZE - (int)(windex - atomic_load(&r->rindex));
+        if(space == 0){
+            atomic_store(&r->writer_waiting, 1);
+            if(windex - atomic_load(&r->rindex) == AUDIO_RING_SIZE && !atomic_load(&r->abort_request)){
+                SDL_SemWait(r->writable);
+            }
+            atomic_store(&r->writer_waiting, 0);
+            continue;
+        }
+
+        len = FFMIN(space, size);
+        offset = windex & (AUDIO_RING_SIZE - 1);
+        len1 = FFMIN(len, AUDIO_RING_SIZE - offset);
+        memcpy(r->buf + offset, data, len1);
+        memcpy(r->buf, data + len1, len - len1);
+        windex += len;
+        atomic_store(&r->windex, windex);
+
+        data += len;
+        size -= len;
+    }
+    return 0;
+}
+
+// callback side, copies at most size bytes and returns how many
+static int audio_ring_read(AudioRing *r, uint8_t *data, int size)
+{
+    uint64_t rindex = atomic_load_explicit(&r->rindex, memory_order_relaxed);
+    int len, offset, len1;
+
+    len = (int)FFMIN((uint64_t)size, atomic_load(&r->windex) - rindex);
+    offset = rindex & (AUDIO_RING_SIZE - 1);
+    len1 = FFMIN(len, AUDIO_RING_SIZE - offset);
+    memcpy(data, r->buf + offset, len1);
+    memcpy(data + len1, r->buf, len - len1);
+    rindex += len;
+    atomic_store(&r->rindex, rindex);
+
+    //wake the decode thread only once a quarter of the ring is free, so it refills in
+    //big chunks instead of being woken from the callback every time
+    if(atomic_load(&r->writer_waiting) &&
+       AUDIO_RING_SIZE - (atomic_load(&r->windex) - rindex) >= AUDIO_RING_SIZE / 4 &&
+       atomic_exchange(&r->writer_waiting, 0)){
+        SDL_SemPost(r->writable);
+    }
+    return len;
+}
+
+// decode thread side, the stream has ended, running dry from now on is not an underrun
+static void audio_ring_finish(AudioRing *r)
+{
+    atomic_store(&r->finished, 1);
+}
+
+// the decode thread has finished and the callback has taken every byte
+static int audio_ring_done(AudioRing *r)
+{
+    return atomic_load(&r->finished) && atomic_load(&r->rindex) == atomic_load(&r->windex);
+}
+
+static void audio_ring_abort(AudioRing *r)
+{
+    atomic_store(&r->abort_request, 1);
+    if(r->writable){
+        SDL_SemPost(r->writable);
+    }
+}
+
+static void audio_ring_destroy(AudioRing *r)
+{
+    av_freep(&r->buf);
+    if(r->writable){
+        SDL_DestroySemaphore(r->writable);
+    }
+}
+
+static void render(VideoState *is, AVFrame *frame)
 {
 
     SDL_UpdateYUVTexture(is->texture, NULL,
-                         is->vFrame->data[0], is->vFrame->linesize[0] ,
-                         is->vFrame->data[1], is->vFrame->linesize[1],
-                         is->vFrame->data[2], is->vFrame->linesize[2]);
+                         frame->data[0], frame->linesize[0] ,
+                         frame->data[1], frame->linesize[1],
+                         frame->data[2], frame->linesize[2]);
     
     SDL_RenderClear(renderer);
     SDL_RenderCopy(renderer, is->texture, NULL, NULL);
     SDL_RenderPresent(renderer);
-
-    int frameRate = is->fmtCtx->streams[is->vIdx]->r_frame_rate.num/is->fmtCtx->streams[is->vIdx]->r_frame_rate.den;
-    SDL_Delay((Uint32)(ONESECOND/frameRate));
 }
 
 static int decode_raw(VideoState *is)
@@ -262,7 +617,7 @@ static int decode_raw(VideoState *is)
         snprintf(buffer, sizeof(buffer), "%s-%d.pgm", fileName, frameNumber++);
         //printf("frame number: %s\n", frameNumber);
         save_pgm(is->vFrame->data[0], is->vFrame->linesize[0], is->vFrame->width, is->vFrame->height, buffer);
-        render(is);
+        render(is, is->vFrame);
         if(frameNumber > 10) exit(-1);
     }
     
@@ -272,176 +627,265 @@ end:
     
 }
 
-static int decode(void *arg)
+// decode stage: packets from videoQueue in, decoded frames into pictq
+static int video_decode_thread(void *arg)
 {
     VideoState *is = arg;
 
     int ret = -1;
 
-    //char buffer[1024];
-    SDL_LockMutex(videoMutex);
-    while (1)
-    {
-        
-        SDL_CondWait(videoCond, videoMutex);
-        
-        if(frame_decoded == 1)
+    for(;;){
+        if(packet_queue_get(&is->videoQueue, is->vPkt, 1) < 0){
+            break;
+        }
+
+        //send packet to decoder, the empty packet queued at the end of file drains it
+        ret = avcodec_send_packet(is->vCtx, is->vPkt);
+        av_packet_unref(is->vPkt);
+        if(ret < 0){
+            av_log(NULL, AV_LOG_ERROR, "Failed to send frame to decoder!\n");
+            continue;
+        }
+
+        while (ret >= 0)
         {
-            //send packet to decoder
-            ret = avcodec_send_packet(is->vCtx, is->vPkt);
-            if(ret < 0){
-                av_log(NULL, AV_LOG_ERROR, "Failed to send frame to decoder!\n");
+            ret = avcodec_receive_frame(is->vCtx, is->vFrame);
+            if(ret == AVERROR(EAGAIN)){
                 break;
+            }else if(ret < 0){
+                //AVERROR_EOF once the decoder has been drained
+                goto end;
             }
+            if(frame_queue_push(&is->pictq, is->vFrame) < 0){
+                goto end;
+            }
+        }
+    }
+
+end:
+    frame_queue_finish(&is->pictq);
+    return ret;
+}
 
-            while (ret >= 0)
-            {
-                ret = avcodec_receive_frame(is->vCtx, is->vFrame);
-                if(ret == AVERROR(EAGAIN) || ret == AVERROR_EOF){
-                    //ret = 0;
-                    break;
-                }else if(ret < 0){
-                    ret = -1;
-                    break;
-                }
-                // char buffer[1024];
-                // static int frameNumber = 0;
-                // char *fileName = "/Users/jacklau/Documents/Programs/C_text/ffmpeg/resource/test/out_test";
-                // snprintf(buffer, sizeof(buffer), "%s-%d.pgm", fileName, frameNumber++);
-                // //printf("frame number: %s\n", frameNumber);
-                // save_pgm(is->vFrame->data[0], is->vFrame->linesize[0], is->vFrame->width, is->vFrame->height, buffer);
-                render(is);
-                // if(frameNumber > 10) exit(-1);
-                
-                av_frame_unref(is->vFrame);
-                
+// demux stage: read the file and hand the packets to the video and audio queues
+static int demux_thread(void *arg)
+{
+    VideoState *is = arg;
 
-            }
-            frame_decoded = 0;
+    int ret = 0;
+    AVPacket *pkt = is->pkt;
+
+    while(av_read_frame(is->fmtCtx, pkt) >= 0){
+        if(pkt->stream_index == is->vIdx){
+            ret = packet_queue_put(&is->videoQueue, pkt);
+        }else if(pkt->stream_index == is->aIdx){
+            ret = packet_queue_put(&is->audioQueue, pkt);
+        }else{
+            av_packet_unref(pkt);
+        }
+        //the queues have been aborted
+        if(ret < 0){
+            goto end;
         }
     }
-    
-    SDL_UnlockMutex(videoMutex);
-    
+    //end of file, an empty packet makes the decoders output the frames they still hold
+    packet_queue_put(&is->videoQueue, pkt);
+    packet_queue_put(&is->audioQueue, pkt);
+
+end:
     return ret;
 }
 
+static void init_clock(Clock *c)
+{
+    atomic_store(&c->pts_drift, NAN);
+}
+
+static void set_clock_at(Clock *c, double pts, double time)
+{
+    atomic_store(&c->pts_drift, pts - time);
+}
+
+static void set_clock(Clock *c, double pts)
+{
+    set_clock_at(c, pts, av_gettime_relative() / 1000000.0);
+}
+
+static double get_clock(Clock *c)
+{
+    return atomic_load(&c->pts_drift) + av_gettime_relative() / 1000000.0;
+}
+
+static double get_master_clock(VideoState *is)
+{
+    switch (is->av_sync_type)
+    {
+    case AV_SYNC_AUDIO_MASTER:
+        return get_clock(&is->audclk);
+    case AV_SYNC_VIDEO_MASTER:
+        return get_clock(&is->vidclk);
+    default:
+        return get_clock(&is->extclk);
+    }
+}
+
+// how long the frame on screen should stay before the next one, stretched when video
+// is ahead of the master clock (the frame is duplicated) and shortened when it is behind
+static double compute_target_delay(VideoState *is, double delay)
+{
+    double diff, sync_threshold;
+
+    if(is->av_sync_type == AV_SYNC_VIDEO_MASTER){
+        return delay;
+    }
+
+    diff = get_clock(&is->vidclk) - get_master_clock(is);
+    sync_threshold = FFMAX(AV_SYNC_THRESHOLD_MIN, FFMIN(AV_SYNC_THRESHOLD_MAX, delay));
+    if(isnan(diff) || fabs(diff) >= AV_NOSYNC_THRESHOLD){
+        return delay;
+    }
+
+    if(diff <= -sync_threshold){
+        delay = FFMAX(0, delay + diff);
+    }else if(diff >= sync_threshold && delay > AV_SYNC_FRAMEDUP_THRESHOLD){
+        delay = delay + diff;
+    }else if(diff >= sync_threshold){
+        delay = 2 * delay;
+    }
+    return delay;
+}
+
+static double frame_pts(VideoState *is, AVFrame *frame)
+{
+    if(frame->best_effort_timestamp == AV_NOPTS_VALUE){
+        return NAN;
+    }
+    return frame->best_effort_timestamp * av_q2d(is->fmtCtx->streams[is->vIdx]->time_base);
+}
+
 static int audio_decode_frame(VideoState *is)
 {
     int ret = -1;
     int len2 = 0;
 
     int data_size = 0;
-    AVPacket *pkt = av_packet_alloc();
+    AVPacket *pkt = is->aPkt;
     for(;;){
-        if(packet_queue_get(&is->audioQueue, pkt, 1)<0){
-            return -1;
+        //take what the decoder already has before feeding it another packet
+        ret = avcodec_receive_frame(is->aCtx, is->aFrame);
+        if(ret == AVERROR(EAGAIN)){
+            if(packet_queue_get(&is->audioQueue, pkt, 1)<0){
+                return -1;
+            }
+            //the empty packet queued at the end of file drains the decoder
+            ret = avcodec_send_packet(is->aCtx, pkt);
+            av_packet_unref(pkt);
+            if(ret < 0){
+                av_log(is->aCtx, AV_LOG_ERROR, "Failed to send pkt to audio decoder!\n");
+            }
+            continue;
+        }else if(ret == AVERROR_EOF){
+            return ret;
+        }else if(ret < 0){
+            av_log(is->aCtx, AV_LOG_ERROR, "Failed to receive frame from audio decoder!\n");
+            return ret;
         }
-
-        ret = avcodec_send_packet(is->aCtx, pkt);
-        if(ret < 0){
-            av_log(is->aCtx, AV_LOG_ERROR, "Failed to send pkt to audio decoder!\n");
-            goto end;
+        //remember where the decoded data ends, the decode thread derives the audio clock from it
+        if(is->aFrame->pts != AV_NOPTS_VALUE){
+            is->audio_clock = is->aFrame->pts * av_q2d(is->fmtCtx->streams[is->aIdx]->time_base);
+        }
+        is->audio_clock += (double)is->aFrame->nb_samples / is->aFrame->sample_rate;
+
+        //re-sampling, always, so audio_buf is our own interleaved S16 copy
+        if(!is->swr_ctx){
+            AVChannelLayout in_ch_layout, out_ch_layout;
+            av_channel_layout_copy(&in_ch_layout, &is->aCtx->ch_layout);
+            av_channel_layout_copy(&out_ch_layout, &in_ch_layout);
+            swr_alloc_set_opts2(&is->swr_ctx, 
+                            &out_ch_layout, 
+                            AV_SAMPLE_FMT_S16,
+                            is->aCtx->sample_rate,
+                            &in_ch_layout,
+                            is->aCtx->sample_fmt,
+                            is->aCtx->sample_rate,
+                            0,
+                            NULL);
+
+            swr_init(is->swr_ctx);
         }
-        while (ret >= 0)
-        {
-            ret = avcodec_receive_frame(is->aCtx, is->aFrame);
-            if(ret == AVERROR(EAGAIN) || ret == AVERROR_EOF){
-                break;
-            }else if(ret < 0){
-                av_log(is->aCtx, AV_LOG_ERROR, "Failed to receive frame from audio decoder!\n");
-                goto end;
-            }
 
-            
-            //re-sampling
-            if(!is->swr_ctx){
-                AVChannelLayout in_ch_layout, out_ch_layout;
-                av_channel_layout_copy(&in_ch_layout, &is->aCtx->ch_layout);
-                av_channel_layout_copy(&out_ch_layout, &in_ch_layout);
-                if(is->aCtx->sample_fmt != AV_SAMPLE_FMT_S16){
-                    swr_alloc_set_opts2(&is->swr_ctx, 
-                                    &out_ch_layout, 
-                                    AV_SAMPLE_FMT_S16,
-                                    is->aCtx->sample_rate,
-                                    &in_ch_layout,
-                                    is->aCtx->sample_fmt,
-                                    is->aCtx->sample_rate,
-                                    0,
-                                    NULL);
-
-                    swr_init(is->swr_ctx);
-                }
-            }
+        const uint8_t **in = (const uint8_t **)is->aFrame->extended_data;
+        int in_count = is->aFrame->nb_samples;
+        uint8_t **out = &is->audio_buf;
+        int out_count = is->aFrame->nb_samples + 512;
 
-            if(is->swr_ctx){
-                const uint8_t **in = (const uint8_t **)is->aFrame->extended_data;
-                int in_count = is->aFrame->nb_samples;
-                uint8_t **out = &is->audio_buf;
-                int out_count = is->aFrame->nb_samples + 512;
-
-                int out_size = av_samples_get_buffer_size(NULL, is->aFrame->ch_layout.nb_channels, out_count, AV_SAMPLE_FMT_S16, 0);
-                av_fast_malloc(&is->audio_buf, &is->audio_buf_size, out_size);
-
-                len2 = swr_convert(is->swr_ctx,
-                            out,
-                            out_count,
-                            in,
-                            in_count);
-
-                //data_size = len2 * is->aFrame->ch_layout.nb_channels*av_get_bytes_per_sample(AV_SAMPLE_FMT_S16);
-                data_size = len2 * is->fmtCtx->streams[is->aIdx]->codecpar->ch_layout.nb_channels * 2; 
-                //data_size = len2 * 2 * 2; 
-            }else{
-                is->audio_buf = is->vFrame->data[0];
-                data_size = av_samples_get_buffer_size(NULL, is->aFrame->ch_layout.nb_channels, is->aFrame->nb_samples, is->aFrame->format, 1);
-            }
+        int out_size = av_samples_get_buffer_size(NULL, is->aFrame->ch_layout.nb_channels, out_count, AV_SAMPLE_FMT_S16, 0);
+        av_fast_malloc(&is->audio_buf, &is->audio_buf_size, out_size);
 
-            av_packet_unref(pkt);
-            av_frame_unref(is->aFrame);
+        len2 = swr_convert(is->swr_ctx,
+                    out,
+                    out_count,
+                    in,
+                    in_count);
 
-            return data_size;
+        data_size = len2 * is->aFrame->ch_layout.nb_channels * 2; 
+
+        av_frame_unref(is->aFrame);
+
+        return data_size;
+    }
+}
 
+// audio decode stage: packets from audioQueue in, PCM into audioRing
+static int audio_decode_thread(void *arg)
+{
+    VideoState *is = arg;
+
+    int audio_size = 0;
+
+    for(;;){
+        audio_size = audio_decode_frame(is);
+        if(audio_size < 0){
+            break;
+        }
+        //the pts the ring would have at byte 0, so the callback can turn the bytes it has
+        //consumed into the audio clock without sharing anything else
+        atomic_store(&is->audio_pts_base, is->audio_clock -
+                     (double)(atomic_load(&is->audioRing.windex) + audio_size) / is->audio_bytes_per_sec);
+        if(audio_ring_write(&is->audioRing, is->audio_buf, audio_size) < 0){
+            break;
         }
-        
     }
-end:
-    return ret;
+    audio_ring_finish(&is->audioRing);
 
+    return 0;
 }
 
 static void sdl_audio_callback(void *userdata, Uint8 *stream, int len)
 {
     int len1 = 0;
-    int audio_size = 0;
     VideoState *is = (VideoState*)userdata;
-
-
-    if (len > 0){
-        if(is->audio_buf_index >= is->audio_buf_size){
-            audio_size = audio_decode_frame(is);
-            if(audio_size < 0){
-                is->audio_buf_size = AUDIO_BUFFER_SIZE;
-                is->audio_buf = NULL;
-            }else {
-                is->audio_buf_size = audio_size;
-            }
-            is->audio_buf_index = 0;
+    double callback_time = av_gettime_relative() / 1000000.0;
+    double pts_base = atomic_load(&is->audio_pts_base);
+
+    //only copy here, decoding happens on the audio decode thread
+    len1 = audio_ring_read(&is->audioRing, stream, len);
+    if(len1 < len){
+        //play silence rather than wait for the decoder, before the first data and
+        //after the end of the stream this is expected
+        memset(stream + len1, 0, len - len1);
+        if(atomic_load(&is->audioRing.windex) > 0 && !atomic_load(&is->audioRing.finished)){
+            atomic_fetch_add(&is->audioRing.underruns, 1);
         }
     }
-    len1 = is->audio_buf_size - is->audio_buf_index;
-    if(len1 > len){
-        len1 = len;
-    }
-    if(is->audio_buf){
-        memcpy(stream, (uint8_t*)(is->audio_buf + is->audio_buf_index), len1);
-    }else{
-        memset(stream, 0, len1);
-    }
 
-    len -= len1;
-    stream += len1;
-    is->audio_buf_index += len1;
+    //what is heard now is the data just before rindex, minus what the device has buffered
+    //(the chunk playing and the one just filled)
+    if(!isnan(pts_base)){
+        set_clock_at(&is->audclk,
+                     pts_base + ((double)atomic_load(&is->audioRing.rindex) - 2.0 * is->audio_hw_buf_size) / is->audio_bytes_per_sec,
+                     callback_time);
+    }
 }
 
 
@@ -479,21 +923,24 @@ int main(int argc, char *argv[])
     VideoState *is = NULL; 
 
     SDL_AudioSpec wanted_spec, spec;
-    
-    // set the mutex and cond
-    // pthread_t decode_tid, render_tid;
-    // pthread_mutex_init(&mutex, NULL);
-    // pthread_cond_init(&cond, NULL);
-    videoMutex = SDL_CreateMutex();
-    videoCond = SDL_CreateCond();
+
+    AVFrame *frame = NULL;
+    AVFrame *next = NULL;
+    AVRational frame_rate;
+    double frame_duration = 0;
+    double pts, last_duration, duration, delay, time;
+    double last_status = 0;
     
     //deal with arguments
     char *src;
 
     av_log_set_level(AV_LOG_DEBUG);
 
+    //-threads N / -thread_type auto|frame|slice for the decoders
+    argc = decoder_threads_parse(argc, argv);
     if(argc < 2){
         av_log(NULL, AV_LOG_ERROR, "the arguments must be more than 2!\n");
+        av_log(NULL, AV_LOG_ERROR, "usage: %s file [audio|video|ext] [-threads N] [-thread_type auto|frame|slice]\n", argv[0]);
         exit(-1);
     }
 
@@ -507,8 +954,20 @@ int main(int argc, char *argv[])
 
     is->aIdx = -1;
     is->vIdx = -1;
-    SDL_Thread *videoThread = SDL_CreateThread(decode, "videoThread", (void *)is);
-    //pthread_create(&decode_tid, NULL, decode, (void *)is);
+
+    //the clock everything else follows, audio by default
+    is->av_sync_type = AV_SYNC_AUDIO_MASTER;
+    if(argc > 2 && !strcmp(argv[2], "video")){
+        is->av_sync_type = AV_SYNC_VIDEO_MASTER;
+    }else if(argc > 2 && !strcmp(argv[2], "ext")){
+        is->av_sync_type = AV_SYNC_EXTERNAL_CLOCK;
+    }
+    init_clock(&is->audclk);
+    init_clock(&is->vidclk);
+    init_clock(&is->extclk);
+    is->audio_clock = NAN;
+    is->audio_pts_base = NAN;
+    is->frame_last_pts = NAN;
 
     //init SDL
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO)){
@@ -578,8 +1037,8 @@ int main(int argc, char *argv[])
         av_log(vCtx, AV_LOG_ERROR, "Couldn't copy codecpar to codecContext");
         goto end;
     }
-    //bind decoder and decoder context
-    ret = avcodec_open2(vCtx, vDecodec, NULL);
+    //bind decoder and decoder context, threaded as far as the codec allows
+    ret = decoder_open(vCtx, vDecodec, NULL);
     if(ret < 0){
         av_log(NULL, AV_LOG_ERROR, "Couldn't open the codec: %s\n", av_err2str(ret));
         goto end;
@@ -611,14 +1070,25 @@ int main(int argc, char *argv[])
         av_log(aCtx, AV_LOG_ERROR, "Couldn't copy codecpar to codecContext");
         goto end;
     }
-    //bind decoder and decoder context
-    ret = avcodec_open2(aCtx, aDecodec, NULL);
+    //bind decoder and decoder context, threaded as far as the codec allows
+    ret = decoder_open(aCtx, aDecodec, NULL);
     if(ret < 0){
         av_log(NULL, AV_LOG_ERROR, "Couldn't open the codec: %s\n", av_err2str(ret));
         goto end;
     }
     //init
-    packet_queue_init(&is->audioQueue);
+    if(packet_queue_init(&is->audioQueue, aInStream->time_base) < 0){
+        goto end;
+    }
+    if(audio_ring_init(&is->audioRing) < 0){
+        goto end;
+    }
+    if(packet_queue_init(&is->videoQueue, vInStream->time_base) < 0){
+        goto end;
+    }
+    if(frame_queue_init(&is->pictq) < 0){
+        goto end;
+    }
 
     aPkt = av_packet_alloc();
     aFrame = av_frame_alloc();
@@ -629,6 +1099,7 @@ int main(int argc, char *argv[])
     pkt = av_packet_alloc();
 
     //init VideoState
+    is->pkt = pkt;
     is->texture = texture;
     is->aCtx = aCtx;
     is->aPkt = aPkt;
@@ -650,52 +1121,149 @@ int main(int argc, char *argv[])
         av_log(NULL, AV_LOG_ERROR, "Failed to open audio device!\n");
         goto end;
     }
+    is->audio_hw_buf_size = spec.size;
+    is->audio_bytes_per_sec = spec.freq * spec.channels * 2;
+    is->audioThread = SDL_CreateThread(audio_decode_thread, "audioThread", (void *)is);
+    if(!is->audioThread){
+        av_log(NULL, AV_LOG_ERROR, "Failed to create thread!\n");
+        goto end;
+    }
     SDL_PauseAudio(0);
-    //decode video
-    while(av_read_frame(is->fmtCtx, pkt) >= 0){
-        if(pkt->stream_index == is->vIdx ){
-            av_packet_move_ref(is->vPkt, pkt);
-            // decode and render
-            // decode_raw(is);
-            frame_decoded = 1;
-            SDL_LockMutex(videoMutex);
-            SDL_CondSignal(videoCond);
-            SDL_UnlockMutex(videoMutex);
-        }else if(pkt->stream_index == is->aIdx){
-            packet_queue_put(&is->audioQueue, pkt);
+
+    //demux and decode run on their own threads, so a slow stage only stalls the
+    //others once the queue in between is empty or full
+    is->videoThread = SDL_CreateThread(video_decode_thread, "videoThread", (void *)is);
+    is->demuxThread = SDL_CreateThread(demux_thread, "demuxThread", (void *)is);
+    if(!is->videoThread || !is->demuxThread){
+        av_log(NULL, AV_LOG_ERROR, "Failed to create thread!\n");
+        goto end;
+    }
+
+    frame_rate = av_guess_frame_rate(is->fmtCtx, vInStream, NULL);
+    if(frame_rate.num <= 0 || frame_rate.den <= 0){
+        frame_rate = (AVRational){25, 1};
+    }
+    frame_duration = av_q2d(av_inv_q(frame_rate));
+
+    //present the frames on the main thread, SDL wants rendering and events here
+    for(;;){
+        while(SDL_PollEvent(&event)){
+            if(event.type == SDL_QUIT){
+                goto quit;
+            }
+        }
+
+        //wait a little at most, to keep handling events
+        frame = frame_queue_peek(&is->pictq, 10);
+        if(!frame){
+            if(frame_queue_done(&is->pictq)){
+                break;
+            }
+            continue;
+        }
+
+        pts = frame_pts(is, frame);
+        if(isnan(pts)){
+            pts = is->frame_last_pts + frame_duration;
+        }
+        time = av_gettime_relative() / 1000000.0;
+
+        //the first frame is shown at once and starts the external clock
+        if(isnan(is->frame_last_pts)){
+            is->frame_timer = time;
+            if(isnan(get_clock(&is->extclk))){
+                set_clock(&is->extclk, pts);
+            }
         }else{
-            av_packet_unref(pkt);
+            last_duration = pts - is->frame_last_pts;
+            if(isnan(last_duration) || last_duration <= 0 || last_duration > AV_NOSYNC_THRESHOLD){
+                last_duration = frame_duration;
+            }
+            delay = compute_target_delay(is, last_duration);
+
+            if(time < is->frame_timer + delay){
+                av_usleep((unsigned)(FFMIN(is->frame_timer + delay - time, 0.01) * 1000000));
+                continue;
+            }
+            //the previous frame stayed on screen longer, as if it was shown twice
+            if(delay > last_duration){
+                is->frame_dups++;
+            }
+            is->frame_timer += delay;
+            //too far behind to catch up with the schedule, start it again from now
+            if(delay > 0 && time - is->frame_timer > AV_SYNC_THRESHOLD_MAX){
+                is->frame_timer = time;
+            }
+        }
+        set_clock(&is->vidclk, pts);
+        is->frame_last_pts = pts;
+
+        //drop the frame instead of showing it if the next one is already due
+        next = frame_queue_peek_next(&is->pictq);
+        if(next && is->av_sync_type != AV_SYNC_VIDEO_MASTER){
+            duration = frame_pts(is, next) - pts;
+            if(isnan(duration) || duration <= 0 || duration > AV_NOSYNC_THRESHOLD){
+                duration = frame_duration;
+            }
+            if(time > is->frame_timer + duration){
+                is->frame_drops++;
+                frame_queue_next(&is->pictq);
+                continue;
+            }
         }
 
-        //deal with SDL event
-        SDL_PollEvent(&event);
-        switch (event.type)
-        {
-        case SDL_QUIT:
-            goto quit;
-            break;
-        
-        default:
-            break;
+        render(is, frame);
+        frame_queue_next(&is->pictq);
+
+        //how far video is from the master clock, and what it took to keep it there
+        if(time - last_status >= 1.0){
+            av_log(NULL, AV_LOG_INFO, "%7.2f %s:%7.3f drop=%d dup=%d aunder=%u\n",
+                   get_master_clock(is), is->av_sync_type == AV_SYNC_AUDIO_MASTER ? "A-V" : "M-V",
+                   get_clock(&is->vidclk) - get_master_clock(is),
+                   is->frame_drops, is->frame_dups, atomic_load(&is->audioRing.underruns));
+            last_status = time;
         }
-    
     }
-    is->vPkt = NULL;
-    frame_decoded = 1;
-    SDL_LockMutex(videoMutex);
-    SDL_CondSignal(videoCond);
-    SDL_UnlockMutex(videoMutex);
-    //decode(is);
 
-    SDL_WaitThread(videoThread, NULL);
+    //the video may end first, let the audio play out before tearing down
+    while(!audio_ring_done(&is->audioRing)){
+        while(SDL_PollEvent(&event)){
+            if(event.type == SDL_QUIT){
+                goto quit;
+            }
+        }
+        SDL_Delay(10);
+    }
+    //and the last buffer the callback handed to the device
+    SDL_Delay(spec.samples * 1000 / spec.freq);
 
 quit:
     ret = 0;
 end:
-    // pthread_mutex_destroy(&mutex);
-    // pthread_cond_destroy(&cond);
-    SDL_DestroyCond(videoCond);
-    SDL_DestroyMutex(videoMutex);
+    //stop the threads and the audio callback before the queues and decoders go away
+    if(is){
+        packet_queue_abort(&is->audioQueue);
+        audio_ring_abort(&is->audioRing);
+        packet_queue_abort(&is->videoQueue);
+        frame_queue_abort(&is->pictq);
+        if(is->demuxThread){
+            SDL_WaitThread(is->demuxThread, NULL);
+        }
+        if(is->videoThread){
+            SDL_WaitThread(is->videoThread, NULL);
+        }
+        if(is->audioThread){
+            SDL_WaitThread(is->audioThread, NULL);
+        }
+        SDL_CloseAudio();
+        av_log(NULL, AV_LOG_INFO, "audio underruns: %u\n", atomic_load(&is->audioRing.underruns));
+        packet_queue_destroy(&is->audioQueue);
+        audio_ring_destroy(&is->audioRing);
+        swr_free(&is->swr_ctx);
+        av_freep(&is->audio_buf);
+        packet_queue_destroy(&is->videoQueue);
+        frame_queue_destroy(&is->pictq);
+    }
     if(vFrame){
         av_frame_free(&vFrame);
     }
@@ -717,7 +1285,7 @@ end:
     if(vCtx){
         avcodec_free_context(&vCtx);
     }
-    if(is->fmtCtx){
+    if(is && is->fmtCtx){
         avformat_close_input(&is->fmtCtx);
     }
     if(win){
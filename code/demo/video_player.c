@@ -13,8 +13,13 @@
 #include <libavformat/avformat.h>
 #include <libavutil/avutil.h>
 #include <libavcodec/avcodec.h>
+#include <libavutil/time.h>
+#include <math.h>
+#include "decoder_threads.h"
 
 #define ONESECOND 1000
+// the schedule restarts when a frame is this far off, the timestamps are probably broken
+#define AV_NOSYNC_THRESHOLD 10.0
 
 typedef struct VideoState{
     AVCodecContext *avctx;
@@ -23,6 +28,12 @@ typedef struct VideoState{
     AVStream       *stream;
 
     SDL_Texture    *texture;
+
+    // there is no audio, the frames follow the system time since the first one
+    int64_t        start_time;
+    double         first_pts;
+    double         last_pts;
+    int            frame_drops;
 }VideoState;
 
 
@@ -34,6 +45,44 @@ static SDL_Renderer *renderer = NULL;
 
 static void render(VideoState *is)
 {
+    double frame_duration = 1.0 / 30;
+    double pts, diff;
+    int64_t now;
+
+    if(is->stream->r_frame_rate.num > 0 && is->stream->r_frame_rate.den > 0){
+        frame_duration = av_q2d(av_inv_q(is->stream->r_frame_rate));
+    }else{
+        av_log(NULL, AV_LOG_ERROR,  "Failed to get framerate!\n");
+    }
+
+    if(is->frame->best_effort_timestamp != AV_NOPTS_VALUE){
+        pts = is->frame->best_effort_timestamp * av_q2d(is->stream->time_base);
+    }else{
+        pts = is->last_pts + frame_duration;
+    }
+    is->last_pts = pts;
+
+    now = av_gettime_relative();
+    if(!is->start_time){
+        is->start_time = now;
+        is->first_pts = pts;
+    }
+
+    //positive when the frame is early, negative when it is late
+    diff = pts - is->first_pts - (now - is->start_time) / 1000000.0;
+    if(fabs(diff) >= AV_NOSYNC_THRESHOLD){
+        is->start_time = now;
+        is->first_pts = pts;
+        diff = 0;
+    }
+    //decoding has fallen behind by more than a frame, skip showing this one to catch up
+    if(diff < -frame_duration){
+        is->frame_drops++;
+        return;
+    }
+    if(diff > 0){
+        av_usleep((unsigned)(diff * 1000000));
+    }
 
     SDL_UpdateYUVTexture(is->texture, NULL,
                          is->frame->data[0], is->frame->linesize[0] ,
@@ -43,13 +92,6 @@ static void render(VideoState *is)
     SDL_RenderClear(renderer);
     SDL_RenderCopy(renderer, is->texture, NULL, NULL);
     SDL_RenderPresent(renderer);
-    int frameRate = is->stream->r_frame_rate.num/is->stream->r_frame_rate.den;
-    if(frameRate <= 0){
-        av_log(NULL, AV_LOG_ERROR,  "Failed to get framerate!\n");
-        SDL_Delay(33);
-        return;
-    }
-    SDL_Delay((Uint32)(ONESECOND/frameRate));
 }
 
 
@@ -116,6 +158,8 @@ int main(int argc, char *argv[])
 
     av_log_set_level(AV_LOG_DEBUG);
 
+    //-threads N / -thread_type auto|frame|slice for the decoders
+    argc = decoder_threads_parse(argc, argv);
     if(argc < 2){
         av_log(NULL, AV_LOG_ERROR, "the arguments must be more than 2!\n");
         exit(-1);
@@ -178,8 +222,8 @@ int main(int argc, char *argv[])
     //copy parameters 
     avcodec_parameters_to_context(ctx, inStream->codecpar);
 
-    //bind decoder and decoder context
-    ret = avcodec_open2(ctx, decodec, NULL);
+    //bind decoder and decoder context, threaded as far as the codec allows
+    ret = decoder_open(ctx, decodec, NULL);
     if(ret < 0){
         av_log(NULL, AV_LOG_ERROR, "Couldn't open the codec: %s\n", av_err2str(ret));
         goto end;
@@ -222,6 +266,7 @@ int main(int argc, char *argv[])
     }
     is->pkt = NULL;
     decode(is);
+    av_log(NULL, AV_LOG_INFO, "%d late frames dropped\n", is->frame_drops);
 
 quit:
     ret = 0;
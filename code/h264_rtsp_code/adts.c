@@ -0,0 +1,338 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "adts.h"
+
+const int adtsSampleRates[16] = {
+    96000, 88200, 64000, 48000, 44100, 32000, 24000, 22050,
+    16000, 12000, 11025, 8000, 7350, 0, 0, 0};
+
+// 检查 pos 处是不是一个完整的 ADTS 帧头，是则返回帧长，否则返回 0
+static uint32_t adtsCheckHeader(const uint8_t *data, size_t size, size_t pos)
+{
+    const uint8_t *p = data + pos;
+    uint32_t frameLength;
+    int headerSize;
+
+    if (pos + ADTS_HEADER_SIZE > size)
+        return 0;
+
+    // syncword 为 12 个 1，layer 必须为 0，采样率下标 13 ~ 15 保留
+    if (p[0] != 0xFF || (p[1] & 0xF6) != 0xF0 || ((p[2] & 0x3C) >> 2) > 12)
+        return 0;
+
+    headerSize = (p[1] & 0x01) ? ADTS_HEADER_SIZE : ADTS_HEADER_SIZE + 2;
+    frameLength = ((p[3] & 0x03) << 11) | (p[4] << 3) | ((p[5] & 0xE0) >> 5);
+    if (frameLength <= (uint32_t)headerSize || pos + frameLength > size)
+        return 0;
+
+    return frameLength;
+}
+
+// 一个帧头有效，并且后面紧跟下一个同步字(或者文件结束)，才认为找到了帧
+// 单看 12 bit 的同步字，损坏的数据中很容易出现假的帧头
+static uint32_t adtsCheckFrame(const uint8_t *data, size_t size, size_t pos)
+{
+    uint32_t frameLength = adtsCheckHeader(data, size, pos);
+    const uint8_t *next = data + pos + frameLength;
+
+    if (frameLength == 0)
+        return 0;
+    if (pos + frameLength + 2 <= size && (next[0] != 0xFF || (next[1] & 0xF6) != 0xF0))
+        return 0;
+
+    return frameLength;
+}
+
+// CRC-16，多项式 0x8005，初值 0xFFFF，从 start 开始按 bit 计算，超出 size 的部分当作 0
+static uint16_t adtsCrcBits(uint16_t crc, const uint8_t *data, size_t size, size_t start, size_t bits)
+{
+    size_t i;
+
+    for (i = start; i < start + bits; i++)
+    {
+        int bit = (i >> 3) < size ? (data[i >> 3] >> (7 - (i & 7))) & 1 : 0;
+
+        if (((crc >> 15) & 1) ^ bit)
+            crc = (crc << 1) ^ 0x8005;
+        else
+            crc <<= 1;
+    }
+
+    return crc;
+}
+
+// 从 pos 开始按 bit 读 n 位，超出 bits 的部分当作 0
+static uint32_t adtsReadBits(const uint8_t *data, size_t bits, size_t pos, int n)
+{
+    uint32_t value = 0;
+
+    while (n-- > 0)
+    {
+        value <<= 1;
+        if (pos < bits)
+            value |= (data[pos >> 3] >> (7 - (pos & 7))) & 1;
+        pos++;
+    }
+
+    return value;
+}
+
+// 原始数据块从 pos 开始是否只剩下 FIL/DSE 元素和 END，END 之后只有不足一字节的补齐
+// 声道元素比 192 bit 短时，用它确定元素在哪里结束
+static int adtsTailIsEnd(const uint8_t *raw, size_t rawBits, size_t pos)
+{
+    uint32_t id, count;
+
+    while (pos + 3 <= rawBits)
+    {
+        id = adtsReadBits(raw, rawBits, pos, 3);
+        pos += 3;
+
+        if (id == 7) // ID_END
+            return rawBits - pos < 8;
+
+        if (id == 6) // ID_FIL
+        {
+            count = adtsReadBits(raw, rawBits, pos, 4);
+            pos += 4;
+            if (count == 15)
+            {
+                count += adtsReadBits(raw, rawBits, pos, 8) - 1;
+                pos += 8;
+            }
+        }
+        else if (id == 4) // ID_DSE
+        {
+            int align = adtsReadBits(raw, rawBits, pos + 4, 1);
+
+            count = adtsReadBits(raw, rawBits, pos + 5, 8);
+            pos += 4 + 1 + 8;
+            if (count == 255)
+            {
+                count += adtsReadBits(raw, rawBits, pos, 8);
+                pos += 8;
+            }
+            if (align)
+                pos = (pos + 7) & ~(size_t)7;
+        }
+        else
+        {
+            return 0;
+        }
+
+        pos += (size_t)count * 8;
+    }
+
+    return 0;
+}
+
+// 校验带 CRC 的帧，返回 1 表示通过，0 表示无法校验，-1 表示 CRC 错误
+// CRC 覆盖 56 bit 的帧头，以及原始数据块中每个声道元素的前 192 bit(不含 3 bit 的元素类型)，
+// 元素不足 192 bit 时按补 0 计算
+// 只校验单个原始数据块、单个 SCE/CPE 的帧(单声道和立体声)：先按元素至少 192 bit 计算；
+// 不一致时元素可能更短，只在元素之后恰好是 FIL/DSE 和 END 的位置按这个长度再算一次，
+// 不会为了让 CRC 对上去尝试任意的长度
+static int adtsCheckCrc(const uint8_t *frame, uint32_t frameLength, int rawBlocks, int channels)
+{
+    const uint8_t *raw = frame + ADTS_HEADER_SIZE + 2;
+    size_t rawBits = (size_t)(frameLength - ADTS_HEADER_SIZE - 2) * 8;
+    uint16_t expected = (frame[7] << 8) | frame[8];
+    uint16_t crc;
+    size_t bits;
+
+    if (rawBlocks != 1 || (channels != 1 && channels != 2))
+        return 0;
+
+    crc = adtsCrcBits(0xFFFF, frame, ADTS_HEADER_SIZE, 0, 56);
+    if (adtsCrcBits(crc, raw, rawBits / 8, 3, 192) == expected)
+        return 1;
+
+    for (bits = 0; bits < 192 && 3 + bits + 3 <= rawBits; bits++)
+    {
+        if (!adtsTailIsEnd(raw, rawBits, 3 + bits))
+            continue;
+
+        if (adtsCrcBits(adtsCrcBits(crc, raw, rawBits / 8, 3, bits), NULL, 0, 0, 192 - bits) == expected)
+            return 1;
+    }
+
+    return -1;
+}
+
+// 扫描整个文件，记录每个 ADTS 帧的位置和长度
+// 遇到不是帧头的数据就逐字节向后找同步字，CRC 错误的帧长度可信，直接跳过这一帧
+static int adtsBuildIndex(struct AdtsSource *source)
+{
+    const uint8_t *data = source->data;
+    size_t pos = 0;
+    int capacity = 1024;
+
+    source->frameCount = 0;
+    source->frames = (struct AdtsFrameEntry *)malloc(capacity * sizeof(struct AdtsFrameEntry));
+    if (!source->frames)
+        return -1;
+
+    while (pos + ADTS_HEADER_SIZE <= source->size)
+    {
+        const uint8_t *p = data + pos;
+        struct AdtsFrameEntry *entry;
+        uint32_t frameLength;
+        int headerSize, rawBlocks, channels, crc;
+
+        frameLength = adtsCheckFrame(data, source->size, pos);
+        if (frameLength == 0)
+        {
+            source->skippedBytes++;
+            pos++;
+            continue;
+        }
+
+        headerSize = (p[1] & 0x01) ? ADTS_HEADER_SIZE : ADTS_HEADER_SIZE + 2;
+        rawBlocks = (p[6] & 0x03) + 1;
+        channels = ((p[2] & 0x01) << 2) | ((p[3] & 0xC0) >> 6);
+        if (headerSize > ADTS_HEADER_SIZE)
+        {
+            crc = adtsCheckCrc(p, frameLength, rawBlocks, channels);
+            if (crc < 0)
+            {
+                source->crcErrors++;
+                pos += frameLength;
+                continue;
+            }
+            if (crc == 0)
+                source->crcUnverified++;
+        }
+
+        if (source->frameCount == capacity)
+        {
+            struct AdtsFrameEntry *frames;
+
+            capacity *= 2;
+            frames = (struct AdtsFrameEntry *)realloc(source->frames, capacity * sizeof(struct AdtsFrameEntry));
+            if (!frames)
+                return -1;
+            source->frames = frames;
+        }
+
+        entry = &source->frames[source->frameCount++];
+        entry->offset = pos;
+        entry->size = frameLength;
+        entry->headerSize = headerSize;
+        entry->rawBlocks = rawBlocks;
+        entry->samplingFreqIndex = (p[2] & 0x3C) >> 2;
+        entry->channels = channels;
+
+        pos += frameLength;
+    }
+    source->skippedBytes += source->size - pos;
+
+    if (source->skippedBytes > 0 || source->crcErrors > 0 || source->crcUnverified > 0)
+        printf("adts: %d frames, skipped %zu bytes, %d crc errors, %d crc frames not verified\n",
+               source->frameCount, source->skippedBytes, source->crcErrors, source->crcUnverified);
+
+    if (source->frameCount == 0)
+        return -1;
+
+    data += source->frames[0].offset;
+    source->profile = (data[2] & 0xC0) >> 6;
+    source->samplingFreqIndex = source->frames[0].samplingFreqIndex;
+    source->sampleRate = adtsSampleRates[source->samplingFreqIndex];
+    source->channels = source->frames[0].channels;
+
+    return 0;
+}
+
+int adtsOpen(struct AdtsSource *source, const char *fileName)
+{
+    struct stat st;
+    void *data;
+
+    memset(source, 0, sizeof(*source));
+
+    source->fd = open(fileName, O_RDONLY);
+    if (source->fd < 0)
+        return -1;
+
+    if (fstat(source->fd, &st) < 0 || st.st_size == 0)
+    {
+        adtsClose(source);
+        return -1;
+    }
+
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, source->fd, 0);
+    if (data == MAP_FAILED)
+    {
+        adtsClose(source);
+        return -1;
+    }
+    source->data = (const uint8_t *)data;
+    source->size = st.st_size;
+
+    if (adtsBuildIndex(source) < 0)
+    {
+        adtsClose(source);
+        return -1;
+    }
+
+    return 0;
+}
+
+void adtsClose(struct AdtsSource *source)
+{
+    if (source->data)
+        munmap((void *)source->data, source->size);
+    if (source->fd >= 0)
+        close(source->fd);
+    free(source->frames);
+
+    memset(source, 0, sizeof(*source));
+    source->fd = -1;
+}
+
+int adtsNextFrame(struct AdtsSource *source, const uint8_t **frame, uint32_t *size, uint32_t *samples)
+{
+    struct AdtsFrameEntry *entry;
+
+    if (source->cursor >= source->frameCount)
+        return -1;
+
+    entry = &source->frames[source->cursor];
+    *frame = source->data + entry->offset + entry->headerSize;
+    *size = entry->size - entry->headerSize;
+    *samples = entry->rawBlocks * ADTS_SAMPLES_PER_FRAME;
+
+    return source->cursor++;
+}
+
+int adtsSeek(struct AdtsSource *source, int index)
+{
+    if (index < 0 || index > source->frameCount)
+        return -1;
+
+    source->cursor = index;
+
+    return 0;
+}
+
+uint16_t adtsAudioSpecificConfig(const struct AdtsSource *source)
+{
+    return ((source->profile + 1) << 11) | (source->samplingFreqIndex << 7) | (source->channels << 3);
+}
+
+void adtsWriteHeader(uint8_t *buf, int profile, int samplingFreqIndex, int channels, uint32_t frameSize)
+{
+    uint32_t frameLength = frameSize + ADTS_HEADER_SIZE;
+
+    buf[0] = 0xFF;
+    buf[1] = 0xF1; // MPEG-4，没有 CRC
+    buf[2] = (profile << 6) | (samplingFreqIndex << 2) | (channels >> 2);
+    buf[3] = ((channels & 0x03) << 6) | (frameLength >> 11);
+    buf[4] = frameLength >> 3;
+    buf[5] = ((frameLength & 0x07) << 5) | 0x1F; // adts_buffer_fullness 为 0x7FF，码率可变
+    buf[6] = 0xFC;                               // 一个原始数据块
+}
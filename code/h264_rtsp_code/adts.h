@@ -0,0 +1,64 @@
+#ifndef _ADTS_H_
+#define _ADTS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ADTS_HEADER_SIZE 7 // 不带 CRC 的 ADTS 头，带 CRC 时再加 2 字节
+// 一个 AAC 原始帧包含 1024 个采样
+#define ADTS_SAMPLES_PER_FRAME 1024
+
+// 索引中的一个 ADTS 帧
+struct AdtsFrameEntry
+{
+    uint64_t offset;     // ADTS 头在文件中的位置
+    uint32_t size;       // 整个 ADTS 帧的长度，包括头部
+    uint8_t headerSize;  // 7 或 9
+    uint8_t rawBlocks;   // number_of_raw_data_blocks_in_frame + 1
+    uint8_t samplingFreqIndex;
+    uint8_t channels;
+};
+
+// 基于 mmap 的 ADTS 音频源(.aac)，和 AnnexbSource 一样打开时建立帧索引
+// 建索引时检查帧头和 CRC，损坏的数据会被跳过，从下一个同步字重新开始
+// 之后取帧只是查索引，返回的指针直接指向文件映射，不复制
+struct AdtsSource
+{
+    int fd;
+    const uint8_t *data;
+    size_t size;
+
+    struct AdtsFrameEntry *frames;
+    int frameCount;
+    int cursor; // 下一个要读取的帧
+
+    size_t skippedBytes; // 重新同步时跳过的字节
+    int crcErrors;       // CRC 校验失败而丢弃的帧
+    int crcUnverified;   // 带 CRC 但无法校验的帧(多个原始数据块或多于两个声道)，照常保留
+
+    // 取自第一个帧头，整个文件的参数应该一致
+    int profile;           // ADTS 中的 profile，audioObjectType - 1
+    int samplingFreqIndex;
+    int sampleRate;
+    int channels;
+};
+
+// samplingFreqIndex 对应的采样率，13 ~ 15 保留
+extern const int adtsSampleRates[16];
+
+int adtsOpen(struct AdtsSource *source, const char *fileName);
+void adtsClose(struct AdtsSource *source);
+
+// 取下一帧的 AAC 原始数据(不含 ADTS 头和 CRC)，samples 为这一帧的采样数
+// 返回帧的下标，可以用它从 frames 中查到这一帧的采样率和声道数，读完返回 -1
+int adtsNextFrame(struct AdtsSource *source, const uint8_t **frame, uint32_t *size, uint32_t *samples);
+// 跳到第 index 帧，返回 0，越界返回 -1
+int adtsSeek(struct AdtsSource *source, int index);
+
+// SDP 中 config 参数使用的 AudioSpecificConfig：
+// audioObjectType(5 bit) samplingFrequencyIndex(4 bit) channelConfiguration(4 bit)
+uint16_t adtsAudioSpecificConfig(const struct AdtsSource *source);
+// 写一个不带 CRC 的 ADTS 头，frameSize 为原始数据的长度
+void adtsWriteHeader(uint8_t *buf, int profile, int samplingFreqIndex, int channels, uint32_t frameSize);
+
+#endif
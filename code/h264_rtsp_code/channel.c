@@ -0,0 +1,1447 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <time.h>
+#include <sys/socket.h>
+#include "channel.h"
+#include "mp4src.h"
+
+// 补发结束的订阅者从当前帧的下一个报文开始接收广播，
+// 当前帧已经广播的报文由调用者补发，之后的序列号和发送历史一一对应
+static void channelJoinLive(struct ChannelTrack *track, struct ChannelSubscriber *subscriber)
+{
+    subscriber->bursting = 0;
+    subscriber->firstPacket = track->sentPackets - track->nextPacket;
+    subscriber->skipAu = 0;
+    subscriber->dropUntilIdr = 0;
+}
+
+// 把刚读取的视频帧加入 GOP 缓存，遇到 IDR 帧时从它重新开始
+static void channelUpdateGop(struct LiveChannel *channel, struct ChannelTrack *track,
+                             int first, int count, int hasParamSets)
+{
+    struct ChannelSubscriber *subscriber;
+    struct ChannelGopFrame *frame;
+
+    if (track->auIsIdr)
+    {
+        channel->gopCount = 0;
+        channel->gopValid = 1;
+    }
+    else if (channel->gopValid && channel->gopCount == CHANNEL_GOP_MAX_FRAMES)
+    {
+        printf("gop longer than %d frames, not cached\n", CHANNEL_GOP_MAX_FRAMES);
+        channel->gopCount = 0;
+        channel->gopValid = 0;
+    }
+
+    if (channel->gopValid)
+    {
+        frame = &channel->gop[channel->gopCount++];
+        frame->firstNalu = first;
+        frame->naluCount = count;
+        frame->pts = track->pts;
+        frame->hasParamSets = hasParamSets;
+    }
+
+    // 正在补发的订阅者不需要再补完旧的 GOP，从新的 IDR 帧接着发；缓存失效时直接接收广播
+    for (subscriber = track->subscribers.next; subscriber != &track->subscribers;
+         subscriber = subscriber->next)
+    {
+        if (!subscriber->bursting)
+            continue;
+
+        if (!channel->gopValid)
+            channelJoinLive(track, subscriber);
+        else if (track->auIsIdr)
+            subscriber->gopCursor = 0;
+    }
+}
+
+// 按编码格式解析 NALU 头，是参数集时返回 CHANNEL_PARAM_*，否则返回 -1
+// VCL NALU 的 *reference 表示后面的帧是否依赖它，*idr 表示是否随机访问点
+static int channelParseNaluHeader(int codec, uint8_t header, int *vcl, int *reference, int *idr)
+{
+    int type;
+
+    if (codec == NALU_CODEC_H265)
+    {
+        type = h265NaluType(header);
+        *vcl = type < 32;
+        // 类型为偶数的 TRAIL_N、TSA_N、RASL_N 等是子层非参考帧，IRAP 都是参考帧
+        *reference = *vcl && (type >= H265_NAL_IRAP_MIN || (type & 1));
+        *idr = type >= H265_NAL_IRAP_MIN && type <= H265_NAL_IRAP_MAX;
+
+        if (type == H265_NAL_VPS)
+            return CHANNEL_PARAM_VPS;
+        if (type == H265_NAL_SPS)
+            return CHANNEL_PARAM_SPS;
+        if (type == H265_NAL_PPS)
+            return CHANNEL_PARAM_PPS;
+        return -1;
+    }
+
+    // SPS/PPS 的 nal_ref_idc 总是不为 0，只看 VCL NALU
+    type = header & 0x1F;
+    *vcl = type >= 1 && type <= 5;
+    *reference = *vcl && (header & 0x60);
+    *idr = type == 5;
+
+    if (type == 7)
+        return CHANNEL_PARAM_SPS;
+    if (type == 8)
+        return CHANNEL_PARAM_PPS;
+    return -1;
+}
+
+// 按视频的编码格式打包源文件中的第 index 个 NALU
+static int channelPacketizeNalu(struct LiveChannel *channel, struct RtpHeader *rtpHeader, int index,
+                                struct RtpPacketView *views, int maxViews)
+{
+    struct AnnexbSource *source = &channel->source;
+    const uint8_t *nalu = source->data + source->nalus[index].offset;
+
+    if (source->codec == NALU_CODEC_H265)
+        return rtpPacketizeH265(rtpHeader, nalu, source->nalus[index].size, views, maxViews);
+
+    return rtpPacketizeH264(rtpHeader, nalu, source->nalus[index].size, views, maxViews);
+}
+
+// H.265 帧开头的 VPS/SPS/PPS/SEI 都很小，放得进一个报文的连续几个聚合成一个 AP，
+// 数据复制到缓冲池中，所有订阅者共用一份；返回聚合了几个 NALU，缓冲池用完时不聚合
+static int channelAggregateH265(struct LiveChannel *channel, struct ChannelTrack *track, int first, int count)
+{
+    struct AnnexbSource *source = &channel->source;
+    const uint8_t *nalus[RTP_H265_MAX_AP_NALUS];
+    uint32_t sizes[RTP_H265_MAX_AP_NALUS];
+    uint32_t bytes = 0;
+    int n = 0;
+
+    while (n < count && n < RTP_H265_MAX_AP_NALUS)
+    {
+        struct NaluIndexEntry *entry = &source->nalus[first + n];
+
+        if (h265NaluType(entry->header) < 32 || rtpH265ApSize(n + 1, bytes + entry->size) > RTP_MAX_PKT_SIZE)
+            break;
+
+        nalus[n] = source->data + entry->offset;
+        sizes[n] = entry->size;
+        bytes += entry->size;
+        n++;
+    }
+
+    if (n < 2 || track->packetCount >= track->maxPackets ||
+        (track->auBuffer = packetBufferAlloc(channel->pool)) == NULL)
+        return 0;
+
+    rtpPacketizeH265Ap(&track->rtpHeader, nalus, sizes, n, track->auBuffer->data,
+                       &track->packets[track->packetCount]);
+    track->auBuffer->size = track->packets[track->packetCount].payloadSize;
+    track->packetCount++;
+
+    return n;
+}
+
+// 读取下一个视频访问单元，把其中所有 NALU 打包到 track->packets
+// 报文只保存头部，负载指向映射的文件内容，H.265 聚合的参数集除外
+static int channelLoadVideo(struct LiveChannel *channel, struct ChannelTrack *track)
+{
+    struct AnnexbSource *source = &channel->source;
+    int first, count, kind, vcl, reference, idr, i, ret;
+    int paramSets = 0, allParamSets;
+
+    count = annexbNextAccessUnit(source, &first);
+    if (count < 0)
+    {
+        // 读到文件末尾后从第一个关键帧循环播放，有索引所以不需要重新解析，时间戳继续递增
+        printf("读取%s结束,从头开始\n", channel->fileName);
+        annexbSeek(source, channel->loopNalu);
+        count = annexbNextAccessUnit(source, &first);
+        if (count < 0)
+            return -1;
+    }
+
+    track->auIsReference = 0;
+    track->auIsIdr = 0;
+    // 同一帧的所有 NALU 使用相同的时间戳
+    track->pts = channel->frameCount * 90000 * channel->frameRateDen / channel->frameRateNum;
+    track->auIntervalUs = (uint64_t)channel->frameRateDen * 1000000 / channel->frameRateNum;
+    track->auTimestamp = (uint32_t)track->pts;
+    track->rtpHeader.timestamp = track->auTimestamp;
+    channel->frameCount++;
+
+    for (i = first; i < first + count; i++)
+    {
+        kind = channelParseNaluHeader(source->codec, source->nalus[i].header, &vcl, &reference, &idr);
+        if (vcl)
+        {
+            track->auIsReference |= reference;
+            track->auIsIdr |= idr;
+        }
+        else if (kind >= 0)
+        {
+            channel->paramSetNalus[kind] = i;
+            paramSets |= 1 << kind;
+        }
+    }
+
+    i = first;
+    if (source->codec == NALU_CODEC_H265)
+        i += channelAggregateH265(channel, track, first, count);
+
+    for (; i < first + count; i++)
+    {
+        ret = channelPacketizeNalu(channel, &track->rtpHeader, i, track->packets + track->packetCount,
+                                   track->maxPackets - track->packetCount);
+        if (ret < 0)
+            break;
+
+        track->packetCount += ret;
+    }
+
+    allParamSets = source->codec == NALU_CODEC_H265 ? 0x7 : 0x6;
+    channelUpdateGop(channel, track, first, count, (paramSets & allParamSets) == allParamSets);
+
+    return 0;
+}
+
+// 读取下一个 AAC 帧并打包，时延上限内的后续帧放得进同一个报文时一起聚合，
+// 聚合的负载复制到缓冲池中，所有订阅者共用一份；单独的帧不复制，超过 MTU 时分片
+// 频道按第一帧的时刻发送，聚合只是让音频提前发出，不增加时延
+// 音频帧之间没有依赖，都当作参考帧和 IDR 帧
+static int channelLoadAudio(struct LiveChannel *channel, struct ChannelTrack *track)
+{
+    struct AdtsSource *source = &channel->audioSource;
+    const uint8_t *frames[RTP_AAC_MAX_AUS];
+    uint32_t sizes[RTP_AAC_MAX_AUS];
+    uint32_t samples, totalSamples, bytes;
+    int first, index, count = 1, maxCount, ret;
+
+    first = adtsNextFrame(source, &frames[0], &sizes[0], &samples);
+    if (first < 0)
+    {
+        printf("读取音频结束,从头开始\n");
+        adtsSeek(source, 0);
+        first = adtsNextFrame(source, &frames[0], &sizes[0], &samples);
+        if (first < 0)
+            return -1;
+    }
+    totalSamples = samples;
+    bytes = sizes[0];
+
+    maxCount = (uint64_t)channel->audioMaxLatencyMs * track->clockRate / (1000 * ADTS_SAMPLES_PER_FRAME) + 1;
+    if (maxCount > RTP_AAC_MAX_AUS)
+        maxCount = RTP_AAC_MAX_AUS;
+
+    // 放不下的帧退回去留给下一个报文，读到文件末尾也停下，不跨过循环点聚合
+    while (count < maxCount && rtpAACAggregateSize(count, bytes) <= RTP_MAX_PKT_SIZE)
+    {
+        index = adtsNextFrame(source, &frames[count], &sizes[count], &samples);
+        if (index < 0)
+            break;
+        if (rtpAACAggregateSize(count + 1, bytes + sizes[count]) > RTP_MAX_PKT_SIZE)
+        {
+            adtsSeek(source, index);
+            break;
+        }
+
+        bytes += sizes[count];
+        totalSamples += samples;
+        count++;
+    }
+
+    // 缓冲池用完时退回到每帧一个报文
+    if (count > 1 && (track->auBuffer = packetBufferAlloc(channel->pool)) == NULL)
+    {
+        adtsSeek(source, first + 1);
+        count = 1;
+        totalSamples = source->frames[first].rawBlocks * ADTS_SAMPLES_PER_FRAME;
+    }
+
+    track->auIsReference = 1;
+    track->auIsIdr = 1;
+    // 音频的时间戳就是采样数
+    track->pts = channel->sampleCount;
+    track->auIntervalUs = (uint64_t)totalSamples * 1000000 / track->clockRate;
+    track->auTimestamp = (uint32_t)track->pts;
+    track->rtpHeader.timestamp = track->auTimestamp;
+    channel->sampleCount += totalSamples;
+
+    if (count > 1)
+    {
+        ret = rtpPacketizeAACFrames(&track->rtpHeader, frames, sizes, count,
+                                    track->auBuffer->data, track->packets);
+        track->auBuffer->size = track->packets[0].payloadSize;
+    }
+    else
+    {
+        ret = rtpPacketizeAAC(&track->rtpHeader, frames[0], sizes[0], track->packets, track->maxPackets);
+    }
+    if (ret > 0)
+        track->packetCount = ret;
+
+    return 0;
+}
+
+// 落后计划太多(例如进程被挂起)时，所有轨道的起点一起后移，音视频仍然对齐，
+// 已经算好发送时刻、还没开始发送的访问单元也一起后移
+static void channelResync(struct LiveChannel *channel, uint64_t lateUs)
+{
+    struct ChannelTrack *track;
+    int i;
+
+    printf("channel: %llu us behind schedule, resync all tracks\n", (unsigned long long)lateUs);
+
+    for (i = 0; i < CHANNEL_MAX_TRACKS; i++)
+    {
+        track = &channel->tracks[i];
+        if (!track->present)
+            continue;
+
+        pacerShift(&track->pacer, lateUs);
+        if (track->nextPacket < track->packetCount && !track->auStarted)
+            track->auScheduledUs += lateUs;
+    }
+}
+
+// 读取轨道的下一个访问单元并计算它的发送时刻
+static int channelLoadAccessUnit(struct LiveChannel *channel, struct ChannelTrack *track)
+{
+    uint64_t lateUs;
+    int i, ret;
+
+    track->packetCount = 0;
+    track->nextPacket = 0;
+    track->auBytes = 0;
+    // 上一个访问单元的缓冲区，还在 TCP 发送队列中的由队列的引用保持
+    packetBufferUnref(track->auBuffer);
+    track->auBuffer = NULL;
+
+    if (track == &channel->tracks[CHANNEL_TRACK_VIDEO])
+        ret = channelLoadVideo(channel, track);
+    else
+        ret = channelLoadAudio(channel, track);
+    if (ret < 0)
+        return -1;
+
+    for (i = 0; i < track->packetCount; i++)
+        track->auBytes += track->packets[i].headerSize + track->packets[i].payloadSize;
+
+    // 一个访问单元的最后一个报文设置 marker
+    if (track->packetCount > 0)
+        rtpHeaderSetMarker(track->packets[track->packetCount - 1].header, 1);
+
+    track->auScheduledUs = pacerSchedule(&track->pacer, track->auTimestamp);
+    track->auStarted = 0;
+
+    lateUs = pacerLateUs(track->auScheduledUs, getMonotonicUs());
+    if (lateUs > 0)
+        channelResync(channel, lateUs);
+
+    return 0;
+}
+
+// 在访问单元的第一个报文发送前，决定 TCP 订阅者是否跳过这一帧
+// 发送队列积压时先丢非参考帧；丢了参考帧之后的帧都没法解码，只能等下一个 IDR 帧
+static void channelCheckBackpressure(struct ChannelTrack *track, struct ChannelSubscriber *subscriber)
+{
+    struct OutBuffer *out = subscriber->out;
+
+    if (subscriber->dropUntilIdr && track->auIsIdr)
+        subscriber->dropUntilIdr = 0;
+
+    if (!subscriber->dropUntilIdr && track->auIsReference &&
+        (out->bytes > CHANNEL_TCP_MAX_BYTES || outBufferRoom(out) < track->packetCount))
+        subscriber->dropUntilIdr = 1;
+
+    subscriber->skipAu = subscriber->dropUntilIdr ||
+                         (!track->auIsReference && out->bytes > CHANNEL_TCP_HIGH_WATER);
+
+    if (subscriber->skipAu && ++subscriber->droppedAus % 100 == 1)
+        printf("tcp subscriber backlog %zu bytes, dropped %u frames\n", out->bytes, subscriber->droppedAus);
+}
+
+// 记录订阅者收到第一个可以解码的帧，也就是从加入到出画面的时间
+static void channelOnFirstFrame(struct ChannelSubscriber *subscriber)
+{
+    subscriber->firstFrameUs = getMonotonicUs();
+    printf("subscriber %08x track%d first frame after %.1fms%s\n", subscriber->ssrc, subscriber->track,
+           (subscriber->firstFrameUs - subscriber->joinUs) / 1000.0,
+           subscriber->bursting ? " from gop cache" : "");
+}
+
+// 把报文加上 '$' 帧头放进订阅者的发送队列，头部复制，负载仍然指向映射的文件或者缓冲池
+static void channelAppendTcp(struct ChannelSubscriber *subscriber, struct RtpPacketView *packets,
+                             int count, struct PacketBuffer *buffer)
+{
+    uint8_t head[OUTBUF_INLINE_SIZE];
+    int i;
+
+    for (i = 0; i < count; i++)
+    {
+        struct RtpPacketView *packet = &packets[i];
+        uint8_t *rtpHeader = head + RTP_INTERLEAVED_HEADER_SIZE;
+
+        rtpWriteInterleavedHeader(head, subscriber->rtpChannel, packet->headerSize + packet->payloadSize);
+        memcpy(rtpHeader, packet->header, packet->headerSize);
+        rtpHeaderSetSeq(rtpHeader, subscriber->seq++);
+        rtpHeaderSetSsrc(rtpHeader, subscriber->ssrc);
+        rtcpStatsOnSend(&subscriber->rtcp, packet->headerSize - packet->rtpHeaderSize + packet->payloadSize);
+
+        outBufferAppendRef(subscriber->out, head, RTP_INTERLEAVED_HEADER_SIZE + packet->headerSize,
+                           buffer, packet->payload, packet->payloadSize);
+    }
+
+    // 这一批报文合并成一次 writev()，发不完的等 EPOLLOUT
+    outBufferFlush(subscriber->out);
+}
+
+// 把报文用一次批量发送发给 UDP 订阅者，只改写序列号和 SSRC，返回发送的字节数
+static uint32_t channelSendUdp(struct ChannelSubscriber *subscriber, struct RtpPacketView *packets, int count)
+{
+    struct RtpBatch batch;
+    uint32_t bytes = 0;
+    int i;
+
+    rtpBatchInit(&batch, subscriber->rtpSockfd, &subscriber->addr);
+
+    for (i = 0; i < count; i++)
+    {
+        struct RtpPacketView *packet = &packets[i];
+
+        rtpHeaderSetSeq(packet->header, subscriber->seq++);
+        rtpHeaderSetSsrc(packet->header, subscriber->ssrc);
+        rtcpStatsOnSend(&subscriber->rtcp, packet->headerSize - packet->rtpHeaderSize + packet->payloadSize);
+        bytes += packet->headerSize + packet->payloadSize;
+
+        rtpBatchAddIov(&batch, packet->header, packet->headerSize,
+                       packet->payload, packet->payloadSize);
+    }
+
+    // 报文可能是所有订阅者共用的，下一个订阅者改写之前必须发送出去
+    rtpBatchFlush(&batch);
+
+    return bytes;
+}
+
+// 在访问单元的第一个报文发送前检查积压，把 [first, last) 之间的报文放进 TCP 订阅者的发送队列
+static void channelQueueTcp(struct ChannelTrack *track, struct ChannelSubscriber *subscriber,
+                            int first, int last)
+{
+    // 连接已经出错，等会话关闭时退订
+    if (subscriber->out->error)
+        return;
+
+    if (first == 0)
+        channelCheckBackpressure(track, subscriber);
+
+    // 帧的中途队列满了，这一帧已经不完整
+    if (!subscriber->skipAu && outBufferRoom(subscriber->out) < last - first)
+    {
+        subscriber->skipAu = 1;
+        subscriber->dropUntilIdr = 1;
+    }
+
+    if (subscriber->skipAu)
+        return;
+
+    channelAppendTcp(subscriber, track->packets + first, last - first, track->auBuffer);
+}
+
+// 把 [first, last) 之间的报文发送给轨道的每一个订阅者，只改写序列号和 SSRC
+// 每个订阅者的这批报文用一次批量发送完成，正在补发 GOP 缓存的订阅者不参与广播
+static void channelBroadcast(struct ChannelTrack *track, int first, int last)
+{
+    struct ChannelSubscriber *subscriber;
+    uint32_t bytes;
+
+    for (subscriber = track->subscribers.next; subscriber != &track->subscribers;
+         subscriber = subscriber->next)
+    {
+        if (subscriber->bursting)
+            continue;
+
+        if (subscriber->out)
+        {
+            channelQueueTcp(track, subscriber, first, last);
+        }
+        else
+        {
+            bytes = channelSendUdp(subscriber, track->packets + first, last - first);
+
+            // 重传额度随新数据按比例增加
+            subscriber->rtxCredit += bytes * CHANNEL_RTX_PERCENT / 100;
+            if (subscriber->rtxCredit > CHANNEL_RTX_BURST_BYTES)
+                subscriber->rtxCredit = CHANNEL_RTX_BURST_BYTES;
+        }
+
+        // 一帧发完时，从这一帧的第一个报文开始接收的订阅者就有了一个完整的帧
+        if (last == track->packetCount && track->auIsIdr && !subscriber->firstFrameUs &&
+            subscriber->firstPacket <= track->sentPackets - first && !(subscriber->out && (subscriber->skipAu || subscriber->out->error)))
+            channelOnFirstFrame(subscriber);
+    }
+}
+
+// 把刚发送的 [first, last) 之间的报文记入发送历史，覆盖最旧的报文
+// 负载指向映射的文件内容，不会失效；在缓冲池中的负载要增加引用
+static void channelRecordHistory(struct ChannelTrack *track, int first, int last)
+{
+    struct ChannelHistoryEntry *entry;
+    int i;
+
+    for (i = first; i < last; i++)
+    {
+        entry = &track->history[track->sentPackets++ & (CHANNEL_RTX_HISTORY - 1)];
+        packetBufferUnref(entry->buffer);
+        entry->packet = track->packets[i];
+        entry->buffer = track->auBuffer ? packetBufferRef(track->auBuffer) : NULL;
+    }
+}
+
+// 发送一个轨道中已经到时间的报文，返回距离下次需要处理还有多少微秒，出错返回 UINT64_MAX
+static uint64_t channelServiceTrack(struct LiveChannel *channel, struct ChannelTrack *track)
+{
+    uint64_t now, waitUs;
+    int first;
+
+    while (1)
+    {
+        now = getMonotonicUs();
+
+        if (track->nextPacket >= track->packetCount)
+        {
+            if (channelLoadAccessUnit(channel, track) < 0)
+                return UINT64_MAX;
+        }
+
+        // 还没到这一帧的发送时刻
+        if (!track->auStarted)
+        {
+            if (track->auScheduledUs > now)
+                return track->auScheduledUs - now;
+
+            track->auStarted = 1;
+            pacerRecordSend(&track->pacer, track->auScheduledUs, now);
+            pacerStartBurst(&track->pacer, track->auBytes, track->auIntervalUs, now);
+        }
+
+        // 令牌允许多少就发多少
+        first = track->nextPacket;
+        while (track->nextPacket < track->packetCount &&
+               pacerConsume(&track->pacer, track->packets[track->nextPacket].headerSize +
+                                               track->packets[track->nextPacket].payloadSize,
+                            now))
+            track->nextPacket++;
+
+        channelBroadcast(track, first, track->nextPacket);
+        channelRecordHistory(track, first, track->nextPacket);
+
+        if (track->nextPacket < track->packetCount)
+        {
+            waitUs = pacerWaitUs(&track->pacer);
+            return waitUs > 0 ? waitUs : 1;
+        }
+    }
+}
+
+// 音视频两个轨道由同一个定时器驱动，定时器按最早需要处理的轨道设置
+static void onChannelTimer(void *arg)
+{
+    struct LiveChannel *channel = (struct LiveChannel *)arg;
+    uint64_t delayUs = UINT64_MAX, waitUs;
+    int i;
+
+    channel->timer = NULL;
+
+    for (i = 0; i < CHANNEL_MAX_TRACKS; i++)
+    {
+        if (!channel->tracks[i].present)
+            continue;
+
+        waitUs = channelServiceTrack(channel, &channel->tracks[i]);
+        if (waitUs < delayUs)
+            delayUs = waitUs;
+    }
+
+    if (delayUs == UINT64_MAX)
+        return;
+
+    channel->timer = eventLoopAddTimer(channel->loop, (delayUs + 999) / 1000, onChannelTimer, channel);
+}
+
+// 把最近的参数集打包到 channel->gopPackets 的开头，时间戳和它们后面的帧相同，返回报文个数
+static int channelPacketizeParamSets(struct LiveChannel *channel, struct RtpHeader *rtpHeader, int maxPackets)
+{
+    int count = 0, i, ret;
+
+    for (i = 0; i < CHANNEL_MAX_PARAM_SETS; i++)
+    {
+        if (channel->paramSetNalus[i] < 0)
+            continue;
+
+        ret = channelPacketizeNalu(channel, rtpHeader, channel->paramSetNalus[i],
+                                   channel->gopPackets + count, maxPackets - count);
+        if (ret > 0)
+            count += ret;
+    }
+
+    return count;
+}
+
+// 把 GOP 缓存中的一帧打包到 channel->gopPackets，使用帧原来的时间戳，返回报文个数
+// GOP 的第一帧中没有参数集时，先发送最近的参数集；补发不聚合，负载都指向映射的文件
+static int channelPacketizeGopFrame(struct LiveChannel *channel, struct ChannelTrack *track,
+                                    const struct ChannelGopFrame *frame, int withParamSets)
+{
+    struct RtpHeader rtpHeader = track->rtpHeader;
+    int maxPackets = track->maxPackets + CHANNEL_MAX_PARAM_SETS;
+    int count = 0, i, ret;
+
+    rtpHeader.timestamp = (uint32_t)frame->pts;
+
+    if (withParamSets && !frame->hasParamSets)
+        count = channelPacketizeParamSets(channel, &rtpHeader, maxPackets);
+
+    for (i = frame->firstNalu; i < frame->firstNalu + frame->naluCount; i++)
+    {
+        ret = channelPacketizeNalu(channel, &rtpHeader, i, channel->gopPackets + count, maxPackets - count);
+        if (ret < 0)
+            break;
+
+        count += ret;
+    }
+
+    if (count > 0)
+        rtpHeaderSetMarker(channel->gopPackets[count - 1].header, 1);
+
+    return count;
+}
+
+// 按补发额度给订阅者补发 GOP 缓存中当前帧之前的帧，
+// 追上之后补发当前帧已经广播的报文，转为接收广播，返回 1；还没有追上返回 0
+// TCP 订阅者的发送队列积压时等下一轮
+static int channelServiceBurst(struct LiveChannel *channel, struct ChannelTrack *track,
+                               struct ChannelSubscriber *subscriber)
+{
+    struct OutBuffer *out = subscriber->out;
+    int32_t quantum = (uint64_t)channel->gopBurstRate * CHANNEL_GOP_BURST_INTERVAL_MS / 1000;
+    int count, i;
+
+    subscriber->burstCredit += quantum;
+    if (subscriber->burstCredit > quantum)
+        subscriber->burstCredit = quantum;
+
+    while (subscriber->gopCursor < channel->gopCount - 1 && subscriber->burstCredit > 0)
+    {
+        if (out && (out->error || out->bytes > CHANNEL_TCP_HIGH_WATER))
+            return 0;
+
+        count = channelPacketizeGopFrame(channel, track, &channel->gop[subscriber->gopCursor],
+                                         subscriber->gopCursor == 0);
+        if (out && outBufferRoom(out) < count)
+            return 0;
+
+        for (i = 0; i < count; i++)
+            subscriber->burstCredit -= channel->gopPackets[i].headerSize + channel->gopPackets[i].payloadSize;
+
+        if (out)
+            channelAppendTcp(subscriber, channel->gopPackets, count, NULL);
+        else
+            channelSendUdp(subscriber, channel->gopPackets, count);
+
+        // GOP 的第一帧就是 IDR 帧
+        subscriber->burstFrames++;
+        if (subscriber->gopCursor++ == 0 && !subscriber->firstFrameUs)
+            channelOnFirstFrame(subscriber);
+    }
+
+    if (subscriber->gopCursor < channel->gopCount - 1)
+        return 0;
+
+    // 当前帧就是 GOP 的第一帧(加入时正好是 IDR 帧，或者补发中途来了新的 IDR 帧)，
+    // 上面没有补发过它，帧中没有参数集时要先发送，SDP 之外客户端没有别的地方能拿到它们
+    count = 0;
+    if (subscriber->gopCursor == 0 && !channel->gop[0].hasParamSets)
+    {
+        struct RtpHeader rtpHeader = track->rtpHeader;
+
+        rtpHeader.timestamp = (uint32_t)channel->gop[0].pts;
+        count = channelPacketizeParamSets(channel, &rtpHeader, CHANNEL_MAX_PARAM_SETS);
+    }
+
+    if (count + track->nextPacket > 0)
+    {
+        if (out && (out->error || outBufferRoom(out) < count + track->nextPacket))
+            return 0;
+
+        if (out)
+        {
+            if (count > 0)
+                channelAppendTcp(subscriber, channel->gopPackets, count, NULL);
+            if (track->nextPacket > 0)
+                channelAppendTcp(subscriber, track->packets, track->nextPacket, track->auBuffer);
+        }
+        else
+        {
+            if (count > 0)
+                channelSendUdp(subscriber, channel->gopPackets, count);
+            if (track->nextPacket > 0)
+                channelSendUdp(subscriber, track->packets, track->nextPacket);
+        }
+    }
+
+    channelJoinLive(track, subscriber);
+
+    return 1;
+}
+
+static void onChannelGopTimer(void *arg)
+{
+    struct LiveChannel *channel = (struct LiveChannel *)arg;
+    struct ChannelTrack *track = &channel->tracks[CHANNEL_TRACK_VIDEO];
+    struct ChannelSubscriber *subscriber;
+    int bursting = 0;
+
+    channel->gopTimer = NULL;
+
+    for (subscriber = track->subscribers.next; subscriber != &track->subscribers;
+         subscriber = subscriber->next)
+    {
+        if (subscriber->bursting && !channelServiceBurst(channel, track, subscriber))
+            bursting = 1;
+    }
+
+    if (bursting)
+        channel->gopTimer = eventLoopAddTimer(channel->loop, CHANNEL_GOP_BURST_INTERVAL_MS,
+                                              onChannelGopTimer, channel);
+}
+
+// 开始或暂停后继续发送：所有轨道以当前时刻为共同的起点，
+// 起点对应各轨道待发送时间戳中最早的那个媒体时刻，同一时刻采样的音视频在同一时刻发出
+static void channelStart(struct LiveChannel *channel)
+{
+    uint64_t startMediaUs = UINT64_MAX, mediaUs, now;
+    struct ChannelTrack *track;
+    int i;
+
+    for (i = 0; i < CHANNEL_MAX_TRACKS; i++)
+    {
+        track = &channel->tracks[i];
+        if (!track->present)
+            continue;
+
+        pacerReset(&track->pacer);
+        if (track->nextPacket >= track->packetCount && channelLoadAccessUnit(channel, track) < 0)
+            continue;
+
+        mediaUs = track->pts * 1000000 / track->clockRate;
+        if (mediaUs < startMediaUs)
+            startMediaUs = mediaUs;
+    }
+
+    if (startMediaUs == UINT64_MAX)
+        return;
+
+    now = getMonotonicUs();
+    for (i = 0; i < CHANNEL_MAX_TRACKS; i++)
+    {
+        track = &channel->tracks[i];
+        if (!track->present)
+            continue;
+
+        pacerStart(&track->pacer, now, (uint32_t)(startMediaUs * track->clockRate / 1000000));
+        if (track->nextPacket < track->packetCount && !track->auStarted)
+            track->auScheduledUs = pacerSchedule(&track->pacer, track->auTimestamp);
+    }
+}
+
+// 给一个订阅者发送 SR，interleaved 的订阅者在 RTSP 连接上使用 RTP 通道号 + 1
+// 紧挨着 SR 中的 NTP 时间推算 RTP 时间戳，两个轨道的映射都基于同一个时钟
+static void channelSendSenderReport(struct LiveChannel *channel, struct ChannelTrack *track,
+                                    struct ChannelSubscriber *subscriber)
+{
+    uint8_t buf[RTP_INTERLEAVED_HEADER_SIZE + RTCP_MAX_PACKET_SIZE];
+    uint32_t rtpTimestamp = pacerTimestampAt(&track->pacer, getMonotonicUs());
+    int len;
+
+    len = rtcpBuildSenderReport(buf + RTP_INTERLEAVED_HEADER_SIZE, RTCP_MAX_PACKET_SIZE,
+                                subscriber->ssrc, rtpTimestamp, &subscriber->rtcp, channel->cname);
+    if (len < 0)
+        return;
+
+    if (subscriber->out)
+    {
+        if (subscriber->out->error)
+            return;
+
+        rtpWriteInterleavedHeader(buf, subscriber->rtpChannel + 1, len);
+        outBufferAppendCopy(subscriber->out, buf, RTP_INTERLEAVED_HEADER_SIZE + len);
+        outBufferFlush(subscriber->out);
+    }
+    else
+    {
+        sendto(subscriber->rtcpSockfd, buf + RTP_INTERLEAVED_HEADER_SIZE, len, 0,
+               (struct sockaddr *)&subscriber->rtcpAddr, sizeof(subscriber->rtcpAddr));
+    }
+}
+
+// RFC 3550 要求把间隔随机化到 0.5 ~ 1.5 倍，避免大量会话同时发送
+static uint32_t channelRtcpIntervalMs(void)
+{
+    return RTCP_INTERVAL_MS / 2 + rand() % RTCP_INTERVAL_MS;
+}
+
+static void onChannelRtcpTimer(void *arg)
+{
+    struct LiveChannel *channel = (struct LiveChannel *)arg;
+    struct ChannelSubscriber *subscriber;
+    struct ChannelTrack *track;
+    int i;
+
+    // 同一轨道的订阅者共用同一个时间轴，只是 SSRC 和计数不同
+    for (i = 0; i < CHANNEL_MAX_TRACKS; i++)
+    {
+        track = &channel->tracks[i];
+        for (subscriber = track->subscribers.next; subscriber != &track->subscribers;
+             subscriber = subscriber->next)
+            channelSendSenderReport(channel, track, subscriber);
+    }
+
+    channel->rtcpTimer = eventLoopAddTimer(channel->loop, channelRtcpIntervalMs(),
+                                           onChannelRtcpTimer, channel);
+}
+
+// H.264 从第一个 SPS 的 VUI 中读取帧率，帧率 = time_scale / (2 * num_units_in_tick)
+// H.265 从第一个 VPS 的 vps_timing_info 中读取，帧率 = time_scale / num_units_in_tick
+static void channelDetectFrameRate(struct LiveChannel *channel)
+{
+    struct AnnexbSource *source = &channel->source;
+    struct H264SpsInfo sps;
+    struct H265VpsInfo vps;
+    uint64_t num = 0, den = 0;
+    uint32_t a, b, t;
+    int i;
+
+    for (i = 0; i < source->naluCount; i++)
+    {
+        const uint8_t *nalu = source->data + source->nalus[i].offset;
+        uint32_t size = source->nalus[i].size;
+
+        if (source->codec == NALU_CODEC_H265)
+        {
+            if (h265NaluType(source->nalus[i].header) != H265_NAL_VPS)
+                continue;
+            if (h265ParseVps(nalu, size, &vps) == 0 && vps.timingInfoPresent)
+            {
+                num = vps.timeScale;
+                den = vps.numUnitsInTick;
+            }
+            break;
+        }
+
+        if ((source->nalus[i].header & 0x1F) != 7)
+            continue;
+
+        if (h264ParseSps(nalu, size, &sps) < 0)
+            break;
+
+        printf("sps: profile=%d level=%d %dx%d\n", sps.profileIdc, sps.levelIdc, sps.width, sps.height);
+        if (sps.timingInfoPresent)
+        {
+            num = sps.timeScale;
+            den = 2ull * sps.numUnitsInTick;
+        }
+        break;
+    }
+
+    // 只接受 1 ~ 240 fps 之间的帧率，其余当作码流中没有帧率信息
+    if (den > 0 && num >= den && num <= 240 * den && den <= UINT32_MAX)
+    {
+        // 约分，避免计算时间戳时溢出
+        a = num;
+        b = den;
+        while (b)
+        {
+            t = a % b;
+            a = b;
+            b = t;
+        }
+        channel->frameRateNum = num / a;
+        channel->frameRateDen = den / a;
+    }
+
+    printf("frame rate: %u/%u (%.3f fps)\n", channel->frameRateNum, channel->frameRateDen,
+           (double)channel->frameRateNum / channel->frameRateDen);
+}
+
+// 打开源文件：.h264/.h265 + 可选的 .aac；定义了 USE_LIBAVFORMAT 时其他扩展名的文件交给 libavformat
+static int channelOpenSources(struct LiveChannel *channel, const char *fileName,
+                              const char *indexFileName, const char *audioFileName)
+{
+    const char *ext = strrchr(fileName, '.');
+    int h265 = ext && (!strcmp(ext, ".h265") || !strcmp(ext, ".265") || !strcmp(ext, ".hevc"));
+
+#ifdef USE_LIBAVFORMAT
+    if (!h265 && (!ext || (strcmp(ext, ".h264") && strcmp(ext, ".264"))))
+        return mp4Load(fileName, &channel->source, &channel->audioSource,
+                       &channel->frameRateNum, &channel->frameRateDen);
+#endif
+
+    if (annexbOpen(&channel->source, fileName, indexFileName) < 0)
+    {
+        printf("读取 %s 失败\n", fileName);
+        return -1;
+    }
+    channel->source.codec = h265 ? NALU_CODEC_H265 : NALU_CODEC_H264;
+
+    if (audioFileName && adtsOpen(&channel->audioSource, audioFileName) < 0)
+    {
+        printf("读取 %s 失败\n", audioFileName);
+        return -1;
+    }
+
+    return 0;
+}
+
+// 每个 NALU 最多拆成 size / RTP_MAX_PKT_SIZE + 1 个报文，按最大的访问单元分配
+// 顺便记下第一组参数集，还没有开始发送时 SDP 也能带上它们
+static int channelInitVideoTrack(struct LiveChannel *channel, struct ChannelTrack *track)
+{
+    int first, count, kind, vcl, reference, idr, i;
+    int firstIdr = -1;
+
+    while ((count = annexbNextAccessUnit(&channel->source, &first)) > 0)
+    {
+        int packets = 0;
+
+        for (i = first; i < first + count; i++)
+        {
+            packets += channel->source.nalus[i].size / RTP_MAX_PKT_SIZE + 1;
+
+            kind = channelParseNaluHeader(channel->source.codec, channel->source.nalus[i].header,
+                                          &vcl, &reference, &idr);
+            if (kind >= 0 && channel->paramSetNalus[kind] < 0)
+                channel->paramSetNalus[kind] = i;
+            if (idr && firstIdr < 0)
+                firstIdr = i;
+        }
+
+        if (packets > track->maxPackets)
+            track->maxPackets = packets;
+    }
+
+    // 从第一个 IDR 帧开始发送，带上同一个访问单元中它前面的参数集，没有 IDR 帧时从头开始
+    // 参数集不在 IDR 帧前面时客户端用 SDP 中的参数集，新订阅者补发时也会先发送它们
+    channel->loopNalu = 0;
+    if (firstIdr >= 0 && annexbSeekKeyFrame(&channel->source, firstIdr) == 0)
+        channel->loopNalu = channel->source.cursor;
+    annexbSeek(&channel->source, channel->loopNalu);
+
+    channelDetectFrameRate(channel);
+
+    track->present = 1;
+    track->clockRate = 90000;
+    rtpHeaderInit(&track->rtpHeader, channel->source.codec == NALU_CODEC_H265 ? RTP_PAYLOAD_TYPE_H265
+                                                                              : RTP_PAYLOAD_TYPE_H264,
+                  0, 0, 0);
+    pacerInit(&track->pacer, track->clockRate, CHANNEL_BURST_BYTES);
+
+    track->packets = (struct RtpPacketView *)malloc(track->maxPackets * sizeof(struct RtpPacketView));
+    track->history = (struct ChannelHistoryEntry *)calloc(CHANNEL_RTX_HISTORY, sizeof(struct ChannelHistoryEntry));
+
+    // 补发的一帧可能还要带上参数集
+    channel->gop = (struct ChannelGopFrame *)malloc(CHANNEL_GOP_MAX_FRAMES * sizeof(struct ChannelGopFrame));
+    channel->gopPackets = (struct RtpPacketView *)malloc((track->maxPackets + CHANNEL_MAX_PARAM_SETS) *
+                                                         sizeof(struct RtpPacketView));
+
+    return track->packets && track->history && channel->gop && channel->gopPackets ? 0 : -1;
+}
+
+// 聚合的帧只占一个报文，超过 MTU 的帧要分片，按最大的帧分配
+static int channelInitAudioTrack(struct LiveChannel *channel, struct ChannelTrack *track)
+{
+    struct AdtsSource *source = &channel->audioSource;
+    int i, packets;
+
+    for (i = 0; i < source->frameCount; i++)
+    {
+        packets = source->frames[i].size / (RTP_MAX_PKT_SIZE - 4) + 1;
+        if (packets > track->maxPackets)
+            track->maxPackets = packets;
+    }
+
+    printf("aac: profile=%d %dHz %d channels, %d frames\n", source->profile + 1,
+           source->sampleRate, source->channels, source->frameCount);
+
+    track->present = 1;
+    track->clockRate = source->sampleRate;
+    rtpHeaderInit(&track->rtpHeader, RTP_PAYLOAD_TYPE_AAC, 0, 0, 0);
+    pacerInit(&track->pacer, track->clockRate, CHANNEL_BURST_BYTES);
+
+    track->packets = (struct RtpPacketView *)malloc(track->maxPackets * sizeof(struct RtpPacketView));
+    track->history = (struct ChannelHistoryEntry *)calloc(CHANNEL_RTX_HISTORY, sizeof(struct ChannelHistoryEntry));
+
+    return track->packets && track->history ? 0 : -1;
+}
+
+int channelInit(struct LiveChannel *channel, struct EventLoop *loop, struct PacketPool *pool,
+                const char *fileName, const char *indexFileName, const char *audioFileName)
+{
+    char hostName[48] = "localhost";
+    int i;
+
+    memset(channel, 0, sizeof(*channel));
+    channel->source.fd = -1;
+    channel->audioSource.fd = -1;
+
+    channel->fileName = fileName;
+    channel->loop = loop;
+    channel->pool = pool;
+    channel->audioMaxLatencyMs = CHANNEL_AUDIO_MAX_LATENCY_MS;
+    channel->gopBurstRate = CHANNEL_GOP_BURST_RATE;
+    for (i = 0; i < CHANNEL_MAX_PARAM_SETS; i++)
+        channel->paramSetNalus[i] = -1;
+    gethostname(hostName, sizeof(hostName) - 1);
+    snprintf(channel->cname, sizeof(channel->cname), "live@%s", hostName);
+    channel->frameRateNum = CHANNEL_DEFAULT_FPS;
+    channel->frameRateDen = 1;
+    for (i = 0; i < CHANNEL_MAX_TRACKS; i++)
+    {
+        channel->tracks[i].subscribers.prev = &channel->tracks[i].subscribers;
+        channel->tracks[i].subscribers.next = &channel->tracks[i].subscribers;
+    }
+
+    if (channelOpenSources(channel, fileName, indexFileName, audioFileName) < 0)
+    {
+        channelDestroy(channel);
+        return -1;
+    }
+
+    if ((channel->source.data && channelInitVideoTrack(channel, &channel->tracks[CHANNEL_TRACK_VIDEO]) < 0) ||
+        (channel->audioSource.data && channelInitAudioTrack(channel, &channel->tracks[CHANNEL_TRACK_AUDIO]) < 0))
+    {
+        channelDestroy(channel);
+        return -1;
+    }
+
+    return 0;
+}
+
+void channelDestroy(struct LiveChannel *channel)
+{
+    int i, j;
+
+    eventLoopCancelTimer(channel->loop, channel->timer);
+    channel->timer = NULL;
+    eventLoopCancelTimer(channel->loop, channel->rtcpTimer);
+    channel->rtcpTimer = NULL;
+    eventLoopCancelTimer(channel->loop, channel->gopTimer);
+    channel->gopTimer = NULL;
+
+    annexbClose(&channel->source);
+    adtsClose(&channel->audioSource);
+
+    for (i = 0; i < CHANNEL_MAX_TRACKS; i++)
+    {
+        free(channel->tracks[i].packets);
+        channel->tracks[i].packets = NULL;
+        packetBufferUnref(channel->tracks[i].auBuffer);
+        channel->tracks[i].auBuffer = NULL;
+
+        if (channel->tracks[i].history)
+        {
+            for (j = 0; j < CHANNEL_RTX_HISTORY; j++)
+                packetBufferUnref(channel->tracks[i].history[j].buffer);
+            free(channel->tracks[i].history);
+            channel->tracks[i].history = NULL;
+        }
+    }
+
+    free(channel->gop);
+    channel->gop = NULL;
+    free(channel->gopPackets);
+    channel->gopPackets = NULL;
+}
+
+int channelHasTrack(struct LiveChannel *channel, int track)
+{
+    return track >= 0 && track < CHANNEL_MAX_TRACKS && channel->tracks[track].present;
+}
+
+// 把参数集按 base64 编码追加到 sdp 中，返回写入的长度，放不下时返回 size
+static int channelAppendBase64(struct LiveChannel *channel, int index, char *sdp, int size)
+{
+    static const char table[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    const uint8_t *data;
+    uint32_t dataSize, i, v;
+    int len = 0;
+
+    if (index < 0)
+        return 0;
+
+    data = channel->source.data + channel->source.nalus[index].offset;
+    dataSize = channel->source.nalus[index].size;
+    if ((int)((dataSize + 2) / 3 * 4) >= size)
+        return size;
+
+    for (i = 0; i < dataSize; i += 3)
+    {
+        v = data[i] << 16;
+        if (i + 1 < dataSize)
+            v |= data[i + 1] << 8;
+        if (i + 2 < dataSize)
+            v |= data[i + 2];
+
+        sdp[len++] = table[(v >> 18) & 0x3F];
+        sdp[len++] = table[(v >> 12) & 0x3F];
+        sdp[len++] = i + 1 < dataSize ? table[(v >> 6) & 0x3F] : '=';
+        sdp[len++] = i + 2 < dataSize ? table[v & 0x3F] : '=';
+    }
+    sdp[len] = '\0';
+
+    return len;
+}
+
+// H.265 的 m= 段，参数集放在 sprop-vps/sprop-sps/sprop-pps 中，客户端不用等带内的参数集就能初始化解码器
+static int channelBuildH265Sdp(struct LiveChannel *channel, char *sdp, int size)
+{
+    static const char *names[CHANNEL_MAX_PARAM_SETS] = {"sprop-vps", "sprop-sps", "sprop-pps"};
+    int len, i, sep = ' ';
+
+    len = snprintf(sdp, size, "m=video 0 RTP/AVP %d\r\n"
+                              "a=rtpmap:%d H265/90000\r\n"
+                              "a=fmtp:%d",
+                   RTP_PAYLOAD_TYPE_H265, RTP_PAYLOAD_TYPE_H265, RTP_PAYLOAD_TYPE_H265);
+
+    for (i = 0; i < CHANNEL_MAX_PARAM_SETS && len < size; i++)
+    {
+        if (channel->paramSetNalus[i] < 0)
+            continue;
+
+        len += snprintf(sdp + len, size - len, "%c%s=", sep, names[i]);
+        if (len < size)
+            len += channelAppendBase64(channel, channel->paramSetNalus[i], sdp + len, size - len);
+        sep = ';';
+    }
+
+    if (len < size)
+        len += snprintf(sdp + len, size - len, "\r\n"
+                                               "a=rtcp-fb:%d nack\r\n"
+                                               "a=control:track%d\r\n",
+                        RTP_PAYLOAD_TYPE_H265, CHANNEL_TRACK_VIDEO);
+
+    return len;
+}
+
+// H.264 的 m= 段，分片用的是 FU-A，所以 packetization-mode=1；profile-level-id 取自 SPS 的第 2~4 字节，
+// SPS/PPS 放在 sprop-parameter-sets 中，IDR 帧前面没有参数集时客户端也能初始化解码器
+static int channelBuildH264Sdp(struct LiveChannel *channel, char *sdp, int size)
+{
+    int sps = channel->paramSetNalus[CHANNEL_PARAM_SPS];
+    int pps = channel->paramSetNalus[CHANNEL_PARAM_PPS];
+    const uint8_t *data;
+    int len;
+
+    len = snprintf(sdp, size, "m=video 0 RTP/AVP %d\r\n"
+                              "a=rtpmap:%d H264/90000\r\n"
+                              "a=fmtp:%d packetization-mode=1",
+                   RTP_PAYLOAD_TYPE_H264, RTP_PAYLOAD_TYPE_H264, RTP_PAYLOAD_TYPE_H264);
+
+    if (sps >= 0 && channel->source.nalus[sps].size >= 4 && len < size)
+    {
+        data = channel->source.data + channel->source.nalus[sps].offset;
+        len += snprintf(sdp + len, size - len, ";profile-level-id=%02X%02X%02X;sprop-parameter-sets=",
+                        data[1], data[2], data[3]);
+        if (len < size)
+            len += channelAppendBase64(channel, sps, sdp + len, size - len);
+        if (pps >= 0 && len < size)
+            len += snprintf(sdp + len, size - len, ",");
+        if (pps >= 0 && len < size)
+            len += channelAppendBase64(channel, pps, sdp + len, size - len);
+    }
+
+    if (len < size)
+        len += snprintf(sdp + len, size - len, "\r\n"
+                                               "a=rtcp-fb:%d nack\r\n"
+                                               "a=control:track%d\r\n",
+                        RTP_PAYLOAD_TYPE_H264, CHANNEL_TRACK_VIDEO);
+
+    return len;
+}
+
+int channelBuildSdp(struct LiveChannel *channel, char *sdp, int size, const char *localIp)
+{
+    int len;
+
+    len = snprintf(sdp, size, "v=0\r\n"
+                              "o=- 9%ld 1 IN IP4 %s\r\n"
+                              "t=0 0\r\n"
+                              "a=control:*\r\n",
+                   time(NULL), localIp);
+
+    if (channel->tracks[CHANNEL_TRACK_VIDEO].present && channel->source.codec == NALU_CODEC_H265 && len < size)
+        len += channelBuildH265Sdp(channel, sdp + len, size - len);
+    else if (channel->tracks[CHANNEL_TRACK_VIDEO].present && len < size)
+        len += channelBuildH264Sdp(channel, sdp + len, size - len);
+
+    if (channel->tracks[CHANNEL_TRACK_AUDIO].present && len < size)
+        len += snprintf(sdp + len, size - len, "m=audio 0 RTP/AVP %d\r\n"
+                                               "a=rtpmap:%d mpeg4-generic/%d/%d\r\n"
+                                               "a=fmtp:%d profile-level-id=1;mode=AAC-hbr;sizelength=13;indexlength=3;indexdeltalength=3;config=%04X;\r\n"
+                                               "a=rtcp-fb:%d nack\r\n"
+                                               "a=control:track%d\r\n",
+                        RTP_PAYLOAD_TYPE_AAC, RTP_PAYLOAD_TYPE_AAC, channel->audioSource.sampleRate,
+                        channel->audioSource.channels, RTP_PAYLOAD_TYPE_AAC,
+                        adtsAudioSpecificConfig(&channel->audioSource), RTP_PAYLOAD_TYPE_AAC,
+                        CHANNEL_TRACK_AUDIO);
+
+    return len < size ? len : -1;
+}
+
+static int channelAddSubscriber(struct LiveChannel *channel, struct ChannelSubscriber *subscriber, int track)
+{
+    struct ChannelTrack *t = &channel->tracks[track];
+
+    subscriber->track = track;
+    subscriber->seq = rand();
+    subscriber->ssrc = rand();
+    subscriber->peerSsrcKnown = 0;
+    subscriber->firstPacket = t->sentPackets;
+    subscriber->joinUs = getMonotonicUs();
+    rtcpStatsInit(&subscriber->rtcp);
+
+    subscriber->prev = t->subscribers.prev;
+    subscriber->next = &t->subscribers;
+    t->subscribers.prev->next = subscriber;
+    t->subscribers.prev = subscriber;
+    t->subscriberCount++;
+    channel->subscriberCount++;
+
+    if (!channel->timer)
+    {
+        // 暂停之后重新开始，以当前时刻作为新的起点
+        channelStart(channel);
+
+        channel->timer = eventLoopAddTimer(channel->loop, 0, onChannelTimer, channel);
+        if (!channel->timer)
+            return -1;
+    }
+
+    if (!channel->rtcpTimer)
+        channel->rtcpTimer = eventLoopAddTimer(channel->loop, channelRtcpIntervalMs(),
+                                               onChannelRtcpTimer, channel);
+
+    // 频道开始后当前帧已经读入，GOP 缓存中至少有它
+    if (track == CHANNEL_TRACK_VIDEO && channel->gopBurstRate > 0 && channel->gopValid &&
+        channel->gopCount > 0)
+    {
+        subscriber->bursting = 1;
+        subscriber->gopCursor = 0;
+        if (!channel->gopTimer)
+            channel->gopTimer = eventLoopAddTimer(channel->loop, 0, onChannelGopTimer, channel);
+    }
+
+    return 0;
+}
+
+int channelSubscribe(struct LiveChannel *channel, struct ChannelSubscriber *subscriber, int track,
+                     int rtpSockfd, int rtcpSockfd, const char *ip, int rtpPort, int rtcpPort)
+{
+    if (!channelHasTrack(channel, track))
+        return -1;
+
+    memset(subscriber, 0, sizeof(*subscriber));
+    subscriber->rtpSockfd = rtpSockfd;
+    subscriber->rtcpSockfd = rtcpSockfd;
+    subscriber->addr.sin_family = AF_INET;
+    subscriber->addr.sin_port = htons(rtpPort);
+    subscriber->addr.sin_addr.s_addr = inet_addr(ip);
+    subscriber->rtcpAddr = subscriber->addr;
+    subscriber->rtcpAddr.sin_port = htons(rtcpPort);
+
+    return channelAddSubscriber(channel, subscriber, track);
+}
+
+int channelSubscribeTcp(struct LiveChannel *channel, struct ChannelSubscriber *subscriber, int track,
+                        struct OutBuffer *out, int rtpChannel)
+{
+    socklen_t len = sizeof(subscriber->addr);
+
+    if (!channelHasTrack(channel, track))
+        return -1;
+
+    memset(subscriber, 0, sizeof(*subscriber));
+    // 只用于统计中显示客户端地址
+    getpeername(out->fd, (struct sockaddr *)&subscriber->addr, &len);
+    subscriber->out = out;
+    subscriber->rtpChannel = rtpChannel;
+    subscriber->rtpSockfd = -1;
+    subscriber->rtcpSockfd = -1;
+    // 中途加入时当前帧可能已经发了一半，从下一帧开始发送
+    subscriber->skipAu = channel->tracks[track].auStarted;
+
+    return channelAddSubscriber(channel, subscriber, track);
+}
+
+void channelUnsubscribe(struct LiveChannel *channel, struct ChannelSubscriber *subscriber)
+{
+    if (!subscriber->next)
+        return;
+
+    subscriber->prev->next = subscriber->next;
+    subscriber->next->prev = subscriber->prev;
+    subscriber->prev = subscriber->next = NULL;
+    channel->tracks[subscriber->track].subscriberCount--;
+    channel->subscriberCount--;
+
+    // 没有人观看时暂停，下次有人订阅时从当前位置继续
+    if (channel->subscriberCount == 0)
+    {
+        eventLoopCancelTimer(channel->loop, channel->timer);
+        channel->timer = NULL;
+        eventLoopCancelTimer(channel->loop, channel->rtcpTimer);
+        channel->rtcpTimer = NULL;
+        eventLoopCancelTimer(channel->loop, channel->gopTimer);
+        channel->gopTimer = NULL;
+    }
+}
+
+// RTCP 包是否来自 receiver 的客户端，并且针对 receiver 自己的 RTP 流
+// 客户端的 SSRC 在 SETUP 中不会告诉我们，以它发来的第一个报告或 NACK 为准，之后必须一致
+static int channelMatchRtcp(struct ChannelSubscriber *receiver, uint32_t senderSsrc, uint32_t mediaSsrc)
+{
+    if (mediaSsrc != receiver->ssrc)
+        return 0;
+
+    if (!receiver->peerSsrcKnown)
+    {
+        receiver->peerSsrc = senderSsrc;
+        receiver->peerSsrcKnown = 1;
+    }
+
+    return senderSsrc == receiver->peerSsrc;
+}
+
+// 按订阅者的序列号在发送历史中找到报文：订阅者的下一个序列号对应轨道的下一个报文编号，
+// UDP 订阅者加入后每个报文都会收到，往回数同样多个就是要找的报文
+static struct ChannelHistoryEntry *channelFindHistory(struct ChannelTrack *track,
+                                                      struct ChannelSubscriber *subscriber, uint16_t seq)
+{
+    uint16_t back = subscriber->seq - seq;
+
+    if (back == 0 || back > CHANNEL_RTX_HISTORY || back > track->sentPackets - subscriber->firstPacket)
+        return NULL;
+
+    return &track->history[(track->sentPackets - back) & (CHANNEL_RTX_HISTORY - 1)];
+}
+
+// 重传一个 NACK 条目中丢失的报文，序列号和 SSRC 与原来的报文相同，超出重传额度的不再重传
+// TCP 不会丢包，interleaved 的订阅者忽略 NACK；补发的报文不在发送历史中，补发期间也忽略
+static void channelRetransmit(struct ChannelTrack *track, struct ChannelSubscriber *subscriber,
+                              const struct RtcpNack *nack)
+{
+    uint8_t headers[17][RTP_MAX_HEADER_SIZE + 4];
+    struct ChannelHistoryEntry *entry;
+    struct RtpBatch batch;
+    uint32_t size;
+    uint16_t seq;
+    int count = 0, i;
+
+    if (subscriber->out || subscriber->bursting)
+        return;
+
+    rtpBatchInit(&batch, subscriber->rtpSockfd, &subscriber->addr);
+
+    // 第 0 个是 PID，后面 16 个由 BLP 的各位表示
+    for (i = 0; i < 17; i++)
+    {
+        if (i > 0 && !(nack->blp & (1 << (i - 1))))
+            continue;
+
+        seq = nack->pid + i;
+        subscriber->nackedPackets++;
+
+        entry = channelFindHistory(track, subscriber, seq);
+        size = entry ? entry->packet.headerSize + entry->packet.payloadSize : 0;
+        if (!entry || size > subscriber->rtxCredit)
+        {
+            subscriber->rtxDropped++;
+            continue;
+        }
+        subscriber->rtxCredit -= size;
+        subscriber->rtxPackets++;
+
+        memcpy(headers[count], entry->packet.header, entry->packet.headerSize);
+        rtpHeaderSetSeq(headers[count], seq);
+        rtpHeaderSetSsrc(headers[count], subscriber->ssrc);
+        rtcpStatsOnSend(&subscriber->rtcp, entry->packet.headerSize - entry->packet.rtpHeaderSize +
+                                               entry->packet.payloadSize);
+
+        rtpBatchAddIov(&batch, headers[count], entry->packet.headerSize,
+                       entry->packet.payload, entry->packet.payloadSize);
+        count++;
+    }
+
+    rtpBatchFlush(&batch);
+}
+
+void channelHandleRtcp(struct LiveChannel *channel, struct ChannelSubscriber *receiver,
+                       const uint8_t *buf, int size)
+{
+    struct RtcpReportBlock blocks[RTCP_MAX_REPORT_BLOCKS];
+    struct RtcpNack nacks[RTCP_MAX_NACKS];
+    uint64_t now = getMonotonicMs();
+    int count, i;
+
+    // 还没有 PLAY 或者已经退订
+    if (!receiver->next)
+        return;
+
+    // 抖动以 RTP 时钟为单位，按订阅者所在轨道的时钟频率换算
+    count = rtcpParseReportBlocks(buf, size, blocks, RTCP_MAX_REPORT_BLOCKS);
+    for (i = 0; i < count; i++)
+    {
+        if (channelMatchRtcp(receiver, blocks[i].reporterSsrc, blocks[i].ssrc))
+            rtcpStatsOnReport(&receiver->rtcp, &blocks[i],
+                              channel->tracks[receiver->track].clockRate, now);
+    }
+
+    // 其他会话的 SSRC 或者伪造的发送者不会触发重传
+    count = rtcpParseNacks(buf, size, nacks, RTCP_MAX_NACKS);
+    for (i = 0; i < count; i++)
+    {
+        if (channelMatchRtcp(receiver, nacks[i].senderSsrc, nacks[i].mediaSsrc))
+            channelRetransmit(&channel->tracks[receiver->track], receiver, &nacks[i]);
+    }
+}
+
+int channelSnapshot(struct LiveChannel *channel, struct ChannelSubscriberStats *stats, int maxCount)
+{
+    struct ChannelSubscriber *subscriber;
+    int count = 0, i;
+
+    for (i = 0; i < CHANNEL_MAX_TRACKS; i++)
+    {
+        for (subscriber = channel->tracks[i].subscribers.next;
+             subscriber != &channel->tracks[i].subscribers && count < maxCount;
+             subscriber = subscriber->next, count++)
+        {
+            stats[count].track = i;
+            stats[count].ssrc = subscriber->ssrc;
+            stats[count].addr = subscriber->addr;
+            stats[count].interleaved = subscriber->out != NULL;
+            stats[count].droppedAus = subscriber->droppedAus;
+            stats[count].nackedPackets = subscriber->nackedPackets;
+            stats[count].rtxPackets = subscriber->rtxPackets;
+            stats[count].rtxDropped = subscriber->rtxDropped;
+            stats[count].firstFrameMs = subscriber->firstFrameUs ?
+                                        (subscriber->firstFrameUs - subscriber->joinUs) / 1000.0 : -1;
+            stats[count].burstFrames = subscriber->burstFrames;
+            stats[count].rtcp = subscriber->rtcp;
+        }
+    }
+
+    return count;
+}
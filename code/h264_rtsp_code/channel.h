@@ -0,0 +1,232 @@
+#ifndef _CHANNEL_H_
+#define _CHANNEL_H_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <netinet/in.h>
+#include "rtp.h"
+#include "event.h"
+#include "nalu.h"
+#include "adts.h"
+#include "pacer.h"
+#include "outbuf.h"
+#include "pktpool.h"
+#include "rtcp.h"
+
+// 码流中没有帧率信息时使用的默认帧率
+#define CHANNEL_DEFAULT_FPS 25
+
+// 一开始就能发出去的字节数，小帧不受令牌桶限制
+#define CHANNEL_BURST_BYTES (4 * (RTP_HEADER_SIZE + 2 + RTP_MAX_PKT_SIZE))
+
+// 音频默认把这么长时间内的 AAC 帧聚合成一个报文，0 表示每帧一个报文
+#define CHANNEL_AUDIO_MAX_LATENCY_MS 100
+
+// TCP 订阅者的发送队列积压超过这个字节数时，丢弃非参考帧
+#define CHANNEL_TCP_HIGH_WATER (256 * 1024)
+// 积压超过这个字节数，或队列放不下一整帧时，丢弃到下一个 IDR 帧为止
+#define CHANNEL_TCP_MAX_BYTES (2 * 1024 * 1024)
+
+// 每个轨道保留最近发送的这么多个报文，用于响应客户端的 NACK 重传，必须是 2 的幂
+#define CHANNEL_RTX_HISTORY 1024
+// 每发送 100 字节新数据，订阅者得到这么多字节的重传额度，重传不会挤占正常发送的带宽
+#define CHANNEL_RTX_PERCENT 25
+// 重传额度的上限，丢包集中时最多一次性补发这么多
+#define CHANNEL_RTX_BURST_BYTES (64 * 1024)
+
+// GOP 缓存最多保存的帧数，GOP 更长时不缓存，新的订阅者直接从当前帧开始接收
+#define CHANNEL_GOP_MAX_FRAMES 512
+// 给新订阅者补发 GOP 缓存的默认速率，字节/秒，比正常播放快，但不会一下子塞满客户端的接收缓冲区
+#define CHANNEL_GOP_BURST_RATE (2 * 1024 * 1024)
+// 补发的定时器间隔，每次最多补发这段时间的额度
+#define CHANNEL_GOP_BURST_INTERVAL_MS 10
+
+// 视频参数集的种类，H.264 没有 VPS
+#define CHANNEL_PARAM_VPS 0
+#define CHANNEL_PARAM_SPS 1
+#define CHANNEL_PARAM_PPS 2
+#define CHANNEL_MAX_PARAM_SETS 3
+
+// 频道中的轨道，SDP 中依次为 track0、track1
+#define CHANNEL_TRACK_VIDEO 0
+#define CHANNEL_TRACK_AUDIO 1
+#define CHANNEL_MAX_TRACKS 2
+
+// 频道某个轨道的订阅者，每个 PLAY 的会话在它 SETUP 过的每个轨道上各一个
+// 频道把每个 NALU/AAC 帧只打包一次，发送给每个订阅者时只改写序列号和 SSRC
+struct ChannelSubscriber
+{
+    struct ChannelSubscriber *prev;
+    struct ChannelSubscriber *next;
+    int track;                   // 订阅的轨道
+    struct sockaddr_in addr;     // 客户端的 RTP 地址
+    struct sockaddr_in rtcpAddr; // 客户端的 RTCP 地址
+    int rtpSockfd;               // 会话自己的 RTP/RTCP 套接字，从端口池分配
+    int rtcpSockfd;
+    uint16_t seq;                // 该订阅者自己的 RTP 序列号
+    uint32_t ssrc;
+    uint32_t peerSsrc;           // 客户端作为接收者的 SSRC，取自它发来的第一个 RTCP 包
+    int peerSsrcKnown;
+    struct RtcpStats rtcp;       // 发送计数和客户端接收报告中的丢包、抖动、RTT
+
+    // NACK 重传，只用于 UDP 订阅者
+    uint64_t firstPacket; // 加入时轨道已经发送的报文数，之前的报文不属于这个订阅者
+    uint32_t rtxCredit;   // 还可以重传的字节数
+    uint32_t nackedPackets;
+    uint32_t rtxPackets;
+    uint32_t rtxDropped;  // 已经不在历史中或者超出重传额度
+
+    // 视频订阅者加入时先补发 GOP 缓存中的帧，追上当前帧之后再接收广播
+    int bursting;
+    int gopCursor;         // 下一个要补发的缓存帧
+    int32_t burstCredit;   // 还可以补发的字节数
+    uint32_t burstFrames;  // 补发了多少帧
+    uint64_t joinUs;
+    uint64_t firstFrameUs; // 第一个完整的 IDR 帧(音频为第一帧)发出的时刻，0 表示还没有
+
+    // RTP over RTSP：报文加上 '$' 帧头放进 RTSP 连接的发送队列，UDP 订阅者为 NULL
+    struct OutBuffer *out;
+    uint8_t rtpChannel; // interleaved 的 RTP 通道号，RTCP 使用下一个通道
+    int skipAu;         // 当前访问单元不发送给该订阅者
+    int dropUntilIdr;   // 已经丢了参考帧，直到下一个 IDR 帧之前都不发送
+    uint32_t droppedAus;
+};
+
+// 发送过的一个报文，头部中的序列号和 SSRC 是最后一个订阅者的，重传时再改写
+// 负载在缓冲池中时持有缓冲区的引用
+struct ChannelHistoryEntry
+{
+    struct RtpPacketView packet;
+    struct PacketBuffer *buffer;
+};
+
+// GOP 缓存中的一帧，只记录 NALU 在源文件索引中的位置，数据仍然在映射的文件中
+struct ChannelGopFrame
+{
+    int firstNalu;
+    int naluCount;
+    uint64_t pts;
+    int hasParamSets; // 帧中带有全部参数集
+};
+
+// 频道中的一路媒体：视频以访问单元(一帧)为单位，音频以一个报文中聚合的若干 AAC 帧为单位
+// 每个轨道有自己的 RTP 时钟、打包结果、令牌桶和订阅者
+struct ChannelTrack
+{
+    int present;        // 源文件中有这一路
+    uint32_t clockRate; // 视频 90000，音频为采样率
+    struct RtpHeader rtpHeader; // RTP 头模板，序列号和 SSRC 发送时再改写
+    uint64_t pts;       // 当前访问单元的时间戳，以时钟频率为单位，扩展到 64 位不会回绕
+
+    // 当前访问单元打包后的 RTP 报文，负载直接指向映射的文件内容，
+    // 聚合的音频帧需要复制，负载放在 auBuffer 中，TCP 订阅者的发送队列各自持有它的引用
+    struct RtpPacketView *packets;
+    struct PacketBuffer *auBuffer;
+    int packetCount;
+    int maxPackets; // 按文件中最大的访问单元分配
+    int nextPacket; // 下一个要发送的报文
+    uint32_t auBytes;
+    uint32_t auTimestamp;
+    uint32_t auIntervalUs;  // 当前访问单元的时长，报文在这段时间内发完
+    uint64_t auScheduledUs; // 当前访问单元的计划发送时刻
+    int auStarted;
+    int auIsReference; // nal_ref_idc 不为 0，丢掉会影响后面的帧；音频帧总是为 1
+    int auIsIdr;       // 音频帧之间没有依赖，总是为 1
+
+    struct RtpPacer pacer;
+
+    // 最近发送的报文，按发送顺序编号，第 n 个放在 history[n % CHANNEL_RTX_HISTORY]
+    // 订阅者的序列号和编号一一对应，由序列号就能找到报文
+    struct ChannelHistoryEntry *history;
+    uint64_t sentPackets;
+
+    struct ChannelSubscriber subscribers; // 订阅者链表的哨兵
+    int subscriberCount;
+};
+
+// 直播频道：H.264/H.265 和 AAC 文件只读取、解析一次，按各自的时间戳广播给所有订阅者
+// 一帧的报文由令牌桶分散在帧间隔内；两个轨道由同一个定时器驱动，
+// 开始发送时以同一时刻作为起点，SR 中的 NTP 时间和各自的 RTP 时间戳对应同一个时钟，客户端据此做音画同步
+struct LiveChannel
+{
+    const char *fileName;
+    struct AnnexbSource source;      // 整个文件映射到内存，按索引逐个取 NALU
+    struct AdtsSource audioSource;   // 同样映射到内存，按索引逐个取 AAC 帧
+
+    // 帧率为 frameRateNum / frameRateDen，优先取自 SPS 的 VUI timing_info
+    uint32_t frameRateNum;
+    uint32_t frameRateDen;
+    uint64_t frameCount; // 已发送的帧数，时间戳由它直接算出，不会累积舍入误差
+    // 每一轮从这个 NALU 开始：第一个 IDR 帧的参数集，文件从 GOP 中间截取时跳过开头无法解码的帧
+    int loopNalu;
+    uint64_t sampleCount; // 已发送的音频采样数，就是音频的时间戳
+
+    struct ChannelTrack tracks[CHANNEL_MAX_TRACKS];
+
+    struct EventLoop *loop;
+    struct PacketPool *pool; // 聚合音频帧的缓冲区从这里分配
+    int audioMaxLatencyMs;   // 音频聚合的时延上限，channelInit() 之后可以修改
+    struct Timer *timer;
+    struct Timer *rtcpTimer; // 定期给每个订阅者发送 SR
+
+    // GOP 缓存：最近一个 IDR 帧以来的所有视频帧，最后一帧就是正在发送的帧
+    struct ChannelGopFrame *gop;
+    int gopCount;
+    int gopValid;          // 已经从 IDR 帧开始缓存，并且没有超过 CHANNEL_GOP_MAX_FRAMES
+    // 最近的 VPS/SPS/PPS，按 CHANNEL_PARAM_* 排列，-1 表示没有
+    // SDP 中的 sprop-* 取自这里，IDR 帧中没有参数集时补发前先发送它们
+    int paramSetNalus[CHANNEL_MAX_PARAM_SETS];
+    struct RtpPacketView *gopPackets; // 补发时打包一帧用
+    uint32_t gopBurstRate; // 补发速率，字节/秒，0 表示不使用 GOP 缓存，channelInit() 之后可以修改
+    struct Timer *gopTimer;
+    char cname[64];          // SDES 中的 CNAME，同一个频道的音视频相同，客户端据此把两路关联起来
+
+    int subscriberCount; // 所有轨道的订阅者总数
+};
+
+// 订阅者统计的快照，可以在频道之外随时读取
+struct ChannelSubscriberStats
+{
+    int track;
+    uint32_t ssrc;
+    struct sockaddr_in addr; // interleaved 时为 RTSP 连接的对端地址
+    int interleaved;
+    uint32_t droppedAus;
+    uint32_t nackedPackets;
+    uint32_t rtxPackets;
+    uint32_t rtxDropped;
+    double firstFrameMs; // 从加入到第一个完整的 IDR 帧发出，小于 0 表示还没有
+    uint32_t burstFrames;
+    struct RtcpStats rtcp;
+};
+
+// fileName 为 .h264 文件，扩展名为 .h265/.265/.hevc 时按 H.265 打包，indexFileName 为 NALU 索引的缓存文件，audioFileName 为 .aac 文件，
+// 后两个可以为 NULL；定义了 USE_LIBAVFORMAT 时 fileName 也可以是 MP4 等容器，此时忽略另外两个
+int channelInit(struct LiveChannel *channel, struct EventLoop *loop, struct PacketPool *pool,
+                const char *fileName, const char *indexFileName, const char *audioFileName);
+void channelDestroy(struct LiveChannel *channel);
+
+// 频道中是否有这个轨道
+int channelHasTrack(struct LiveChannel *channel, int track);
+// 生成 DESCRIBE 回复中的 SDP，每个轨道一个 m= 段，返回长度
+int channelBuildSdp(struct LiveChannel *channel, char *sdp, int size, const char *localIp);
+
+// 第一个订阅者加入时频道开始发送，最后一个离开时暂停
+// 视频订阅者先以 gopBurstRate 补发最近一个 IDR 帧以来的帧，马上就有画面，之后跟随正常的节奏
+// 报文从 rtpSockfd/rtcpSockfd 发往客户端的 ip:rtpPort 和 ip:rtcpPort
+int channelSubscribe(struct LiveChannel *channel, struct ChannelSubscriber *subscriber, int track,
+                     int rtpSockfd, int rtcpSockfd, const char *ip, int rtpPort, int rtcpPort);
+// 通过 RTSP 连接发送 interleaved 的 RTP 报文，发送队列积压时按帧丢弃
+int channelSubscribeTcp(struct LiveChannel *channel, struct ChannelSubscriber *subscriber, int track,
+                        struct OutBuffer *out, int rtpChannel);
+void channelUnsubscribe(struct LiveChannel *channel, struct ChannelSubscriber *subscriber);
+
+// 处理客户端发来的 RTCP 复合包，receiver 为收到这个包的订阅者(它的 RTCP 端口或 interleaved 通道)
+// 只接受针对 receiver 的 SSRC、并且来自同一个客户端 SSRC 的报告块和 NACK：
+// 更新 receiver 的统计，按 NACK 从发送历史中重传丢失的报文
+void channelHandleRtcp(struct LiveChannel *channel, struct ChannelSubscriber *receiver,
+                       const uint8_t *buf, int size);
+// 把最多 maxCount 个订阅者的统计复制到 stats，返回个数
+int channelSnapshot(struct LiveChannel *channel, struct ChannelSubscriberStats *stats, int maxCount);
+
+#endif
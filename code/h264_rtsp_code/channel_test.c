@@ -0,0 +1,255 @@
+// channel.c 中 GOP 缓存补发的测试：生成一个 IDR 帧前面不带 SPS/PPS 的 .h264 文件，
+// 新订阅者正好在这个 IDR 帧加入，或者补发中途遇到它时，收到的第一个 NALU 必须是 SPS，接着 PPS，再是 IDR
+// gcc channel_test.c channel.c rtp.c rtpheader.c rtcp.c event.c nalu.c adts.c mp4src.c pacer.c outbuf.c pktpool.c -o channel_test
+// ./channel_test，全部通过时返回 0
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "channel.h"
+
+// 每个 GOP 的帧数，只有文件开头的 IDR 帧带参数集
+#define TEST_GOP_FRAMES 4
+#define TEST_GOPS 3
+// 加入后收这么多个报文就够判断开头的顺序
+#define TEST_RECV_PACKETS 8
+
+static int failures = 0;
+
+#define CHECK(cond)                                                          \
+    do                                                                       \
+    {                                                                        \
+        if (!(cond))                                                         \
+        {                                                                    \
+            printf("FAIL %s:%d: %s\n", __FUNCTION__, __LINE__, #cond);       \
+            failures++;                                                      \
+        }                                                                    \
+    } while (0)
+
+static const uint8_t sps[] = {0x67, 0x64, 0x00, 0x28, 0xAC, 0xD9, 0x40, 0x78, 0x02, 0x27, 0xE5, 0xC0, 0x5A,
+                              0x80, 0x80, 0x80, 0xA0, 0x00, 0x00, 0x7D, 0x20, 0x00, 0x1D, 0x4C, 0x10, 0x80};
+static const uint8_t pps[] = {0x68, 0x23, 0x92, 0xD9, 0xCE, 0xC4};
+
+struct JoinTest
+{
+    struct LiveChannel *channel;
+    struct ChannelSubscriber *subscriber;
+    int rtpSockfd;
+    int port;
+    int joinAtIdr; // 1：在没有参数集的 IDR 帧加入；0：在它前一帧加入，补发中途遇到它
+    int joined;
+    int frames;    // 加入之后又读入的帧数
+};
+
+// 写一个 NALU：起始码、NALU 头、first_mb_in_slice = 0 的 slice 头和一些数据
+static void writeNalu(FILE *fp, const uint8_t *data, int size)
+{
+    static const uint8_t startCode[] = {0x00, 0x00, 0x00, 0x01};
+
+    fwrite(startCode, 1, sizeof(startCode), fp);
+    fwrite(data, 1, size, fp);
+}
+
+static void writeSlice(FILE *fp, uint8_t header)
+{
+    uint8_t slice[64];
+
+    memset(slice, 0x55, sizeof(slice));
+    slice[0] = header;
+    slice[1] = 0x88;
+    writeNalu(fp, slice, sizeof(slice));
+}
+
+static int writeStream(char *fileName)
+{
+    int fd, gop, frame;
+    FILE *fp;
+
+    fd = mkstemp(fileName);
+    if (fd < 0 || (fp = fdopen(fd, "wb")) == NULL)
+        return -1;
+
+    for (gop = 0; gop < TEST_GOPS; gop++)
+    {
+        if (gop == 0)
+        {
+            writeNalu(fp, sps, sizeof(sps));
+            writeNalu(fp, pps, sizeof(pps));
+        }
+        writeSlice(fp, 0x65);
+        for (frame = 1; frame < TEST_GOP_FRAMES; frame++)
+            writeSlice(fp, 0x41);
+    }
+
+    fclose(fp);
+
+    return 0;
+}
+
+static int openUdp(struct sockaddr_in *addr)
+{
+    socklen_t addrLen = sizeof(*addr);
+    int sockfd;
+
+    memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd < 0 || bind(sockfd, (struct sockaddr *)addr, sizeof(*addr)) < 0)
+        return -1;
+    getsockname(sockfd, (struct sockaddr *)addr, &addrLen);
+
+    return sockfd;
+}
+
+// 每毫秒看一下当前帧：到了加入的时机就订阅，之后再读入几帧就停止
+static void onCheckTimer(void *arg)
+{
+    struct JoinTest *test = (struct JoinTest *)arg;
+    struct LiveChannel *channel = test->channel;
+    struct ChannelTrack *track = &channel->tracks[CHANNEL_TRACK_VIDEO];
+    static uint64_t lastFrame;
+
+    if (!test->joined)
+    {
+        int noParamIdr = track->auIsIdr && channel->gopCount == 1 && !channel->gop[0].hasParamSets;
+        // 文件开头那个 GOP 的最后一帧，下一个 IDR 帧没有参数集
+        int beforeIdr = channel->gopCount == TEST_GOP_FRAMES && channel->gop[0].hasParamSets;
+
+        if (test->joinAtIdr ? noParamIdr : beforeIdr)
+        {
+            CHECK(channelSubscribe(channel, test->subscriber, CHANNEL_TRACK_VIDEO, test->rtpSockfd,
+                                   test->rtpSockfd, "127.0.0.1", test->port, test->port) == 0);
+            test->joined = 1;
+            lastFrame = channel->frameCount;
+        }
+    }
+    else if (channel->frameCount != lastFrame)
+    {
+        lastFrame = channel->frameCount;
+        if (++test->frames >= 3)
+        {
+            eventLoopStop(channel->loop);
+            return;
+        }
+    }
+
+    eventLoopAddTimer(channel->loop, 1, onCheckTimer, test);
+}
+
+// RTP 负载中 NALU 的类型，FU-A 取 FU header 中的类型
+static int payloadNaluType(const uint8_t *buf, int size)
+{
+    int offset = 12 + (buf[0] & 0x0F) * 4;
+
+    if (buf[0] & 0x10)
+        offset += 4 + ((buf[offset + 2] << 8) | buf[offset + 3]) * 4;
+    if (offset + 2 > size)
+        return -1;
+
+    if ((buf[offset] & 0x1F) == 28)
+        return buf[offset + 1] & 0x1F;
+
+    return buf[offset] & 0x1F;
+}
+
+static void runJoin(const char *fileName, int joinAtIdr, uint32_t gopBurstRate)
+{
+    struct EventLoop loop;
+    struct PacketPool pool;
+    struct LiveChannel channel;
+    struct ChannelSubscriber driver, subscriber;
+    struct JoinTest test;
+    struct sockaddr_in sinkAddr, recvAddr;
+    uint8_t buf[2048];
+    int sinkfd, sockfd, types[TEST_RECV_PACKETS], count = 0, n;
+
+    CHECK(eventLoopInit(&loop) == 0);
+    packetPoolInit(&pool, 64);
+    if (channelInit(&channel, &loop, &pool, fileName, NULL, NULL) < 0)
+    {
+        CHECK(!"channelInit");
+        return;
+    }
+    channel.gopBurstRate = gopBurstRate;
+
+    sinkfd = openUdp(&sinkAddr);
+    sockfd = openUdp(&recvAddr);
+    CHECK(sinkfd >= 0 && sockfd >= 0);
+    fcntl(sockfd, F_SETFL, O_NONBLOCK);
+
+    // 先有一个订阅者让频道开始发送，它收到的报文不看
+    CHECK(channelSubscribe(&channel, &driver, CHANNEL_TRACK_VIDEO, sinkfd, sinkfd, "127.0.0.1",
+                           ntohs(sinkAddr.sin_port), ntohs(sinkAddr.sin_port)) == 0);
+
+    memset(&test, 0, sizeof(test));
+    test.channel = &channel;
+    test.subscriber = &subscriber;
+    test.rtpSockfd = sinkfd;
+    test.port = ntohs(recvAddr.sin_port);
+    test.joinAtIdr = joinAtIdr;
+    eventLoopAddTimer(&loop, 1, onCheckTimer, &test);
+    eventLoopRun(&loop);
+
+    while (count < TEST_RECV_PACKETS && (n = recv(sockfd, buf, sizeof(buf), 0)) > 0)
+    {
+        // 只看 RTP，跳过 SR
+        if (buf[1] >= 200 && buf[1] <= 204)
+            continue;
+        types[count++] = payloadNaluType(buf, n);
+    }
+
+    printf("%s, burst %u B/s: first nalus", joinAtIdr ? "join at idr" : "idr during burst", gopBurstRate);
+    for (n = 0; n < count; n++)
+        printf(" %d", types[n]);
+    printf("\n");
+
+    CHECK(count >= 3);
+    if (count >= 3)
+    {
+        CHECK(types[0] == 7);
+        CHECK(types[1] == 8);
+        CHECK(types[2] == 5);
+    }
+
+    channelUnsubscribe(&channel, &subscriber);
+    channelUnsubscribe(&channel, &driver);
+    channelDestroy(&channel);
+    packetPoolDestroy(&pool);
+    eventLoopDestroy(&loop);
+    close(sinkfd);
+    close(sockfd);
+}
+
+int main(void)
+{
+    char fileName[] = "/tmp/channel_test_XXXXXX";
+
+    if (writeStream(fileName) < 0)
+    {
+        printf("failed to write %s\n", fileName);
+        return 1;
+    }
+
+    // 当前帧是 GOP 的第一帧，缓存中没有更早的帧可以补发
+    runJoin(fileName, 1, CHANNEL_GOP_BURST_RATE);
+    // 补发额度为 0，一直追不上，直到新的 IDR 帧把补发位置重置到 0
+    runJoin(fileName, 0, 1);
+
+    unlink(fileName);
+
+    if (failures)
+    {
+        printf("channel: %d checks failed\n", failures);
+        return 1;
+    }
+
+    printf("channel: all checks passed\n");
+
+    return 0;
+}
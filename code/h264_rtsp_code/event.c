@@ -0,0 +1,287 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include "event.h"
+
+#define MAX_EVENTS 256
+
+uint64_t getMonotonicMs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static inline void timerListInit(struct Timer *head)
+{
+    head->prev = head;
+    head->next = head;
+}
+
+static inline void timerUnlink(struct Timer *timer)
+{
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = timer->next = timer;
+}
+
+static inline void timerLinkTail(struct Timer *head, struct Timer *timer)
+{
+    timer->prev = head->prev;
+    timer->next = head;
+    head->prev->next = timer;
+    head->prev = timer;
+}
+
+int eventLoopInit(struct EventLoop *loop)
+{
+    int i;
+
+    memset(loop, 0, sizeof(*loop));
+
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epfd < 0)
+        return -1;
+
+    for (i = 0; i < TIMER_WHEEL_SIZE; i++)
+        timerListInit(&loop->wheel[i]);
+    timerListInit(&loop->expired);
+
+    loop->nowMs = getMonotonicMs();
+
+    return 0;
+}
+
+void eventLoopDestroy(struct EventLoop *loop)
+{
+    struct Timer *head, *timer;
+    int i;
+
+    for (i = 0; i < TIMER_WHEEL_SIZE; i++)
+    {
+        head = &loop->wheel[i];
+        while ((timer = head->next) != head)
+        {
+            timerUnlink(timer);
+            free(timer);
+        }
+    }
+
+    close(loop->epfd);
+    free(loop->handlers);
+    loop->handlers = NULL;
+    loop->handlerCount = 0;
+}
+
+int eventLoopAdd(struct EventLoop *loop, int fd, uint32_t events, EventCallback cb, void *arg)
+{
+    struct epoll_event ev;
+
+    if (fd >= loop->handlerCount)
+    {
+        int count = loop->handlerCount ? loop->handlerCount : 64;
+        struct EventHandler *handlers;
+
+        while (count <= fd)
+            count *= 2;
+
+        handlers = (struct EventHandler *)realloc(loop->handlers, count * sizeof(*handlers));
+        if (!handlers)
+            return -1;
+
+        memset(handlers + loop->handlerCount, 0, (count - loop->handlerCount) * sizeof(*handlers));
+        loop->handlers = handlers;
+        loop->handlerCount = count;
+    }
+
+    loop->handlers[fd].cb = cb;
+    loop->handlers[fd].arg = arg;
+    loop->handlers[fd].gen++;
+
+    ev.events = events;
+    ev.data.u64 = ((uint64_t)loop->handlers[fd].gen << 32) | (uint32_t)fd;
+
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+    {
+        loop->handlers[fd].cb = NULL;
+        return -1;
+    }
+
+    return 0;
+}
+
+int eventLoopMod(struct EventLoop *loop, int fd, uint32_t events)
+{
+    struct epoll_event ev;
+
+    if (fd >= loop->handlerCount || !loop->handlers[fd].cb)
+        return -1;
+
+    ev.events = events;
+    ev.data.u64 = ((uint64_t)loop->handlers[fd].gen << 32) | (uint32_t)fd;
+
+    return epoll_ctl(loop->epfd, EPOLL_CTL_MOD, fd, &ev);
+}
+
+void eventLoopDel(struct EventLoop *loop, int fd)
+{
+    if (fd < 0 || fd >= loop->handlerCount || !loop->handlers[fd].cb)
+        return;
+
+    epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, NULL);
+    loop->handlers[fd].cb = NULL;
+    loop->handlers[fd].arg = NULL;
+}
+
+struct Timer *eventLoopAddTimer(struct EventLoop *loop, uint32_t delayMs, TimerCallback cb, void *arg)
+{
+    struct Timer *timer;
+    uint64_t now, ticks, expire;
+
+    timer = (struct Timer *)malloc(sizeof(*timer));
+    if (!timer)
+        return NULL;
+
+    // 至少要等到下一格，避免在处理当前格时又插入到当前格
+    if (delayMs == 0)
+        delayMs = 1;
+
+    // nowMs 只在处理定时器时推进，fd 回调里它可能已经落后了一个 epoll_wait 超时，
+    // 所以按当前时刻计算到期时间，再换算成从 nowMs 开始要走的格数
+    now = getMonotonicMs();
+    if (now < loop->nowMs)
+        now = loop->nowMs;
+    ticks = now - loop->nowMs + delayMs;
+    expire = loop->nowMs + ticks;
+    timer->rotation = (ticks - 1) / TIMER_WHEEL_SIZE;
+    timer->cb = cb;
+    timer->arg = arg;
+
+    timerLinkTail(&loop->wheel[expire % TIMER_WHEEL_SIZE], timer);
+    loop->timerCount++;
+
+    return timer;
+}
+
+void eventLoopCancelTimer(struct EventLoop *loop, struct Timer *timer)
+{
+    if (!timer)
+        return;
+
+    timerUnlink(timer);
+    loop->timerCount--;
+    free(timer);
+}
+
+// 把时间轮从 nowMs 推进到当前时刻，依次执行到期的定时器
+static void eventLoopExpireTimers(struct EventLoop *loop)
+{
+    uint64_t now = getMonotonicMs();
+    struct Timer *head, *timer, *next;
+
+    while (loop->nowMs < now)
+    {
+        loop->nowMs++;
+
+        // 先把到期的定时器挪到 expired 链表，再逐个回调
+        // 回调中可能添加或取消其他定时器，所以不能边遍历槽边回调
+        head = &loop->wheel[loop->nowMs % TIMER_WHEEL_SIZE];
+        for (timer = head->next; timer != head; timer = next)
+        {
+            next = timer->next;
+            if (timer->rotation > 0)
+            {
+                timer->rotation--;
+                continue;
+            }
+
+            timerUnlink(timer);
+            timerLinkTail(&loop->expired, timer);
+        }
+
+        while ((timer = loop->expired.next) != &loop->expired)
+        {
+            TimerCallback cb = timer->cb;
+            void *arg = timer->arg;
+
+            timerUnlink(timer);
+            loop->timerCount--;
+            free(timer);
+
+            cb(arg);
+        }
+    }
+}
+
+// 计算 epoll_wait 的超时时间：找到下一个非空的槽
+// 槽里的定时器可能还要再转几圈，那样只是提前醒来一次
+static int eventLoopTimeout(struct EventLoop *loop)
+{
+    uint64_t now;
+    int i;
+
+    if (loop->timerCount == 0)
+        return -1;
+
+    now = getMonotonicMs();
+    for (i = 1; i <= TIMER_WHEEL_SIZE; i++)
+    {
+        struct Timer *head = &loop->wheel[(loop->nowMs + i) % TIMER_WHEEL_SIZE];
+
+        if (head->next != head)
+        {
+            if (loop->nowMs + i <= now)
+                return 0;
+
+            return (int)(loop->nowMs + i - now);
+        }
+    }
+
+    return TIMER_WHEEL_SIZE;
+}
+
+void eventLoopRun(struct EventLoop *loop)
+{
+    struct epoll_event events[MAX_EVENTS];
+    int i, n;
+
+    loop->running = 1;
+
+    while (loop->running)
+    {
+        n = epoll_wait(loop->epfd, events, MAX_EVENTS, eventLoopTimeout(loop));
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            printf("epoll_wait error\n");
+            break;
+        }
+
+        for (i = 0; i < n; i++)
+        {
+            int fd = (int)(uint32_t)events[i].data.u64;
+            uint32_t gen = (uint32_t)(events[i].data.u64 >> 32);
+            struct EventHandler *handler = &loop->handlers[fd];
+
+            // 本轮前面的回调可能已经关闭了这个 fd
+            if (!handler->cb || handler->gen != gen)
+                continue;
+
+            handler->cb(fd, events[i].events, handler->arg);
+        }
+
+        eventLoopExpireTimers(loop);
+    }
+}
+
+void eventLoopStop(struct EventLoop *loop)
+{
+    loop->running = 0;
+}
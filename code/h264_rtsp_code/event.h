@@ -0,0 +1,67 @@
+#ifndef _EVENT_H_
+#define _EVENT_H_
+
+#include <stdint.h>
+#include <sys/epoll.h>
+
+// 时间轮的槽数，每个槽代表 1ms，转一圈约 1 秒
+#define TIMER_WHEEL_SIZE 1024
+
+// fd 上有事件时的回调，events 为 epoll 返回的事件掩码(EPOLLIN/EPOLLOUT/...)
+typedef void (*EventCallback)(int fd, uint32_t events, void *arg);
+// 定时器到期时的回调，定时器都是一次性的，需要周期执行时在回调里重新添加
+typedef void (*TimerCallback)(void *arg);
+
+struct Timer
+{
+    struct Timer *prev;
+    struct Timer *next;
+    uint32_t rotation; // 还需要再转几圈才到期
+    TimerCallback cb;
+    void *arg;
+};
+
+struct EventHandler
+{
+    EventCallback cb;
+    void *arg;
+    uint32_t gen; // fd 被关闭后可能马上被复用，用代数区分旧事件
+};
+
+// 基于 epoll 的 reactor 加上一个 1ms 精度的时间轮
+struct EventLoop
+{
+    int epfd;
+    int running;
+
+    struct EventHandler *handlers; // 以 fd 为下标
+    int handlerCount;
+
+    uint64_t nowMs;      // 时间轮已经处理到的时刻
+    uint32_t timerCount; // 挂在时间轮上的定时器总数
+    struct Timer wheel[TIMER_WHEEL_SIZE]; // 每个槽是一个带哨兵的双向环形链表
+    struct Timer expired;                 // 当前这一格到期、等待回调的定时器
+};
+
+// 单调时钟，单位毫秒
+uint64_t getMonotonicMs(void);
+
+int eventLoopInit(struct EventLoop *loop);
+void eventLoopDestroy(struct EventLoop *loop);
+
+// 监听 fd 上的事件，同一个 fd 只能添加一次
+int eventLoopAdd(struct EventLoop *loop, int fd, uint32_t events, EventCallback cb, void *arg);
+int eventLoopMod(struct EventLoop *loop, int fd, uint32_t events);
+// 在 close(fd) 之前调用，之后本轮中已经取到的该 fd 的事件也不会再回调
+void eventLoopDel(struct EventLoop *loop, int fd);
+
+// 添加一个 delayMs 毫秒后到期的定时器
+// 回调执行前定时器就已经被释放，回调里不要再对它调用 eventLoopCancelTimer()
+struct Timer *eventLoopAddTimer(struct EventLoop *loop, uint32_t delayMs, TimerCallback cb, void *arg);
+void eventLoopCancelTimer(struct EventLoop *loop, struct Timer *timer);
+
+// 事件循环，直到 eventLoopStop() 被调用
+void eventLoopRun(struct EventLoop *loop);
+void eventLoopStop(struct EventLoop *loop);
+
+#endif
@@ -0,0 +1,547 @@
+// RTSP 服务器压力测试：在本机开 N 个客户端，每个都走完 OPTIONS/DESCRIBE/SETUP/PLAY 后收流，
+// 测量期间统计每个会话的收包速率和服务器进程的 CPU 占用，算出每个核能带多少个会话
+// gcc load_bench.c -o load_bench
+// ./load_bench [-a 服务器地址] [-p RTSP端口] [-n 客户端数] [-d 测量秒数] [-u] [-P 服务器pid | -- ./main -a 127.0.0.1 test.h264]
+// 默认用 interleaved TCP 收流，-u 改用 UDP；"--" 后面是服务器的命令行时由本程序启动、测完后结束服务器
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define MAX_CLIENTS 4096
+#define RECV_BUF_SIZE (16 * 1024)
+#define SETUP_TIMEOUT_SEC 10 // 所有客户端开始收流的最长等待时间
+#define WARMUP_SEC 1         // 开始测量前先收一会，避开 GOP 补发
+#define STALL_US 1000000     // 这么久没收到 RTP 包就算卡住
+#define KEEPALIVE_SEC 20     // 测量时间比会话超时长时用 GET_PARAMETER 保活
+
+enum
+{
+    CLIENT_OPTIONS,
+    CLIENT_DESCRIBE,
+    CLIENT_SETUP,
+    CLIENT_PLAY,
+    CLIENT_PLAYING,
+    CLIENT_FAILED,
+};
+
+struct Client
+{
+    int fd;
+    int udpFd; // -u 时接收 RTP 的套接字，RTCP 不接收
+    int state;
+    int cseq;
+    char sessionId[64];
+    char buf[RECV_BUF_SIZE];
+    int len;
+
+    uint64_t packets; // 测量开始后收到的 RTP 包
+    uint64_t bytes;
+    uint64_t lastPacketUs;
+};
+
+static struct
+{
+    const char *ip;
+    int port;
+    int clients;
+    int seconds;
+    int udp;
+    pid_t serverPid;
+} config = {"127.0.0.1", 8554, 100, 10, 0, 0};
+
+static struct Client *clients;
+static int epfd;
+
+static uint64_t getMonotonicUs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// /proc/<pid>/stat 中的 utime + stime，单位为时钟滴答
+static int64_t getProcessTicks(pid_t pid)
+{
+    char path[64];
+    char stat[1024];
+    char *p;
+    unsigned long utime, stime;
+    FILE *f;
+    int n;
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int)pid);
+    f = fopen(path, "r");
+    if (!f)
+        return -1;
+    n = fread(stat, 1, sizeof(stat) - 1, f);
+    fclose(f);
+    stat[n > 0 ? n : 0] = '\0';
+
+    // 进程名里可能有空格，从最后一个 ')' 之后开始数：state 是第 3 个字段，utime/stime 是第 14/15 个
+    p = strrchr(stat, ')');
+    if (!p || sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2)
+        return -1;
+
+    return (int64_t)(utime + stime);
+}
+
+static int sendRequest(struct Client *client, const char *method, const char *track, const char *extra)
+{
+    char req[512];
+    int len;
+
+    len = snprintf(req, sizeof(req), "%s rtsp://%s:%d/%s RTSP/1.0\r\nCSeq: %d\r\n%s%s%s%s\r\n",
+                   method, config.ip, config.port, track, ++client->cseq,
+                   client->sessionId[0] ? "Session: " : "", client->sessionId,
+                   client->sessionId[0] ? "\r\n" : "", extra);
+
+    // 请求很小，非阻塞套接字上也能一次发完
+    return send(client->fd, req, len, MSG_NOSIGNAL) == len ? 0 : -1;
+}
+
+// 发出当前状态对应的请求
+static int sendNextRequest(struct Client *client)
+{
+    char transport[128];
+    struct sockaddr_in addr;
+    socklen_t addrLen = sizeof(addr);
+
+    switch (client->state)
+    {
+    case CLIENT_OPTIONS:
+        return sendRequest(client, "OPTIONS", "", "");
+    case CLIENT_DESCRIBE:
+        return sendRequest(client, "DESCRIBE", "", "Accept: application/sdp\r\n");
+    case CLIENT_SETUP:
+        if (config.udp)
+        {
+            getsockname(client->udpFd, (struct sockaddr *)&addr, &addrLen);
+            snprintf(transport, sizeof(transport), "Transport: RTP/AVP;unicast;client_port=%d-%d\r\n",
+                     ntohs(addr.sin_port), ntohs(addr.sin_port) + 1);
+        }
+        else
+        {
+            snprintf(transport, sizeof(transport), "Transport: RTP/AVP/TCP;unicast;interleaved=0-1\r\n");
+        }
+        return sendRequest(client, "SETUP", "track0", transport);
+    case CLIENT_PLAY:
+        return sendRequest(client, "PLAY", "", "Range: npt=0.000-\r\n");
+    }
+
+    return 0;
+}
+
+static void countPacket(struct Client *client, int len)
+{
+    client->packets++;
+    client->bytes += len;
+    client->lastPacketUs = getMonotonicUs();
+}
+
+// 处理一个完整的 RTSP 回复，返回 -1 表示出错
+static int handleResponse(struct Client *client, const char *resp)
+{
+    const char *p;
+    int code = 0;
+
+    if (sscanf(resp, "RTSP/1.0 %d", &code) != 1 || code != 200)
+        return -1;
+
+    // 播放中只会收到保活请求的回复
+    if (client->state == CLIENT_PLAYING)
+        return 0;
+
+    if (client->state == CLIENT_SETUP)
+    {
+        p = strstr(resp, "Session:");
+        if (!p || sscanf(p, "Session: %63[^;\r\n]", client->sessionId) != 1)
+            return -1;
+    }
+
+    client->state++;
+    if (client->state == CLIENT_PLAYING)
+    {
+        client->lastPacketUs = getMonotonicUs();
+        return 0;
+    }
+
+    return sendNextRequest(client);
+}
+
+// 处理缓冲区中的 RTSP 回复和 interleaved 包，返回 -1 表示出错
+static int handleData(struct Client *client)
+{
+    int off = 0;
+
+    while (off < client->len)
+    {
+        char *data = client->buf + off;
+        int avail = client->len - off;
+
+        if (data[0] == '$')
+        {
+            int len;
+
+            if (avail < 4)
+                break;
+            len = ((uint8_t)data[2] << 8) | (uint8_t)data[3];
+            if (avail < 4 + len)
+                break;
+            if (data[1] == 0)
+                countPacket(client, len);
+            off += 4 + len;
+        }
+        else
+        {
+            char *end, *p;
+            int headerLen, contentLength = 0;
+
+            // 回复中没有 '\0'，在缓冲区末尾临时加一个，buf 比最多收到的数据多留了一个字节
+            client->buf[client->len] = '\0';
+            end = strstr(data, "\r\n\r\n");
+            if (!end)
+                break;
+            headerLen = end + 4 - data;
+            if ((p = strstr(data, "Content-length:")) != NULL && p < end)
+                contentLength = atoi(p + 15);
+            else if ((p = strstr(data, "Content-Length:")) != NULL && p < end)
+                contentLength = atoi(p + 15);
+            if (avail < headerLen + contentLength)
+                break;
+            if (handleResponse(client, data) < 0)
+                return -1;
+            off += headerLen + contentLength;
+        }
+    }
+
+    memmove(client->buf, client->buf + off, client->len - off);
+    client->len -= off;
+
+    return 0;
+}
+
+static void failClient(struct Client *client)
+{
+    if (client->state == CLIENT_FAILED)
+        return;
+    client->state = CLIENT_FAILED;
+    epoll_ctl(epfd, EPOLL_CTL_DEL, client->fd, NULL);
+    close(client->fd);
+    if (client->udpFd >= 0)
+    {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, client->udpFd, NULL);
+        close(client->udpFd);
+    }
+}
+
+static void onClientReadable(struct Client *client)
+{
+    int n;
+
+    while (client->state != CLIENT_FAILED)
+    {
+        n = recv(client->fd, client->buf + client->len, RECV_BUF_SIZE - 1 - client->len, 0);
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        if (n <= 0)
+        {
+            failClient(client);
+            return;
+        }
+        client->len += n;
+        if (handleData(client) < 0 || client->len >= RECV_BUF_SIZE - 1)
+            failClient(client);
+    }
+}
+
+static void onUdpReadable(struct Client *client)
+{
+    uint8_t buf[2048];
+    int n;
+
+    while ((n = recv(client->udpFd, buf, sizeof(buf), 0)) > 0)
+    {
+        // 声明的 RTCP 端口可能正好是别的客户端的 RTP 端口，按负载类型去掉 RTCP
+        if (n >= 12 && !(buf[1] >= 200 && buf[1] <= 204))
+            countPacket(client, n);
+    }
+}
+
+// epoll 的 data 中低位区分 RTSP 连接(0)和 UDP(1)
+static void pollOnce(int timeoutMs)
+{
+    struct epoll_event events[256];
+    int n, i;
+
+    n = epoll_wait(epfd, events, 256, timeoutMs);
+    for (i = 0; i < n; i++)
+    {
+        struct Client *client = &clients[events[i].data.u64 >> 1];
+
+        if (events[i].data.u64 & 1)
+            onUdpReadable(client);
+        else
+            onClientReadable(client);
+    }
+}
+
+static int startClient(int index)
+{
+    struct Client *client = &clients[index];
+    struct sockaddr_in addr;
+    struct epoll_event ev;
+
+    client->fd = -1;
+    client->udpFd = -1;
+    client->state = CLIENT_OPTIONS;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(config.port);
+    addr.sin_addr.s_addr = inet_addr(config.ip);
+
+    client->fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (client->fd < 0 || connect(client->fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        goto fail;
+    fcntl(client->fd, F_SETFL, fcntl(client->fd, F_GETFL) | O_NONBLOCK);
+
+    ev.events = EPOLLIN;
+    ev.data.u64 = (uint64_t)index << 1;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, client->fd, &ev);
+
+    if (config.udp)
+    {
+        int rcvBuf = 256 * 1024;
+
+        // 端口由内核分配
+        addr.sin_port = 0;
+        client->udpFd = socket(AF_INET, SOCK_DGRAM, 0);
+        if (client->udpFd < 0 || bind(client->udpFd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+            goto fail;
+        setsockopt(client->udpFd, SOL_SOCKET, SO_RCVBUF, &rcvBuf, sizeof(rcvBuf));
+        fcntl(client->udpFd, F_SETFL, fcntl(client->udpFd, F_GETFL) | O_NONBLOCK);
+        ev.data.u64 = ((uint64_t)index << 1) | 1;
+        epoll_ctl(epfd, EPOLL_CTL_ADD, client->udpFd, &ev);
+    }
+
+    if (sendNextRequest(client) < 0)
+        goto fail;
+
+    return 0;
+
+fail:
+    printf("client %d: %s\n", index, strerror(errno));
+    if (client->fd >= 0)
+        close(client->fd);
+    if (client->udpFd >= 0)
+        close(client->udpFd);
+    client->state = CLIENT_FAILED;
+    return -1;
+}
+
+static int countState(int state)
+{
+    int i, n = 0;
+
+    for (i = 0; i < config.clients; i++)
+        n += clients[i].state == state;
+
+    return n;
+}
+
+static int cmpU64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+// 解析命令行参数，格式见文件开头，返回服务器命令行在 argv 中的位置，没有时为 argc
+static int parseArgs(int argc, char *argv[])
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "a:p:n:d:uP:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'a':
+            config.ip = optarg;
+            break;
+        case 'p':
+            config.port = atoi(optarg);
+            break;
+        case 'n':
+            config.clients = atoi(optarg);
+            break;
+        case 'd':
+            config.seconds = atoi(optarg);
+            break;
+        case 'u':
+            config.udp = 1;
+            break;
+        case 'P':
+            config.serverPid = atoi(optarg);
+            break;
+        default:
+            return -1;
+        }
+    }
+
+    if (config.clients <= 0 || config.clients > MAX_CLIENTS || config.seconds <= 0)
+        return -1;
+
+    return optind;
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t *rates;
+    uint64_t startUs, endUs, deadlineUs, now, lastKeepaliveUs;
+    uint64_t totalPackets = 0, totalBytes = 0;
+    int64_t startTicks = -1, endTicks = -1;
+    double wall, serverCores = 0;
+    int serverArg, playing, stalled, i;
+    pid_t child = 0;
+
+    serverArg = parseArgs(argc, argv);
+    if (serverArg < 0)
+    {
+        printf("usage: %s [-a server_ip] [-p rtsp_port] [-n clients] [-d seconds] [-u] [-P server_pid | -- server command]\n",
+               argv[0]);
+        return -1;
+    }
+
+    // 服务器由本程序启动
+    if (serverArg < argc)
+    {
+        child = fork();
+        if (child == 0)
+        {
+            // 服务器每个请求都会打印，测量时不要让终端拖慢它
+            int null = open("/dev/null", O_WRONLY);
+
+            dup2(null, STDOUT_FILENO);
+            execvp(argv[serverArg], argv + serverArg);
+            _exit(127);
+        }
+        config.serverPid = child;
+        usleep(500 * 1000);
+    }
+
+    clients = (struct Client *)calloc(config.clients, sizeof(struct Client));
+    rates = (uint64_t *)calloc(config.clients, sizeof(uint64_t));
+    epfd = epoll_create1(0);
+    if (!clients || !rates || epfd < 0)
+        return -1;
+
+    // 所有客户端同时开始建立会话
+    for (i = 0; i < config.clients; i++)
+        startClient(i);
+
+    deadlineUs = getMonotonicUs() + SETUP_TIMEOUT_SEC * 1000000ULL;
+    while (countState(CLIENT_PLAYING) + countState(CLIENT_FAILED) < config.clients &&
+           getMonotonicUs() < deadlineUs)
+        pollOnce(10);
+
+    printf("%d/%d clients playing over %s\n", countState(CLIENT_PLAYING), config.clients,
+           config.udp ? "udp" : "tcp");
+
+    deadlineUs = getMonotonicUs() + WARMUP_SEC * 1000000ULL;
+    while (getMonotonicUs() < deadlineUs)
+        pollOnce(10);
+
+    // 开始测量
+    for (i = 0; i < config.clients; i++)
+    {
+        clients[i].packets = 0;
+        clients[i].bytes = 0;
+    }
+    if (config.serverPid > 0)
+        startTicks = getProcessTicks(config.serverPid);
+    startUs = getMonotonicUs();
+    lastKeepaliveUs = startUs;
+    deadlineUs = startUs + config.seconds * 1000000ULL;
+
+    while ((now = getMonotonicUs()) < deadlineUs)
+    {
+        pollOnce(10);
+
+        if (now - lastKeepaliveUs >= KEEPALIVE_SEC * 1000000ULL)
+        {
+            for (i = 0; i < config.clients; i++)
+            {
+                if (clients[i].state == CLIENT_PLAYING)
+                    sendRequest(&clients[i], "GET_PARAMETER", "", "");
+            }
+            lastKeepaliveUs = now;
+        }
+    }
+
+    endUs = getMonotonicUs();
+    if (config.serverPid > 0)
+        endTicks = getProcessTicks(config.serverPid);
+    wall = (endUs - startUs) / 1e6;
+
+    playing = 0;
+    stalled = 0;
+    for (i = 0; i < config.clients; i++)
+    {
+        if (clients[i].state != CLIENT_PLAYING)
+            continue;
+        if (endUs - clients[i].lastPacketUs > STALL_US)
+            stalled++;
+        rates[playing++] = clients[i].packets;
+        totalPackets += clients[i].packets;
+        totalBytes += clients[i].bytes;
+    }
+    qsort(rates, playing, sizeof(uint64_t), cmpU64);
+
+    printf("measured %.1fs: %d sessions playing, %d stalled\n", wall, playing, stalled);
+    if (playing > 0)
+        printf("per session pkt/s: min=%.1f median=%.1f max=%.1f, total %.0f pkt/s %.2f Mbit/s\n",
+               rates[0] / wall, rates[playing / 2] / wall, rates[playing - 1] / wall,
+               totalPackets / wall, totalBytes * 8 / wall / 1e6);
+
+    if (startTicks >= 0 && endTicks >= 0)
+    {
+        serverCores = (double)(endTicks - startTicks) / sysconf(_SC_CLK_TCK) / wall;
+        printf("server cpu: %.1f%% of one core", serverCores * 100);
+        // 没卡住的会话数除以服务器用掉的核数
+        if (serverCores > 0)
+            printf(", %.0f sessions per core", (playing - stalled) / serverCores);
+        printf("\n");
+    }
+    else
+    {
+        printf("server cpu: unknown, pass -P <pid> or the server command after --\n");
+    }
+
+    for (i = 0; i < config.clients; i++)
+        failClient(&clients[i]);
+    close(epfd);
+    free(clients);
+    free(rates);
+
+    if (child > 0)
+    {
+        kill(child, SIGTERM);
+        waitpid(child, NULL, 0);
+    }
+
+    return 0;
+}
@@ -1,9 +1,14 @@
-// transport h264 video
+// transport h264 video and aac audio
 // ffmpeg -i test.mp4 -codec copy -bsf: h264_mp4toannexb -f h264 test.h264
-// gcc main.c rtp.c rtp.h -o main
-// ./main test.h264
+// ffmpeg -i test.mp4 -vn -acodec copy test.aac
+// H.265：ffmpeg -i test.mp4 -codec copy -bsf: hevc_mp4toannexb -f hevc test.h265，扩展名为 .h265/.265/.hevc
+// gcc main.c rtp.c rtpheader.c rtcp.c rtsp.c event.c channel.c nalu.c adts.c mp4src.c pacer.c outbuf.c pktpool.c session.c -o main
+// 直接读取 MP4 需要 FFmpeg：gcc -DUSE_LIBAVFORMAT ... -o main -lavformat -lavcodec -lavutil
+// ./main [-a 绑定地址] [-p RTSP端口] [-r RTP最小端口-最大端口] [-t 会话超时秒数] [-l 音频聚合时延毫秒] [-g GOP补发速率KB/s,0为不补发] [-i] [test.h264|test.h265 [test.aac] | test.mp4]
+// -i 把 NALU 索引保存到视频文件旁边的 <文件名>.idx，下次启动直接加载，默认只在内存中建立索引
 #include <stdio.h>
 #include <stdlib.h>
+#include <errno.h>
 #include <stdint.h>
 #include <string.h>
 #include <time.h>
@@ -15,13 +20,27 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 #include "rtp.h"
+#include "event.h"
+#include "channel.h"
+#include "outbuf.h"
+#include "session.h"
+#include "rtsp.h"
 
 #define H264_FILE_NAME "test.h264"
 #define ServerIP "192.168.50.236"
 #define SERVER_PORT 8554
-#define SERVER_RTP_PORT 55532
-#define SERVER_RTCP_PORT 55533
-#define BUF_MAX_SIZE (1024 * 1024)
+// 每个会话从这个范围中分配一对 RTP/RTCP 端口
+#define SERVER_RTP_PORT_MIN 55532
+#define SERVER_RTP_PORT_MAX 57531
+// 这么长时间没有收到请求或 RTCP 报告就关闭会话
+#define SESSION_TIMEOUT_SEC 60
+#define BUF_MAX_SIZE 4096 // 每个会话一份回复缓冲区，RTSP 回复都很小
+// interleaved 会话的内核发送缓冲区，限制在内核里排队的数据量，积压时由频道丢帧
+#define TCP_SNDBUF_SIZE (256 * 1024)
+#define STATS_INTERVAL_MS 10000 // 输出会话统计的间隔
+// 报文缓冲池的上限，每个缓冲区 1.5KB，所有会话共用
+#define PACKET_POOL_MAX_BUFFERS 8192
+#define MAX_STATS_SESSIONS 1024
 
 static int createTcpSocket()
 {
@@ -37,20 +56,6 @@ static int createTcpSocket()
     return sockfd;
 }
 
-static int createUdpSocket()
-{
-    int sockfd;
-    int on = 1;
-
-    sockfd = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sockfd < 0)
-        return -1;
-
-    setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, (const char *)&on, sizeof(on));
-
-    return sockfd;
-}
-
 static int bindSocketAddr(int sockfd, const char *ip, int port)
 {
     struct sockaddr_in addr;
@@ -83,464 +88,832 @@ static int acceptClient(int sockfd, char *ip, int *port)
 
     return clientfd;
 }
-// 判断前三个元素是否分别为 0 0 1
-// 用于标识帧开始或编码参数等信息
-static inline int startCode3(char *buf)
-{
-    if (buf[0] == 0 && buf[1] == 0 && buf[2] == 1)
-        return 1;
-    else
-        return 0;
-}
 
-// 判断前四个字节是否分别为 0 0 0 1
-// 用于表示帧开始或编码参数等信息
-static inline int startCode4(char *buf)
+static int handleCmd_OPTIONS(char *result, int cseq)
 {
-    if (buf[0] == 0 && buf[1] == 0 && buf[2] == 0 && buf[3] == 1)
-        return 1;
-    else
-        return 0;
+    sprintf(result, "RTSP/1.0 200 OK\r\n"
+                    "CSeq: %d\r\n"
+                    "Public: OPTIONS, DESCRIBE, SETUP, PLAY, TEARDOWN, GET_PARAMETER\r\n"
+                    "\r\n",
+            cseq);
+
+    return 0;
 }
 
-static char *findNextStartCode(char *buf, int len)
+static int handleCmd_DESCRIBE(char *result, int cseq, char *url, struct LiveChannel *channel)
 {
-    int i;
+    char sdp[2048]; // sprop-* 中有 base64 编码的参数集
+    char localIp[100];
+
+    sscanf(url, "rtsp://%[^:]:", localIp);
 
-    if (len < 3)
-        return NULL;
+    // 每个轨道一个 m= 段，视频为 track0，音频为 track1
+    if (channelBuildSdp(channel, sdp, sizeof(sdp), localIp) < 0)
+        return -1;
 
-    for (i = 0; i < len - 3; ++i)
+    sprintf(result, "RTSP/1.0 200 OK\r\nCSeq: %d\r\n"
+                    "Content-Base: %s\r\n"
+                    "Content-type: application/sdp\r\n"
+                    "Content-length: %zu\r\n\r\n"
+                    "%s",
+            cseq,
+            url,
+            strlen(sdp),
+            sdp);
+
+    return 0;
+}
+
+// rtpChannel >= 0 时 RTP 通过 RTSP 连接以 interleaved 方式发送
+static int handleCmd_SETUP(char *result, int cseq, const char *sessionId, int timeoutSec,
+                           int clientRtpPort, int serverRtpPort, int rtpChannel)
+{
+    if (rtpChannel >= 0)
     {
-        if (startCode3(buf) || startCode4(buf))
-            return buf;
+        sprintf(result, "RTSP/1.0 200 OK\r\n"
+                        "CSeq: %d\r\n"
+                        "Transport: RTP/AVP/TCP;unicast;interleaved=%d-%d\r\n"
+                        "Session: %s; timeout=%d\r\n"
+                        "\r\n",
+                cseq,
+                rtpChannel,
+                rtpChannel + 1,
+                sessionId,
+                timeoutSec);
 
-        ++buf;
+        return 0;
     }
 
-    if (startCode3(buf))
-        return buf;
+    sprintf(result, "RTSP/1.0 200 OK\r\n"
+                    "CSeq: %d\r\n"
+                    "Transport: RTP/AVP;unicast;client_port=%d-%d;server_port=%d-%d\r\n"
+                    "Session: %s; timeout=%d\r\n"
+                    "\r\n",
+            cseq,
+            clientRtpPort,
+            clientRtpPort + 1,
+            serverRtpPort,
+            serverRtpPort + 1,
+            sessionId,
+            timeoutSec);
 
-    return NULL;
+    return 0;
 }
 
-// 从H.264文件中读取一个帧的数据
-static int getFrameFromH264File(FILE *fp, char *frame, int size)
+static int handleCmd_PLAY(char *result, int cseq, const char *sessionId, int timeoutSec)
 {
-    int rSize, frameSize;
-    char *nextStartCode;
+    sprintf(result, "RTSP/1.0 200 OK\r\n"
+                    "CSeq: %d\r\n"
+                    "Range: npt=0.000-\r\n"
+                    "Session: %s; timeout=%d\r\n\r\n",
+            cseq,
+            sessionId,
+            timeoutSec);
 
-    if (fp < 0)
-        return -1;
+    return 0;
+}
 
-    rSize = fread(frame, 1, size, fp);
+// TEARDOWN 和 GET_PARAMETER(客户端用来保活)都只需要回复 200
+static int handleCmd_SessionOK(char *result, int cseq, const char *sessionId)
+{
+    sprintf(result, "RTSP/1.0 200 OK\r\n"
+                    "CSeq: %d\r\n"
+                    "Session: %s\r\n\r\n",
+            cseq,
+            sessionId);
 
-    // 检查是否为特定的起始码开始
-    if (!startCode3(frame) && !startCode4(frame))
-        return -1;
+    return 0;
+}
 
-    nextStartCode = findNextStartCode(frame + 3, rSize - 3);
-    if (!nextStartCode)
-    {
-        // lseek(fd, 0, SEEK_SET);
-        // frameSize = rSize;
-        return -1;
-    }
-    else
-    {
-        frameSize = (nextStartCode - frame);
-        fseek(fp, frameSize - rSize, SEEK_CUR);
-    }
+// 只有状态行和 CSeq 的回复，用于错误和没有会话时的 GET_PARAMETER
+static int handleCmd_Status(char *result, int cseq, int code, const char *reason)
+{
+    sprintf(result, "RTSP/1.0 %d %s\r\n"
+                    "CSeq: %d\r\n\r\n",
+            code,
+            reason,
+            cseq);
 
-    return frameSize;
+    return 0;
 }
 
-// 将 H.264 视频帧通过RTP协议发送到指定的IP地址和端口
-static int rtpSendH264Frame(int serverRtpSockfd, const char *ip, int16_t port,
-                            struct RtpPacket *rtpPacket, char *frame, uint32_t frameSize)
+// 会话在一个轨道上的传输参数，音视频分别 SETUP
+struct SessionTrack
 {
+    int setup;
+    int clientRtpPort;
+    int clientRtcpPort;
+    int rtpChannel;    // interleaved 的 RTP 通道号，-1 表示使用 UDP
+    int serverRtpPort; // 从端口池分配，-1 表示没有分配
+    int serverRtpSockfd;
+    int serverRtcpSockfd;
+
+    // PLAY 之后订阅直播频道的这个轨道
+    struct ChannelSubscriber subscriber;
+};
+
+// 每个 RTSP 客户端一个会话，保存原来 doClient() 中的局部变量
+// 会话由事件循环驱动：收到请求时处理 RTSP 命令，PLAY 之后订阅直播频道
+struct Session
+{
+    int clientSockfd;
+    char clientIp[40];
+    int clientPort;
+
+    // SETUP 之后才有的媒体会话
+    char sessionId[SESSION_ID_SIZE]; // 空串表示还没有 SETUP
+    struct SessionTrack tracks[CHANNEL_MAX_TRACKS];
+    uint64_t lastActiveMs;           // 最近一次收到请求或 RTCP 报告的时刻
+    struct Timer *keepaliveTimer;    // 连接建立时启动，没有 SETUP 的空闲连接也会超时关闭
+
+    // 请求可能分多次到达，也可能一次到达多个，由解析器增量解析
+    char rBuf[RTSP_MAX_REQUEST_SIZE]; // 放得下头部和请求体都到上限的请求
+    int rOff;  // 已经处理完的字节数，每次 recv() 之后统一移到缓冲区开头
+    int rLen;
+    int rSkip; // 客户端发来的 interleaved 数据还有多少字节要丢弃
+    struct RtspParser parser;
+    char sBuf[BUF_MAX_SIZE];
+
+    // RTSP 回复和 interleaved 的 RTP 包共用一个发送队列，保证按顺序发送
+    struct OutBuffer out;
+};
+
+// 服务器配置，可以通过命令行修改
+static struct
+{
+    const char *bindIp;
+    int port;
+    int rtpPortMin;
+    int rtpPortMax;
+    int timeoutSec;
+    const char *fileName;
+    const char *audioFileName; // 可选的 .aac 文件，和视频合成一个频道
+    int audioLatencyMs;
+    int gopBurstKBps; // 新订阅者补发 GOP 缓存的速率，0 表示不补发
+    int indexSidecar; // 是否把 NALU 索引保存到视频文件旁边
+} config = {ServerIP, SERVER_PORT, SERVER_RTP_PORT_MIN, SERVER_RTP_PORT_MAX,
+            SESSION_TIMEOUT_SEC, H264_FILE_NAME, NULL, CHANNEL_AUDIO_MAX_LATENCY_MS,
+            CHANNEL_GOP_BURST_RATE / 1024, 0};
+
+static struct EventLoop eventLoop;
+static struct PacketPool packetPool;
+static struct PortPool portPool;
+static struct SessionTable sessionTable;
+static int sessionCount = 0;
+// 所有会话共享的直播频道，文件只读取、打包一次
+static struct LiveChannel liveChannel;
+
+static void initSessionTracks(struct Session *session)
+{
+    int i;
 
-    uint8_t naluType; // nalu第一个字节
-    int sendBytes = 0;
-    int ret;
-
-    // 获取帧数据的第一个字节
-    naluType = frame[0];
+    for (i = 0; i < CHANNEL_MAX_TRACKS; i++)
+    {
+        session->tracks[i].setup = 0;
+        session->tracks[i].rtpChannel = -1;
+        session->tracks[i].serverRtpPort = -1;
+    }
+}
 
-    printf("frameSize=%d \n", frameSize);
+// 结束媒体会话(TEARDOWN 或连接关闭)：停止发送，归还端口和会话 ID，RTSP 连接保留
+static void releaseMediaSession(struct Session *session)
+{
+    int i;
 
-    // 如果帧数据的大小小于RTP最大包大小
-    if (frameSize <= RTP_MAX_PKT_SIZE) // nalu长度小于最大包长：单一NALU单元模式
+    for (i = 0; i < CHANNEL_MAX_TRACKS; i++)
     {
+        struct SessionTrack *track = &session->tracks[i];
 
-        //*   0 1 2 3 4 5 6 7 8 9
-        //*  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-        //*  |F|NRI|  Type   | a single NAL unit ... |
-        //*  +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+        // 先退订，频道不会再往发送队列里放报文，也不会再用这对套接字
+        channelUnsubscribe(&liveChannel, &track->subscriber);
 
-        // 先将整个数据复制到rtpPacket的负载payload中
-        // 然后调用rtpSendPacketOverUdp通过UDP发送RTP包
-        memcpy(rtpPacket->payload, frame, frameSize);
-        ret = rtpSendPacketOverUdp(serverRtpSockfd, ip, port, rtpPacket, frameSize);
-        if (ret < 0)
-            return -1;
-
-        // 发送成功后更新RTP序列号，增加发送的字节数，并检查帧数据的类型是否为SPS或PPS
-        rtpPacket->rtpHeader.seq++;
-        sendBytes += ret;
-        if ((naluType & 0x1F) == 7 || (naluType & 0x1F) == 8) // 如果是SPS、PPS就不需要加时间戳
-            goto out;
+        if (track->serverRtpPort > 0)
+        {
+            eventLoopDel(&eventLoop, track->serverRtcpSockfd);
+            close(track->serverRtpSockfd);
+            close(track->serverRtcpSockfd);
+            portPoolRelease(&portPool, track->serverRtpPort);
+        }
     }
-    else // nalu长度小于最大包场：分片模式
+    initSessionTracks(session);
+
+    if (session->sessionId[0])
     {
+        sessionTableRemove(&sessionTable, session->sessionId);
+        session->sessionId[0] = '\0';
+    }
+}
 
-        //*  0                   1                   2
-        //*  0 1 2 3 4 5 6 7 8 9 0 1 2 3 4 5 6 7 8 9 0 1 2 3
-        //* +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
-        //* | FU indicator  |   FU header   |   FU payload   ...  |
-        //* +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+static void closeSession(struct Session *session)
+{
+    eventLoopDel(&eventLoop, session->clientSockfd);
+    eventLoopCancelTimer(&eventLoop, session->keepaliveTimer);
+    session->keepaliveTimer = NULL;
 
-        //*     FU Indicator
-        //*    0 1 2 3 4 5 6 7
-        //*   +-+-+-+-+-+-+-+-+
-        //*   |F|NRI|  Type   |
-        //*   +---------------+
+    releaseMediaSession(session);
+    outBufferFree(&session->out);
+    close(session->clientSockfd);
 
-        //*      FU Header
-        //*    0 1 2 3 4 5 6 7
-        //*   +-+-+-+-+-+-+-+-+
-        //*   |S|E|R|  Type   |
-        //*   +---------------+
+    sessionCount--;
+    printf("close client;client ip:%s,client port:%d,sessions:%d\n",
+           session->clientIp, session->clientPort, sessionCount);
 
-        int pktNum = frameSize / RTP_MAX_PKT_SIZE;        // 有几个完整的包
-        int remainPktSize = frameSize % RTP_MAX_PKT_SIZE; // 剩余不完整包的大小
-        int i, pos = 1;
+    free(session);
+}
 
-        // 发送完整的包
-        for (i = 0; i < pktNum; i++)
-        {
-            // 为了设置分片包的FU Indicator字段
-            rtpPacket->payload[0] = (naluType & 0x60) | 28;
-            // 为了设置分包的UF Header字段
-            rtpPacket->payload[1] = naluType & 0x1F;
-
-            if (i == 0)                                     // 第一包数据
-                rtpPacket->payload[1] |= 0x80;              // start
-            else if (remainPktSize == 0 && i == pktNum - 1) // 最后一包数据
-                rtpPacket->payload[1] |= 0x40;              // end
-
-            memcpy(rtpPacket->payload + 2, frame + pos, RTP_MAX_PKT_SIZE);
-            ret = rtpSendPacketOverUdp(serverRtpSockfd, ip, port, rtpPacket, RTP_MAX_PKT_SIZE + 2);
-            if (ret < 0)
-                return -1;
+// 订阅所有 SETUP 过的轨道，两个轨道在同一次事件回调中加入，从同一个时刻开始发送
+static int startPlay(struct Session *session)
+{
+    int sndBuf = TCP_SNDBUF_SIZE;
+    int i, ret;
 
-            rtpPacket->rtpHeader.seq++;
-            sendBytes += ret;
-            pos += RTP_MAX_PKT_SIZE;
-        }
+    printf("start play\n");
+    printf("client ip:%s\n", session->clientIp);
 
-        // 发送剩余的数据
-        if (remainPktSize > 0)
-        {
-            rtpPacket->payload[0] = (naluType & 0x60) | 28;
-            rtpPacket->payload[1] = naluType & 0x1F;
-            rtpPacket->payload[1] |= 0x40; // end
+    for (i = 0; i < CHANNEL_MAX_TRACKS; i++)
+    {
+        struct SessionTrack *track = &session->tracks[i];
 
-            memcpy(rtpPacket->payload + 2, frame + pos, remainPktSize + 2);
-            ret = rtpSendPacketOverUdp(serverRtpSockfd, ip, port, rtpPacket, remainPktSize + 2);
-            if (ret < 0)
-                return -1;
+        // 没有 SETUP 或者已经在播放
+        if (!track->setup || track->subscriber.next)
+            continue;
 
-            rtpPacket->rtpHeader.seq++;
-            sendBytes += ret;
+        if (track->rtpChannel >= 0)
+        {
+            printf("track%d interleaved channel:%d\n", i, track->rtpChannel);
+            setsockopt(session->clientSockfd, SOL_SOCKET, SO_SNDBUF, &sndBuf, sizeof(sndBuf));
+            ret = channelSubscribeTcp(&liveChannel, &track->subscriber, i,
+                                      &session->out, track->rtpChannel);
+        }
+        else
+        {
+            printf("track%d client port:%d\n", i, track->clientRtpPort);
+            ret = channelSubscribe(&liveChannel, &track->subscriber, i,
+                                   track->serverRtpSockfd, track->serverRtcpSockfd,
+                                   session->clientIp, track->clientRtpPort, track->clientRtcpPort);
         }
-    }
 
-    rtpPacket->rtpHeader.timestamp += 90000 / 25;
-out:
+        if (ret < 0)
+            return -1;
+    }
 
-    return sendBytes;
+    return 0;
 }
 
-static int handleCmd_OPTIONS(char *result, int cseq)
+// 客户端在会话自己的 RTCP 端口上发来的接收报告，同时也说明客户端还在
+// 每个轨道一个 RTCP 端口，收到的包只交给这个轨道的订阅者处理
+static void onSessionRtcpReadable(int fd, uint32_t events, void *arg)
 {
-    sprintf(result, "RTSP/1.0 200 OK\r\n"
-                    "CSeq: %d\r\n"
-                    "Public: OPTIONS, DESCRIBE, SETUP, PLAY\r\n"
-                    "\r\n",
-            cseq);
+    struct Session *session = (struct Session *)arg;
+    struct ChannelSubscriber *receiver = NULL;
+    uint8_t buf[RTCP_MAX_PACKET_SIZE];
+    int len, i;
 
-    return 0;
+    for (i = 0; i < CHANNEL_MAX_TRACKS; i++)
+    {
+        if (session->tracks[i].serverRtpPort > 0 && session->tracks[i].serverRtcpSockfd == fd)
+            receiver = &session->tracks[i].subscriber;
+    }
+
+    while ((len = recv(fd, buf, sizeof(buf), 0)) > 0)
+    {
+        session->lastActiveMs = getMonotonicMs();
+        if (receiver)
+            channelHandleRtcp(&liveChannel, receiver, buf, len);
+    }
 }
 
-static int handleCmd_DESCRIBE(char *result, int cseq, char *url)
+// 连接超时检查：每个请求和 RTCP 报告都会更新 lastActiveMs，
+// 到期时如果期间有过活动就按最近一次活动重新设置定时器，否则关闭连接
+static void onKeepaliveTimer(void *arg)
 {
-    char sdp[500];
-    char localIp[100];
+    struct Session *session = (struct Session *)arg;
+    uint64_t timeoutMs = (uint64_t)config.timeoutSec * 1000;
+    uint64_t idleMs = getMonotonicMs() - session->lastActiveMs;
 
-    sscanf(url, "rtsp://%[^:]:", localIp);
-
-    sprintf(sdp, "v=0\r\n"
-                 "o=- 9%ld 1 IN IP4 %s\r\n"
-                 "t=0 0\r\n"
-                 "a=control:*\r\n"
-                 "m=video 0 RTP/AVP 96\r\n"
-                 "a=rtpmap:96 H264/90000\r\n"
-                 "a=control:track0\r\n",
-            time(NULL), localIp);
+    session->keepaliveTimer = NULL;
 
-    sprintf(result, "RTSP/1.0 200 OK\r\nCSeq: %d\r\n"
-                    "Content-Base: %s\r\n"
-                    "Content-type: application/sdp\r\n"
-                    "Content-length: %zu\r\n\r\n"
-                    "%s",
-            cseq,
-            url,
-            strlen(sdp),
-            sdp);
+    if (idleMs >= timeoutMs)
+    {
+        if (session->sessionId[0])
+            printf("session %s timeout\n", session->sessionId);
+        else
+            printf("idle client %s:%d timeout\n", session->clientIp, session->clientPort);
+        closeSession(session);
+        return;
+    }
 
-    return 0;
+    session->keepaliveTimer = eventLoopAddTimer(&eventLoop, timeoutMs - idleMs, onKeepaliveTimer, session);
 }
 
-static int handleCmd_SETUP(char *result, int cseq, int clientRtpPort)
+// 从 SETUP 的 URL 中取出轨道号
+static int parseTrackIndex(const char *url)
 {
-    sprintf(result, "RTSP/1.0 200 OK\r\n"
-                    "CSeq: %d\r\n"
-                    "Transport: RTP/AVP;unicast;client_port=%d-%d;server_port=%d-%d\r\n"
-                    "Session: 66334873\r\n"
-                    "\r\n",
-            cseq,
-            clientRtpPort,
-            clientRtpPort + 1,
-            SERVER_RTP_PORT,
-            SERVER_RTCP_PORT);
+    const char *p = strstr(url, "/track");
+    int i;
 
-    return 0;
+    if (p && p[6] >= '0' && p[6] <= '9')
+        return atoi(p + 6);
+
+    for (i = 0; i < CHANNEL_MAX_TRACKS; i++)
+    {
+        if (channelHasTrack(&liveChannel, i))
+            return i;
+    }
+
+    return -1;
 }
 
-static int handleCmd_PLAY(char *result, int cseq)
+// SETUP：第一次时分配会话 ID；UDP 传输时再为这个轨道从端口池分配一对端口
+static int setupMediaSession(struct Session *session, struct SessionTrack *track)
 {
-    sprintf(result, "RTSP/1.0 200 OK\r\n"
-                    "CSeq: %d\r\n"
-                    "Range: npt=0.000-\r\n"
-                    "Session: 66334873; timeout=10\r\n\r\n",
-            cseq);
+    int created = 0;
+
+    if (!session->sessionId[0])
+    {
+        if (sessionTableAdd(&sessionTable, session, session->sessionId) < 0)
+            return -1;
+
+        created = 1;
+    }
+
+    track->setup = 1;
+    if (track->rtpChannel >= 0 || track->serverRtpPort > 0)
+        return 0;
+
+    track->serverRtpPort = portPoolAlloc(&portPool, &track->serverRtpSockfd,
+                                         &track->serverRtcpSockfd);
+    if (track->serverRtpPort < 0)
+    {
+        track->setup = 0;
+        printf("no free rtp port, %d in use\n", portPool.usedCount);
+        if (created)
+            releaseMediaSession(session);
+        return -1;
+    }
+
+    fcntl(track->serverRtcpSockfd, F_SETFL, fcntl(track->serverRtcpSockfd, F_GETFL) | O_NONBLOCK);
+    eventLoopAdd(&eventLoop, track->serverRtcpSockfd, EPOLLIN, onSessionRtcpReadable, session);
 
     return 0;
 }
 
-//
-static void doClient(int clientSockfd, const char *clientIP, int clientPort)
+// 处理一个完整的请求，返回 -1 表示需要关闭会话
+static int handleRequest(struct Session *session, const struct RtspRequest *request)
 {
-    // 存储解析出的请求方法的字符串数组
-    char method[40];
+    // 请求的各部分都是指向接收缓冲区的视图，只有需要以 '\0' 结尾的才复制出来
+    struct RtspStr method = request->method;
     // 存储解析出的URL的字符串数组
     char url[100];
-    // 存储解析出的协议版本号的字符串数组
-    char version[40];
     // 存储解析出的请求序列号的整数
-    int CSeq;
+    int CSeq = request->cseq >= 0 ? request->cseq : 0;
+    // 请求中的 Session 头
+    char sessionId[SESSION_ID_SIZE] = {0};
+    // 请求中的 Transport 头，只有 SETUP 才用到
+    int clientRtpPort = 0, clientRtcpPort = 0, rtpChannel = -1;
+    int trackIndex = -1;
+    const struct RtspStr *header;
 
-    int serverRtpSockfd = -1, serverRtcpSockfd = -1;
-    int clientRtpPort, clientRtcpPort;
-    // 用于接收客户端请求消息的缓冲区
-    char *rBuf = (char *)malloc(BUF_MAX_SIZE);
-    // 用于存储服务器相应消息的缓冲区
-    char *sBuf = (char *)malloc(BUF_MAX_SIZE);
+    rtspStrCopy(request->url, url, sizeof(url));
+    printf("%s %.*s %s\n", __FUNCTION__, method.len, method.ptr, url);
 
-    while (1)
+    // 任何请求都算一次保活
+    session->lastActiveMs = getMonotonicMs();
+
+    if ((header = rtspFindHeader(request, "Session")) != NULL)
     {
-        int recvLen;
-        // 从客户端接收请求消息，并存储在rBuf缓冲区中
-        recvLen = recv(clientSockfd, rBuf, BUF_MAX_SIZE, 0);
-        if (recvLen <= 0)
+        // Session: 1A2B3C4D5E6F7081; timeout=60
+        char value[64];
+
+        sscanf(rtspStrCopy(*header, value, sizeof(value)), "%16[0-9A-Fa-f]", sessionId);
+    }
+
+    if ((header = rtspFindHeader(request, "Transport")) != NULL)
+    {
+        // Transport: RTP/AVP/UDP;unicast;client_port=13358-13359
+        // Transport: RTP/AVP;unicast;client_port=13358-13359
+        // Transport: RTP/AVP/TCP;unicast;interleaved=0-1
+        char line[256];
+        char *param;
+        int rtcpChannel;
+
+        rtspStrCopy(*header, line, sizeof(line));
+        if (strstr(line, "RTP/AVP/TCP"))
         {
-            break;
+            // 没有指定通道号时用 -2 表示，SETUP 时视频使用 0-1，音频使用 2-3
+            rtpChannel = -2;
+            if ((param = strstr(line, "interleaved=")) != NULL)
+                sscanf(param, "interleaved=%d-%d", &rtpChannel, &rtcpChannel);
+            if (rtpChannel < 0 || rtpChannel > 254)
+                rtpChannel = -2;
+        }
+        else if ((param = strstr(line, "client_port=")) != NULL &&
+                 sscanf(param, "client_port=%d-%d", &clientRtpPort, &clientRtcpPort) == 2)
+        {
+            rtpChannel = -1;
         }
+        else
+        {
+            // error
+            printf("parse Transport error \n");
+        }
+    }
 
-        rBuf[recvLen] = '\0';
-        printf("%s rBuf = %s \n", __FUNCTION__, rBuf);
+    if (rtspStrEqual(method, "OPTIONS"))
+    {
+        if (handleCmd_OPTIONS(session->sBuf, CSeq))
+        {
+            printf("failed to handle options\n");
+            return -1;
+        }
+    }
+    else if (rtspStrEqual(method, "DESCRIBE"))
+    {
+        if (handleCmd_DESCRIBE(session->sBuf, CSeq, url, &liveChannel))
+        {
+            printf("failed to handle describe\n");
+            return -1;
+        }
+    }
+    else if (sessionId[0] && sessionTableFind(&sessionTable, sessionId) != session)
+    {
+        // 只认本连接上建立的会话
+        handleCmd_Status(session->sBuf, CSeq, 454, "Session Not Found");
+    }
+    else if (rtspStrEqual(method, "SETUP"))
+    {
+        struct SessionTrack *track;
 
-        const char *sep = "\n";
-        char *line = strtok(rBuf, sep);
-        // 根据解析出的方法调用相应的处理函数,并传递相应的参数
-        while (line)
+        // URL 以 track0/track1 结尾，没有时(只有一路的老客户端)取第一个存在的轨道
+        trackIndex = parseTrackIndex(url);
+        if (!channelHasTrack(&liveChannel, trackIndex))
         {
-            if (strstr(line, "OPTIONS") ||
-                strstr(line, "DESCRIBE") ||
-                strstr(line, "SETUP") ||
-                strstr(line, "PLAY"))
-            {
+            handleCmd_Status(session->sBuf, CSeq, 404, "Stream Not Found");
+            goto reply;
+        }
 
-                if (sscanf(line, "%s %s %s\r\n", method, url, version) != 3)
-                {
-                    // error
-                }
-            }
-            else if (strstr(line, "CSeq"))
-            {
-                if (sscanf(line, "CSeq: %d\r\n", &CSeq) != 1)
-                {
-                    // error
-                }
-            }
-            else if (!strncmp(line, "Transport:", strlen("Transport:")))
-            {
-                // Transport: RTP/AVP/UDP;unicast;client_port=13358-13359
-                // Transport: RTP/AVP;unicast;client_port=13358-13359
-
-                if (sscanf(line, "Transport: RTP/AVP/UDP;unicast;client_port=%d-%d\r\n",
-                           &clientRtpPort, &clientRtcpPort) != 2)
-                {
-                    // error
-                    printf("parse Transport error \n");
-                }
-            }
-            line = strtok(NULL, sep);
+        track = &session->tracks[trackIndex];
+        if (!track->setup)
+        {
+            track->rtpChannel = rtpChannel == -2 ? trackIndex * 2 : rtpChannel;
+            track->clientRtpPort = clientRtpPort;
+            track->clientRtcpPort = clientRtcpPort;
         }
 
-        if (!strcmp(method, "OPTIONS"))
+        if (setupMediaSession(session, track) < 0)
+            handleCmd_Status(session->sBuf, CSeq, 503, "Service Unavailable");
+        else if (handleCmd_SETUP(session->sBuf, CSeq, session->sessionId, config.timeoutSec,
+                                 track->clientRtpPort, track->serverRtpPort, track->rtpChannel))
         {
-            if (handleCmd_OPTIONS(sBuf, CSeq))
-            {
-                printf("failed to handle options\n");
-                break;
-            }
+            printf("failed to handle setup\n");
+            return -1;
         }
-        else if (!strcmp(method, "DESCRIBE"))
+    }
+    else if (rtspStrEqual(method, "PLAY"))
+    {
+        if (!session->sessionId[0])
+            handleCmd_Status(session->sBuf, CSeq, 455, "Method Not Valid in This State");
+        else if (handleCmd_PLAY(session->sBuf, CSeq, session->sessionId, config.timeoutSec))
         {
-            if (handleCmd_DESCRIBE(sBuf, CSeq, url))
-            {
-                printf("failed to handle describe\n");
-                break;
-            }
+            printf("failed to handle play\n");
+            return -1;
         }
-        else if (!strcmp(method, "SETUP"))
+    }
+    else if (rtspStrEqual(method, "TEARDOWN") || rtspStrEqual(method, "GET_PARAMETER"))
+    {
+        if (!session->sessionId[0])
+            handleCmd_Status(session->sBuf, CSeq, rtspStrEqual(method, "TEARDOWN") ? 454 : 200,
+                             rtspStrEqual(method, "TEARDOWN") ? "Session Not Found" : "OK");
+        else
+            handleCmd_SessionOK(session->sBuf, CSeq, session->sessionId);
+    }
+    else
+    {
+        printf("未定义的method = %.*s \n", method.len, method.ptr);
+        handleCmd_Status(session->sBuf, CSeq, 501, "Not Implemented");
+    }
+
+reply:
+    printf("%s sBuf = %s \n", __FUNCTION__, session->sBuf);
+
+    // 将处理函数返回的相应消息存储在sBuf缓冲区中
+    // 回复排在已经放进发送队列的 RTP 包后面
+    if (outBufferAppendCopy(&session->out, session->sBuf, strlen(session->sBuf)) < 0 ||
+        outBufferFlush(&session->out) < 0)
+        return -1;
+
+    // 开始播放，之后由直播频道发送RTP包
+    if (rtspStrEqual(method, "PLAY") && session->sessionId[0])
+    {
+        if (startPlay(session) < 0)
+            return -1;
+    }
+
+    // 回复已经排队，之后才释放端口和会话 ID
+    if (rtspStrEqual(method, "TEARDOWN") && session->sessionId[0])
+    {
+        printf("teardown session %s\n", session->sessionId);
+        releaseMediaSession(session);
+    }
+
+    return 0;
+}
+
+// 处理客户端在 RTSP 连接上发来的 interleaved 数据，RTCP 接收报告交给频道，其余丢弃
+// 格式为 '$' + 通道号(1字节) + 长度(2字节) + 数据，数据可能比接收缓冲区还大
+// 返回 0 表示需要收到更多数据
+static int handleInterleaved(struct Session *session, const char *data, int avail)
+{
+    int len;
+
+    if (avail < 4)
+        return 0;
+
+    len = ((uint8_t)data[2] << 8) | (uint8_t)data[3];
+    if (4 + len <= RTSP_MAX_REQUEST_SIZE)
+    {
+        // 能放进接收缓冲区的等收完整再处理
+        if (avail < 4 + len)
+            return 0;
+
+        int i;
+
+        for (i = 0; i < CHANNEL_MAX_TRACKS; i++)
         {
-            if (handleCmd_SETUP(sBuf, CSeq, clientRtpPort))
+            if (session->tracks[i].rtpChannel >= 0 && (uint8_t)data[1] == session->tracks[i].rtpChannel + 1)
             {
-                printf("failed to handle setup\n");
+                session->lastActiveMs = getMonotonicMs();
+                channelHandleRtcp(&liveChannel, &session->tracks[i].subscriber,
+                                  (const uint8_t *)data + 4, len);
                 break;
             }
+        }
+    }
 
-            serverRtpSockfd = createUdpSocket();
-            serverRtcpSockfd = createUdpSocket();
+    session->rSkip = 4 + len;
 
-            if (serverRtpSockfd < 0 || serverRtcpSockfd < 0)
-            {
-                printf("failed to create udp socket\n");
-                break;
-            }
+    return 1;
+}
 
-            if (bindSocketAddr(serverRtpSockfd, ServerIP, SERVER_RTP_PORT) < 0 ||
-                bindSocketAddr(serverRtcpSockfd, ServerIP, SERVER_RTCP_PORT) < 0)
-            {
-                printf("failed to bind addr\n");
-                break;
-            }
+// 处理缓冲区中所有完整的请求，返回 -1 表示需要关闭会话
+static int handleReceived(struct Session *session)
+{
+    struct RtspRequest request;
+    char *data;
+    int avail, n, ret;
+
+    while (session->rOff < session->rLen)
+    {
+        data = session->rBuf + session->rOff;
+        avail = session->rLen - session->rOff;
+
+        if (session->rSkip > 0)
+        {
+            n = session->rSkip < avail ? session->rSkip : avail;
+            session->rSkip -= n;
+            session->rOff += n;
+            continue;
         }
-        else if (!strcmp(method, "PLAY"))
+
+        // interleaved 数据只会出现在两个请求之间
+        if (session->parser.pos == 0 && data[0] == '$')
         {
-            if (handleCmd_PLAY(sBuf, CSeq))
-            {
-                printf("failed to handle play\n");
+            if (!handleInterleaved(session, data, avail))
                 break;
-            }
+            continue;
         }
-        else
-        {
-            printf("未定义的method = %s \n", method);
+
+        // 解析器记得上次扫描到哪里，半个请求不会被重复扫描
+        ret = rtspParse(&session->parser, data, avail, &request);
+        if (ret == RTSP_PARSE_AGAIN)
             break;
+        if (ret == RTSP_PARSE_ERROR)
+        {
+            printf("bad request\n");
+            handleCmd_Status(session->sBuf, 0, 400, "Bad Request");
+            outBufferAppendCopy(&session->out, session->sBuf, strlen(session->sBuf));
+            outBufferFlush(&session->out);
+            return -1;
         }
-        printf("sBuf = %s \n", sBuf);
-        printf("%s sBuf = %s \n", __FUNCTION__, sBuf);
 
-        // 将处理函数返回的相应消息存储在sBuf缓冲区中
-        send(clientSockfd, sBuf, strlen(sBuf), 0);
+        if (handleRequest(session, &request) < 0)
+            return -1;
 
-        // 开始播放，发送RTP包
-        if (!strcmp(method, "PLAY"))
-        {
-            // 存储帧数据的大小和起始码的类型
-            int frameSize, startCode;
-            // 用于存储数据帧
-            char *frame = (char *)malloc(500000);
-            // 用于存储RTP数据包
-            struct RtpPacket *rtpPacket = (struct RtpPacket *)malloc(500000);
-            // 用于打开 H.264视频文件
-            FILE *fp = fopen(H264_FILE_NAME, "rb");
-            if (!fp)
-            {
-                printf("读取 %s 失败\n", H264_FILE_NAME);
-                break;
-            }
-            // 初始化rtpPacket中的RTP头部信息，包括版本号，负载类型
-            rtpHeaderInit(rtpPacket, 0, 0, 0, RTP_VESION, RTP_PAYLOAD_TYPE_H264, 0,
-                          0, 0, 0x88923423);
+        session->rOff += request.length;
+    }
 
-            printf("start play\n");
-            printf("client ip:%s\n", clientIP);
-            printf("client port:%d\n", clientRtpPort);
+    // 把没处理完的数据移到缓冲区开头，解析器的位置是相对请求开头的，不受影响
+    memmove(session->rBuf, session->rBuf + session->rOff, session->rLen - session->rOff);
+    session->rLen -= session->rOff;
+    session->rOff = 0;
 
-            // 从H.264文件中读取帧数据到fram数组中，如果读取失败或已经读取完所有的帧数据就跳出循环
-            while (1)
-            {
-                frameSize = getFrameFromH264File(fp, frame, 500000);
-                if (frameSize < 0)
-                {
-                    printf("读取%s结束,frameSize=%d \n", H264_FILE_NAME, frameSize);
-                    break;
-                }
-
-                // 检查起始码类型
-                if (startCode3(frame))
-                    startCode = 3;
-                else
-                    startCode = 4;
-                // 根据起始码类型调整帧数据的大小，将起始码部分去除
-                frameSize -= startCode;
-                // 使用RTP协议将帧数据发送到客户端的RTP端口
-                rtpSendH264Frame(serverRtpSockfd, clientIP, clientRtpPort,
-                                 rtpPacket, frame + startCode, frameSize);
-
-                // 控制帧的发送速率
-                //  Sleep(40);
-                usleep(40000); // 1000/25 * 1000
-            }
-            // 释放动态分配的内存，包括frame数组和rtpPacket结构体
-            free(frame);
-            free(rtpPacket);
+    return 0;
+}
+
+static void onClientReadable(struct Session *session)
+{
+    int fd = session->clientSockfd;
+    int recvLen;
+
+    while (1)
+    {
+        if (session->rLen >= RTSP_MAX_REQUEST_SIZE)
+        {
+            printf("request too large\n");
+            closeSession(session);
+            return;
+        }
 
+        recvLen = recv(fd, session->rBuf + session->rLen, RTSP_MAX_REQUEST_SIZE - session->rLen, 0);
+        if (recvLen < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
             break;
+        if (recvLen < 0 && errno == EINTR)
+            continue;
+        if (recvLen <= 0)
+        {
+            closeSession(session);
+            return;
+        }
+
+        session->rLen += recvLen;
+
+        if (handleReceived(session) < 0)
+        {
+            closeSession(session);
+            return;
         }
-        // method字符串数组用于存储解析出的请求方法
-        // url字符串数组用于存储解析出的URL
-        // 这里将其之前存储的内容清空，以便下一次请求的处理
-        memset(method, 0, sizeof(method) / sizeof(char));
-        memset(url, 0, sizeof(url) / sizeof(char));
-        // 重置序列号，以便下一次请求的处理
-        CSeq = 0;
     }
+}
+
+static void onClientEvent(int fd, uint32_t events, void *arg)
+{
+    struct Session *session = (struct Session *)arg;
 
-    // 关闭与客户端的套接字连接，释放与客户端通信的资源
-    close(clientSockfd);
-    if (serverRtpSockfd)
+    // 发送队列中积压的数据可以继续发送了
+    if (events & EPOLLOUT)
+        outBufferFlush(&session->out);
+
+    // 频道发送时出错不能当场关闭会话，在这里统一关闭
+    if (session->out.error)
     {
-        close(serverRtpSockfd);
+        closeSession(session);
+        return;
     }
-    if (serverRtcpSockfd > 0)
+
+    if (events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+        onClientReadable(session);
+}
+
+static void onStatsTimer(void *arg)
+{
+    static struct ChannelSubscriberStats stats[MAX_STATS_SESSIONS];
+    uint64_t now = getMonotonicMs();
+    int count, i;
+
+    count = channelSnapshot(&liveChannel, stats, MAX_STATS_SESSIONS);
+    for (i = 0; i < count; i++)
     {
-        close(serverRtcpSockfd);
+        struct RtcpStats *rtcp = &stats[i].rtcp;
+
+        printf("session %s ssrc=%08x %s:%d %s sent=%u/%uB sr=%u rr=%u",
+               stats[i].track == CHANNEL_TRACK_VIDEO ? "video" : "audio", stats[i].ssrc, inet_ntoa(stats[i].addr.sin_addr), ntohs(stats[i].addr.sin_port),
+               stats[i].interleaved ? "tcp" : "udp", rtcp->packetCount, rtcp->octetCount,
+               rtcp->srCount, rtcp->rrCount);
+        if (rtcp->rrCount > 0)
+            printf(" loss=%.1f%% lost=%d jitter=%.1fms rtt=%.1fms rr_age=%llums",
+                   rtcp->fractionLost * 100, rtcp->cumulativeLost, rtcp->jitterMs, rtcp->rttMs,
+                   (unsigned long long)(now - rtcp->lastRrMs));
+        if (stats[i].interleaved)
+            printf(" dropped=%u", stats[i].droppedAus);
+        if (stats[i].firstFrameMs >= 0)
+            printf(" ttff=%.1fms gop=%u", stats[i].firstFrameMs, stats[i].burstFrames);
+        if (stats[i].nackedPackets > 0)
+            printf(" nack=%u rtx=%u rtx_dropped=%u", stats[i].nackedPackets, stats[i].rtxPackets,
+                   stats[i].rtxDropped);
+        printf("\n");
     }
+    if (count > 0)
+        printf("packet pool: used=%d allocated=%d max=%d failures=%u\n", packetPool.usedCount,
+               packetPool.bufferCount, packetPool.maxBuffers, packetPool.allocFailures);
+
+    eventLoopAddTimer(&eventLoop, STATS_INTERVAL_MS, onStatsTimer, NULL);
+}
 
-    free(rBuf);
-    free(sBuf);
+static void onServerReadable(int fd, uint32_t events, void *arg)
+{
+    while (1)
+    {
+        struct Session *session;
+        int clientSockfd;
+        char clientIp[40];
+        int clientPort;
+
+        clientSockfd = acceptClient(fd, clientIp, &clientPort);
+        if (clientSockfd < 0)
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+                printf("failed to accept client\n");
+            return;
+        }
+
+        session = (struct Session *)calloc(1, sizeof(struct Session));
+        if (!session)
+        {
+            close(clientSockfd);
+            continue;
+        }
+
+        session->clientSockfd = clientSockfd;
+        strcpy(session->clientIp, clientIp);
+        session->clientPort = clientPort;
+        initSessionTracks(session);
+        rtspParserInit(&session->parser);
+        outBufferInit(&session->out, &eventLoop, clientSockfd, &packetPool);
+
+        fcntl(clientSockfd, F_SETFL, fcntl(clientSockfd, F_GETFL) | O_NONBLOCK);
+        if (eventLoopAdd(&eventLoop, clientSockfd, EPOLLIN, onClientEvent, session) < 0)
+        {
+            close(clientSockfd);
+            free(session);
+            continue;
+        }
+
+        // 从连接建立开始计时，只连接不发请求的客户端不会一直占着连接
+        session->lastActiveMs = getMonotonicMs();
+        session->keepaliveTimer = eventLoopAddTimer(&eventLoop, config.timeoutSec * 1000,
+                                                    onKeepaliveTimer, session);
+
+        sessionCount++;
+        printf("accept client;client ip:%s,client port:%d,sessions:%d\n",
+               clientIp, clientPort, sessionCount);
+    }
+}
+
+// 解析命令行参数，格式见文件开头
+static int parseArgs(int argc, char *argv[])
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "a:p:r:t:l:g:i")) != -1)
+    {
+        switch (opt)
+        {
+        case 'a':
+            config.bindIp = optarg;
+            break;
+        case 'p':
+            config.port = atoi(optarg);
+            break;
+        case 'r':
+            if (sscanf(optarg, "%d-%d", &config.rtpPortMin, &config.rtpPortMax) != 2)
+                return -1;
+            break;
+        case 't':
+            config.timeoutSec = atoi(optarg);
+            break;
+        case 'l':
+            config.audioLatencyMs = atoi(optarg);
+            break;
+        case 'g':
+            config.gopBurstKBps = atoi(optarg);
+            break;
+        case 'i':
+            config.indexSidecar = 1;
+            break;
+        default:
+            return -1;
+        }
+    }
+
+    if (optind < argc)
+        config.fileName = argv[optind];
+    if (optind + 1 < argc)
+        config.audioFileName = argv[optind + 1];
+
+    if (config.port <= 0 || config.port > 65535 || config.timeoutSec <= 0 || config.audioLatencyMs < 0 ||
+        config.gopBurstKBps < 0 || config.rtpPortMin <= 0 || config.rtpPortMax > 65535 ||
+        config.rtpPortMin >= config.rtpPortMax)
+        return -1;
+
+    return 0;
 }
 
 int main(int argc, char *argv[])
 {
 
     int rtspServerSockfd;
+    char indexFileName[256];
+
+    srand(time(NULL));
+
+    if (parseArgs(argc, argv) < 0)
+    {
+        printf("usage: %s [-a bind_ip] [-p rtsp_port] [-r rtp_port_min-rtp_port_max] [-t timeout_sec] [-l audio_latency_ms] [-g gop_burst_kbytes_per_sec] [-i] [file.h264|file.h265 [file.aac] | file.mp4]\n",
+               argv[0]);
+        return -1;
+    }
+    // -i 时 NALU 索引的缓存文件放在视频文件旁边
+    snprintf(indexFileName, sizeof(indexFileName), "%s.idx", config.fileName);
 
     rtspServerSockfd = createTcpSocket();
     if (rtspServerSockfd < 0)
@@ -549,39 +922,62 @@ int main(int argc, char *argv[])
         return -1;
     }
 
-    if (bindSocketAddr(rtspServerSockfd, ServerIP, SERVER_PORT) < 0)
+    if (bindSocketAddr(rtspServerSockfd, config.bindIp, config.port) < 0)
     {
         printf("failed to bind addr\n");
         return -1;
     }
 
-    if (listen(rtspServerSockfd, 10) < 0)
+    if (listen(rtspServerSockfd, SOMAXCONN) < 0)
     {
         printf("failed to listen\n");
         return -1;
     }
 
-    printf("%s rtsp://%s:%d\n", __FILE__, ServerIP, SERVER_PORT);
+    if (portPoolInit(&portPool, config.bindIp, config.rtpPortMin, config.rtpPortMax) < 0)
+    {
+        printf("invalid rtp port range %d-%d\n", config.rtpPortMin, config.rtpPortMax);
+        return -1;
+    }
+    sessionTableInit(&sessionTable);
 
-    while (1)
+    if (eventLoopInit(&eventLoop) < 0)
     {
-        int clientSockfd;
-        char clientIp[40];
-        int clientPort;
+        printf("failed to create event loop\n");
+        return -1;
+    }
 
-        clientSockfd = acceptClient(rtspServerSockfd, clientIp, &clientPort);
-        if (clientSockfd < 0)
-        {
-            printf("failed to accept client\n");
-            return -1;
-        }
+    packetPoolInit(&packetPool, PACKET_POOL_MAX_BUFFERS);
 
-        printf("accept client;client ip:%s,client port:%d\n", clientIp, clientPort);
+    if (channelInit(&liveChannel, &eventLoop, &packetPool, config.fileName,
+                    config.indexSidecar ? indexFileName : NULL, config.audioFileName) < 0)
+    {
+        printf("failed to open live channel\n");
+        return -1;
+    }
+    liveChannel.audioMaxLatencyMs = config.audioLatencyMs;
+    liveChannel.gopBurstRate = (uint32_t)config.gopBurstKBps * 1024;
 
-        doClient(clientSockfd, clientIp, clientPort);
+    fcntl(rtspServerSockfd, F_SETFL, fcntl(rtspServerSockfd, F_GETFL) | O_NONBLOCK);
+    if (eventLoopAdd(&eventLoop, rtspServerSockfd, EPOLLIN, onServerReadable, NULL) < 0)
+    {
+        printf("failed to add server socket\n");
+        return -1;
     }
 
+    eventLoopAddTimer(&eventLoop, STATS_INTERVAL_MS, onStatsTimer, NULL);
+
+    printf("%s rtsp://%s:%d\n", __FILE__, config.bindIp, config.port);
+    printf("rtp ports %d-%d, session timeout %ds\n", config.rtpPortMin, config.rtpPortMax, config.timeoutSec);
+
+    eventLoopRun(&eventLoop);
+
     // 关闭套接字连接
+    channelDestroy(&liveChannel);
+    packetPoolDestroy(&packetPool);
+    eventLoopDestroy(&eventLoop);
+    sessionTableDestroy(&sessionTable);
+    portPoolDestroy(&portPool);
     close(rtspServerSockfd);
 
     return 0;
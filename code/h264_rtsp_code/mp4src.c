@@ -0,0 +1,281 @@
+#ifdef USE_LIBAVFORMAT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <libavformat/avformat.h>
+#include <libavcodec/bsf.h>
+#include "mp4src.h"
+
+// 解复用得到的码流先写到一个临时文件，之后和 .h264/.aac 文件一样 mmap 进来
+// 这样占用的是可以换出的页缓存，而不是和文件一样大的堆内存
+struct SpoolFile
+{
+    FILE *fp;
+    char name[256];
+    size_t size;
+};
+
+static int spoolOpen(struct SpoolFile *spool)
+{
+    const char *dir = getenv("TMPDIR");
+    int fd;
+
+    snprintf(spool->name, sizeof(spool->name), "%s/rtsp-mp4-XXXXXX", dir ? dir : "/tmp");
+    spool->size = 0;
+    fd = mkstemp(spool->name);
+    if (fd < 0)
+    {
+        spool->fp = NULL;
+        return -1;
+    }
+
+    spool->fp = fdopen(fd, "wb");
+    if (!spool->fp)
+    {
+        close(fd);
+        unlink(spool->name);
+        return -1;
+    }
+
+    return 0;
+}
+
+static int spoolWrite(struct SpoolFile *spool, const uint8_t *data, size_t size)
+{
+    if (fwrite(data, 1, size, spool->fp) != size)
+        return -1;
+    spool->size += size;
+
+    return 0;
+}
+
+// 写完后关闭，返回 -1 表示写入失败
+static int spoolFinish(struct SpoolFile *spool)
+{
+    int ret = fclose(spool->fp);
+
+    spool->fp = NULL;
+
+    return ret == 0 ? 0 : -1;
+}
+
+// 映射之后文件名就没用了，source 关闭时文件随之释放
+static void spoolRemove(struct SpoolFile *spool)
+{
+    if (spool->fp)
+        fclose(spool->fp);
+    spool->fp = NULL;
+    if (spool->name[0])
+        unlink(spool->name);
+    spool->name[0] = '\0';
+}
+
+// 取出过滤器中已经转换好的 Annex-B 数据
+static int drainVideo(AVBSFContext *bsfCtx, AVPacket *pkt, struct SpoolFile *spool)
+{
+    while (av_bsf_receive_packet(bsfCtx, pkt) == 0)
+    {
+        int ret = spoolWrite(spool, pkt->data, pkt->size);
+
+        av_packet_unref(pkt);
+        if (ret < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+// 从 AudioSpecificConfig 中取出 ADTS 头需要的参数
+static int parseAudioConfig(const AVCodecParameters *par, int *profile, int *freqIndex, int *channels)
+{
+    int i;
+
+    if (par->extradata && par->extradata_size >= 2)
+    {
+        *profile = (par->extradata[0] >> 3) - 1;
+        *freqIndex = ((par->extradata[0] & 0x07) << 1) | (par->extradata[1] >> 7);
+        *channels = (par->extradata[1] >> 3) & 0x0F;
+    }
+    else
+    {
+        *profile = 1; // AAC LC
+        *freqIndex = -1;
+        for (i = 0; i < 13; i++)
+        {
+            if (adtsSampleRates[i] == par->sample_rate)
+                *freqIndex = i;
+        }
+#if LIBAVUTIL_VERSION_INT >= AV_VERSION_INT(57, 24, 100)
+        *channels = par->ch_layout.nb_channels;
+#else
+        *channels = par->channels;
+#endif
+    }
+
+    // ADTS 的 profile 只有 2 bit，HE-AAC 等需要扩展配置的格式放不进去
+    if (*profile < 0 || *profile > 3 || *freqIndex < 0 || *freqIndex > 12 ||
+        *channels <= 0 || *channels > 7)
+        return -1;
+
+    return 0;
+}
+
+int mp4Load(const char *fileName, struct AnnexbSource *video, struct AdtsSource *audio,
+            uint32_t *frameRateNum, uint32_t *frameRateDen)
+{
+    AVFormatContext *fmtCtx = NULL;
+    AVBSFContext *bsfCtx = NULL;
+    AVPacket *pkt = NULL;
+    struct SpoolFile videoSpool = {0}, audioSpool = {0};
+    int64_t lastPts = AV_NOPTS_VALUE;
+    int videoIdx, audioIdx;
+    int profile = 0, freqIndex = 0, channels = 0;
+    int ret = -1;
+
+    memset(video, 0, sizeof(*video));
+    video->fd = -1;
+    memset(audio, 0, sizeof(*audio));
+    audio->fd = -1;
+
+    if (avformat_open_input(&fmtCtx, fileName, NULL, NULL) < 0)
+    {
+        printf("failed to open %s\n", fileName);
+        return -1;
+    }
+
+    if (avformat_find_stream_info(fmtCtx, NULL) < 0)
+        goto end;
+
+    av_dump_format(fmtCtx, 0, fileName, 0);
+
+    videoIdx = av_find_best_stream(fmtCtx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0);
+    if (videoIdx >= 0 && fmtCtx->streams[videoIdx]->codecpar->codec_id != AV_CODEC_ID_H264 &&
+        fmtCtx->streams[videoIdx]->codecpar->codec_id != AV_CODEC_ID_HEVC)
+    {
+        printf("video stream is not h264/hevc, ignored\n");
+        videoIdx = -1;
+    }
+
+    audioIdx = av_find_best_stream(fmtCtx, AVMEDIA_TYPE_AUDIO, -1, -1, NULL, 0);
+    if (audioIdx >= 0 && (fmtCtx->streams[audioIdx]->codecpar->codec_id != AV_CODEC_ID_AAC ||
+                          parseAudioConfig(fmtCtx->streams[audioIdx]->codecpar,
+                                           &profile, &freqIndex, &channels) < 0))
+    {
+        printf("audio stream is not aac lc, ignored\n");
+        audioIdx = -1;
+    }
+
+    if (videoIdx < 0 && audioIdx < 0)
+        goto end;
+
+    if (videoIdx >= 0)
+    {
+        AVStream *st = fmtCtx->streams[videoIdx];
+        int hevc = st->codecpar->codec_id == AV_CODEC_ID_HEVC;
+        const AVBitStreamFilter *bsf = av_bsf_get_by_name(hevc ? "hevc_mp4toannexb" : "h264_mp4toannexb");
+        AVRational rate = st->avg_frame_rate.num > 0 ? st->avg_frame_rate : st->r_frame_rate;
+
+        // 时间戳按解码顺序逐帧递增，带 B 帧的视频显示顺序不同，这样发出去画面会错乱
+        if (st->codecpar->video_delay > 0)
+        {
+            printf("video stream has b-frames (has_b_frames=%d), not supported\n", st->codecpar->video_delay);
+            goto end;
+        }
+
+        // MP4 中的 NALU 以长度开头，参数集在 extradata 里，转换成带起始码的码流，关键帧前插入参数集
+        if (!bsf || av_bsf_alloc(bsf, &bsfCtx) < 0 ||
+            avcodec_parameters_copy(bsfCtx->par_in, st->codecpar) < 0)
+            goto end;
+        bsfCtx->time_base_in = st->time_base;
+        if (av_bsf_init(bsfCtx) < 0)
+            goto end;
+
+        if (rate.num > 0 && rate.den > 0)
+        {
+            *frameRateNum = rate.num;
+            *frameRateDen = rate.den;
+        }
+    }
+
+    pkt = av_packet_alloc();
+    if (!pkt)
+        goto end;
+
+    if ((videoIdx >= 0 && spoolOpen(&videoSpool) < 0) || (audioIdx >= 0 && spoolOpen(&audioSpool) < 0))
+    {
+        printf("failed to create temporary file for %s\n", fileName);
+        goto end;
+    }
+
+    while (av_read_frame(fmtCtx, pkt) >= 0)
+    {
+        if (pkt->stream_index == videoIdx)
+        {
+            // 有的文件不标记 has_b_frames，解码顺序中 PTS 往回走也说明有 B 帧
+            if (pkt->pts != AV_NOPTS_VALUE && lastPts != AV_NOPTS_VALUE && pkt->pts < lastPts)
+            {
+                printf("video stream has b-frames (pts out of decode order), not supported\n");
+                av_packet_unref(pkt);
+                goto end;
+            }
+            if (pkt->pts != AV_NOPTS_VALUE)
+                lastPts = pkt->pts;
+
+            // 过滤器接管 pkt 中的数据
+            if (av_bsf_send_packet(bsfCtx, pkt) < 0 || drainVideo(bsfCtx, pkt, &videoSpool) < 0)
+            {
+                av_packet_unref(pkt);
+                goto end;
+            }
+        }
+        else if (pkt->stream_index == audioIdx && pkt->size > 0 &&
+                 pkt->size + ADTS_HEADER_SIZE <= 0x1FFF)
+        {
+            uint8_t header[ADTS_HEADER_SIZE];
+
+            // ADTS 的 frame_length 只有 13 bit
+            adtsWriteHeader(header, profile, freqIndex, channels, pkt->size);
+            if (spoolWrite(&audioSpool, header, sizeof(header)) < 0 ||
+                spoolWrite(&audioSpool, pkt->data, pkt->size) < 0)
+            {
+                av_packet_unref(pkt);
+                goto end;
+            }
+        }
+
+        av_packet_unref(pkt);
+    }
+
+    if (bsfCtx && (av_bsf_send_packet(bsfCtx, NULL) < 0 || drainVideo(bsfCtx, pkt, &videoSpool) < 0))
+        goto end;
+
+    if ((videoSpool.fp && spoolFinish(&videoSpool) < 0) || (audioSpool.fp && spoolFinish(&audioSpool) < 0))
+    {
+        printf("failed to write temporary file for %s\n", fileName);
+        goto end;
+    }
+
+    // 和读取 .h264/.aac 文件一样映射进来，索引只在内存中
+    if (videoSpool.size > 0 && annexbOpen(video, videoSpool.name, NULL) < 0)
+        printf("no video frame in %s\n", fileName);
+    else if (videoSpool.size > 0 && fmtCtx->streams[videoIdx]->codecpar->codec_id == AV_CODEC_ID_HEVC)
+        video->codec = NALU_CODEC_H265;
+
+    if (audioSpool.size > 0 && adtsOpen(audio, audioSpool.name) < 0)
+        printf("no aac frame in %s\n", fileName);
+
+    ret = (video->data || audio->data) ? 0 : -1;
+
+end:
+    spoolRemove(&videoSpool);
+    spoolRemove(&audioSpool);
+    av_packet_free(&pkt);
+    av_bsf_free(&bsfCtx);
+    avformat_close_input(&fmtCtx);
+
+    return ret;
+}
+
+#endif
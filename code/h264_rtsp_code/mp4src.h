@@ -0,0 +1,18 @@
+#ifndef _MP4SRC_H_
+#define _MP4SRC_H_
+
+#include <stdint.h>
+#include "nalu.h"
+#include "adts.h"
+
+// 用 libavformat 读取 MP4 等容器中的 H.264/H.265 视频和 AAC 音频，编译时需要定义 USE_LIBAVFORMAT
+// 启动时用 av_read_frame() 把整个文件解复用一遍：视频经过 h264_mp4toannexb/hevc_mp4toannexb 转换成 Annex-B，
+// 音频加上 ADTS 头，分别写到临时文件中(打开后就删除文件名)，再像 .h264/.aac 文件一样 mmap 成 AnnexbSource 和 AdtsSource
+// 之后按索引取帧，报文负载可以一直指向映射的内存，不会占用和文件一样大的堆内存
+// 时间戳仍然按帧率和采样数计算，带 B 帧(PTS 和解码顺序不同)的视频在启动时报错返回 -1
+// 文件中没有的轨道对应的 source 保持关闭(data 为 NULL)，两个都没有时返回 -1
+// 容器中有平均帧率时写到 frameRateNum/frameRateDen，否则不修改
+int mp4Load(const char *fileName, struct AnnexbSource *video, struct AdtsSource *audio,
+            uint32_t *frameRateNum, uint32_t *frameRateDen);
+
+#endif
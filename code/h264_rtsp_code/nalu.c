@@ -0,0 +1,753 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "nalu.h"
+
+// 索引缓存文件的头部，文件大小和修改时间与码流文件一致时才认为有效
+struct NaluIndexFileHeader
+{
+    char magic[4]; // "NIDX"
+    uint32_t version;
+    uint64_t fileSize;
+    int64_t fileMtime;
+    uint32_t naluCount;
+    uint32_t reserved;
+};
+
+#define NALU_INDEX_VERSION 1
+
+// 判断前三个元素是否分别为 0 0 1
+// 用于标识帧开始或编码参数等信息
+static inline int startCode3(const uint8_t *buf)
+{
+    if (buf[0] == 0 && buf[1] == 0 && buf[2] == 1)
+        return 1;
+    else
+        return 0;
+}
+
+// 以下几个函数都返回 buf 中第一个完整的 00 00 01 的位置
+// 标量版本：先看第三个字节，大于 1 时前三个位置都不可能是起始码，直接跳过 3 个字节
+static const uint8_t *findStartCode3C(const uint8_t *buf, size_t len)
+{
+    size_t i = 0;
+
+    while (i + 2 < len)
+    {
+        if (buf[i + 2] > 1)
+            i += 3;
+        else if (buf[i + 2] == 0)
+            i++;
+        else if (buf[i + 1] == 0 && buf[i] == 0)
+            return buf + i;
+        else
+            i += 3;
+    }
+
+    return NULL;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+// SSE2 版本：一次比较 16 个位置，b[i] == 0 && b[i+1] == 0 && b[i+2] == 1
+__attribute__((target("sse2"))) static const uint8_t *findStartCode3SSE2(const uint8_t *buf, size_t len)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i one = _mm_set1_epi8(1);
+    size_t i = 0;
+
+    for (; i + 16 + 2 <= len; i += 16)
+    {
+        __m128i v0 = _mm_loadu_si128((const __m128i *)(buf + i));
+        __m128i v1 = _mm_loadu_si128((const __m128i *)(buf + i + 1));
+        __m128i v2 = _mm_loadu_si128((const __m128i *)(buf + i + 2));
+        __m128i m = _mm_and_si128(_mm_and_si128(_mm_cmpeq_epi8(v0, zero), _mm_cmpeq_epi8(v1, zero)),
+                                  _mm_cmpeq_epi8(v2, one));
+        int mask = _mm_movemask_epi8(m);
+
+        if (mask)
+            return buf + i + __builtin_ctz(mask);
+    }
+
+    return findStartCode3C(buf + i, len - i);
+}
+
+// AVX2 版本：每次处理一个 64 字节的缓存行，没有候选位置时只需要一次判断
+__attribute__((target("avx2"))) static const uint8_t *findStartCode3AVX2(const uint8_t *buf, size_t len)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i one = _mm256_set1_epi8(1);
+    size_t i = 0;
+
+    for (; i + 64 + 2 <= len; i += 64)
+    {
+        __m256i a0 = _mm256_loadu_si256((const __m256i *)(buf + i));
+        __m256i a1 = _mm256_loadu_si256((const __m256i *)(buf + i + 1));
+        __m256i a2 = _mm256_loadu_si256((const __m256i *)(buf + i + 2));
+        __m256i b0 = _mm256_loadu_si256((const __m256i *)(buf + i + 32));
+        __m256i b1 = _mm256_loadu_si256((const __m256i *)(buf + i + 33));
+        __m256i b2 = _mm256_loadu_si256((const __m256i *)(buf + i + 34));
+        __m256i ma = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(a0, zero), _mm256_cmpeq_epi8(a1, zero)),
+                                      _mm256_cmpeq_epi8(a2, one));
+        __m256i mb = _mm256_and_si256(_mm256_and_si256(_mm256_cmpeq_epi8(b0, zero), _mm256_cmpeq_epi8(b1, zero)),
+                                      _mm256_cmpeq_epi8(b2, one));
+
+        if (!_mm256_testz_si256(_mm256_or_si256(ma, mb), _mm256_or_si256(ma, mb)))
+        {
+            uint32_t maskA = (uint32_t)_mm256_movemask_epi8(ma);
+            uint32_t maskB = (uint32_t)_mm256_movemask_epi8(mb);
+
+            if (maskA)
+                return buf + i + __builtin_ctz(maskA);
+
+            return buf + i + 32 + __builtin_ctz(maskB);
+        }
+    }
+
+    return findStartCode3C(buf + i, len - i);
+}
+#endif
+
+static const uint8_t *(*findStartCode3)(const uint8_t *buf, size_t len) = NULL;
+
+// 第一次使用时按 CPU 支持的指令集选择实现
+static void initStartCodeScanner(void)
+{
+    findStartCode3 = findStartCode3C;
+
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        findStartCode3 = findStartCode3AVX2;
+    else if (__builtin_cpu_supports("sse2"))
+        findStartCode3 = findStartCode3SSE2;
+#endif
+}
+
+int naluSetScanner(int scanner)
+{
+    switch (scanner)
+    {
+    case NALU_SCANNER_AUTO:
+        initStartCodeScanner();
+        return 0;
+    case NALU_SCANNER_C:
+        findStartCode3 = findStartCode3C;
+        return 0;
+#if defined(__x86_64__) || defined(__i386__)
+    case NALU_SCANNER_SSE2:
+        __builtin_cpu_init();
+        if (!__builtin_cpu_supports("sse2"))
+            return -1;
+        findStartCode3 = findStartCode3SSE2;
+        return 0;
+    case NALU_SCANNER_AVX2:
+        __builtin_cpu_init();
+        if (!__builtin_cpu_supports("avx2"))
+            return -1;
+        findStartCode3 = findStartCode3AVX2;
+        return 0;
+#endif
+    default:
+        return -1;
+    }
+}
+
+const uint8_t *findNextStartCode(const uint8_t *buf, size_t len)
+{
+    const uint8_t *pos;
+
+    if (!findStartCode3)
+        initStartCodeScanner();
+
+    pos = findStartCode3(buf, len);
+
+    // 00 00 00 01 也会先匹配到后面的 00 00 01，这时起始码从前一个字节开始
+    if (pos && pos > buf && pos[-1] == 0)
+        return pos - 1;
+
+    return pos;
+}
+
+// 按位读取 RBSP，用于解析 SPS 中的指数哥伦布编码
+struct BitReader
+{
+    const uint8_t *data;
+    uint32_t size; // 字节数
+    uint32_t pos;  // 已读取的位数
+    int error;     // 遇到了超过 32 位的指数哥伦布码
+};
+
+static uint32_t readBits(struct BitReader *br, int n)
+{
+    uint32_t value = 0;
+
+    while (n-- > 0)
+    {
+        value <<= 1;
+        if (br->pos < br->size * 8)
+            value |= (br->data[br->pos >> 3] >> (7 - (br->pos & 7))) & 1;
+        br->pos++;
+    }
+
+    return value;
+}
+
+// ue(v)，最多 31 个前导 0，再多就不是合法的 ue(v)(也可能已经读到了数据之外)，
+// 记下错误由调用者丢弃整个参数集，而不是去算 1u << 32
+static uint32_t readUe(struct BitReader *br)
+{
+    int zeros = 0;
+
+    while (readBits(br, 1) == 0)
+    {
+        if (++zeros > 31)
+        {
+            br->error = 1;
+            return 0;
+        }
+    }
+
+    if (zeros == 0)
+        return 0;
+
+    return ((1u << zeros) - 1) + readBits(br, zeros);
+}
+
+// se(v)
+static int32_t readSe(struct BitReader *br)
+{
+    uint32_t value = readUe(br);
+
+    if (value & 1)
+        return (int32_t)((value + 1) / 2);
+
+    return -(int32_t)(value / 2);
+}
+
+static void skipScalingList(struct BitReader *br, int size)
+{
+    int lastScale = 8, nextScale = 8, i;
+
+    for (i = 0; i < size; i++)
+    {
+        if (nextScale != 0)
+            nextScale = (lastScale + readSe(br) + 256) % 256;
+        lastScale = nextScale == 0 ? lastScale : nextScale;
+    }
+}
+
+static void skipBits(struct BitReader *br, int n)
+{
+    br->pos += n;
+}
+
+// 去掉 NALU 头之后的防竞争字节 00 00 03，最多保留 size 字节，返回 RBSP 的长度
+static uint32_t naluToRbsp(const uint8_t *nalu, uint32_t naluSize, uint32_t headerSize,
+                           uint8_t *rbsp, uint32_t size)
+{
+    uint32_t rbspSize = 0, i;
+
+    for (i = headerSize; i < naluSize && rbspSize < size; i++)
+    {
+        if (i >= headerSize + 2 && nalu[i] == 3 && nalu[i - 1] == 0 && nalu[i - 2] == 0)
+            continue;
+        rbsp[rbspSize++] = nalu[i];
+    }
+
+    return rbspSize;
+}
+
+int h264ParseSps(const uint8_t *nalu, uint32_t size, struct H264SpsInfo *info)
+{
+    uint8_t rbsp[256];
+    struct BitReader br;
+    uint32_t i;
+    int chromaFormatIdc = 1, frameMbsOnly;
+    uint32_t picOrderCntType, widthInMbs, heightInMapUnits;
+    uint32_t cropLeft = 0, cropRight = 0, cropTop = 0, cropBottom = 0;
+
+    memset(info, 0, sizeof(*info));
+
+    if (size < 4 || (nalu[0] & 0x1F) != 7)
+        return -1;
+
+    br.data = rbsp;
+    br.size = naluToRbsp(nalu, size, 1, rbsp, sizeof(rbsp));
+    br.pos = 0;
+    br.error = 0;
+
+    info->profileIdc = readBits(&br, 8);
+    readBits(&br, 8); // constraint_set_flags
+    info->levelIdc = readBits(&br, 8);
+    readUe(&br); // seq_parameter_set_id
+
+    if (info->profileIdc == 100 || info->profileIdc == 110 || info->profileIdc == 122 ||
+        info->profileIdc == 244 || info->profileIdc == 44 || info->profileIdc == 83 ||
+        info->profileIdc == 86 || info->profileIdc == 118 || info->profileIdc == 128 ||
+        info->profileIdc == 138 || info->profileIdc == 139 || info->profileIdc == 134 ||
+        info->profileIdc == 135)
+    {
+        chromaFormatIdc = readUe(&br);
+        if (chromaFormatIdc == 3)
+            readBits(&br, 1); // separate_colour_plane_flag
+        readUe(&br);          // bit_depth_luma_minus8
+        readUe(&br);          // bit_depth_chroma_minus8
+        readBits(&br, 1);     // qpprime_y_zero_transform_bypass_flag
+        if (readBits(&br, 1)) // seq_scaling_matrix_present_flag
+        {
+            for (i = 0; i < (chromaFormatIdc != 3 ? 8u : 12u); i++)
+            {
+                if (readBits(&br, 1))
+                    skipScalingList(&br, i < 6 ? 16 : 64);
+            }
+        }
+    }
+
+    readUe(&br); // log2_max_frame_num_minus4
+    picOrderCntType = readUe(&br);
+    if (picOrderCntType == 0)
+    {
+        readUe(&br); // log2_max_pic_order_cnt_lsb_minus4
+    }
+    else if (picOrderCntType == 1)
+    {
+        uint32_t cycle;
+
+        readBits(&br, 1); // delta_pic_order_always_zero_flag
+        readSe(&br);      // offset_for_non_ref_pic
+        readSe(&br);      // offset_for_top_to_bottom_field
+        cycle = readUe(&br);
+        for (i = 0; i < cycle && i < 256; i++)
+            readSe(&br);
+    }
+
+    readUe(&br);      // max_num_ref_frames
+    readBits(&br, 1); // gaps_in_frame_num_value_allowed_flag
+    widthInMbs = readUe(&br) + 1;
+    heightInMapUnits = readUe(&br) + 1;
+    frameMbsOnly = readBits(&br, 1);
+    if (!frameMbsOnly)
+        readBits(&br, 1); // mb_adaptive_frame_field_flag
+    readBits(&br, 1);     // direct_8x8_inference_flag
+    if (readBits(&br, 1)) // frame_cropping_flag
+    {
+        cropLeft = readUe(&br);
+        cropRight = readUe(&br);
+        cropTop = readUe(&br);
+        cropBottom = readUe(&br);
+    }
+
+    // 裁剪单位按 4:2:0 计算，其他格式只影响显示的宽高
+    info->width = widthInMbs * 16 - (cropLeft + cropRight) * 2;
+    info->height = (2 - frameMbsOnly) * heightInMapUnits * 16 - (cropTop + cropBottom) * 2 * (2 - frameMbsOnly);
+
+    if (readBits(&br, 1)) // vui_parameters_present_flag
+    {
+        if (readBits(&br, 1)) // aspect_ratio_info_present_flag
+        {
+            if (readBits(&br, 8) == 255) // Extended_SAR
+                readBits(&br, 32);
+        }
+        if (readBits(&br, 1)) // overscan_info_present_flag
+            readBits(&br, 1);
+        if (readBits(&br, 1)) // video_signal_type_present_flag
+        {
+            readBits(&br, 4);
+            if (readBits(&br, 1)) // colour_description_present_flag
+                readBits(&br, 24);
+        }
+        if (readBits(&br, 1)) // chroma_loc_info_present_flag
+        {
+            readUe(&br);
+            readUe(&br);
+        }
+        info->timingInfoPresent = readBits(&br, 1);
+        if (info->timingInfoPresent)
+        {
+            info->numUnitsInTick = readBits(&br, 32);
+            info->timeScale = readBits(&br, 32);
+        }
+    }
+
+    // 读到了数据之外，说明 SPS 不完整；或者其中有非法的 ue(v)
+    if (br.error || br.pos > br.size * 8)
+        return -1;
+
+    return 0;
+}
+
+// profile_tier_level(1, maxSubLayersMinus1)，只跳过不解析
+static void skipProfileTierLevel(struct BitReader *br, int maxSubLayersMinus1)
+{
+    int profilePresent[8], levelPresent[8], i;
+
+    // general_profile_space 到 general_inbld_flag 共 88 bit，再加 general_level_idc
+    skipBits(br, 88 + 8);
+
+    for (i = 0; i < maxSubLayersMinus1; i++)
+    {
+        profilePresent[i] = readBits(br, 1);
+        levelPresent[i] = readBits(br, 1);
+    }
+    if (maxSubLayersMinus1 > 0)
+        skipBits(br, 2 * (8 - maxSubLayersMinus1)); // reserved_zero_2bits
+
+    for (i = 0; i < maxSubLayersMinus1; i++)
+    {
+        if (profilePresent[i])
+            skipBits(br, 88);
+        if (levelPresent[i])
+            skipBits(br, 8);
+    }
+}
+
+int h265ParseVps(const uint8_t *nalu, uint32_t size, struct H265VpsInfo *info)
+{
+    uint8_t rbsp[256];
+    struct BitReader br;
+    int maxSubLayersMinus1, subLayerOrderingInfo, maxLayerId, i;
+    uint32_t numLayerSetsMinus1;
+
+    memset(info, 0, sizeof(*info));
+
+    if (size < 6 || h265NaluType(nalu[0]) != H265_NAL_VPS)
+        return -1;
+
+    br.data = rbsp;
+    br.size = naluToRbsp(nalu, size, 2, rbsp, sizeof(rbsp));
+    br.pos = 0;
+    br.error = 0;
+
+    // vps_video_parameter_set_id、vps_base_layer_internal_flag、vps_base_layer_available_flag、
+    // vps_max_layers_minus1
+    skipBits(&br, 4 + 1 + 1 + 6);
+    maxSubLayersMinus1 = readBits(&br, 3);
+    info->maxSubLayers = maxSubLayersMinus1 + 1;
+    skipBits(&br, 1 + 16); // vps_temporal_id_nesting_flag、vps_reserved_0xffff_16bits
+
+    skipProfileTierLevel(&br, maxSubLayersMinus1);
+
+    subLayerOrderingInfo = readBits(&br, 1);
+    for (i = subLayerOrderingInfo ? 0 : maxSubLayersMinus1; i <= maxSubLayersMinus1; i++)
+    {
+        readUe(&br); // vps_max_dec_pic_buffering_minus1
+        readUe(&br); // vps_max_num_reorder_pics
+        readUe(&br); // vps_max_latency_increase_plus1
+    }
+
+    maxLayerId = readBits(&br, 6);
+    numLayerSetsMinus1 = readUe(&br);
+    if (numLayerSetsMinus1 > 1023)
+        return -1;
+    skipBits(&br, numLayerSetsMinus1 * (maxLayerId + 1)); // layer_id_included_flag
+
+    info->timingInfoPresent = readBits(&br, 1);
+    if (info->timingInfoPresent)
+    {
+        info->numUnitsInTick = readBits(&br, 32);
+        info->timeScale = readBits(&br, 32);
+    }
+
+    if (br.error || br.pos > br.size * 8)
+        return -1;
+
+    return 0;
+}
+
+// 扫描整个文件，记录每个 NALU 的位置、大小和类型
+static int annexbBuildIndex(struct AnnexbSource *source)
+{
+    const uint8_t *end = source->data + source->size;
+    const uint8_t *cur, *next;
+    int capacity = 1024;
+
+    source->naluCount = 0;
+    source->nalus = (struct NaluIndexEntry *)malloc(capacity * sizeof(struct NaluIndexEntry));
+    if (!source->nalus)
+        return -1;
+
+    cur = findNextStartCode(source->data, source->size);
+    while (cur)
+    {
+        struct NaluIndexEntry *entry;
+        int startCodeLen = startCode3(cur) ? 3 : 4;
+        const uint8_t *nalu = cur + startCodeLen;
+
+        next = findNextStartCode(nalu, end - nalu);
+
+        if (source->naluCount == capacity)
+        {
+            struct NaluIndexEntry *nalus;
+
+            capacity *= 2;
+            nalus = (struct NaluIndexEntry *)realloc(source->nalus, capacity * sizeof(struct NaluIndexEntry));
+            if (!nalus)
+                return -1;
+            source->nalus = nalus;
+        }
+
+        entry = &source->nalus[source->naluCount];
+        memset(entry, 0, sizeof(*entry));
+        entry->offset = nalu - source->data;
+        entry->size = (next ? next : end) - nalu;
+        entry->header = entry->size > 0 ? nalu[0] : 0;
+        entry->startCodeLen = startCodeLen;
+
+        if (entry->size > 0)
+            source->naluCount++;
+
+        cur = next;
+    }
+
+    return 0;
+}
+
+static int annexbLoadIndex(struct AnnexbSource *source, const char *indexFileName,
+                           const struct stat *st)
+{
+    struct NaluIndexFileHeader header;
+    FILE *fp;
+    int i;
+
+    fp = fopen(indexFileName, "rb");
+    if (!fp)
+        return -1;
+
+    if (fread(&header, sizeof(header), 1, fp) != 1 ||
+        memcmp(header.magic, "NIDX", 4) != 0 ||
+        header.version != NALU_INDEX_VERSION ||
+        header.fileSize != (uint64_t)st->st_size ||
+        header.fileMtime != (int64_t)st->st_mtime)
+    {
+        fclose(fp);
+        return -1;
+    }
+
+    source->nalus = (struct NaluIndexEntry *)malloc((header.naluCount + 1) * sizeof(struct NaluIndexEntry));
+    if (!source->nalus ||
+        fread(source->nalus, sizeof(struct NaluIndexEntry), header.naluCount, fp) != header.naluCount)
+    {
+        free(source->nalus);
+        source->nalus = NULL;
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    // 索引文件可能被篡改，确保每一项都落在映射范围内
+    for (i = 0; i < (int)header.naluCount; i++)
+    {
+        if (source->nalus[i].offset > source->size ||
+            source->nalus[i].size > source->size - source->nalus[i].offset)
+        {
+            free(source->nalus);
+            source->nalus = NULL;
+            return -1;
+        }
+    }
+
+    source->naluCount = header.naluCount;
+
+    return 0;
+}
+
+static void annexbSaveIndex(struct AnnexbSource *source, const char *indexFileName,
+                            const struct stat *st)
+{
+    struct NaluIndexFileHeader header;
+    FILE *fp;
+    int ok;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, "NIDX", 4);
+    header.version = NALU_INDEX_VERSION;
+    header.fileSize = st->st_size;
+    header.fileMtime = st->st_mtime;
+    header.naluCount = source->naluCount;
+
+    // 写不了(比如只读目录)就只用内存中的索引，下次启动重新扫描
+    fp = fopen(indexFileName, "wb");
+    if (!fp)
+        return;
+
+    ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+         fwrite(source->nalus, sizeof(struct NaluIndexEntry), source->naluCount, fp) == (size_t)source->naluCount;
+
+    // 写了一半的文件加载时也会被发现，这里直接删掉
+    if (fclose(fp) != 0 || !ok)
+        unlink(indexFileName);
+}
+
+int annexbOpen(struct AnnexbSource *source, const char *fileName, const char *indexFileName)
+{
+    struct stat st;
+    void *data;
+
+    memset(source, 0, sizeof(*source));
+    source->fd = -1;
+
+    source->fd = open(fileName, O_RDONLY);
+    if (source->fd < 0)
+        return -1;
+
+    if (fstat(source->fd, &st) < 0 || st.st_size == 0)
+    {
+        annexbClose(source);
+        return -1;
+    }
+
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, source->fd, 0);
+    if (data == MAP_FAILED)
+    {
+        annexbClose(source);
+        return -1;
+    }
+    source->data = (const uint8_t *)data;
+    source->size = st.st_size;
+
+    if (indexFileName && annexbLoadIndex(source, indexFileName, &st) == 0)
+        return 0;
+
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    if (annexbBuildIndex(source) < 0 || source->naluCount == 0)
+    {
+        annexbClose(source);
+        return -1;
+    }
+    madvise(data, st.st_size, MADV_NORMAL);
+
+    if (indexFileName)
+        annexbSaveIndex(source, indexFileName, &st);
+
+    return 0;
+}
+
+void annexbClose(struct AnnexbSource *source)
+{
+    if (source->data)
+        munmap((void *)source->data, source->size);
+    if (source->fd >= 0)
+        close(source->fd);
+    free(source->nalus);
+
+    memset(source, 0, sizeof(*source));
+    source->fd = -1;
+}
+
+int annexbNext(struct AnnexbSource *source, const uint8_t **nalu, uint32_t *size)
+{
+    struct NaluIndexEntry *entry;
+
+    if (source->cursor >= source->naluCount)
+        return -1;
+
+    entry = &source->nalus[source->cursor];
+    *nalu = source->data + entry->offset;
+    *size = entry->size;
+
+    return source->cursor++;
+}
+
+// 参考 H.264 7.4.1.2.3：出现过 slice 之后，遇到 SEI/SPS/PPS/AUD 等，
+// 或者 first_mb_in_slice 为 0 的 slice(头部之后的第一个 bit 为 1)，就是下一个访问单元
+static int h264StartsAccessUnit(struct AnnexbSource *source, struct NaluIndexEntry *entry, int *vcl)
+{
+    int type = entry->header & 0x1F;
+
+    *vcl = type >= 1 && type <= 5;
+    if (*vcl)
+        return entry->size > 1 && (source->data[entry->offset + 1] & 0x80);
+
+    return type == 6 || type == 7 || type == 8 || type == 9 || (type >= 14 && type <= 18);
+}
+
+// 参考 H.265 7.4.2.4.4：出现过 slice 之后，遇到 VPS/SPS/PPS/AUD/前缀 SEI 等，
+// 或者 first_slice_segment_in_pic_flag 为 1 的 slice(2 字节头部之后的第一个 bit)，就是下一个访问单元
+static int h265StartsAccessUnit(struct AnnexbSource *source, struct NaluIndexEntry *entry, int *vcl)
+{
+    int type = h265NaluType(entry->header);
+
+    *vcl = type < 32;
+    if (*vcl)
+        return entry->size > 2 && (source->data[entry->offset + 2] & 0x80);
+
+    return (type >= H265_NAL_VPS && type <= H265_NAL_AUD) || type == H265_NAL_PREFIX_SEI ||
+           (type >= 41 && type <= 44) || (type >= 48 && type <= 55);
+}
+
+int annexbNextAccessUnit(struct AnnexbSource *source, int *first)
+{
+    int i, vcl, starts, seenVcl = 0;
+
+    if (source->cursor >= source->naluCount)
+        return -1;
+
+    for (i = source->cursor; i < source->naluCount; i++)
+    {
+        struct NaluIndexEntry *entry = &source->nalus[i];
+
+        if (source->codec == NALU_CODEC_H265)
+            starts = h265StartsAccessUnit(source, entry, &vcl);
+        else
+            starts = h264StartsAccessUnit(source, entry, &vcl);
+
+        if (seenVcl && starts)
+            break;
+
+        if (vcl)
+            seenVcl = 1;
+    }
+
+    *first = source->cursor;
+    source->cursor = i;
+
+    return i - *first;
+}
+
+int annexbSeek(struct AnnexbSource *source, int index)
+{
+    if (index < 0 || index > source->naluCount)
+        return -1;
+
+    source->cursor = index;
+
+    return 0;
+}
+
+int annexbSeekKeyFrame(struct AnnexbSource *source, int index)
+{
+    int h265 = source->codec == NALU_CODEC_H265;
+    int i, type;
+
+    if (index >= source->naluCount)
+        index = source->naluCount - 1;
+
+    // 先找到 IDR
+    for (i = index; i >= 0; i--)
+    {
+        type = h265 ? h265NaluType(source->nalus[i].header) : source->nalus[i].header & 0x1F;
+        if (h265 ? type >= H265_NAL_IRAP_MIN && type <= H265_NAL_IRAP_MAX : type == 5)
+            break;
+    }
+    if (i < 0)
+        return annexbSeek(source, 0);
+
+    // 再带上它前面同一个访问单元里的 AUD/参数集/SEI，遇到上一帧的数据就停
+    // 这里没有参数集时客户端用 SDP 中的参数集(H.264 的 sprop-parameter-sets，H.265 的 sprop-vps/sps/pps)，
+    // 也能从这个 IDR 帧开始解码
+    while (i > 0)
+    {
+        type = h265 ? h265NaluType(source->nalus[i - 1].header) : source->nalus[i - 1].header & 0x1F;
+        if (h265 ? type < 32 : type >= 1 && type <= 5)
+            break;
+        i--;
+    }
+
+    return annexbSeek(source, i);
+}
@@ -0,0 +1,104 @@
+#ifndef _NALU_H_
+#define _NALU_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+// 码流的编码格式，决定 NALU 类型的解析和访问单元的划分
+#define NALU_CODEC_H264 0
+#define NALU_CODEC_H265 1
+
+// H.265 的 NALU 头为 2 字节，类型在第一个字节的中间 6 位
+#define H265_NAL_IRAP_MIN 16 // 16 ~ 23 为随机访问点(IDR/CRA/BLA)
+#define H265_NAL_IRAP_MAX 23
+#define H265_NAL_VPS 32
+#define H265_NAL_SPS 33
+#define H265_NAL_PPS 34
+#define H265_NAL_AUD 35
+#define H265_NAL_PREFIX_SEI 39
+
+static inline int h265NaluType(uint8_t header)
+{
+    return (header >> 1) & 0x3F;
+}
+
+// 索引中的一个 NALU，offset/size 不包含起始码
+struct NaluIndexEntry
+{
+    uint64_t offset;
+    uint32_t size;
+    uint8_t header;      // NALU 的第一个字节，H.264 的类型为 header & 0x1F，H.265 见 h265NaluType()
+    uint8_t startCodeLen; // 3 或 4
+    uint8_t reserved[2];
+};
+
+// 基于 mmap 的 Annex-B 码流源(.h264/.h265)
+// 打开时扫描一遍文件建立 NALU 索引，之后取帧只是查表，数据直接指向映射的内存
+struct AnnexbSource
+{
+    int fd;
+    const uint8_t *data;
+    size_t size;
+    int codec; // NALU_CODEC_*，打开后默认为 H.264，由调用者按文件类型设置
+
+    struct NaluIndexEntry *nalus;
+    int naluCount;
+    int cursor; // 下一个要读取的 NALU
+};
+
+// 从 SPS 中解析出的部分信息
+struct H264SpsInfo
+{
+    int profileIdc;
+    int levelIdc;
+    int width;
+    int height;
+    // VUI 中的 timing_info，帧率为 timeScale / (2 * numUnitsInTick)
+    int timingInfoPresent;
+    uint32_t numUnitsInTick;
+    uint32_t timeScale;
+};
+
+// 从 H.265 VPS 中解析出的部分信息
+struct H265VpsInfo
+{
+    int maxSubLayers;
+    // vps_timing_info，帧率为 timeScale / numUnitsInTick
+    int timingInfoPresent;
+    uint32_t numUnitsInTick;
+    uint32_t timeScale;
+};
+
+// 在 buf 中查找下一个起始码(00 00 01 或 00 00 00 01)，返回起始码的位置
+const uint8_t *findNextStartCode(const uint8_t *buf, size_t len);
+
+// findNextStartCode() 的实现，默认第一次调用时按 CPU 支持的指令集选择
+#define NALU_SCANNER_AUTO 0
+#define NALU_SCANNER_C 1
+#define NALU_SCANNER_SSE2 2
+#define NALU_SCANNER_AVX2 3
+// 指定使用的实现，用于对比测试，CPU 不支持时返回 -1
+int naluSetScanner(int scanner);
+
+// 解析 SPS(nalu 从 NALU 头开始)，成功返回 0
+int h264ParseSps(const uint8_t *nalu, uint32_t size, struct H264SpsInfo *info);
+// 解析 H.265 VPS(nalu 从 2 字节的 NALU 头开始)，成功返回 0
+int h265ParseVps(const uint8_t *nalu, uint32_t size, struct H265VpsInfo *info);
+
+// 映射 fileName 并建立索引
+// indexFileName 不为 NULL 时作为索引的缓存文件：有效则直接加载，否则扫描后写入，写不了时只用内存中的索引
+int annexbOpen(struct AnnexbSource *source, const char *fileName, const char *indexFileName);
+void annexbClose(struct AnnexbSource *source);
+
+// 取下一个 NALU(不含起始码)，返回其下标，读完返回 -1
+int annexbNext(struct AnnexbSource *source, const uint8_t **nalu, uint32_t *size);
+// 取下一个访问单元(一帧图像及其前面的 VPS/SPS/PPS/SEI 等)，first 为第一个 NALU 的下标
+// 返回其中 NALU 的个数，读完返回 -1
+int annexbNextAccessUnit(struct AnnexbSource *source, int *first);
+// 跳到第 index 个 NALU，返回 0，越界返回 -1
+int annexbSeek(struct AnnexbSource *source, int index);
+// 跳到第 index 个 NALU 之前最近的 IDR(H.265 为 IRAP)帧所在访问单元的开头(它前面的参数集、SEI 等)，
+// 没有 IDR 帧时跳到开头
+int annexbSeekKeyFrame(struct AnnexbSource *source, int index);
+
+#endif
@@ -0,0 +1,202 @@
+// 起始码扫描的性能测试：把码流文件 mmap 进来，分别用原来逐字节比较的版本、标量、SSE2 和 AVX2 版本
+// 的 findNextStartCode() 从头扫描到尾，输出每种实现的 GB/s，并检查它们找到的起始码位置完全一致
+// gcc -O2 nalu_bench.c nalu.c -o nalu_bench
+// ./nalu_bench [-m 总大小MB] [-r 重复次数] test.h264
+// -m 大于文件时在内存中重复文件内容凑够这个大小，不用在磁盘上准备几 GB 的文件
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "nalu.h"
+
+// 原来 main.c 中的实现：每个位置都比较 00 00 01 和 00 00 00 01
+static const uint8_t *findNextStartCodeOrig(const uint8_t *buf, size_t len)
+{
+    size_t i;
+
+    if (len < 3)
+        return NULL;
+
+    for (i = 0; i < len - 3; ++i)
+    {
+        if ((buf[0] == 0 && buf[1] == 0 && buf[2] == 1) ||
+            (buf[0] == 0 && buf[1] == 0 && buf[2] == 0 && buf[3] == 1))
+            return buf;
+
+        ++buf;
+    }
+
+    if (buf[0] == 0 && buf[1] == 0 && buf[2] == 1)
+        return buf;
+
+    return NULL;
+}
+
+struct Scanner
+{
+    const char *name;
+    int scanner; // NALU_SCANNER_*，-1 表示原来的实现
+};
+
+static const struct Scanner scanners[] = {
+    {"orig", -1},
+    {"scalar", NALU_SCANNER_C},
+    {"sse2", NALU_SCANNER_SSE2},
+    {"avx2", NALU_SCANNER_AVX2},
+};
+
+static double getMonotonicSec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 从头到尾找出所有起始码，offsets 不为 NULL 时记下位置，返回起始码个数
+static size_t scanAll(int scanner, const uint8_t *data, size_t size, uint64_t *offsets)
+{
+    const uint8_t *p = data, *end = data + size, *q;
+    size_t count = 0;
+
+    while (p < end)
+    {
+        q = scanner < 0 ? findNextStartCodeOrig(p, end - p) : findNextStartCode(p, end - p);
+        if (!q)
+            break;
+        if (offsets)
+            offsets[count] = q - data;
+        count++;
+        p = q + 3;
+    }
+
+    return count;
+}
+
+// 把文件映射进来，totalSize 大于文件时改为匿名映射并重复填充文件内容
+static uint8_t *loadData(const char *fileName, size_t totalSize, size_t *size)
+{
+    struct stat st;
+    uint8_t *file, *data;
+    size_t pos;
+    int fd;
+
+    fd = open(fileName, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0 || st.st_size == 0)
+        return NULL;
+
+    file = (uint8_t *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED)
+        return NULL;
+
+    if (totalSize <= (size_t)st.st_size)
+    {
+        *size = st.st_size;
+        return file;
+    }
+
+    data = (uint8_t *)mmap(NULL, totalSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED)
+        return NULL;
+    for (pos = 0; pos < totalSize; pos += st.st_size)
+        memcpy(data + pos, file, totalSize - pos < (size_t)st.st_size ? totalSize - pos : (size_t)st.st_size);
+    munmap(file, st.st_size);
+
+    *size = totalSize;
+    return data;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t totalSize = 0, size, count, expectCount = 0, i;
+    uint64_t *expect, *offsets;
+    uint8_t *data;
+    int repeat = 3, failed = 0, opt, s, r;
+
+    while ((opt = getopt(argc, argv, "m:r:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'm':
+            totalSize = (size_t)atol(optarg) * 1024 * 1024;
+            break;
+        case 'r':
+            repeat = atoi(optarg);
+            break;
+        default:
+            optind = argc;
+            break;
+        }
+    }
+    if (optind >= argc || repeat <= 0)
+    {
+        printf("usage: %s [-m total_mbytes] [-r repeat] file.h264\n", argv[0]);
+        return -1;
+    }
+
+    data = loadData(argv[optind], totalSize, &size);
+    if (!data)
+    {
+        printf("failed to load %s\n", argv[optind]);
+        return -1;
+    }
+
+    // 先用原来的实现得到标准答案，起始码之间至少隔 3 个字节
+    expect = (uint64_t *)malloc((size / 3 + 1) * sizeof(uint64_t));
+    offsets = (uint64_t *)malloc((size / 3 + 1) * sizeof(uint64_t));
+    if (!expect || !offsets)
+        return -1;
+    expectCount = scanAll(-1, data, size, expect);
+    printf("%s: %.2f GB, %zu start codes\n", argv[optind], size / 1e9, expectCount);
+
+    for (s = 0; s < (int)(sizeof(scanners) / sizeof(scanners[0])); s++)
+    {
+        double best = 0;
+
+        if (scanners[s].scanner >= 0 && naluSetScanner(scanners[s].scanner) < 0)
+        {
+            printf("%-6s not supported by this cpu\n", scanners[s].name);
+            continue;
+        }
+
+        // 先扫一遍核对结果，同时把数据读进缓存/内存
+        count = scanAll(scanners[s].scanner, data, size, offsets);
+        if (count != expectCount || memcmp(offsets, expect, count * sizeof(uint64_t)) != 0)
+        {
+            for (i = 0; i < count && i < expectCount && offsets[i] == expect[i]; i++)
+                ;
+            printf("%-6s MISMATCH: %zu start codes, first difference at #%zu (%llu vs %llu)\n",
+                   scanners[s].name, count, i, i < count ? (unsigned long long)offsets[i] : 0ULL,
+                   i < expectCount ? (unsigned long long)expect[i] : 0ULL);
+            failed = 1;
+            continue;
+        }
+
+        // 取 repeat 次中最快的一次
+        for (r = 0; r < repeat; r++)
+        {
+            double start = getMonotonicSec(), sec;
+
+            scanAll(scanners[s].scanner, data, size, NULL);
+            sec = getMonotonicSec() - start;
+            if (best == 0 || sec < best)
+                best = sec;
+        }
+
+        printf("%-6s %7.2f GB/s  offsets match\n", scanners[s].name, size / best / 1e9);
+    }
+
+    naluSetScanner(NALU_SCANNER_AUTO);
+    free(expect);
+    free(offsets);
+    munmap(data, size);
+
+    return failed;
+}
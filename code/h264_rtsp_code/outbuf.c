@@ -0,0 +1,205 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include "outbuf.h"
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+void outBufferInit(struct OutBuffer *out, struct EventLoop *loop, int fd, struct PacketPool *pool)
+{
+    memset(out, 0, sizeof(*out));
+
+    out->fd = fd;
+    out->loop = loop;
+    out->pool = pool;
+}
+
+void outBufferFree(struct OutBuffer *out)
+{
+    while (out->count > 0)
+    {
+        packetBufferUnref(out->entries[out->head].buffer);
+        out->head = (out->head + 1) % OUTBUF_MAX_ENTRIES;
+        out->count--;
+    }
+
+    free(out->entries);
+    out->entries = NULL;
+    out->bytes = 0;
+}
+
+int outBufferRoom(struct OutBuffer *out)
+{
+    return OUTBUF_MAX_ENTRIES - out->count;
+}
+
+int outBufferAppend(struct OutBuffer *out, const void *head, uint32_t headSize,
+                    const void *data, uint32_t dataSize)
+{
+    struct OutBufferEntry *entry;
+
+    if (headSize > OUTBUF_INLINE_SIZE || out->count == OUTBUF_MAX_ENTRIES)
+        return -1;
+
+    if (!out->entries)
+    {
+        out->entries = (struct OutBufferEntry *)malloc(OUTBUF_MAX_ENTRIES * sizeof(struct OutBufferEntry));
+        if (!out->entries)
+            return -1;
+    }
+
+    entry = &out->entries[(out->head + out->count) % OUTBUF_MAX_ENTRIES];
+    memcpy(entry->head, head, headSize);
+    entry->headSize = headSize;
+    entry->data = (const uint8_t *)data;
+    entry->dataSize = dataSize;
+    entry->buffer = NULL;
+
+    out->count++;
+    out->bytes += headSize + dataSize;
+
+    return 0;
+}
+
+int outBufferAppendRef(struct OutBuffer *out, const void *head, uint32_t headSize,
+                       struct PacketBuffer *buffer, const void *data, uint32_t dataSize)
+{
+    if (outBufferAppend(out, head, headSize, data, dataSize) < 0)
+        return -1;
+
+    if (buffer)
+        out->entries[(out->head + out->count - 1) % OUTBUF_MAX_ENTRIES].buffer = packetBufferRef(buffer);
+
+    return 0;
+}
+
+int outBufferAppendCopy(struct OutBuffer *out, const void *data, uint32_t size)
+{
+    const uint8_t *p = (const uint8_t *)data;
+    uint32_t chunks = (size + PKTPOOL_BUF_SIZE - 1) / PKTPOOL_BUF_SIZE;
+    int ret;
+
+    if ((uint32_t)outBufferRoom(out) < chunks)
+        return -1;
+
+    // 超过一个缓冲区的数据分成几段，每段一个缓冲区
+    while (size > 0)
+    {
+        struct PacketBuffer *buffer = packetBufferAlloc(out->pool);
+        uint32_t n = size < PKTPOOL_BUF_SIZE ? size : PKTPOOL_BUF_SIZE;
+
+        if (!buffer)
+            return -1;
+
+        memcpy(buffer->data, p, n);
+        buffer->size = n;
+
+        // 队列持有自己的引用，这里的引用用完就释放
+        ret = outBufferAppendRef(out, NULL, 0, buffer, buffer->data, n);
+        packetBufferUnref(buffer);
+        if (ret < 0)
+            return -1;
+
+        p += n;
+        size -= n;
+    }
+
+    return 0;
+}
+
+// 根据队列是否为空打开或关闭 EPOLLOUT
+static void outBufferWatch(struct OutBuffer *out, int writing)
+{
+    if (out->writing == writing)
+        return;
+
+    out->writing = writing;
+    eventLoopMod(out->loop, out->fd, EPOLLIN | (writing ? EPOLLOUT : 0));
+}
+
+int outBufferFlush(struct OutBuffer *out)
+{
+    struct iovec iov[IOV_MAX];
+
+    if (out->error)
+        return -1;
+
+    while (out->count > 0)
+    {
+        struct msghdr msg;
+        int i, n = 0;
+        uint32_t skip = out->offset;
+        ssize_t ret;
+
+        // 从队首开始把每一段的头部和数据放进 iovec，已经发送的部分跳过
+        for (i = 0; i < out->count && n + 2 <= IOV_MAX; i++)
+        {
+            struct OutBufferEntry *entry = &out->entries[(out->head + i) % OUTBUF_MAX_ENTRIES];
+
+            if (skip < entry->headSize)
+            {
+                iov[n].iov_base = entry->head + skip;
+                iov[n].iov_len = entry->headSize - skip;
+                n++;
+                skip = 0;
+            }
+            else
+            {
+                skip -= entry->headSize;
+            }
+
+            if (entry->dataSize > skip)
+            {
+                iov[n].iov_base = (void *)(entry->data + skip);
+                iov[n].iov_len = entry->dataSize - skip;
+                n++;
+            }
+            skip = 0;
+        }
+
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = n;
+
+        // 相当于 writev()，但对端关闭时不会触发 SIGPIPE
+        ret = sendmsg(out->fd, &msg, MSG_NOSIGNAL);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+                break;
+
+            out->error = 1;
+            return -1;
+        }
+
+        // 把发送完的段出队
+        out->bytes -= ret;
+        ret += out->offset;
+        while (out->count > 0)
+        {
+            struct OutBufferEntry *entry = &out->entries[out->head];
+            uint32_t size = entry->headSize + entry->dataSize;
+
+            if ((size_t)ret < size)
+                break;
+
+            ret -= size;
+            packetBufferUnref(entry->buffer);
+            out->head = (out->head + 1) % OUTBUF_MAX_ENTRIES;
+            out->count--;
+        }
+        out->offset = ret;
+    }
+
+    outBufferWatch(out, out->count > 0);
+
+    return 0;
+}
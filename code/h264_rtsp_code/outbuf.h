@@ -0,0 +1,58 @@
+#ifndef _OUTBUF_H_
+#define _OUTBUF_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "event.h"
+#include "pktpool.h"
+
+#define OUTBUF_MAX_ENTRIES 1024
+// 内联保存的头部，足够放下 '$' 帧头 + RTP 头 + FU/AU 头，
+// RTP 头还可以带 12 字节以内的扩展(例如 abs-send-time 加 transport-wide 序列号)
+#define OUTBUF_INLINE_SIZE 32
+
+// 一段待发送的数据：内联的头部加上一段外部数据
+struct OutBufferEntry
+{
+    uint8_t head[OUTBUF_INLINE_SIZE];
+    uint32_t headSize;
+    const uint8_t *data; // 不复制，发送完之前必须保持有效
+    uint32_t dataSize;
+    struct PacketBuffer *buffer; // 不为 NULL 时 data 在这个缓冲区中，发送完释放引用
+};
+
+// TCP 连接的发送队列，RTSP 回复和 interleaved 的 RTP 包都经过它按顺序发送
+// 积攒的数据用一次 writev() 发出；发不完时打开 EPOLLOUT，可写时继续发送
+struct OutBuffer
+{
+    int fd;
+    struct EventLoop *loop;
+    struct PacketPool *pool; // outBufferAppendCopy() 从这里分配缓冲区
+    int writing; // 是否在等待 EPOLLOUT
+    int error;   // 连接已经出错，由连接的事件回调负责关闭
+
+    struct OutBufferEntry *entries; // 环形队列，第一次使用时分配
+    int head;
+    int count;
+    uint32_t offset; // 队首已经发送的字节数
+    size_t bytes;    // 还没发送的字节数
+};
+
+void outBufferInit(struct OutBuffer *out, struct EventLoop *loop, int fd, struct PacketPool *pool);
+void outBufferFree(struct OutBuffer *out);
+
+// 队列中还能放下多少段
+int outBufferRoom(struct OutBuffer *out);
+// 追加 head(复制) + data(不复制)，队列满时返回 -1
+int outBufferAppend(struct OutBuffer *out, const void *head, uint32_t headSize,
+                    const void *data, uint32_t dataSize);
+// 和 outBufferAppend() 一样，data 位于 buffer 中，队列持有 buffer 的一个引用直到发送完
+// buffer 为 NULL 时相当于 outBufferAppend()
+int outBufferAppendRef(struct OutBuffer *out, const void *head, uint32_t headSize,
+                       struct PacketBuffer *buffer, const void *data, uint32_t dataSize);
+// 追加一段数据的副本，副本放在缓冲池中，长的数据占用多个缓冲区，池已用完时返回 -1
+int outBufferAppendCopy(struct OutBuffer *out, const void *data, uint32_t size);
+// 尽可能多地发送，出错返回 -1
+int outBufferFlush(struct OutBuffer *out);
+
+#endif
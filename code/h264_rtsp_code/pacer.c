@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include "pacer.h"
+
+uint64_t getMonotonicUs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void sleepUntilUs(uint64_t us)
+{
+    struct timespec ts;
+
+    ts.tv_sec = us / 1000000;
+    ts.tv_nsec = (us % 1000000) * 1000;
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+        ;
+}
+
+void pacerInit(struct RtpPacer *pacer, uint32_t clockRate, uint32_t burstBytes)
+{
+    memset(pacer, 0, sizeof(*pacer));
+
+    pacer->clockRate = clockRate;
+    pacer->burst = burstBytes;
+}
+
+void pacerReset(struct RtpPacer *pacer)
+{
+    pacer->started = 0;
+}
+
+void pacerStart(struct RtpPacer *pacer, uint64_t startUs, uint32_t timestamp)
+{
+    pacer->started = 1;
+    pacer->startUs = startUs;
+    pacer->lastTimestamp = timestamp;
+    pacer->elapsedTicks = 0;
+}
+
+uint64_t pacerSchedule(struct RtpPacer *pacer, uint32_t timestamp)
+{
+    uint64_t now = getMonotonicUs();
+    uint64_t scheduledUs;
+
+    if (!pacer->started)
+        pacerStart(pacer, now, timestamp);
+
+    // 时间戳差值按 32 位无符号数计算，回绕后依然正确
+    pacer->elapsedTicks += (uint32_t)(timestamp - pacer->lastTimestamp);
+    pacer->lastTimestamp = timestamp;
+
+    scheduledUs = pacer->startUs + pacer->elapsedTicks * 1000000 / pacer->clockRate;
+
+    return scheduledUs;
+}
+
+uint64_t pacerLateUs(uint64_t scheduledUs, uint64_t nowUs)
+{
+    if (nowUs > scheduledUs + PACER_MAX_LATE_US)
+        return nowUs - scheduledUs;
+
+    return 0;
+}
+
+void pacerShift(struct RtpPacer *pacer, uint64_t deltaUs)
+{
+    // 时间戳和起点的对应关系整体后移，pacerTimestampAt() 推算的时间戳也随之连续
+    pacer->startUs += deltaUs;
+}
+
+uint32_t pacerTimestampAt(struct RtpPacer *pacer, uint64_t nowUs)
+{
+    int64_t ticks;
+
+    if (!pacer->started || pacer->clockRate == 0)
+        return pacer->lastTimestamp;
+
+    // 从起点开始按时钟频率推算，再减去已经用掉的时钟数，得到相对最后一个时间戳的偏移
+    ticks = ((int64_t)nowUs - (int64_t)pacer->startUs) * pacer->clockRate / 1000000 -
+            (int64_t)pacer->elapsedTicks;
+
+    return pacer->lastTimestamp + (uint32_t)ticks;
+}
+
+void pacerRecordSend(struct RtpPacer *pacer, uint64_t scheduledUs, uint64_t actualUs)
+{
+    int64_t delay = (int64_t)(actualUs - scheduledUs);
+    int64_t diff = delay - pacer->lastDelayUs;
+
+    if (diff < 0)
+        diff = -diff;
+
+    if (pacer->frames > 0)
+        pacer->jitterUs += (diff - pacer->jitterUs) / 16;
+    pacer->lastDelayUs = delay;
+    if (delay > pacer->maxDelayUs)
+        pacer->maxDelayUs = delay;
+    pacer->frames++;
+
+    // 按单调时钟每隔一段时间输出一次统计，和帧率、每个报文的帧数无关
+    if (pacer->lastReportUs == 0)
+        pacer->lastReportUs = actualUs;
+    if (actualUs - pacer->lastReportUs >= PACER_REPORT_INTERVAL_US)
+    {
+        printf("pacer: clock=%u frames=%llu jitter=%.0fus max delay=%lldus\n", pacer->clockRate,
+               (unsigned long long)pacer->frames, pacer->jitterUs, (long long)pacer->maxDelayUs);
+        pacer->maxDelayUs = 0;
+        pacer->lastReportUs = actualUs;
+    }
+}
+
+void pacerStartBurst(struct RtpPacer *pacer, uint32_t bytes, uint32_t intervalUs, uint64_t nowUs)
+{
+    // 留出一些余量，保证一帧在下一帧到来之前发完
+    pacer->rate = (double)bytes / (intervalUs * 0.8);
+    pacer->tokens = pacer->burst;
+    pacer->lastRefillUs = nowUs;
+}
+
+int pacerConsume(struct RtpPacer *pacer, uint32_t bytes, uint64_t nowUs)
+{
+    if (nowUs > pacer->lastRefillUs)
+    {
+        pacer->tokens += pacer->rate * (nowUs - pacer->lastRefillUs);
+        if (pacer->tokens > pacer->burst)
+            pacer->tokens = pacer->burst;
+        pacer->lastRefillUs = nowUs;
+    }
+
+    // 令牌不为负就允许发送，一个报文比桶还大时也不会一直卡住
+    if (pacer->tokens < 0)
+        return 0;
+
+    pacer->tokens -= bytes;
+
+    return 1;
+}
+
+uint64_t pacerWaitUs(struct RtpPacer *pacer)
+{
+    if (pacer->tokens >= 0 || pacer->rate <= 0)
+        return 0;
+
+    return (uint64_t)(-pacer->tokens / pacer->rate) + 1;
+}
@@ -0,0 +1,64 @@
+#ifndef _PACER_H_
+#define _PACER_H_
+
+#include <stdint.h>
+
+// 落后计划超过这个时间(例如进程被挂起)就重新以当前时刻为起点，避免之后集中补发
+#define PACER_MAX_LATE_US 1000000
+// 发送延迟统计的输出间隔
+#define PACER_REPORT_INTERVAL_US 10000000
+
+// 按 RTP 时间戳和单调时钟安排发送时间，代替固定的 usleep()
+// 发送本身花费的时间不会累积成漂移，大帧的报文用令牌桶分散到帧间隔内发送
+struct RtpPacer
+{
+    uint32_t clockRate; // RTP 时钟频率，视频 90000，音频为采样率
+
+    int started;
+    uint64_t startUs;       // 第一个时间戳对应的单调时钟
+    uint32_t lastTimestamp;
+    uint64_t elapsedTicks;  // 相对第一个时间戳的时钟数，扩展到 64 位避免回绕
+
+    // 令牌桶，单位字节
+    double rate;  // 每微秒补充的令牌
+    double burst; // 桶容量，小帧可以一次发完
+    double tokens;
+    uint64_t lastRefillUs;
+
+    // 实际发送时刻相对计划时刻的延迟统计
+    uint64_t frames;
+    uint64_t lastReportUs;
+    int64_t lastDelayUs;
+    double jitterUs; // 按 RFC 3550 的方式平滑的延迟变化
+    int64_t maxDelayUs;
+};
+
+uint64_t getMonotonicUs(void);
+// 阻塞直到单调时钟到达 us
+void sleepUntilUs(uint64_t us);
+
+void pacerInit(struct RtpPacer *pacer, uint32_t clockRate, uint32_t burstBytes);
+// 暂停后重新开始时调用，下一个时间戳作为新的起点
+void pacerReset(struct RtpPacer *pacer);
+// 指定起点：时间戳 timestamp 对应单调时钟 startUs，多路媒体用同一个起点即可对齐
+void pacerStart(struct RtpPacer *pacer, uint64_t startUs, uint32_t timestamp);
+
+// 返回该时间戳的计划发送时刻(微秒)
+uint64_t pacerSchedule(struct RtpPacer *pacer, uint32_t timestamp);
+// 计划时刻比 nowUs 落后超过 PACER_MAX_LATE_US 时返回落后的微秒数，否则返回 0
+uint64_t pacerLateUs(uint64_t scheduledUs, uint64_t nowUs);
+// 起点往后移 deltaUs，落后时由调用者决定哪些 pacer 一起移动，多路媒体要一起移动才能保持对齐
+void pacerShift(struct RtpPacer *pacer, uint64_t deltaUs);
+// 单调时钟 nowUs 对应的 RTP 时间戳，用于 RTCP 发送者报告
+uint32_t pacerTimestampAt(struct RtpPacer *pacer, uint64_t nowUs);
+// 记录一帧的实际发送时刻，更新抖动统计
+void pacerRecordSend(struct RtpPacer *pacer, uint64_t scheduledUs, uint64_t actualUs);
+
+// 开始发送新的一帧：让 bytes 字节在 intervalUs 内均匀发出
+void pacerStartBurst(struct RtpPacer *pacer, uint32_t bytes, uint32_t intervalUs, uint64_t nowUs);
+// 令牌足够时扣除并返回 1，否则返回 0
+int pacerConsume(struct RtpPacer *pacer, uint32_t bytes, uint64_t nowUs);
+// 还需要等待多少微秒才能继续发送
+uint64_t pacerWaitUs(struct RtpPacer *pacer);
+
+#endif
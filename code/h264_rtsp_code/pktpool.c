@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "pktpool.h"
+
+void packetPoolInit(struct PacketPool *pool, int maxBuffers)
+{
+    memset(pool, 0, sizeof(*pool));
+    pool->maxBuffers = maxBuffers;
+}
+
+void packetPoolDestroy(struct PacketPool *pool)
+{
+    int i;
+
+    if (pool->usedCount > 0)
+        printf("packet pool destroyed with %d buffers in use\n", pool->usedCount);
+
+    for (i = 0; i < pool->slabCount; i++)
+        free(pool->slabs[i]);
+    free(pool->slabs);
+
+    memset(pool, 0, sizeof(*pool));
+}
+
+// 申请一块新的缓冲区放进空闲链表
+static int packetPoolGrow(struct PacketPool *pool)
+{
+    struct PacketBuffer *slab;
+    void **slabs;
+    int i, count = PKTPOOL_SLAB_BUFFERS;
+
+    if (pool->bufferCount + count > pool->maxBuffers)
+        count = pool->maxBuffers - pool->bufferCount;
+    if (count <= 0)
+        return -1;
+
+    slabs = (void **)realloc(pool->slabs, (pool->slabCount + 1) * sizeof(void *));
+    if (!slabs)
+        return -1;
+    pool->slabs = slabs;
+
+    slab = (struct PacketBuffer *)malloc(count * sizeof(struct PacketBuffer));
+    if (!slab)
+        return -1;
+    pool->slabs[pool->slabCount++] = slab;
+
+    for (i = 0; i < count; i++)
+    {
+        slab[i].pool = pool;
+        slab[i].next = pool->freeList;
+        pool->freeList = &slab[i];
+    }
+    pool->bufferCount += count;
+
+    return 0;
+}
+
+struct PacketBuffer *packetBufferAlloc(struct PacketPool *pool)
+{
+    struct PacketBuffer *buf;
+
+    if (!pool->freeList && packetPoolGrow(pool) < 0)
+    {
+        pool->allocFailures++;
+        return NULL;
+    }
+
+    buf = pool->freeList;
+    pool->freeList = buf->next;
+    pool->usedCount++;
+
+    buf->next = NULL;
+    buf->refCount = 1;
+    buf->size = 0;
+
+    return buf;
+}
+
+void packetBufferUnref(struct PacketBuffer *buf)
+{
+    struct PacketPool *pool;
+
+    if (!buf || --buf->refCount > 0)
+        return;
+
+    pool = buf->pool;
+    buf->next = pool->freeList;
+    pool->freeList = buf;
+    pool->usedCount--;
+}
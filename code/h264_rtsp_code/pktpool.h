@@ -0,0 +1,54 @@
+#ifndef _PKTPOOL_H_
+#define _PKTPOOL_H_
+
+#include <stdint.h>
+
+// 一个缓冲区放一个以太网 MTU 的报文，RTSP 回复和 RTCP 包也都放得下
+#define PKTPOOL_BUF_SIZE 1500
+// 每次向系统申请这么多个缓冲区
+#define PKTPOOL_SLAB_BUFFERS 64
+
+struct PacketPool;
+
+// 带引用计数的报文缓冲区，同一份数据可以同时挂在多个订阅者的发送队列里，
+// 最后一个引用释放时回到池中
+struct PacketBuffer
+{
+    struct PacketPool *pool;
+    struct PacketBuffer *next; // 空闲链表
+    int refCount;
+    uint32_t size;             // data 中有效数据的长度，由使用者维护
+    uint8_t data[PKTPOOL_BUF_SIZE];
+};
+
+// 固定大小的报文缓冲池：按块申请，空闲的缓冲区放在链表中，分配和释放都是 O(1)
+// 服务器是单线程的事件循环，所以只有一个空闲链表，不需要加锁或者每个线程一份缓存
+// 缓冲区总数有上限，用完之后分配失败，由调用者丢弃数据，内存占用不会随会话数无限增长
+struct PacketPool
+{
+    struct PacketBuffer *freeList;
+    void **slabs;
+    int slabCount;
+    int bufferCount; // 已经申请的缓冲区
+    int maxBuffers;
+    int usedCount;   // 正在使用的缓冲区
+    uint32_t allocFailures;
+};
+
+void packetPoolInit(struct PacketPool *pool, int maxBuffers);
+// 所有缓冲区都应该已经释放
+void packetPoolDestroy(struct PacketPool *pool);
+
+// 分配一个引用计数为 1 的缓冲区，池已经用完时返回 NULL
+struct PacketBuffer *packetBufferAlloc(struct PacketPool *pool);
+
+static inline struct PacketBuffer *packetBufferRef(struct PacketBuffer *buf)
+{
+    buf->refCount++;
+    return buf;
+}
+
+// buf 可以为 NULL
+void packetBufferUnref(struct PacketBuffer *buf);
+
+#endif
@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "rtcp.h"
+
+// 1900-01-01 到 1970-01-01 的秒数
+#define NTP_UNIX_OFFSET 2208988800u
+
+static inline void rtcpWrite16(uint8_t *p, uint16_t v)
+{
+    p[0] = v >> 8;
+    p[1] = v;
+}
+
+static inline void rtcpWrite32(uint8_t *p, uint32_t v)
+{
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+static inline uint32_t rtcpRead32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+void rtcpStatsInit(struct RtcpStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->rttMs = -1;
+}
+
+void rtcpGetNtpTime(uint32_t *msw, uint32_t *lsw)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    *msw = (uint32_t)ts.tv_sec + NTP_UNIX_OFFSET;
+    // 纳秒换算成 1/2^32 秒
+    *lsw = (uint32_t)(((uint64_t)ts.tv_nsec << 32) / 1000000000);
+}
+
+int rtcpBuildSenderReport(uint8_t *buf, int size, uint32_t ssrc, uint32_t rtpTimestamp,
+                          struct RtcpStats *stats, const char *cname)
+{
+    int cnameLen = strlen(cname);
+    int sdesLen, len;
+    uint32_t msw, lsw;
+
+    if (cnameLen > 255)
+        cnameLen = 255;
+
+    // SDES: 头部 4 字节 + SSRC 4 字节 + CNAME 项(类型、长度、文本) + 结束符，补齐到 4 字节
+    sdesLen = (4 + 4 + 2 + cnameLen + 1 + 3) & ~3;
+    if (size < 28 + sdesLen)
+        return -1;
+
+    rtcpGetNtpTime(&msw, &lsw);
+
+    // SR，不带报告块，长度以 32 位字为单位并减一
+    buf[0] = RTCP_VERSION << 6;
+    buf[1] = RTCP_TYPE_SR;
+    rtcpWrite16(buf + 2, 28 / 4 - 1);
+    rtcpWrite32(buf + 4, ssrc);
+    rtcpWrite32(buf + 8, msw);
+    rtcpWrite32(buf + 12, lsw);
+    rtcpWrite32(buf + 16, rtpTimestamp);
+    rtcpWrite32(buf + 20, stats->packetCount);
+    rtcpWrite32(buf + 24, stats->octetCount);
+    len = 28;
+
+    // SDES，一个块，只有 CNAME 一项
+    memset(buf + len, 0, sdesLen);
+    buf[len] = (RTCP_VERSION << 6) | 1;
+    buf[len + 1] = RTCP_TYPE_SDES;
+    rtcpWrite16(buf + len + 2, sdesLen / 4 - 1);
+    rtcpWrite32(buf + len + 4, ssrc);
+    buf[len + 8] = 1; // CNAME
+    buf[len + 9] = cnameLen;
+    memcpy(buf + len + 10, cname, cnameLen);
+    len += sdesLen;
+
+    stats->lastSrNtp = (msw << 16) | (lsw >> 16);
+    stats->srCount++;
+
+    return len;
+}
+
+int rtcpParseReportBlocks(const uint8_t *buf, int size, struct RtcpReportBlock *blocks, int maxBlocks)
+{
+    int count = 0;
+
+    // 复合包由多个 RTCP 包首尾相连组成，每个包的长度都在头部
+    while (size >= 4)
+    {
+        int version = buf[0] >> 6;
+        int rc = buf[0] & 0x1F;
+        int type = buf[1];
+        int len = (((buf[2] << 8) | buf[3]) + 1) * 4;
+        const uint8_t *p;
+        int i;
+
+        if (version != RTCP_VERSION || len > size)
+            return -1;
+
+        if (type == RTCP_TYPE_SR || type == RTCP_TYPE_RR)
+        {
+            // 报告块前面是发送者 SSRC，SR 还多了 20 字节的发送者信息
+            p = buf + (type == RTCP_TYPE_SR ? 28 : 8);
+            if (p + rc * 24 > buf + len)
+                return -1;
+
+            for (i = 0; i < rc && count < maxBlocks; i++, p += 24)
+            {
+                struct RtcpReportBlock *block = &blocks[count++];
+                uint32_t lost = rtcpRead32(p + 4) & 0xFFFFFF;
+
+                block->reporterSsrc = rtcpRead32(buf + 4);
+                block->ssrc = rtcpRead32(p);
+                block->fractionLost = p[4];
+                // 24 位有符号数扩展到 32 位
+                block->cumulativeLost = (lost & 0x800000) ? (int32_t)(lost | 0xFF000000) : (int32_t)lost;
+                block->highestSeq = rtcpRead32(p + 8);
+                block->jitter = rtcpRead32(p + 12);
+                block->lsr = rtcpRead32(p + 16);
+                block->dlsr = rtcpRead32(p + 20);
+            }
+        }
+
+        buf += len;
+        size -= len;
+    }
+
+    return count;
+}
+
+int rtcpParseNacks(const uint8_t *buf, int size, struct RtcpNack *nacks, int maxNacks)
+{
+    int count = 0;
+
+    while (size >= 4)
+    {
+        int version = buf[0] >> 6;
+        int fmt = buf[0] & 0x1F;
+        int type = buf[1];
+        int len = (((buf[2] << 8) | buf[3]) + 1) * 4;
+        const uint8_t *p;
+
+        if (version != RTCP_VERSION || len > size)
+            return -1;
+
+        // 两个 SSRC 之后每 4 字节一个条目
+        if (type == RTCP_TYPE_RTPFB && fmt == RTCP_RTPFB_NACK && len >= 12)
+        {
+            uint32_t senderSsrc = rtcpRead32(buf + 4);
+            uint32_t mediaSsrc = rtcpRead32(buf + 8);
+
+            for (p = buf + 12; p + 4 <= buf + len && count < maxNacks; p += 4)
+            {
+                nacks[count].senderSsrc = senderSsrc;
+                nacks[count].mediaSsrc = mediaSsrc;
+                nacks[count].pid = (p[0] << 8) | p[1];
+                nacks[count].blp = (p[2] << 8) | p[3];
+                count++;
+            }
+        }
+
+        buf += len;
+        size -= len;
+    }
+
+    return count;
+}
+
+void rtcpStatsOnReport(struct RtcpStats *stats, const struct RtcpReportBlock *block,
+                       uint32_t clockRate, uint64_t nowMs)
+{
+    uint32_t msw, lsw, now;
+    int32_t rtt;
+
+    stats->rrCount++;
+    stats->lastRrMs = nowMs;
+    stats->fractionLost = block->fractionLost / 256.0;
+    stats->cumulativeLost = block->cumulativeLost;
+    stats->highestSeq = block->highestSeq;
+    if (clockRate > 0)
+        stats->jitterMs = block->jitter * 1000.0 / clockRate;
+
+    // RTT = 收到 RR 的时刻 - LSR - DLSR，都是 NTP 时间戳的中间 32 位，单位 1/65536 秒
+    // 对端还没收到过 SR 时 LSR 为 0
+    if (block->lsr == 0)
+        return;
+
+    rtcpGetNtpTime(&msw, &lsw);
+    now = (msw << 16) | (lsw >> 16);
+    rtt = (int32_t)(now - block->lsr - block->dlsr);
+    if (rtt >= 0)
+        stats->rttMs = rtt * 1000.0 / 65536;
+}
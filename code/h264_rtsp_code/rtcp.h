@@ -0,0 +1,141 @@
+#ifndef _RTCP_H_
+#define _RTCP_H_
+
+#include <stdint.h>
+
+#define RTCP_VERSION 2
+
+#define RTCP_TYPE_SR 200   // 发送者报告
+#define RTCP_TYPE_RR 201   // 接收者报告
+#define RTCP_TYPE_SDES 202 // 源描述
+#define RTCP_TYPE_BYE 203
+#define RTCP_TYPE_RTPFB 205 // RFC 4585 传输层反馈
+
+#define RTCP_RTPFB_NACK 1 // RTPFB 中 FMT=1 为 generic NACK
+
+// 发送者报告的平均间隔，RFC 3550 建议不小于 5 秒，实际间隔在 0.5 ~ 1.5 倍之间随机
+#define RTCP_INTERVAL_MS 5000
+
+#define RTCP_MAX_PACKET_SIZE 1500
+// 一个复合包最多解析多少个接收报告块
+#define RTCP_MAX_REPORT_BLOCKS 31
+// 一个复合包最多解析多少个 NACK 条目，每个条目最多表示 17 个丢失的报文
+#define RTCP_MAX_NACKS 64
+
+/*
+ * 发送者报告(SR)，后面紧跟一个带 CNAME 的 SDES 组成复合包
+ *
+ *    0                   1                   2                   3
+ *    7 6 5 4 3 2 1 0|7 6 5 4 3 2 1 0|7 6 5 4 3 2 1 0|7 6 5 4 3 2 1 0
+ *   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *   |V=2|P|    RC   |   PT=SR=200   |             length            |
+ *   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *   |                         SSRC of sender                        |
+ *   +=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+
+ *   |              NTP timestamp, most significant word             |
+ *   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *   |             NTP timestamp, least significant word             |
+ *   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *   |                         RTP timestamp                         |
+ *   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *   |                     sender's packet count                     |
+ *   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *   |                      sender's octet count                     |
+ *   +=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+
+ *
+ * 接收者报告(RR)中每个报告块的格式，SR 中也可以带报告块
+ *
+ *   +=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+
+ *   |                 SSRC_1 (SSRC of first source)                 |
+ *   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *   | fraction lost |       cumulative number of packets lost       |
+ *   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *   |           extended highest sequence number received           |
+ *   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *   |                      interarrival jitter                      |
+ *   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *   |                         last SR (LSR)                         |
+ *   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *   |                   delay since last SR (DLSR)                  |
+ *   +=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+
+ *
+ * generic NACK(RFC 4585)，FCI 中可以有多个 PID + BLP 条目
+ *
+ *   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *   |V=2|P|  FMT=1  |  PT=RTPFB=205 |             length            |
+ *   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *   |                  SSRC of packet sender                        |
+ *   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *   |                  SSRC of media source                         |
+ *   +=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+
+ *   |            PID                |             BLP               |
+ *   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ */
+
+// 解析出的一个接收报告块，字段已经转换成主机字节顺序
+struct RtcpReportBlock
+{
+    uint32_t reporterSsrc;   // 发出这个报告的接收者
+    uint32_t ssrc;           // 被报告的发送者，也就是我们的 SSRC
+    uint8_t fractionLost;    // 上次报告以来的丢包率，乘以 256
+    int32_t cumulativeLost;  // 24 位有符号数
+    uint32_t highestSeq;     // 扩展的最大序列号，高 16 位是回绕次数
+    uint32_t jitter;         // 到达间隔抖动，单位是 RTP 时钟
+    uint32_t lsr;            // 收到的最后一个 SR 的 NTP 时间戳中间 32 位
+    uint32_t dlsr;           // 收到那个 SR 之后过了多久，单位 1/65536 秒
+};
+
+// 解析出的一个 NACK 条目：序列号 pid 的报文丢失，
+// blp 的第 i 位(最低位为第 0 位)为 1 表示 pid + i + 1 也丢失
+struct RtcpNack
+{
+    uint32_t senderSsrc; // 发出 NACK 的接收者
+    uint32_t mediaSsrc;  // 丢包的 RTP 流，也就是我们的 SSRC
+    uint16_t pid;
+    uint16_t blp;
+};
+
+// 一个 RTP 流的统计：发送计数用于 SR，其余来自对端的接收报告
+struct RtcpStats
+{
+    uint32_t packetCount; // 已发送的 RTP 报文数
+    uint32_t octetCount;  // 已发送的负载字节数，不含 RTP 头
+    uint32_t srCount;
+    uint32_t lastSrNtp;   // 最近一个 SR 的 NTP 时间戳中间 32 位，和 RR 的 LSR 对应
+
+    uint32_t rrCount;
+    uint64_t lastRrMs;    // 最近一次收到 RR 的单调时钟
+    double fractionLost;  // 0 ~ 1
+    int32_t cumulativeLost;
+    uint32_t highestSeq;
+    double jitterMs;
+    double rttMs;         // 小于 0 表示还不知道
+};
+
+void rtcpStatsInit(struct RtcpStats *stats);
+// 记录发送了一个 RTP 报文，payloadSize 不含 12 字节的 RTP 头
+static inline void rtcpStatsOnSend(struct RtcpStats *stats, uint32_t payloadSize)
+{
+    stats->packetCount++;
+    stats->octetCount += payloadSize;
+}
+
+// 当前墙上时间的 64 位 NTP 时间戳
+void rtcpGetNtpTime(uint32_t *msw, uint32_t *lsw);
+
+// 生成 SR + SDES(CNAME) 复合包，返回长度，缓冲区不够时返回 -1
+// rtpTimestamp 是与当前 NTP 时间对应的 RTP 时间戳，接收端用它做音视频同步
+int rtcpBuildSenderReport(uint8_t *buf, int size, uint32_t ssrc, uint32_t rtpTimestamp,
+                          struct RtcpStats *stats, const char *cname);
+
+// 解析一个复合包中所有 SR/RR 的报告块，返回块数，格式错误时返回 -1
+int rtcpParseReportBlocks(const uint8_t *buf, int size, struct RtcpReportBlock *blocks, int maxBlocks);
+
+// 解析一个复合包中所有 generic NACK 的条目，返回条目数，格式错误时返回 -1
+int rtcpParseNacks(const uint8_t *buf, int size, struct RtcpNack *nacks, int maxNacks);
+
+// 用对端的报告块更新统计，clockRate 用于把抖动换算成毫秒
+void rtcpStatsOnReport(struct RtcpStats *stats, const struct RtcpReportBlock *block,
+                       uint32_t clockRate, uint64_t nowMs);
+
+#endif
@@ -1,47 +1,494 @@
+#define _GNU_SOURCE
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
+#include <netinet/udp.h>
+#include <errno.h>
 #include <unistd.h>
 #include <string.h>
 #include "rtp.h"
 
-void rtpHeaderInit(struct RtpPacket *rtpPacket, uint8_t csrcLen, uint8_t extension,
-                   uint8_t padding, uint8_t version, uint8_t payloadType, uint8_t marker,
-                   uint16_t seq, uint32_t timestamp, uint32_t ssrc)
+#ifndef UDP_SEGMENT
+#define UDP_SEGMENT 103
+#endif
+
+// 一次 GSO 发送最多的分段数和总长度
+#define RTP_GSO_MAX_SEGS 64
+#define RTP_GSO_MAX_BYTES 65000
+
+// 内核不支持 UDP GSO 时置 1，之后只用 sendmmsg()
+static int gsoUnsupported = 0;
+
+// 阻塞地写完 iov 中的全部数据，会修改 iov
+// 用 sendmsg() 代替 writev()，对端关闭时返回错误而不是触发 SIGPIPE
+static int writevAll(int sockfd, struct iovec *iov, int iovcnt)
+{
+    struct msghdr msg;
+    int total = 0;
+    ssize_t ret;
+
+    while (iovcnt > 0)
+    {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = iov;
+        msg.msg_iovlen = iovcnt;
+
+        ret = sendmsg(sockfd, &msg, MSG_NOSIGNAL);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+
+        total += ret;
+        while (iovcnt > 0 && (size_t)ret >= iov->iov_len)
+        {
+            ret -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0)
+        {
+            iov->iov_base = (uint8_t *)iov->iov_base + ret;
+            iov->iov_len -= ret;
+        }
+    }
+
+    return total;
+}
+
+void rtpWriteInterleavedHeader(uint8_t *buf, uint8_t channel, uint16_t size)
+{
+    buf[0] = '$';
+    buf[1] = channel;
+    buf[2] = (size >> 8) & 0xFF;
+    buf[3] = size & 0xFF;
+}
+
+// 把主机字节序的头部模板写到 view 中，返回写入的字节数
+static uint32_t rtpWriteViewHeader(struct RtpPacketView *view, const struct RtpHeader *rtpHeader)
+{
+    view->rtpHeaderSize = rtpHeaderWrite(view->header, RTP_MAX_HEADER_SIZE, rtpHeader);
+
+    return view->rtpHeaderSize;
+}
+
+int rtpPacketizeH264(struct RtpHeader *rtpHeader, const uint8_t *frame, uint32_t frameSize,
+                     struct RtpPacketView *views, int maxViews)
+{
+    uint8_t naluType = frame[0]; // nalu第一个字节
+    uint32_t pos = 1;
+    int count = 0;
+
+    if (frameSize <= RTP_MAX_PKT_SIZE) // nalu长度小于最大包长：单一NALU单元模式
+    {
+        if (maxViews < 1)
+            return -1;
+
+        views[0].headerSize = rtpWriteViewHeader(&views[0], rtpHeader);
+        views[0].payload = frame;
+        views[0].payloadSize = frameSize;
+        rtpHeader->seq++;
+
+        return 1;
+    }
+
+    // 分片模式：NALU头不发送，拆到 FU indicator 和 FU header 中
+    // 每个报文的负载直接指向帧数据，不做复制
+    while (pos < frameSize)
+    {
+        struct RtpPacketView *view = &views[count];
+        uint32_t size = frameSize - pos;
+        uint8_t *fu;
+
+        if (count == maxViews)
+            return -1;
+
+        if (size > RTP_MAX_PKT_SIZE)
+            size = RTP_MAX_PKT_SIZE;
+
+        view->headerSize = rtpWriteViewHeader(view, rtpHeader);
+        fu = view->header + view->headerSize;
+        fu[0] = (naluType & 0x60) | 28; // FU indicator
+        fu[1] = naluType & 0x1F;        // FU header
+        if (pos == 1)
+            fu[1] |= 0x80; // start
+        if (pos + size == frameSize)
+            fu[1] |= 0x40; // end
+        view->headerSize += 2;
+
+        view->payload = frame + pos;
+        view->payloadSize = size;
+
+        rtpHeader->seq++;
+        pos += size;
+        count++;
+    }
+
+    return count;
+}
+
+int rtpPacketizeH265(struct RtpHeader *rtpHeader, const uint8_t *frame, uint32_t frameSize,
+                     struct RtpPacketView *views, int maxViews)
+{
+    uint32_t pos = 2;
+    int count = 0;
+
+    // 只有 2 字节 NALU 头的 NALU(EOS 36、EOB 37 等)也是合法的，用单一NALU模式发送
+    if (frameSize < 2)
+        return -1;
+
+    if (frameSize <= RTP_MAX_PKT_SIZE) // 单一NALU模式，NALU 头就是 PayloadHdr
+    {
+        if (maxViews < 1)
+            return -1;
+
+        views[0].headerSize = rtpWriteViewHeader(&views[0], rtpHeader);
+        views[0].payload = frame;
+        views[0].payloadSize = frameSize;
+        rtpHeader->seq++;
+
+        return 1;
+    }
+
+    // 分片模式：PayloadHdr 沿用 NALU 头中的 F、LayerId 和 TID，类型改为 49，
+    // 原来的类型放进 FU header 的低 6 位；到这里 NALU 比 RTP_MAX_PKT_SIZE 长，每个分片至少有 1 字节数据
+    while (pos < frameSize)
+    {
+        struct RtpPacketView *view = &views[count];
+        uint32_t size = frameSize - pos;
+        uint8_t *fu;
+
+        if (count == maxViews)
+            return -1;
+
+        if (size > RTP_MAX_PKT_SIZE)
+            size = RTP_MAX_PKT_SIZE;
+
+        view->headerSize = rtpWriteViewHeader(view, rtpHeader);
+        fu = view->header + view->headerSize;
+        fu[0] = (frame[0] & 0x81) | (49 << 1); // PayloadHdr
+        fu[1] = frame[1];
+        fu[2] = (frame[0] >> 1) & 0x3F;        // FU header
+        if (pos == 2)
+            fu[2] |= 0x80; // start
+        if (pos + size == frameSize)
+            fu[2] |= 0x40; // end
+        view->headerSize += 3;
+
+        view->payload = frame + pos;
+        view->payloadSize = size;
+
+        rtpHeader->seq++;
+        pos += size;
+        count++;
+    }
+
+    return count;
+}
+
+int rtpPacketizeH265Ap(struct RtpHeader *rtpHeader, const uint8_t *const *nalus,
+                       const uint32_t *sizes, int count, uint8_t *buf, struct RtpPacketView *view)
+{
+    uint32_t bytes = 0, pos = 2;
+    uint8_t forbidden = 0, layerId = 0x3F, tid = 7;
+    int i;
+
+    for (i = 0; i < count; i++)
+        bytes += sizes[i];
+
+    if (count < 2 || count > RTP_H265_MAX_AP_NALUS || rtpH265ApSize(count, bytes) > RTP_MAX_PKT_SIZE)
+        return -1;
+
+    for (i = 0; i < count; i++)
+    {
+        uint8_t nalLayerId = ((nalus[i][0] & 0x01) << 5) | (nalus[i][1] >> 3);
+
+        forbidden |= nalus[i][0] & 0x80;
+        if (nalLayerId < layerId)
+            layerId = nalLayerId;
+        if ((nalus[i][1] & 0x07) < tid)
+            tid = nalus[i][1] & 0x07;
+
+        buf[pos] = sizes[i] >> 8;
+        buf[pos + 1] = sizes[i];
+        memcpy(buf + pos + 2, nalus[i], sizes[i]);
+        pos += 2 + sizes[i];
+    }
+
+    buf[0] = forbidden | (48 << 1) | (layerId >> 5);
+    buf[1] = ((layerId & 0x1F) << 3) | tid;
+
+    view->headerSize = rtpWriteViewHeader(view, rtpHeader);
+    view->payload = buf;
+    view->payloadSize = pos;
+    rtpHeader->seq++;
+
+    return 1;
+}
+
+// AU-headers-length 和一个 AU header：AU-size(13 bit) + AU-Index/AU-Index-delta(3 bit，总是 0)
+static inline void rtpWriteAuHeaders(uint8_t *buf, int count)
+{
+    buf[0] = (count * 16) >> 8; // AU-headers-length 以 bit 为单位
+    buf[1] = count * 16;
+}
+
+static inline void rtpWriteAuHeader(uint8_t *buf, uint32_t auSize)
 {
-    rtpPacket->rtpHeader.csrcLen = csrcLen;
-    rtpPacket->rtpHeader.extension = extension;
-    rtpPacket->rtpHeader.padding = padding;
-    rtpPacket->rtpHeader.version = version;
-    rtpPacket->rtpHeader.payloadType = payloadType;
-    rtpPacket->rtpHeader.marker = marker;
-    rtpPacket->rtpHeader.seq = seq;
-    rtpPacket->rtpHeader.timestamp = timestamp;
-    rtpPacket->rtpHeader.ssrc = ssrc;
+    buf[0] = (auSize & 0x1FE0) >> 5; // AU-size 高8位
+    buf[1] = (auSize & 0x1F) << 3;   // AU-size 低5位
 }
 
-int rtpSendPacketOverUdp(int serverRtpSockfd, const char *ip, int16_t port, struct RtpPacket *rtpPacket, uint32_t dataSize)
+int rtpPacketizeAAC(struct RtpHeader *rtpHeader, const uint8_t *frame, uint32_t frameSize,
+                    struct RtpPacketView *views, int maxViews)
 {
+    uint32_t maxPayload = RTP_MAX_PKT_SIZE - 4;
+    uint32_t pos = 0;
+    int count = 0;
 
+    // 超过 MTU 的帧按 RFC 3640 分片：每个分片都带一个 AU header，AU-size 为整帧的长度，
+    // 时间戳相同，只有最后一个分片设置 marker
+    do
+    {
+        struct RtpPacketView *view = &views[count];
+        uint32_t size = frameSize - pos;
+
+        if (count == maxViews)
+            return -1;
+
+        if (size > maxPayload)
+            size = maxPayload;
+
+        rtpHeader->marker = pos + size == frameSize;
+        view->headerSize = rtpWriteViewHeader(view, rtpHeader);
+        rtpWriteAuHeaders(view->header + view->headerSize, 1);
+        rtpWriteAuHeader(view->header + view->headerSize + 2, frameSize);
+        view->headerSize += 4;
+
+        view->payload = frame + pos;
+        view->payloadSize = size;
+        rtpHeader->seq++;
+
+        pos += size;
+        count++;
+    } while (pos < frameSize);
+
+    return count;
+}
+
+int rtpPacketizeAACFrames(struct RtpHeader *rtpHeader, const uint8_t *const *frames,
+                          const uint32_t *sizes, int count, uint8_t *buf, struct RtpPacketView *view)
+{
+    uint32_t bytes = 0, pos;
+    int i;
+
+    for (i = 0; i < count; i++)
+        bytes += sizes[i];
+
+    if (count < 1 || count > RTP_AAC_MAX_AUS || rtpAACAggregateSize(count, bytes) > RTP_MAX_PKT_SIZE)
+        return -1;
+
+    // 负载：AU-headers-length + count 个 AU header + 依次排列的帧数据
+    // AU-Index-delta 为 0 表示各帧在时间上连续，接收端按第一帧的时间戳加上帧长推算
+    rtpWriteAuHeaders(buf, count);
+    pos = 2 + RTP_AAC_AU_HEADER_SIZE * count;
+    for (i = 0; i < count; i++)
+    {
+        rtpWriteAuHeader(buf + 2 + RTP_AAC_AU_HEADER_SIZE * i, sizes[i]);
+        memcpy(buf + pos, frames[i], sizes[i]);
+        pos += sizes[i];
+    }
+
+    rtpHeader->marker = 1; // 报文中都是完整的帧
+    view->headerSize = rtpWriteViewHeader(view, rtpHeader);
+    view->payload = buf;
+    view->payloadSize = pos;
+    rtpHeader->seq++;
+
+    return 1;
+}
+
+void rtpBatchInit(struct RtpBatch *batch, int sockfd, const struct sockaddr_in *addr)
+{
+    batch->sockfd = sockfd;
+    batch->addr = *addr;
+    batch->count = 0;
+}
+
+int rtpBatchAdd(struct RtpBatch *batch, const void *data, uint32_t size)
+{
+    return rtpBatchAddIov(batch, data, size, NULL, 0);
+}
+
+int rtpBatchAddIov(struct RtpBatch *batch, const void *header, uint32_t headerSize,
+                   const void *payload, uint32_t payloadSize)
+{
+    int ret = 0;
+
+    if (batch->count == RTP_BATCH_MAX_PKTS)
+        ret = rtpBatchFlush(batch);
+
+    batch->iov[batch->count * 2].iov_base = (void *)header;
+    batch->iov[batch->count * 2].iov_len = headerSize;
+    batch->iov[batch->count * 2 + 1].iov_base = (void *)payload;
+    batch->iov[batch->count * 2 + 1].iov_len = payloadSize;
+    batch->count++;
+
+    return ret < 0 ? -1 : 0;
+}
+
+void rtpBatchDisableGso(void)
+{
+    gsoUnsupported = 1;
+}
+
+static inline size_t rtpBatchPacketSize(struct RtpBatch *batch, int i)
+{
+    return batch->iov[i * 2].iov_len + batch->iov[i * 2 + 1].iov_len;
+}
+
+int rtpBatchFlush(struct RtpBatch *batch)
+{
+    struct mmsghdr msgs[RTP_BATCH_MAX_PKTS];
+    char control[RTP_BATCH_MAX_PKTS][CMSG_SPACE(sizeof(uint16_t))];
+    int firstPkt[RTP_BATCH_MAX_PKTS + 1]; // 每个 msg 从第几个报文开始
+    int pos = 0, sendBytes = 0;
+
+    while (pos < batch->count)
+    {
+        int msgCount = 0, i = pos, ret, k;
+
+        memset(msgs, 0, sizeof(msgs));
+
+        while (i < batch->count)
+        {
+            struct msghdr *msg = &msgs[msgCount].msg_hdr;
+            size_t segSize = rtpBatchPacketSize(batch, i);
+            size_t total = segSize;
+            int n = 1;
+
+            // 长度相同的连续报文合并成一次 GSO 发送，只有最后一段可以更短
+            if (!gsoUnsupported)
+            {
+                while (i + n < batch->count && n < RTP_GSO_MAX_SEGS &&
+                       rtpBatchPacketSize(batch, i + n) <= segSize &&
+                       total + rtpBatchPacketSize(batch, i + n) <= RTP_GSO_MAX_BYTES)
+                {
+                    total += rtpBatchPacketSize(batch, i + n);
+                    n++;
+                    if (rtpBatchPacketSize(batch, i + n - 1) < segSize)
+                        break;
+                }
+            }
+
+            msg->msg_name = &batch->addr;
+            msg->msg_namelen = sizeof(batch->addr);
+            msg->msg_iov = &batch->iov[i * 2];
+            msg->msg_iovlen = n * 2;
+
+            if (n > 1)
+            {
+                struct cmsghdr *cmsg;
+
+                msg->msg_control = control[msgCount];
+                msg->msg_controllen = sizeof(control[msgCount]);
+                cmsg = CMSG_FIRSTHDR(msg);
+                cmsg->cmsg_level = SOL_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                *(uint16_t *)CMSG_DATA(cmsg) = segSize;
+            }
+
+            firstPkt[msgCount++] = i;
+            i += n;
+        }
+        firstPkt[msgCount] = i;
+
+        ret = sendmmsg(batch->sockfd, msgs, msgCount, 0);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+
+            // 老内核或者网卡不支持 GSO，退回到逐个报文的 sendmmsg()
+            if (!gsoUnsupported && (errno == EINVAL || errno == EIO ||
+                                    errno == ENOPROTOOPT || errno == EOPNOTSUPP))
+            {
+                gsoUnsupported = 1;
+                continue;
+            }
+
+            batch->count = 0;
+            return -1;
+        }
+
+        for (k = 0; k < ret; k++)
+            sendBytes += msgs[k].msg_len;
+        pos = firstPkt[ret];
+    }
+
+    batch->count = 0;
+
+    return sendBytes;
+}
+
+int rtpSendPacketViewsOverUdp(int serverRtpSockfd, const char *ip, int16_t port,
+                              struct RtpPacketView *views, int count)
+{
     struct sockaddr_in addr;
-    int ret;
+    struct RtpBatch batch;
+    int i;
 
     memset(&addr, 0, sizeof(addr));
     addr.sin_family = AF_INET;
     addr.sin_port = htons(port);
     addr.sin_addr.s_addr = inet_addr(ip);
 
-    rtpPacket->rtpHeader.seq = htons(rtpPacket->rtpHeader.seq); // 从主机字节顺序转变成网络字节顺序
-    rtpPacket->rtpHeader.timestamp = htonl(rtpPacket->rtpHeader.timestamp);
-    rtpPacket->rtpHeader.ssrc = htonl(rtpPacket->rtpHeader.ssrc);
+    rtpBatchInit(&batch, serverRtpSockfd, &addr);
+    for (i = 0; i < count; i++)
+    {
+        if (rtpBatchAddIov(&batch, views[i].header, views[i].headerSize,
+                           views[i].payload, views[i].payloadSize) < 0)
+            return -1;
+    }
+
+    return rtpBatchFlush(&batch);
+}
+
+int rtpSendPacketViewsOverTcp(int clientSockfd, uint8_t channel,
+                              struct RtpPacketView *views, int count)
+{
+    uint8_t interleaved[RTP_BATCH_MAX_PKTS][RTP_INTERLEAVED_HEADER_SIZE];
+    struct iovec iov[RTP_BATCH_MAX_PKTS * 3];
+    int sendBytes = 0, i, n, ret;
+
+    // 每次最多合并 RTP_BATCH_MAX_PKTS 个报文，用一次 writev() 发送
+    while (count > 0)
+    {
+        n = count < RTP_BATCH_MAX_PKTS ? count : RTP_BATCH_MAX_PKTS;
+
+        for (i = 0; i < n; i++)
+        {
+            rtpWriteInterleavedHeader(interleaved[i], channel, views[i].headerSize + views[i].payloadSize);
+            iov[i * 3].iov_base = interleaved[i];
+            iov[i * 3].iov_len = RTP_INTERLEAVED_HEADER_SIZE;
+            iov[i * 3 + 1].iov_base = views[i].header;
+            iov[i * 3 + 1].iov_len = views[i].headerSize;
+            iov[i * 3 + 2].iov_base = (void *)views[i].payload;
+            iov[i * 3 + 2].iov_len = views[i].payloadSize;
+        }
 
-    ret = sendto(serverRtpSockfd, (char *)rtpPacket, dataSize + RTP_HEADER_SIZE, 0,
-                 (struct sockaddr *)&addr, sizeof(addr));
+        ret = writevAll(clientSockfd, iov, n * 3);
+        if (ret < 0)
+            return -1;
 
-    rtpPacket->rtpHeader.seq = ntohs(rtpPacket->rtpHeader.seq);
-    rtpPacket->rtpHeader.timestamp = ntohl(rtpPacket->rtpHeader.timestamp);
-    rtpPacket->rtpHeader.ssrc = ntohl(rtpPacket->rtpHeader.ssrc);
+        sendBytes += ret;
+        views += n;
+        count -= n;
+    }
 
-    return ret;
+    return sendBytes;
 }
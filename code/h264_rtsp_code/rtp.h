@@ -1,55 +1,110 @@
-#include <stdint.h>
+#ifndef _RTP_H_
+#define _RTP_H_
 
-#define RTP_VESION 2
+#include <stdint.h>
+#include <netinet/in.h>
+#include <sys/uio.h>
+#include "rtpheader.h"
 
 #define RTP_PAYLOAD_TYPE_H264 96
 #define RTP_PAYLOAD_TYPE_AAC 97
+#define RTP_PAYLOAD_TYPE_H265 98
 
-#define RTP_HEADER_SIZE 12
 #define RTP_MAX_PKT_SIZE 1400
 
+// 一次批量发送最多缓存的 RTP 包数，超过后自动发送
+#define RTP_BATCH_MAX_PKTS 64
 
-struct RtpHeader
+// 零拷贝打包后的一个 RTP 报文：header 中是网络字节序的 RTP 头(包括 CSRC 和扩展)，后面跟着
+// FU indicator/FU header、AU header 等负载前缀，payload 直接指向原始帧数据
+// 发送时 header 和 payload 作为两个 iovec，帧数据不需要复制
+struct RtpPacketView
 {
-    /* byte 0 */
-    uint8_t csrcLen : 4;   // CSRC计数器，占4位，指示CSRC 标识符的个数。
-    uint8_t extension : 1; // 占1位，如果X=1，则在RTP报头后跟有一个扩展报头。
-    uint8_t padding : 1;   // 填充标志，占1位，如果P=1，则在该报文的尾部填充一个或多个额外的八位组，它们不是有效载荷的一部分。
-    uint8_t version : 2;   // RTP协议的版本号，占2位，当前协议版本号为2。
+    uint8_t header[RTP_MAX_HEADER_SIZE + 4];
+    uint32_t headerSize;
+    uint32_t rtpHeaderSize; // 其中 RTP 头的长度，剩下的是负载前缀
+    const uint8_t *payload;
+    uint32_t payloadSize;
+};
 
-    /* byte 1 */
-    uint8_t payloadType : 7; // 有效载荷类型，占7位，用于说明RTP报文中有效载荷的类型，如GSM音频、JPEM图像等。
-    uint8_t marker : 1;      // 标记，占1位，不同的有效载荷有不同的含义，对于视频，标记一帧的结束；对于音频，标记会话的开始。
+// 把一个 H.264 NALU(不含起始码)按单一NALU或FU-A模式打包到 views 中
+// rtpHeader 为主机字节序的头部模板，每打包一个报文序列号加一，时间戳由调用者维护
+// 返回报文个数，views 不够用时返回 -1
+int rtpPacketizeH264(struct RtpHeader *rtpHeader, const uint8_t *frame, uint32_t frameSize,
+                     struct RtpPacketView *views, int maxViews);
+// 把一个 H.265 NALU(不含起始码，2 字节的 NALU 头)按单一NALU或FU(type 49)模式打包(RFC 7798)，规则同上
+int rtpPacketizeH265(struct RtpHeader *rtpHeader, const uint8_t *frame, uint32_t frameSize,
+                     struct RtpPacketView *views, int maxViews);
+// 把一个 AAC 帧(不含 ADTS 头)加上 AU header 打包(RFC 3640 AAC-hbr)，规则同上
+// 超过 RTP_MAX_PKT_SIZE 的帧拆成多个分片，只有最后一个分片设置 marker
+int rtpPacketizeAAC(struct RtpHeader *rtpHeader, const uint8_t *frame, uint32_t frameSize,
+                    struct RtpPacketView *views, int maxViews);
 
-    /* bytes 2,3 */
-    uint16_t seq; // 占16位，用于标识发送者所发送的RTP报文的序列号，每发送一个报文，序列号增1。接收者通过序列号来检测报文丢失情况，重新排序报文，恢复数据。
+// AAC-hbr 中每个 AU 的 AU header 为 2 字节，AU header 区前面还有 2 字节的 AU-headers-length
+#define RTP_AAC_AU_HEADER_SIZE 2
+// 一个报文最多聚合的 AAC 帧数
+#define RTP_AAC_MAX_AUS 32
 
-    /* bytes 4-7 */
-    uint32_t timestamp; // 占32位，时戳反映了该RTP报文的第一个八位组的采样时刻。接收者使用时戳来计算延迟和延迟抖动，并进行同步控制。
+// count 个帧、共 bytes 字节的帧数据聚合成一个报文后的负载长度
+static inline uint32_t rtpAACAggregateSize(int count, uint32_t bytes)
+{
+    return 2 + RTP_AAC_AU_HEADER_SIZE * count + bytes;
+}
 
-    /* bytes 8-11 */
-    uint32_t ssrc; // 占32位，用于标识同步信源。该标识符是随机选择的，参加同一视频会议的两个同步信源不能有相同的SSRC。
+// 把 count 个时间上连续的 AAC 帧聚合成一个报文，时间戳为第一帧的时间戳
+// 帧在文件中被 ADTS 头隔开，所以 AU header 和帧数据一起复制到 buf，view 的负载指向 buf
+// buf 至少 RTP_MAX_PKT_SIZE 字节，聚合后超过 RTP_MAX_PKT_SIZE 时返回 -1，否则返回 1
+int rtpPacketizeAACFrames(struct RtpHeader *rtpHeader, const uint8_t *const *frames,
+                          const uint32_t *sizes, int count, uint8_t *buf, struct RtpPacketView *view);
 
-    /*标准的RTP Header 还可能存在 0-15个特约信源(CSRC)标识符
+// H.265 AP(type 48)：2 字节的 PayloadHdr 之后，每个 NALU 前面有 2 字节的长度
+#define RTP_H265_MAX_AP_NALUS 16
 
-    每个CSRC标识符占32位，可以有0～15个。每个CSRC标识了包含在该RTP报文有效载荷中的所有特约信源
+// count 个 NALU、共 bytes 字节聚合成一个 AP 后的负载长度
+static inline uint32_t rtpH265ApSize(int count, uint32_t bytes)
+{
+    return 2 + 2 * count + bytes;
+}
 
-    */
-};
+// 把同一个访问单元中的 count 个 NALU(例如 VPS/SPS/PPS)聚合成一个 AP 报文，数据复制到 buf，
+// view 的负载指向 buf；PayloadHdr 的 F 取各 NALU 的或，LayerId 和 TID 取最小值
+// buf 至少 RTP_MAX_PKT_SIZE 字节，count 小于 2 或者超过 RTP_MAX_PKT_SIZE 时返回 -1，否则返回 1
+int rtpPacketizeH265Ap(struct RtpHeader *rtpHeader, const uint8_t *const *nalus,
+                       const uint32_t *sizes, int count, uint8_t *buf, struct RtpPacketView *view);
 
-struct RtpPacket
+// 批量发送：把发往同一地址的多个 RTP 报文(例如一帧的所有 FU-A 分片)攒起来，
+// 用一次 sendmmsg() 发送；内核支持 UDP GSO(UDP_SEGMENT)时，
+// 长度相同的连续报文再合并成一个超大报文，由内核切分
+// 缓存的只是指针，rtpBatchFlush() 之前报文内容不能修改或释放
+struct RtpBatch
 {
-    struct RtpHeader rtpHeader;
-    uint8_t payload[0];
+    int sockfd;
+    struct sockaddr_in addr;
+    int count;
+    struct iovec iov[RTP_BATCH_MAX_PKTS * 2]; // 每个报文两段：头部和负载
 };
 
-// 初始化struct RtpPacket中的struct RtpHeader字段，可以设置各个字段的值
-void rtpHeaderInit(struct RtpPacket *rtpPacket, uint8_t csrcLen, uint8_t extension,
-                   uint8_t padding, uint8_t version, uint8_t payloadType, uint8_t marker,
-                   uint16_t seq, uint32_t timestamp, uint32_t ssrc);
+void rtpBatchInit(struct RtpBatch *batch, int sockfd, const struct sockaddr_in *addr);
+// data 为完整的 RTP 报文(包含头部)，size 为报文总长度
+int rtpBatchAdd(struct RtpBatch *batch, const void *data, uint32_t size);
+// 报文由头部和负载两段组成，发送时由内核拼接
+int rtpBatchAddIov(struct RtpBatch *batch, const void *header, uint32_t headerSize,
+                   const void *payload, uint32_t payloadSize);
+// 发送缓存的所有报文，返回发送的字节数，出错返回 -1
+int rtpBatchFlush(struct RtpBatch *batch);
+// 之后的批量发送不再使用 UDP GSO，只用 sendmmsg()，用于对比测试
+void rtpBatchDisableGso(void);
+
+// RTP over RTSP 的帧头：'$' + 通道号(1字节) + 报文长度(2字节)
+#define RTP_INTERLEAVED_HEADER_SIZE 4
+void rtpWriteInterleavedHeader(uint8_t *buf, uint8_t channel, uint16_t size);
+
+// 把打包好的若干报文加上 '$' 帧头，通过 RTSP 的 TCP 连接阻塞地发送
+int rtpSendPacketViewsOverTcp(int clientSockfd, uint8_t channel,
+                              struct RtpPacketView *views, int count);
+
+// 把打包好的若干报文通过一次批量发送发给指定的IP地址和端口
+int rtpSendPacketViewsOverUdp(int serverRtpSockfd, const char *ip, int16_t port,
+                              struct RtpPacketView *views, int count);
 
-// 通过TCP将RTP报文发送给客户端，它接受一个客户端套接字描述符、指向RTP报文的指针以及数据大小，并将报文发送给客户端
-int rtpSendPacketOverTcp(int clientSockfd, struct RtpPacket *rtpPacket, uint32_t dataSize);
-// 通过UDP将RTP报文发送给指定的IP地址和端口号，它接受一个服务器的RTP套接字描述符，目标IP地址、目标端口号、
-// 指向RTP报文的指针以及数据大小，并将报文发送给指定的地址和端口
-int rtpSendPacketOverUdp(int serverRtpSockfd, const char *ip, int16_t port, struct RtpPacket *rtpPacket, uint32_t dataSize);
+#endif
@@ -0,0 +1,241 @@
+// RTP 发送的对比测试：同一个 H.264 文件按帧打包后，分别用
+//   sendto   每个报文拼到一个缓冲区后调用一次 sendto()(原来 rtpSendPacketOverUdp() 的做法)
+//   sendmmsg 一帧的报文用 rtpBatch 攒起来，一次 sendmmsg()，关闭 GSO
+//   gso      同上，长度相同的分片再合并成 UDP GSO 超大报文
+// 发给本机一个不读取的 UDP 套接字，输出每秒报文数和每帧的系统调用次数
+// gcc -O2 rtp_send_bench.c rtp.c rtpheader.c nalu.c -o rtp_send_bench
+// ./rtp_send_bench [-d 每种方式的秒数] test.h264
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "rtp.h"
+#include "nalu.h"
+
+#define MAX_VIEWS_PER_NALU 4096
+
+enum
+{
+    MODE_SENDTO,
+    MODE_SENDMMSG,
+    MODE_GSO,
+};
+
+static const char *modeNames[] = {"sendto", "sendmmsg", "sendmmsg+gso"};
+
+// 一帧打包后的报文在 views 中的范围
+struct Frame
+{
+    int first;
+    int count;
+    int isIdr;
+};
+
+static struct RtpPacketView *views;
+static int viewCount;
+static struct Frame *frames;
+static int frameCount;
+
+// 统计发送用的系统调用次数：rtp.c 和本文件中对这两个函数的调用都会链接到这里
+static uint64_t syscallCount;
+
+int sendmmsg(int sockfd, struct mmsghdr *msgvec, unsigned int vlen, int flags)
+{
+    syscallCount++;
+    return syscall(SYS_sendmmsg, sockfd, msgvec, vlen, flags);
+}
+
+ssize_t sendto(int sockfd, const void *buf, size_t len, int flags,
+               const struct sockaddr *addr, socklen_t addrLen)
+{
+    syscallCount++;
+    return syscall(SYS_sendto, sockfd, buf, len, flags, addr, addrLen);
+}
+
+static uint64_t getMonotonicUs(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// 把整个文件按访问单元打包成报文，之后每种方式都发送同样的报文
+static int loadFrames(const char *fileName)
+{
+    struct AnnexbSource source;
+    struct RtpHeader rtpHeader;
+    int maxViews = 1024, maxFrames = 256;
+    int first, count, i;
+
+    if (annexbOpen(&source, fileName, NULL) < 0)
+        return -1;
+
+    views = (struct RtpPacketView *)malloc(maxViews * sizeof(*views));
+    frames = (struct Frame *)malloc(maxFrames * sizeof(*frames));
+    rtpHeaderInit(&rtpHeader, RTP_PAYLOAD_TYPE_H264, 0, 0, 0x12345678);
+
+    while ((count = annexbNextAccessUnit(&source, &first)) > 0)
+    {
+        struct Frame *frame;
+
+        if (frameCount == maxFrames)
+        {
+            maxFrames *= 2;
+            frames = (struct Frame *)realloc(frames, maxFrames * sizeof(*frames));
+        }
+        frame = &frames[frameCount++];
+        frame->first = viewCount;
+        frame->count = 0;
+        frame->isIdr = 0;
+
+        for (i = first; i < first + count; i++)
+        {
+            const struct NaluIndexEntry *nalu = &source.nalus[i];
+            int n;
+
+            if ((nalu->header & 0x1F) == 5)
+                frame->isIdr = 1;
+            while (viewCount + MAX_VIEWS_PER_NALU > maxViews)
+            {
+                maxViews *= 2;
+                views = (struct RtpPacketView *)realloc(views, maxViews * sizeof(*views));
+            }
+            n = rtpPacketizeH264(&rtpHeader, source.data + nalu->offset, nalu->size,
+                                 views + viewCount, MAX_VIEWS_PER_NALU);
+            if (n < 0)
+                return -1;
+            viewCount += n;
+            frame->count += n;
+        }
+        rtpHeader.timestamp += 3600;
+    }
+
+    // 报文的负载指向映射的文件，测试期间不关闭
+    return frameCount > 0 ? 0 : -1;
+}
+
+static void sendFrameSendto(int sockfd, const struct sockaddr_in *addr, const struct Frame *frame)
+{
+    uint8_t buf[RTP_MAX_HEADER_SIZE + 4 + RTP_MAX_PKT_SIZE];
+    int i;
+
+    for (i = frame->first; i < frame->first + frame->count; i++)
+    {
+        memcpy(buf, views[i].header, views[i].headerSize);
+        memcpy(buf + views[i].headerSize, views[i].payload, views[i].payloadSize);
+        sendto(sockfd, buf, views[i].headerSize + views[i].payloadSize, 0,
+               (const struct sockaddr *)addr, sizeof(*addr));
+    }
+}
+
+static void sendFrameBatch(int sockfd, const struct sockaddr_in *addr, const struct Frame *frame)
+{
+    struct RtpBatch batch;
+    int i;
+
+    rtpBatchInit(&batch, sockfd, addr);
+    for (i = frame->first; i < frame->first + frame->count; i++)
+        rtpBatchAddIov(&batch, views[i].header, views[i].headerSize, views[i].payload, views[i].payloadSize);
+    rtpBatchFlush(&batch);
+}
+
+// 按 mode 循环发送整个文件 seconds 秒
+static void runMode(int mode, int sockfd, const struct sockaddr_in *addr, int seconds)
+{
+    uint64_t startUs, endUs, packets = 0, frameRuns = 0, idrRuns = 0, idrPackets = 0;
+    uint64_t syscalls, idrSyscalls = 0, before;
+    int i;
+
+    if (mode == MODE_SENDMMSG)
+        rtpBatchDisableGso();
+
+    syscallCount = 0;
+    startUs = getMonotonicUs();
+    endUs = startUs + (uint64_t)seconds * 1000000;
+
+    while (getMonotonicUs() < endUs)
+    {
+        for (i = 0; i < frameCount; i++)
+        {
+            before = syscallCount;
+            if (mode == MODE_SENDTO)
+                sendFrameSendto(sockfd, addr, &frames[i]);
+            else
+                sendFrameBatch(sockfd, addr, &frames[i]);
+
+            packets += frames[i].count;
+            frameRuns++;
+            if (frames[i].isIdr)
+            {
+                idrRuns++;
+                idrPackets += frames[i].count;
+                idrSyscalls += syscallCount - before;
+            }
+        }
+    }
+
+    syscalls = syscallCount;
+    endUs = getMonotonicUs();
+    printf("%-13s %10.0f pkt/s %8.0f frame/s  syscalls/frame %.2f  pkts/frame %.2f",
+           modeNames[mode], packets * 1e6 / (endUs - startUs), frameRuns * 1e6 / (endUs - startUs),
+           (double)syscalls / frameRuns, (double)packets / frameRuns);
+    if (idrRuns > 0)
+        printf("  idr: %.1f pkts, %.2f syscalls", (double)idrPackets / idrRuns, (double)idrSyscalls / idrRuns);
+    printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+    struct sockaddr_in addr;
+    socklen_t addrLen = sizeof(addr);
+    int seconds = 3;
+    int sinkfd, sockfd, opt;
+
+    while ((opt = getopt(argc, argv, "d:")) != -1)
+    {
+        if (opt != 'd')
+            break;
+        seconds = atoi(optarg);
+    }
+    if (optind >= argc || seconds <= 0)
+    {
+        printf("usage: %s [-d seconds_per_mode] file.h264\n", argv[0]);
+        return -1;
+    }
+
+    if (loadFrames(argv[optind]) < 0)
+    {
+        printf("failed to load %s\n", argv[optind]);
+        return -1;
+    }
+    printf("%s: %d frames, %d rtp packets\n", argv[optind], frameCount, viewCount);
+
+    // 接收端只绑定不读取，缓冲区满了之后内核直接丢弃，发送端照常走完整个发送路径
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+    sinkfd = socket(AF_INET, SOCK_DGRAM, 0);
+    sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sinkfd < 0 || sockfd < 0 || bind(sinkfd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+        return -1;
+    getsockname(sinkfd, (struct sockaddr *)&addr, &addrLen);
+
+    // GSO 要在关闭之前测
+    runMode(MODE_SENDTO, sockfd, &addr, seconds);
+    runMode(MODE_GSO, sockfd, &addr, seconds);
+    runMode(MODE_SENDMMSG, sockfd, &addr, seconds);
+
+    close(sockfd);
+    close(sinkfd);
+
+    return 0;
+}
@@ -0,0 +1,167 @@
+#include <string.h>
+#include "rtpheader.h"
+
+static inline void writeU16(uint8_t *buf, uint16_t value)
+{
+    buf[0] = value >> 8;
+    buf[1] = value;
+}
+
+static inline void writeU32(uint8_t *buf, uint32_t value)
+{
+    buf[0] = value >> 24;
+    buf[1] = value >> 16;
+    buf[2] = value >> 8;
+    buf[3] = value;
+}
+
+void rtpHeaderInit(struct RtpHeader *rtpHeader, uint8_t payloadType, uint16_t seq,
+                   uint32_t timestamp, uint32_t ssrc)
+{
+    memset(rtpHeader, 0, sizeof(*rtpHeader));
+    rtpHeader->version = RTP_VESION;
+    rtpHeader->payloadType = payloadType;
+    rtpHeader->seq = seq;
+    rtpHeader->timestamp = timestamp;
+    rtpHeader->ssrc = ssrc;
+}
+
+static inline uint32_t rtpHeaderCsrcCount(const struct RtpHeader *rtpHeader)
+{
+    return rtpHeader->csrcLen < RTP_MAX_CSRC ? rtpHeader->csrcLen : RTP_MAX_CSRC;
+}
+
+uint32_t rtpHeaderSize(const struct RtpHeader *rtpHeader)
+{
+    uint32_t size = RTP_HEADER_SIZE + 4 * rtpHeaderCsrcCount(rtpHeader);
+
+    // 扩展长度以 32 bit 为单位
+    if (rtpHeader->extensionSize > 0)
+        size += 4 + (rtpHeader->extensionSize + 3) / 4 * 4;
+
+    return size;
+}
+
+int rtpHeaderWrite(uint8_t *buf, uint32_t size, const struct RtpHeader *rtpHeader)
+{
+    uint32_t csrcCount = rtpHeaderCsrcCount(rtpHeader);
+    uint32_t headerSize = rtpHeaderSize(rtpHeader);
+    uint8_t *p = buf + RTP_HEADER_SIZE;
+    uint32_t i;
+
+    if (size < headerSize)
+        return -1;
+
+    buf[0] = (rtpHeader->version << 6) | (rtpHeader->padding ? 0x20 : 0) |
+             (rtpHeader->extensionSize > 0 ? 0x10 : 0) | csrcCount;
+    buf[1] = (rtpHeader->marker ? 0x80 : 0) | (rtpHeader->payloadType & 0x7F);
+    writeU16(buf + 2, rtpHeader->seq);
+    writeU32(buf + 4, rtpHeader->timestamp);
+    writeU32(buf + 8, rtpHeader->ssrc);
+
+    for (i = 0; i < csrcCount; i++, p += 4)
+        writeU32(p, rtpHeader->csrc[i]);
+
+    if (rtpHeader->extensionSize > 0)
+    {
+        uint32_t words = (rtpHeader->extensionSize + 3) / 4;
+
+        writeU16(p, rtpHeader->extensionProfile);
+        writeU16(p + 2, words);
+        memcpy(p + 4, rtpHeader->extensionData, rtpHeader->extensionSize);
+        // one-byte 形式中 0 是填充
+        memset(p + 4 + rtpHeader->extensionSize, 0, words * 4 - rtpHeader->extensionSize);
+    }
+
+    return headerSize;
+}
+
+int rtpHeaderAddCsrc(struct RtpHeader *rtpHeader, uint32_t csrc)
+{
+    if (rtpHeader->csrcLen >= RTP_MAX_CSRC)
+        return -1;
+
+    rtpHeader->csrc[rtpHeader->csrcLen++] = csrc;
+
+    return 0;
+}
+
+int rtpHeaderAddExtension(struct RtpHeader *rtpHeader, uint8_t id, const void *data, uint32_t size)
+{
+    uint8_t *p;
+
+    // ID 0 是填充，15 保留
+    if (id < 1 || id > 14 || size < 1 || size > 16)
+        return -1;
+
+    if (rtpHeader->extensionSize > 0 && rtpHeader->extensionProfile != RTP_EXTENSION_ONE_BYTE)
+        return -1;
+
+    if (rtpHeader->extensionSize + 1 + size > RTP_MAX_EXTENSION_SIZE)
+        return -1;
+
+    rtpHeader->extensionProfile = RTP_EXTENSION_ONE_BYTE;
+    p = rtpHeader->extensionData + rtpHeader->extensionSize;
+    p[0] = (id << 4) | (size - 1);
+    memcpy(p + 1, data, size);
+    rtpHeader->extensionSize += 1 + size;
+
+    return 0;
+}
+
+int rtpHeaderAddAbsSendTime(struct RtpHeader *rtpHeader, uint8_t id, uint64_t timeUs)
+{
+    uint8_t data[3];
+
+    rtpWriteAbsSendTime(data, timeUs);
+
+    return rtpHeaderAddExtension(rtpHeader, id, data, sizeof(data));
+}
+
+int rtpHeaderAddTransportSeq(struct RtpHeader *rtpHeader, uint8_t id, uint16_t seq)
+{
+    uint8_t data[2];
+
+    writeU16(data, seq);
+
+    return rtpHeaderAddExtension(rtpHeader, id, data, sizeof(data));
+}
+
+uint8_t *rtpHeaderFindExtension(uint8_t *buf, uint32_t size, uint8_t id, uint32_t *dataSize)
+{
+    uint32_t pos = RTP_HEADER_SIZE + 4 * (buf[0] & 0x0F);
+    uint32_t end;
+
+    if (!(buf[0] & 0x10) || size < pos + 4 ||
+        ((buf[pos] << 8) | buf[pos + 1]) != RTP_EXTENSION_ONE_BYTE)
+        return NULL;
+
+    end = pos + 4 + 4 * ((buf[pos + 2] << 8) | buf[pos + 3]);
+    if (end > size)
+        return NULL;
+
+    pos += 4;
+    while (pos < end)
+    {
+        uint8_t elementId = buf[pos] >> 4;
+        uint32_t elementSize = (buf[pos] & 0x0F) + 1;
+
+        if (buf[pos] == 0) // 填充
+        {
+            pos++;
+            continue;
+        }
+        if (elementId == 15 || pos + 1 + elementSize > end)
+            break;
+
+        if (elementId == id)
+        {
+            *dataSize = elementSize;
+            return buf + pos + 1;
+        }
+
+        pos += 1 + elementSize;
+    }
+
+    return NULL;
+}
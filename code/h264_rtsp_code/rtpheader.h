@@ -0,0 +1,117 @@
+#ifndef _RTPHEADER_H_
+#define _RTPHEADER_H_
+
+#include <stdint.h>
+
+#define RTP_VESION 2
+
+#define RTP_HEADER_SIZE 12
+#define RTP_MAX_CSRC 15
+// 头部扩展数据(不含 4 字节的扩展头)的最大长度
+#define RTP_MAX_EXTENSION_SIZE 16
+// 带满 CSRC 和扩展时的头部长度
+#define RTP_MAX_HEADER_SIZE (RTP_HEADER_SIZE + 4 * RTP_MAX_CSRC + 4 + RTP_MAX_EXTENSION_SIZE)
+
+// RFC 8285 one-byte 形式的头部扩展，每个元素 1 字节(ID 4 bit + 长度-1 4 bit)加 1 ~ 16 字节数据
+#define RTP_EXTENSION_ONE_BYTE 0xBEDE
+
+/*
+ *    0                   1                   2                   3
+ *    7 6 5 4 3 2 1 0|7 6 5 4 3 2 1 0|7 6 5 4 3 2 1 0|7 6 5 4 3 2 1 0
+ *   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *   |V=2|P|X|  CC   |M|     PT      |       sequence number         |
+ *   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *   |                           timestamp                           |
+ *   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *   |           synchronization source (SSRC) identifier            |
+ *   +=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+
+ *   |            contributing source (CSRC) identifiers             |
+ *   :                             ....                              :
+ *   +=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+=+
+ *   |      defined by profile       |           length              |
+ *   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *   |                        header extension                       |
+ *   :                             ....                              :
+ *   +-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+ *
+ */
+
+// RTP 头部，字段都是主机字节序，用 rtpHeaderWrite() 写成报文中的格式
+// 不依赖编译器的位域布局，也不需要在发送前后来回转换字节序
+struct RtpHeader
+{
+    uint8_t version;     // RTP协议的版本号，占2位，当前协议版本号为2。
+    uint8_t padding;     // 填充标志，占1位，如果P=1，则在该报文的尾部填充一个或多个额外的八位组，它们不是有效载荷的一部分。
+    uint8_t csrcLen;     // CSRC计数器，占4位，指示CSRC 标识符的个数。
+    uint8_t marker;      // 标记，占1位，不同的有效载荷有不同的含义，对于视频，标记一帧的结束；对于音频，标记会话的开始。
+    uint8_t payloadType; // 有效载荷类型，占7位，用于说明RTP报文中有效载荷的类型，如GSM音频、JPEM图像等。
+
+    uint16_t seq;       // 占16位，用于标识发送者所发送的RTP报文的序列号，每发送一个报文，序列号增1。
+    uint32_t timestamp; // 占32位，时戳反映了该RTP报文的第一个八位组的采样时刻。接收者使用时戳来计算延迟和延迟抖动，并进行同步控制。
+    uint32_t ssrc;      // 占32位，用于标识同步信源。该标识符是随机选择的，参加同一视频会议的两个同步信源不能有相同的SSRC。
+
+    // 0 ~ 15 个特约信源(CSRC)，标识了包含在该RTP报文有效载荷中的所有特约信源
+    uint32_t csrc[RTP_MAX_CSRC];
+
+    // 头部扩展，extensionSize 不为 0 时设置 X 位，写出时补 0 到 4 字节对齐
+    uint16_t extensionProfile;
+    uint16_t extensionSize;
+    uint8_t extensionData[RTP_MAX_EXTENSION_SIZE];
+};
+
+void rtpHeaderInit(struct RtpHeader *rtpHeader, uint8_t payloadType, uint16_t seq,
+                   uint32_t timestamp, uint32_t ssrc);
+
+// 写出后的头部长度，csrcLen 超过 15 时按 15 计算
+uint32_t rtpHeaderSize(const struct RtpHeader *rtpHeader);
+// 写出网络字节序的头部(包括 CSRC 和扩展)，返回写入的字节数，size 不够时返回 -1
+int rtpHeaderWrite(uint8_t *buf, uint32_t size, const struct RtpHeader *rtpHeader);
+
+// 添加一个 CSRC，已满时返回 -1
+int rtpHeaderAddCsrc(struct RtpHeader *rtpHeader, uint32_t csrc);
+
+// 添加一个 one-byte 形式的扩展元素，id 为 1 ~ 14，数据 1 ~ 16 字节
+// 已经有其他形式的扩展或者放不下时返回 -1
+int rtpHeaderAddExtension(struct RtpHeader *rtpHeader, uint8_t id, const void *data, uint32_t size);
+// abs-send-time：发送时刻的 6.18 定点秒数，共 24 bit
+// http://www.webrtc.org/experiments/rtp-hdrext/abs-send-time
+int rtpHeaderAddAbsSendTime(struct RtpHeader *rtpHeader, uint8_t id, uint64_t timeUs);
+// transport-wide-cc：同一传输通道上所有报文共用的 16 bit 序列号
+// http://www.ietf.org/id/draft-holmer-rmcat-transport-wide-cc-extensions-01
+int rtpHeaderAddTransportSeq(struct RtpHeader *rtpHeader, uint8_t id, uint16_t seq);
+
+// 在写好的头部中找到 one-byte 扩展元素的数据，找不到返回 NULL
+// 同一个头部发给多个接收者时，可以像序列号一样就地改写每个报文的扩展数据
+uint8_t *rtpHeaderFindExtension(uint8_t *buf, uint32_t size, uint8_t id, uint32_t *dataSize);
+
+// 就地改写已经写好的头部中的字段
+static inline void rtpHeaderSetMarker(uint8_t *buf, int marker)
+{
+    buf[1] = (buf[1] & 0x7F) | (marker ? 0x80 : 0);
+}
+
+static inline void rtpHeaderSetSeq(uint8_t *buf, uint16_t seq)
+{
+    buf[2] = seq >> 8;
+    buf[3] = seq;
+}
+
+static inline void rtpHeaderSetSsrc(uint8_t *buf, uint32_t ssrc)
+{
+    buf[8] = ssrc >> 24;
+    buf[9] = ssrc >> 16;
+    buf[10] = ssrc >> 8;
+    buf[11] = ssrc;
+}
+
+static inline void rtpWriteAbsSendTime(uint8_t *data, uint64_t timeUs)
+{
+    // 秒数左移 18 位，只保留低 24 bit(64 秒回绕)
+    uint32_t value = ((timeUs << 18) / 1000000) & 0xFFFFFF;
+
+    data[0] = value >> 16;
+    data[1] = value >> 8;
+    data[2] = value;
+}
+
+#endif
@@ -0,0 +1,260 @@
+// rtpheader.c 的测试：按 RFC 3550 / RFC 8285 手工写出期望的报文字节，和 rtpHeaderWrite() 的结果逐字节比较
+// 覆盖固定头部、CSRC、one-byte 扩展的补齐、rtpHeaderFindExtension() 的查找和越界检查、abs-send-time 的 64 秒回绕
+// gcc rtpheader_test.c rtpheader.c -o rtpheader_test
+// ./rtpheader_test，全部通过时返回 0
+#include <stdio.h>
+#include <string.h>
+#include "rtpheader.h"
+
+static int failures = 0;
+
+#define CHECK(cond)                                                          \
+    do                                                                       \
+    {                                                                        \
+        if (!(cond))                                                         \
+        {                                                                    \
+            printf("FAIL %s:%d: %s\n", __FUNCTION__, __LINE__, #cond);       \
+            failures++;                                                      \
+        }                                                                    \
+    } while (0)
+
+// 写出的头部和期望的字节不同时打印两者，方便看出是哪个字节
+static void checkBytes(const char *name, const uint8_t *buf, int len, const uint8_t *expect, int expectLen)
+{
+    int i;
+
+    if (len == expectLen && memcmp(buf, expect, len) == 0)
+        return;
+
+    printf("FAIL %s: wire image differs\n  got   ", name);
+    for (i = 0; i < len; i++)
+        printf(" %02x", buf[i]);
+    printf("\n  expect");
+    for (i = 0; i < expectLen; i++)
+        printf(" %02x", expect[i]);
+    printf("\n");
+    failures++;
+}
+
+// 固定的 12 字节头部：V=2 P=0 X=0 CC=0，M 和 PT 在第二个字节，其余都是网络字节序
+static void testFixedHeader(void)
+{
+    static const uint8_t expect[] = {
+        0x80, 0xE0, 0x12, 0x34,
+        0xDE, 0xAD, 0xBE, 0xEF,
+        0x01, 0x02, 0x03, 0x04,
+    };
+    struct RtpHeader header;
+    uint8_t buf[RTP_MAX_HEADER_SIZE];
+    int len;
+
+    rtpHeaderInit(&header, 96, 0x1234, 0xDEADBEEF, 0x01020304);
+    header.marker = 1;
+
+    CHECK(rtpHeaderSize(&header) == RTP_HEADER_SIZE);
+    len = rtpHeaderWrite(buf, sizeof(buf), &header);
+    checkBytes(__FUNCTION__, buf, len, expect, sizeof(expect));
+
+    // 缓冲区不够时不写
+    CHECK(rtpHeaderWrite(buf, RTP_HEADER_SIZE - 1, &header) == -1);
+
+    // 就地改写的字段只影响各自的位
+    rtpHeaderSetMarker(buf, 0);
+    rtpHeaderSetSeq(buf, 0xFFFF);
+    rtpHeaderSetSsrc(buf, 0xCAFEBABE);
+    CHECK(buf[0] == 0x80 && buf[1] == 0x60);
+    CHECK(buf[2] == 0xFF && buf[3] == 0xFF);
+    CHECK(buf[8] == 0xCA && buf[9] == 0xFE && buf[10] == 0xBA && buf[11] == 0xBE);
+}
+
+// CSRC 紧跟在 SSRC 后面，CC 记录个数，最多 15 个
+static void testCsrc(void)
+{
+    static const uint8_t expect[] = {
+        0x82, 0x60, 0x00, 0x01,
+        0x00, 0x00, 0x00, 0x02,
+        0x00, 0x00, 0x00, 0x03,
+        0xAA, 0xBB, 0xCC, 0xDD,
+        0x11, 0x22, 0x33, 0x44,
+    };
+    struct RtpHeader header;
+    uint8_t buf[RTP_MAX_HEADER_SIZE];
+    int len, i;
+
+    rtpHeaderInit(&header, 96, 1, 2, 3);
+    CHECK(rtpHeaderAddCsrc(&header, 0xAABBCCDD) == 0);
+    CHECK(rtpHeaderAddCsrc(&header, 0x11223344) == 0);
+
+    CHECK(rtpHeaderSize(&header) == sizeof(expect));
+    len = rtpHeaderWrite(buf, sizeof(buf), &header);
+    checkBytes(__FUNCTION__, buf, len, expect, sizeof(expect));
+    CHECK(rtpHeaderWrite(buf, sizeof(expect) - 1, &header) == -1);
+
+    for (i = 2; i < RTP_MAX_CSRC; i++)
+        CHECK(rtpHeaderAddCsrc(&header, i) == 0);
+    CHECK(rtpHeaderAddCsrc(&header, 0xFFFFFFFF) == -1);
+    CHECK(header.csrcLen == RTP_MAX_CSRC);
+    CHECK(rtpHeaderSize(&header) == RTP_HEADER_SIZE + 4 * RTP_MAX_CSRC);
+
+    len = rtpHeaderWrite(buf, sizeof(buf), &header);
+    CHECK(len == RTP_HEADER_SIZE + 4 * RTP_MAX_CSRC);
+    CHECK(buf[0] == 0x8F);
+    CHECK(buf[len - 4] == 0 && buf[len - 1] == RTP_MAX_CSRC - 1);
+}
+
+// one-byte 扩展：0xBEDE + 以 4 字节为单位的长度，元素为 ID(4 bit) 和 长度-1(4 bit)，最后补 0 对齐
+static void testOneByteExtension(void)
+{
+    // abs-send-time(ID 3，3 字节) + transport-wide-cc(ID 5，2 字节) = 7 字节，补 1 个 0 到 8 字节
+    static const uint8_t expect[] = {
+        0x90, 0x60, 0x00, 0x01,
+        0x00, 0x00, 0x00, 0x02,
+        0x00, 0x00, 0x00, 0x03,
+        0xBE, 0xDE, 0x00, 0x02,
+        0x32, 0x06, 0x00, 0x00,
+        0x51, 0xBE, 0xEF, 0x00,
+    };
+    // 只有 1 字节数据的元素，2 字节补齐到 4 字节
+    static const uint8_t expectShort[] = {
+        0x90, 0x60, 0x00, 0x01,
+        0x00, 0x00, 0x00, 0x02,
+        0x00, 0x00, 0x00, 0x03,
+        0xBE, 0xDE, 0x00, 0x01,
+        0xE0, 0x7F, 0x00, 0x00,
+    };
+    struct RtpHeader header;
+    uint8_t buf[RTP_MAX_HEADER_SIZE];
+    uint8_t value = 0x7F;
+    int len;
+
+    rtpHeaderInit(&header, 96, 1, 2, 3);
+    CHECK(rtpHeaderAddAbsSendTime(&header, 3, 1500000) == 0); // 1.5 秒 = 0x060000
+    CHECK(rtpHeaderAddTransportSeq(&header, 5, 0xBEEF) == 0);
+    CHECK(header.extensionProfile == RTP_EXTENSION_ONE_BYTE);
+    CHECK(header.extensionSize == 7);
+
+    CHECK(rtpHeaderSize(&header) == sizeof(expect));
+    len = rtpHeaderWrite(buf, sizeof(buf), &header);
+    checkBytes(__FUNCTION__, buf, len, expect, sizeof(expect));
+
+    rtpHeaderInit(&header, 96, 1, 2, 3);
+    CHECK(rtpHeaderAddExtension(&header, 14, &value, 1) == 0);
+    len = rtpHeaderWrite(buf, sizeof(buf), &header);
+    checkBytes("testOneByteExtension(short)", buf, len, expectShort, sizeof(expectShort));
+
+    // ID 0 是补齐用的，15 保留；数据 1 ~ 16 字节；总长不能超过 RTP_MAX_EXTENSION_SIZE
+    CHECK(rtpHeaderAddExtension(&header, 0, &value, 1) == -1);
+    CHECK(rtpHeaderAddExtension(&header, 15, &value, 1) == -1);
+    CHECK(rtpHeaderAddExtension(&header, 1, &value, 0) == -1);
+    CHECK(rtpHeaderAddExtension(&header, 1, "0123456789ABCDEF", 15) == -1);
+    CHECK(header.extensionSize == 2);
+    CHECK(rtpHeaderAddExtension(&header, 1, "0123456789ABC", 13) == 0);
+    CHECK(header.extensionSize == RTP_MAX_EXTENSION_SIZE);
+    CHECK(rtpHeaderAddExtension(&header, 2, &value, 1) == -1);
+
+    // 其他形式的扩展(例如 two-byte 的 0x100x)不能再加 one-byte 元素
+    rtpHeaderInit(&header, 96, 1, 2, 3);
+    header.extensionProfile = 0x1000;
+    header.extensionSize = 2;
+    CHECK(rtpHeaderAddExtension(&header, 1, &value, 1) == -1);
+}
+
+// CSRC 和扩展同时存在时扩展在 CSRC 之后，查找时要跳过 CSRC
+static void testFindExtension(void)
+{
+    struct RtpHeader header;
+    uint8_t buf[RTP_MAX_HEADER_SIZE];
+    uint32_t dataSize = 0;
+    uint8_t *data;
+    int len;
+
+    rtpHeaderInit(&header, 96, 1, 2, 3);
+    rtpHeaderAddCsrc(&header, 0xAABBCCDD);
+    rtpHeaderAddAbsSendTime(&header, 3, 0);
+    rtpHeaderAddTransportSeq(&header, 5, 0xBEEF);
+    len = rtpHeaderWrite(buf, sizeof(buf), &header);
+    CHECK(len == RTP_HEADER_SIZE + 4 + 4 + 8);
+
+    data = rtpHeaderFindExtension(buf, len, 5, &dataSize);
+    CHECK(data == buf + RTP_HEADER_SIZE + 4 + 4 + 5);
+    CHECK(data && dataSize == 2 && data[0] == 0xBE && data[1] == 0xEF);
+
+    data = rtpHeaderFindExtension(buf, len, 3, &dataSize);
+    CHECK(data == buf + RTP_HEADER_SIZE + 4 + 4 + 1 && dataSize == 3);
+
+    // 就地改写后再写出的报文中对应的位置跟着变
+    if (data)
+    {
+        rtpWriteAbsSendTime(data, 1500000);
+        CHECK(buf[RTP_HEADER_SIZE + 4 + 5] == 0x06 && buf[RTP_HEADER_SIZE + 4 + 6] == 0x00);
+    }
+
+    // 没有这个 ID、末尾的补齐字节、缓冲区被截断、没有扩展时都找不到
+    CHECK(rtpHeaderFindExtension(buf, len, 7, &dataSize) == NULL);
+    CHECK(rtpHeaderFindExtension(buf, len, 0, &dataSize) == NULL);
+    CHECK(rtpHeaderFindExtension(buf, len - 2, 5, &dataSize) == NULL);
+    CHECK(rtpHeaderFindExtension(buf, RTP_HEADER_SIZE + 4 + 2, 3, &dataSize) == NULL);
+    CHECK(rtpHeaderFindExtension(buf, 8, 3, &dataSize) == NULL);
+
+    rtpHeaderInit(&header, 96, 1, 2, 3);
+    len = rtpHeaderWrite(buf, sizeof(buf), &header);
+    CHECK(rtpHeaderFindExtension(buf, len, 3, &dataSize) == NULL);
+
+    // 扩展头声明的长度超过缓冲区时不能越界
+    rtpHeaderAddAbsSendTime(&header, 3, 0);
+    len = rtpHeaderWrite(buf, sizeof(buf), &header);
+    buf[RTP_HEADER_SIZE + 3] = 0x40;
+    CHECK(rtpHeaderFindExtension(buf, len, 3, &dataSize) == NULL);
+}
+
+// abs-send-time 是 6.18 定点的秒数，只保留 24 bit，每 64 秒回绕一次
+static void testAbsSendTimeWrap(void)
+{
+    static const struct
+    {
+        uint64_t timeUs;
+        uint32_t value;
+    } cases[] = {
+        {0, 0x000000},
+        {250000, 0x010000},    // 0.25 秒
+        {1500000, 0x060000},   // 1.5 秒
+        {63999999, 0xFFFFFF},  // 回绕前的最后一个值
+        {64000000, 0x000000},  // 64 秒回到 0
+        {64250000, 0x010000},
+        {3600250000ULL, 0x410000}, // 3600.25 秒 = 56 * 64 + 16.25 秒
+    };
+    uint8_t data[3];
+    uint32_t value;
+    int i;
+
+    for (i = 0; i < (int)(sizeof(cases) / sizeof(cases[0])); i++)
+    {
+        rtpWriteAbsSendTime(data, cases[i].timeUs);
+        value = (data[0] << 16) | (data[1] << 8) | data[2];
+        if (value != cases[i].value)
+        {
+            printf("FAIL %s: %llu us -> 0x%06x, expect 0x%06x\n", __FUNCTION__,
+                   (unsigned long long)cases[i].timeUs, value, cases[i].value);
+            failures++;
+        }
+    }
+}
+
+int main(void)
+{
+    testFixedHeader();
+    testCsrc();
+    testOneByteExtension();
+    testFindExtension();
+    testAbsSendTimeWrap();
+
+    if (failures)
+    {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+
+    printf("rtpheader: all checks passed\n");
+
+    return 0;
+}
@@ -0,0 +1,251 @@
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include "rtsp.h"
+
+enum
+{
+    RTSP_STATE_REQUEST_LINE,
+    RTSP_STATE_HEADER,
+    RTSP_STATE_BODY,
+};
+
+void rtspParserInit(struct RtspParser *parser)
+{
+    memset(parser, 0, sizeof(*parser));
+    parser->state = RTSP_STATE_REQUEST_LINE;
+}
+
+static inline int isSpace(char c)
+{
+    return c == ' ' || c == '\t';
+}
+
+// 方法名只能是大写字母、下划线和减号，比如 OPTIONS、GET_PARAMETER
+static inline int isMethodChar(char c)
+{
+    return (c >= 'A' && c <= 'Z') || c == '_' || c == '-';
+}
+
+// Method SP Request-URI SP RTSP-Version
+static int parseRequestLine(struct RtspParser *parser, const char *buf, int start, int end)
+{
+    int i = start;
+
+    while (i < end && isMethodChar(buf[i]))
+        i++;
+    if (i == start || i == end || buf[i] != ' ')
+        return -1;
+    parser->methodStart = start; // 请求行之前可能有空行
+    parser->methodEnd = i;
+
+    while (i < end && buf[i] == ' ')
+        i++;
+    parser->urlStart = i;
+    while (i < end && buf[i] != ' ')
+        i++;
+    parser->urlEnd = i;
+    if (parser->urlEnd == parser->urlStart)
+        return -1;
+
+    while (i < end && buf[i] == ' ')
+        i++;
+    parser->versionStart = i;
+    while (end > i && isSpace(buf[end - 1]))
+        end--;
+    parser->versionEnd = end;
+
+    if (end - i < 5 || memcmp(buf + i, "RTSP/", 5))
+        return -1;
+
+    return 0;
+}
+
+// Name: value
+static int parseHeaderLine(struct RtspParser *parser, const char *buf, int start, int end)
+{
+    const char *colon;
+    int n = parser->headerCount;
+    int valueStart, valueEnd, i;
+
+    // 不支持以空白开头的续行
+    if (isSpace(buf[start]))
+        return -1;
+
+    colon = (const char *)memchr(buf + start, ':', end - start);
+    if (!colon || colon == buf + start || n == RTSP_MAX_HEADERS)
+        return -1;
+
+    parser->nameStart[n] = start;
+    parser->nameEnd[n] = colon - buf;
+    while (parser->nameEnd[n] > start && isSpace(buf[parser->nameEnd[n] - 1]))
+        parser->nameEnd[n]--;
+
+    valueStart = colon - buf + 1;
+    valueEnd = end;
+    while (valueStart < valueEnd && isSpace(buf[valueStart]))
+        valueStart++;
+    while (valueEnd > valueStart && isSpace(buf[valueEnd - 1]))
+        valueEnd--;
+    parser->valueStart[n] = valueStart;
+    parser->valueEnd[n] = valueEnd;
+    parser->headerCount++;
+
+    // 解析头部时就要知道请求体有多长
+    if (parser->nameEnd[n] - start == 14 && !strncasecmp(buf + start, "Content-Length", 14))
+    {
+        if (valueStart == valueEnd)
+            return -1;
+
+        parser->contentLength = 0;
+        for (i = valueStart; i < valueEnd; i++)
+        {
+            if (buf[i] < '0' || buf[i] > '9')
+                return -1;
+
+            parser->contentLength = parser->contentLength * 10 + buf[i] - '0';
+            if (parser->contentLength > RTSP_MAX_BODY_SIZE)
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+static int parseInt(struct RtspStr str)
+{
+    int value = 0, i;
+
+    if (str.len == 0 || str.len > 9)
+        return -1;
+
+    for (i = 0; i < str.len; i++)
+    {
+        if (str.ptr[i] < '0' || str.ptr[i] > '9')
+            return -1;
+        value = value * 10 + str.ptr[i] - '0';
+    }
+
+    return value;
+}
+
+// 把偏移换算成指向 buf 的视图
+static void fillRequest(struct RtspParser *parser, const char *buf, struct RtspRequest *request)
+{
+    const struct RtspStr *cseq;
+    int i;
+
+    request->method.ptr = buf + parser->methodStart;
+    request->method.len = parser->methodEnd - parser->methodStart;
+
+    request->url.ptr = buf + parser->urlStart;
+    request->url.len = parser->urlEnd - parser->urlStart;
+    request->version.ptr = buf + parser->versionStart;
+    request->version.len = parser->versionEnd - parser->versionStart;
+
+    request->headerCount = parser->headerCount;
+    for (i = 0; i < parser->headerCount; i++)
+    {
+        request->headers[i].name.ptr = buf + parser->nameStart[i];
+        request->headers[i].name.len = parser->nameEnd[i] - parser->nameStart[i];
+        request->headers[i].value.ptr = buf + parser->valueStart[i];
+        request->headers[i].value.len = parser->valueEnd[i] - parser->valueStart[i];
+    }
+
+    request->body.ptr = buf + parser->bodyStart;
+    request->body.len = parser->contentLength;
+    request->length = parser->bodyStart + parser->contentLength;
+
+    cseq = rtspFindHeader(request, "CSeq");
+    request->cseq = cseq ? parseInt(*cseq) : -1;
+}
+
+int rtspParse(struct RtspParser *parser, const char *buf, int len, struct RtspRequest *request)
+{
+    const char *newline;
+    int lineEnd, end;
+
+    while (1)
+    {
+        if (parser->state == RTSP_STATE_BODY)
+        {
+            if (len < parser->bodyStart + parser->contentLength)
+                return RTSP_PARSE_AGAIN;
+
+            fillRequest(parser, buf, request);
+            rtspParserInit(parser);
+
+            return RTSP_PARSE_OK;
+        }
+
+        // 只扫描新到的数据
+        newline = (const char *)memchr(buf + parser->pos, '\n', len - parser->pos);
+        if (!newline)
+        {
+            parser->pos = len;
+            return len > RTSP_MAX_HEADER_SIZE ? RTSP_PARSE_ERROR : RTSP_PARSE_AGAIN;
+        }
+
+        // 行以 CRLF 结尾，也接受只有 LF 的
+        lineEnd = newline - buf;
+        end = lineEnd;
+        if (end > parser->lineStart && buf[end - 1] == '\r')
+            end--;
+        parser->pos = lineEnd + 1;
+
+        if (parser->pos > RTSP_MAX_HEADER_SIZE)
+            return RTSP_PARSE_ERROR;
+
+        if (parser->state == RTSP_STATE_REQUEST_LINE)
+        {
+            // 跳过请求之间多余的空行
+            if (end > parser->lineStart)
+            {
+                if (parseRequestLine(parser, buf, parser->lineStart, end) < 0)
+                    return RTSP_PARSE_ERROR;
+                parser->state = RTSP_STATE_HEADER;
+            }
+        }
+        else if (end == parser->lineStart)
+        {
+            // 空行，头部结束
+            parser->bodyStart = parser->pos;
+            parser->state = RTSP_STATE_BODY;
+        }
+        else if (parseHeaderLine(parser, buf, parser->lineStart, end) < 0)
+        {
+            return RTSP_PARSE_ERROR;
+        }
+
+        parser->lineStart = parser->pos;
+    }
+}
+
+const struct RtspStr *rtspFindHeader(const struct RtspRequest *request, const char *name)
+{
+    int len = strlen(name);
+    int i;
+
+    for (i = 0; i < request->headerCount; i++)
+    {
+        if (request->headers[i].name.len == len && !strncasecmp(request->headers[i].name.ptr, name, len))
+            return &request->headers[i].value;
+    }
+
+    return NULL;
+}
+
+int rtspStrEqual(struct RtspStr str, const char *s)
+{
+    return (int)strlen(s) == str.len && !memcmp(str.ptr, s, str.len);
+}
+
+char *rtspStrCopy(struct RtspStr str, char *buf, size_t size)
+{
+    size_t len = (size_t)str.len < size - 1 ? (size_t)str.len : size - 1;
+
+    memcpy(buf, str.ptr, len);
+    buf[len] = '\0';
+
+    return buf;
+}
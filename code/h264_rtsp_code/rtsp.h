@@ -0,0 +1,74 @@
+#ifndef _RTSP_H_
+#define _RTSP_H_
+
+#include <stddef.h>
+
+#define RTSP_MAX_HEADERS 32
+// 请求行和头部的总长度上限，超过就认为是错误的请求
+#define RTSP_MAX_HEADER_SIZE 4096
+// 请求体的上限，RTSP 请求一般没有请求体，有也很小
+#define RTSP_MAX_BODY_SIZE 4096
+// 一个合法请求最长的字节数，接收缓冲区至少要这么大
+#define RTSP_MAX_REQUEST_SIZE (RTSP_MAX_HEADER_SIZE + RTSP_MAX_BODY_SIZE)
+
+#define RTSP_PARSE_ERROR -1
+#define RTSP_PARSE_AGAIN 0 // 请求还不完整，收到更多数据后再调用
+#define RTSP_PARSE_OK 1
+
+// 指向接收缓冲区的字符串视图，不以 '\0' 结尾
+struct RtspStr
+{
+    const char *ptr;
+    int len;
+};
+
+struct RtspHeader
+{
+    struct RtspStr name;
+    struct RtspStr value; // 去掉了前后的空白
+};
+
+// 解析出的请求，所有字段都指向接收缓冲区，处理完之前缓冲区不能移动
+struct RtspRequest
+{
+    struct RtspStr method;
+    struct RtspStr url;
+    struct RtspStr version;
+    struct RtspHeader headers[RTSP_MAX_HEADERS];
+    int headerCount;
+    struct RtspStr body; // 按 Content-Length，没有时为空
+    int cseq;            // CSeq 头，没有时为 -1
+    int length;          // 整个请求占用的字节数，处理完后从缓冲区丢弃
+};
+
+// 增量解析的状态：请求分几次到达时，已经扫描过的部分不会再扫描
+// 位置都是相对请求开头的偏移，所以缓冲区在两次调用之间可以整体移动
+struct RtspParser
+{
+    int state;
+    int pos;       // 下一个要扫描的字节
+    int lineStart; // 当前行的开头
+    int bodyStart;
+    int contentLength;
+
+    int methodStart, methodEnd;
+    int urlStart, urlEnd;
+    int versionStart, versionEnd;
+    int headerCount;
+    int nameStart[RTSP_MAX_HEADERS], nameEnd[RTSP_MAX_HEADERS];
+    int valueStart[RTSP_MAX_HEADERS], valueEnd[RTSP_MAX_HEADERS];
+};
+
+void rtspParserInit(struct RtspParser *parser);
+// buf 指向请求的开头，len 为目前收到的字节数，可以包含后面的请求
+// 返回 RTSP_PARSE_OK 时 request 有效，解析器已经复位，可以接着解析 buf + request->length
+int rtspParse(struct RtspParser *parser, const char *buf, int len, struct RtspRequest *request);
+
+// 不区分大小写地查找头部，没有时返回 NULL
+const struct RtspStr *rtspFindHeader(const struct RtspRequest *request, const char *name);
+// 视图是否等于字符串，区分大小写
+int rtspStrEqual(struct RtspStr str, const char *s);
+// 把视图复制到 buf 并以 '\0' 结尾，超长时截断，返回 buf
+char *rtspStrCopy(struct RtspStr str, char *buf, size_t size);
+
+#endif
@@ -0,0 +1,437 @@
+// RTSP 请求解析的模糊测试和性能测试
+//   1. 把几种常见请求随机拼接，再切成随机大小的块依次交给 rtspParse()，检查解析出的方法、CSeq、头部和请求体
+//   2. 对正常请求随机改写、插入、截断字节，以及完全随机的数据，检查解析器不崩溃、不越界、返回的长度合理；
+//      头部和请求体都在上限附近的请求，必须放得进会话的接收缓冲区，超过上限时必须报错
+//   3. 测量每秒能解析的请求数：请求一次到齐，以及每次只多收到一个字节(增量解析最坏的情况)
+// 数据放在刚好这么大的堆内存末尾，加上 -fsanitize=address 编译时任何越界读都会被发现
+// gcc -O2 rtsp_bench.c rtsp.c -o rtsp_bench
+// ./rtsp_bench [-i 模糊测试轮数] [-d 每项性能测试的秒数]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "rtsp.h"
+
+#define MAX_INPUT_SIZE (RTSP_MAX_HEADER_SIZE * 4)
+#define MAX_REQUESTS_PER_INPUT 8
+
+struct Sample
+{
+    const char *name;
+    const char *text;
+    const char *method;
+    int cseq;
+    const char *headerName; // 要检查的一个头部，NULL 表示不检查
+    const char *headerValue;
+    const char *body;
+};
+
+// 和 ffplay、VLC 发来的请求差不多，另外加上裸 \n 换行、请求前的空行和请求体
+static const struct Sample samples[] = {
+    {"OPTIONS",
+     "OPTIONS rtsp://127.0.0.1:8554/live RTSP/1.0\r\n"
+     "CSeq: 1\r\n"
+     "User-Agent: Lavf60.16.100\r\n\r\n",
+     "OPTIONS", 1, "User-Agent", "Lavf60.16.100", ""},
+    {"DESCRIBE",
+     "DESCRIBE rtsp://127.0.0.1:8554/live RTSP/1.0\r\n"
+     "Accept: application/sdp\r\n"
+     "CSeq: 2\r\n"
+     "User-Agent: LibVLC/3.0.18 (LIVE555 Streaming Media v2016.11.28)\r\n\r\n",
+     "DESCRIBE", 2, "accept", "application/sdp", ""},
+    {"SETUP",
+     "SETUP rtsp://127.0.0.1:8554/live/track0 RTSP/1.0\r\n"
+     "Transport: RTP/AVP/UDP;unicast;client_port=21000-21001\r\n"
+     "CSeq: 3\r\n"
+     "User-Agent: Lavf60.16.100\r\n\r\n",
+     "SETUP", 3, "Transport", "RTP/AVP/UDP;unicast;client_port=21000-21001", ""},
+    {"PLAY",
+     "PLAY rtsp://127.0.0.1:8554/live RTSP/1.0\r\n"
+     "Range: npt=0.000-\r\n"
+     "CSeq: 4\r\n"
+     "User-Agent: Lavf60.16.100\r\n"
+     "Session:  1A2B3C4D5E6F7081 ; timeout=60 \r\n\r\n",
+     "PLAY", 4, "session", "1A2B3C4D5E6F7081 ; timeout=60", ""},
+    {"SET_PARAMETER",
+     "\r\nSET_PARAMETER rtsp://127.0.0.1:8554/live RTSP/1.0\n"
+     "CSeq: 5\n"
+     "Content-Type: text/parameters\n"
+     "Content-Length: 12\n\n"
+     "volume: 0.5\n",
+     "SET_PARAMETER", 5, "Content-Type", "text/parameters", "volume: 0.5\n"},
+    {"GET_PARAMETER",
+     "GET_PARAMETER rtsp://127.0.0.1:8554/live RTSP/1.0\r\n"
+     "CSeq: 6\r\n"
+     "content-length: 0\r\n"
+     "Session: 1A2B3C4D5E6F7081\r\n\r\n",
+     "GET_PARAMETER", 6, "Session", "1A2B3C4D5E6F7081", ""},
+};
+
+#define SAMPLE_COUNT ((int)(sizeof(samples) / sizeof(samples[0])))
+
+static double getMonotonicSec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// 把 data 复制到刚好 len 字节的堆内存中，越界读会碰到内存末尾
+static char *copyExact(const char *data, int len)
+{
+    char *buf = (char *)malloc(len > 0 ? len : 1);
+
+    memcpy(buf, data, len);
+
+    return buf;
+}
+
+static int strEqualN(struct RtspStr str, const char *s)
+{
+    return str.len == (int)strlen(s) && memcmp(str.ptr, s, str.len) == 0;
+}
+
+// 视图必须落在 [buf, buf + len) 之内
+static int strInside(struct RtspStr str, const char *buf, int len)
+{
+    return str.len == 0 || (str.len > 0 && str.ptr >= buf && str.ptr + str.len <= buf + len);
+}
+
+static int checkRequestBounds(const struct RtspRequest *request, const char *buf, int len)
+{
+    int i;
+
+    if (request->length <= 0 || request->length > len)
+        return -1;
+    if (!strInside(request->method, buf, request->length) || !strInside(request->url, buf, request->length) ||
+        !strInside(request->version, buf, request->length) || !strInside(request->body, buf, request->length))
+        return -1;
+    if (request->headerCount < 0 || request->headerCount > RTSP_MAX_HEADERS)
+        return -1;
+    for (i = 0; i < request->headerCount; i++)
+    {
+        if (!strInside(request->headers[i].name, buf, request->length) ||
+            !strInside(request->headers[i].value, buf, request->length))
+            return -1;
+    }
+
+    return 0;
+}
+
+static int checkSample(const struct RtspRequest *request, const struct Sample *sample)
+{
+    const struct RtspStr *header;
+
+    if (!strEqualN(request->method, sample->method) || request->cseq != sample->cseq ||
+        !strEqualN(request->body, sample->body) || !rtspStrEqual(request->version, "RTSP/1.0"))
+        return -1;
+
+    header = rtspFindHeader(request, sample->headerName);
+    if (!header || !strEqualN(*header, sample->headerValue))
+        return -1;
+
+    return 0;
+}
+
+// 随机拼接几个请求，按随机大小的块逐步交给解析器，和从套接字分几次收到一样
+static int testSplit(int rounds)
+{
+    char data[MAX_INPUT_SIZE];
+    int expect[MAX_REQUESTS_PER_INPUT];
+    struct RtspParser parser;
+    struct RtspRequest request;
+    int round, i;
+
+    for (round = 0; round < rounds; round++)
+    {
+        int len = 0, count = 1 + rand() % MAX_REQUESTS_PER_INPUT;
+        int have = 0, off = 0, got = 0, ret;
+        char *buf;
+
+        for (i = 0; i < count; i++)
+        {
+            expect[i] = rand() % SAMPLE_COUNT;
+            memcpy(data + len, samples[expect[i]].text, strlen(samples[expect[i]].text));
+            len += strlen(samples[expect[i]].text);
+        }
+        buf = copyExact(data, len);
+
+        rtspParserInit(&parser);
+        while (1)
+        {
+            ret = rtspParse(&parser, buf + off, have - off, &request);
+            if (ret == RTSP_PARSE_OK)
+            {
+                if (got == count || checkRequestBounds(&request, buf + off, have - off) < 0 ||
+                    checkSample(&request, &samples[expect[got]]) < 0)
+                {
+                    printf("split: round %d, request %d (%s) parsed wrong\n", round, got,
+                           got < count ? samples[expect[got]].name : "extra");
+                    return -1;
+                }
+                off += request.length;
+                got++;
+                continue;
+            }
+            if (ret == RTSP_PARSE_ERROR)
+            {
+                printf("split: round %d, parse error at offset %d\n", round, off);
+                return -1;
+            }
+            if (have == len)
+                break;
+            have += 1 + rand() % (len - have);
+        }
+
+        free(buf);
+        if (got != count || off != len)
+        {
+            printf("split: round %d, %d/%d requests, %d/%d bytes\n", round, got, count, off, len);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// 对一段输入反复解析直到出错或需要更多数据，只检查返回的结果落在输入范围内
+static int parseAll(const char *data, int len)
+{
+    struct RtspParser parser;
+    struct RtspRequest request;
+    char *buf = copyExact(data, len);
+    int off = 0, ret = 0;
+
+    rtspParserInit(&parser);
+    while (off < len && rtspParse(&parser, buf + off, len - off, &request) == RTSP_PARSE_OK)
+    {
+        if (checkRequestBounds(&request, buf + off, len - off) < 0)
+        {
+            ret = -1;
+            break;
+        }
+        off += request.length;
+    }
+
+    free(buf);
+
+    return ret;
+}
+
+// 变异：在正常请求上改写、插入、删除字节；随机：由 RTSP 中常见字符组成的随机数据
+static int testFuzz(int rounds)
+{
+    static const char alphabet[] = "AZ_ :;=-\r\n\r\n\t$0123456789CSeq:Content-Length:RTSP/1.0";
+    char data[MAX_INPUT_SIZE];
+    int round, i;
+
+    for (round = 0; round < rounds; round++)
+    {
+        int len = 0, edits, pos;
+
+        if (round % 2 == 0)
+        {
+            for (i = 1 + rand() % 3; i > 0; i--)
+            {
+                const char *text = samples[rand() % SAMPLE_COUNT].text;
+
+                memcpy(data + len, text, strlen(text));
+                len += strlen(text);
+            }
+
+            for (edits = 1 + rand() % 8; edits > 0 && len > 0; edits--)
+            {
+                pos = rand() % len;
+                switch (rand() % 4)
+                {
+                case 0:
+                    data[pos] = alphabet[rand() % (sizeof(alphabet) - 1)];
+                    break;
+                case 1:
+                    data[pos] = (char)(rand() % 256);
+                    break;
+                case 2:
+                    if (len < MAX_INPUT_SIZE)
+                    {
+                        memmove(data + pos + 1, data + pos, len - pos);
+                        data[pos] = alphabet[rand() % (sizeof(alphabet) - 1)];
+                        len++;
+                    }
+                    break;
+                default:
+                    len = pos;
+                    break;
+                }
+            }
+        }
+        else
+        {
+            len = rand() % (RTSP_MAX_HEADER_SIZE + 512);
+            for (i = 0; i < len; i++)
+                data[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
+        }
+
+        if (parseAll(data, len) < 0)
+        {
+            printf("fuzz: round %d, request view outside the %d byte input\n", round, len);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// 头部和请求体长度在上限附近的请求，按随机大小的块收进一个 RTSP_MAX_REQUEST_SIZE 的接收缓冲区，
+// 和 main.c 的会话一样：两者都不超过上限时必须解析成功，缓冲区不会先满；超过任何一个上限时必须报错
+static int testLimits(int rounds)
+{
+    static char data[RTSP_MAX_REQUEST_SIZE + 256];
+    struct RtspParser parser;
+    struct RtspRequest request;
+    int round;
+
+    for (round = 0; round < rounds; round++)
+    {
+        int headerSize = RTSP_MAX_HEADER_SIZE - 64 + rand() % 129;
+        int bodySize = round % 2 ? RTSP_MAX_BODY_SIZE - 64 + rand() % 129 : rand() % RTSP_MAX_BODY_SIZE;
+        int expectOk = headerSize <= RTSP_MAX_HEADER_SIZE && bodySize <= RTSP_MAX_BODY_SIZE;
+        int len, pad, have = 0, ret = RTSP_PARSE_AGAIN;
+        char *buf;
+
+        len = snprintf(data, sizeof(data), "SET_PARAMETER rtsp://127.0.0.1:8554/live RTSP/1.0\r\n"
+                                           "CSeq: %d\r\n"
+                                           "Content-Length: %d\r\n"
+                                           "X-Pad: ",
+                       round, bodySize);
+        pad = headerSize - len - 4;
+        memset(data + len, 'p', pad);
+        len += pad;
+        memcpy(data + len, "\r\n\r\n", 4);
+        len += 4;
+        // 只有请求体放得进接收缓冲区的部分才会被收到
+        if (bodySize > (int)sizeof(data) - len)
+            bodySize = sizeof(data) - len;
+        memset(data + len, 'b', bodySize);
+        len += bodySize;
+        if (len > RTSP_MAX_REQUEST_SIZE)
+            len = RTSP_MAX_REQUEST_SIZE;
+
+        rtspParserInit(&parser);
+        while (have < len)
+        {
+            have += 1 + rand() % (len - have);
+            buf = copyExact(data, have);
+            ret = rtspParse(&parser, buf, have, &request);
+            if (ret == RTSP_PARSE_OK && (checkRequestBounds(&request, buf, have) < 0 ||
+                                         request.cseq != round || request.body.len != bodySize))
+                ret = RTSP_PARSE_ERROR;
+            free(buf);
+            if (ret != RTSP_PARSE_AGAIN)
+                break;
+        }
+
+        if (ret != (expectOk ? RTSP_PARSE_OK : RTSP_PARSE_ERROR))
+        {
+            printf("limits: round %d, %d byte header and %d byte body %s\n", round, headerSize, bodySize,
+                   ret == RTSP_PARSE_AGAIN ? "filled the receive buffer" : expectOk ? "rejected" : "accepted");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+// 把 sample 重复放满一个缓冲区，测量 seconds 秒内解析的请求数
+// byteByByte 为 1 时每次只多给一个字节，衡量增量解析是否重复扫描
+static void benchParse(const struct Sample *sample, int byteByByte, double seconds)
+{
+    static char buf[64 * 1024];
+    int textLen = strlen(sample->text);
+    int count = sizeof(buf) / textLen;
+    int len = count * textLen;
+    struct RtspParser parser;
+    struct RtspRequest request;
+    double start, elapsed;
+    long long requests = 0;
+    int i, off, have;
+
+    for (i = 0; i < count; i++)
+        memcpy(buf + i * textLen, sample->text, textLen);
+
+    start = getMonotonicSec();
+    do
+    {
+        rtspParserInit(&parser);
+        off = 0;
+        have = byteByByte ? 1 : len;
+        while (off < len)
+        {
+            if (rtspParse(&parser, buf + off, have - off, &request) == RTSP_PARSE_OK)
+            {
+                off += request.length;
+                requests++;
+            }
+            else if (have < len)
+            {
+                have++;
+            }
+            else
+            {
+                break;
+            }
+        }
+        elapsed = getMonotonicSec() - start;
+    } while (elapsed < seconds);
+
+    printf("%-14s %-13s %8.2f M req/s %7.0f MB/s\n", sample->name, byteByByte ? "byte-by-byte" : "whole",
+           requests / elapsed / 1e6, requests * textLen / elapsed / 1e6);
+}
+
+int main(int argc, char *argv[])
+{
+    int rounds = 200000;
+    double seconds = 1;
+    int opt, i;
+
+    while ((opt = getopt(argc, argv, "i:d:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'i':
+            rounds = atoi(optarg);
+            break;
+        case 'd':
+            seconds = atof(optarg);
+            break;
+        default:
+            printf("usage: %s [-i fuzz_rounds] [-d seconds_per_bench]\n", argv[0]);
+            return -1;
+        }
+    }
+
+    srand(1);
+
+    if (testSplit(rounds) < 0)
+        return 1;
+    printf("split: %d rounds ok\n", rounds);
+
+    if (testFuzz(rounds) < 0)
+        return 1;
+    printf("fuzz: %d rounds ok\n", rounds);
+
+    if (testLimits(rounds / 100 + 1) < 0)
+        return 1;
+    printf("limits: %d rounds ok\n", rounds / 100 + 1);
+
+    if (seconds <= 0)
+        return 0;
+
+    for (i = 0; i < SAMPLE_COUNT; i++)
+        benchParse(&samples[i], 0, seconds);
+    benchParse(&samples[2], 1, seconds);
+
+    return 0;
+}
@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/random.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "session.h"
+
+int portPoolInit(struct PortPool *pool, const char *ip, uint16_t minPort, uint16_t maxPort)
+{
+    memset(pool, 0, sizeof(*pool));
+
+    // RTP 使用偶数端口，RTCP 使用紧接着的奇数端口
+    minPort = (minPort + 1) & ~1;
+    if (maxPort <= minPort)
+        return -1;
+
+    snprintf(pool->ip, sizeof(pool->ip), "%s", ip);
+    pool->minPort = minPort;
+    pool->pairCount = (maxPort - minPort + 1) / 2;
+    pool->used = (uint8_t *)calloc(pool->pairCount, 1);
+    if (!pool->used)
+        return -1;
+
+    return 0;
+}
+
+void portPoolDestroy(struct PortPool *pool)
+{
+    free(pool->used);
+    pool->used = NULL;
+}
+
+static int bindUdpSocket(const char *ip, int port)
+{
+    struct sockaddr_in addr;
+    int sockfd;
+
+    sockfd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sockfd < 0)
+        return -1;
+
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr(ip);
+
+    // 不设置 SO_REUSEADDR，端口被别的进程占用时 bind() 失败，换下一对
+    if (bind(sockfd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        close(sockfd);
+        return -1;
+    }
+
+    return sockfd;
+}
+
+int portPoolAlloc(struct PortPool *pool, int *rtpSockfd, int *rtcpSockfd)
+{
+    int i, index, port;
+
+    for (i = 0; i < pool->pairCount; i++)
+    {
+        index = (pool->next + i) % pool->pairCount;
+        if (pool->used[index])
+            continue;
+
+        port = pool->minPort + index * 2;
+
+        *rtpSockfd = bindUdpSocket(pool->ip, port);
+        if (*rtpSockfd < 0)
+            continue;
+
+        *rtcpSockfd = bindUdpSocket(pool->ip, port + 1);
+        if (*rtcpSockfd < 0)
+        {
+            close(*rtpSockfd);
+            continue;
+        }
+
+        pool->used[index] = 1;
+        pool->usedCount++;
+        pool->next = (index + 1) % pool->pairCount;
+
+        return port;
+    }
+
+    return -1;
+}
+
+void portPoolRelease(struct PortPool *pool, int rtpPort)
+{
+    int index = (rtpPort - pool->minPort) / 2;
+
+    if (index < 0 || index >= pool->pairCount || !pool->used[index])
+        return;
+
+    pool->used[index] = 0;
+    pool->usedCount--;
+}
+
+// FNV-1a
+static unsigned int sessionHash(const char *id)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*id)
+    {
+        hash ^= (uint8_t)*id++;
+        hash *= 16777619u;
+    }
+
+    return hash % SESSION_TABLE_BUCKETS;
+}
+
+void sessionTableInit(struct SessionTable *table)
+{
+    memset(table, 0, sizeof(*table));
+}
+
+void sessionTableDestroy(struct SessionTable *table)
+{
+    struct SessionEntry *entry, *next;
+    int i;
+
+    for (i = 0; i < SESSION_TABLE_BUCKETS; i++)
+    {
+        for (entry = table->buckets[i]; entry; entry = next)
+        {
+            next = entry->next;
+            free(entry);
+        }
+        table->buckets[i] = NULL;
+    }
+    table->count = 0;
+}
+
+int sessionTableAdd(struct SessionTable *table, void *session, char *id)
+{
+    struct SessionEntry *entry;
+    uint64_t value;
+    unsigned int bucket;
+
+    entry = (struct SessionEntry *)malloc(sizeof(*entry));
+    if (!entry)
+        return -1;
+
+    // 会话 ID 不能被猜到，否则别人可以用它控制这个会话
+    do
+    {
+        if (getrandom(&value, sizeof(value), 0) != sizeof(value))
+            value = ((uint64_t)rand() << 32) ^ rand();
+
+        snprintf(entry->id, sizeof(entry->id), "%016llX", (unsigned long long)value);
+    } while (sessionTableFind(table, entry->id));
+
+    bucket = sessionHash(entry->id);
+    entry->session = session;
+    entry->next = table->buckets[bucket];
+    table->buckets[bucket] = entry;
+    table->count++;
+
+    strcpy(id, entry->id);
+
+    return 0;
+}
+
+void *sessionTableFind(struct SessionTable *table, const char *id)
+{
+    struct SessionEntry *entry;
+
+    for (entry = table->buckets[sessionHash(id)]; entry; entry = entry->next)
+    {
+        if (!strcmp(entry->id, id))
+            return entry->session;
+    }
+
+    return NULL;
+}
+
+void sessionTableRemove(struct SessionTable *table, const char *id)
+{
+    struct SessionEntry **link, *entry;
+
+    for (link = &table->buckets[sessionHash(id)]; (entry = *link) != NULL; link = &entry->next)
+    {
+        if (!strcmp(entry->id, id))
+        {
+            *link = entry->next;
+            free(entry);
+            table->count--;
+            return;
+        }
+    }
+}
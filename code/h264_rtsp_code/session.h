@@ -0,0 +1,50 @@
+#ifndef _SESSION_H_
+#define _SESSION_H_
+
+#include <stdint.h>
+
+// RTSP Session 头中的会话 ID，16 个十六进制字符
+#define SESSION_ID_SIZE 17
+
+#define SESSION_TABLE_BUCKETS 256
+
+// RTP/RTCP 端口池：从 [minPort, maxPort] 中分配相邻的偶数/奇数端口对
+// 每个会话绑定自己的一对套接字，RTCP 报告按套接字就能区分是哪个会话的
+struct PortPool
+{
+    char ip[40];      // 绑定的地址
+    uint16_t minPort; // 偶数
+    int pairCount;
+    uint8_t *used;    // 每个端口对是否已经分配
+    int next;         // 下次从这里开始找，刚释放的端口不会马上被复用
+    int usedCount;
+};
+
+int portPoolInit(struct PortPool *pool, const char *ip, uint16_t minPort, uint16_t maxPort);
+void portPoolDestroy(struct PortPool *pool);
+// 分配一对端口并绑定好两个 UDP 套接字，返回 RTP 端口，端口用完时返回 -1
+int portPoolAlloc(struct PortPool *pool, int *rtpSockfd, int *rtcpSockfd);
+void portPoolRelease(struct PortPool *pool, int rtpPort);
+
+struct SessionEntry
+{
+    char id[SESSION_ID_SIZE];
+    void *session;
+    struct SessionEntry *next;
+};
+
+// 会话 ID 到会话的哈希表
+struct SessionTable
+{
+    struct SessionEntry *buckets[SESSION_TABLE_BUCKETS];
+    int count;
+};
+
+void sessionTableInit(struct SessionTable *table);
+void sessionTableDestroy(struct SessionTable *table);
+// 生成一个随机的、表中还没有的会话 ID 并登记，失败返回 -1
+int sessionTableAdd(struct SessionTable *table, void *session, char *id);
+void *sessionTableFind(struct SessionTable *table, const char *id);
+void sessionTableRemove(struct SessionTable *table, const char *id);
+
+#endif
@@ -6,9 +6,12 @@ extern "C"
 	// include format and codec headers
 #include <libavformat/avformat.h>
 #include <libavcodec/avcodec.h>
+#include "decoder_threads.h"
 
 }
 
+static DecoderUsage usage;
+
 void pgm_save(unsigned char *buf, int wrap, int xsize, int ysize, FILE *f)
 {
 	// write header
@@ -40,6 +43,7 @@ void decode(AVCodecContext *dec_ctx, AVFrame *frame, AVPacket *pkt,	FILE *f)
 			fprintf(stderr, "Error during decoding\n");
 			exit(1);
 		}
+		usage.frames++;
 		//printf("saving frame %3d\n", dec_ctx->pkt_serial);
 		printf("saving frame %lld\n", frame->pts);
         fflush(stdout);
@@ -49,7 +53,7 @@ void decode(AVCodecContext *dec_ctx, AVFrame *frame, AVPacket *pkt,	FILE *f)
 }
 
 
-int main()
+int main(int argc, char *argv[])
 {
 
 	// declare format and codec contexts, also codec for decoding
@@ -61,6 +65,13 @@ int main()
 	const char *outfilename = "/Users/jacklau/Movies/ffmpeg_test/input/out.yuv";
 	int VideoStreamIndex = -1;
 
+	// -threads N / -thread_type frame|slice, then optional input and output paths
+	argc = decoder_threads_parse(argc, argv);
+	if (argc > 1)
+		infilename = argv[1];
+	if (argc > 2)
+		outfilename = argv[2];
+
 	FILE *fin = NULL;
 	FILE *fout = NULL;
 
@@ -122,8 +133,8 @@ int main()
 		goto end;
 	}
 
-	// try to open codec
-	if ((ret = avcodec_open2(codec_ctx, Codec, NULL)) < 0)
+	// try to open codec, using frame/slice threads where the codec has them
+	if ((ret = decoder_open(codec_ctx, Codec, NULL)) < 0)
 	{
 		av_log(NULL, AV_LOG_ERROR, "Cannot open video decoder\n");
 		goto end;
@@ -165,6 +176,7 @@ int main()
 	}
 
 	// main loop
+	decoder_usage_start(&usage);
 	while (1)
 	{
 		// read an encoded packet from file
@@ -185,6 +197,7 @@ int main()
 
 	//flush decoder
 	decode(codec_ctx, frame, NULL, fout);
+	decoder_usage_report(&usage, codec_ctx);
 
 	// clear and out
 end:
@@ -10,6 +10,9 @@
 #include <libavformat/avformat.h>
 #include <libavutil/avutil.h>
 #include <libavcodec/avcodec.h>
+#include "decoder_threads.h"
+
+static DecoderUsage usage;
 
 static void save_pgm(unsigned char* buffer, int linesize, int width, int height, char *name)
 {
@@ -46,13 +49,17 @@ static int decode(AVCodecContext *ctx, AVFrame *frame,AVPacket *pkt, const char
 
             return -1;
         }
-        snprintf(buffer, sizeof(buffer), "%s-%d", fileName, ctx->frame_number);
-
-        save_pgm(frame->data[0],
-                 frame->linesize[0],
-                 frame->width,
-                 frame->height,
-                 buffer);
+        usage.frames++;
+        //without a destination only decode, e.g. to time the decoder threads
+        if(fileName){
+            snprintf(buffer, sizeof(buffer), "%s-%d", fileName, ctx->frame_number);
+
+            save_pgm(frame->data[0],
+                     frame->linesize[0],
+                     frame->width,
+                     frame->height,
+                     buffer);
+        }
         
         if (pkt)
             av_packet_unref(pkt);
@@ -64,13 +71,13 @@ end:
 }
 
 
-int main(int argc, char *argv[])
+// decode src once with the current decoder_thread_count, saving frames to dst if
+// given, and return the decode speed in fps through fps
+static int decode_file(const char *src, const char *dst, double *fps)
 {
     int ret = -1;
     int idx = -1;
-    //deal with arguments
-    char *src;
-    char *dst;
+    double wall;
 
     AVFormatContext *pFmtCtx = NULL;
 
@@ -83,23 +90,16 @@ int main(int argc, char *argv[])
 
     AVFrame *frame = NULL;
 
-    av_log_set_level(AV_LOG_DEBUG);
-    if(argc < 3){
-        av_log(NULL, AV_LOG_ERROR, "the arguments must be more than 3!\n");
-    }
-
-    src = argv[1];
-    dst = argv[2];
-    
     //open the multimedia file
     if( (ret = avformat_open_input(&pFmtCtx, src, NULL, NULL)) < 0 ){
         av_log(NULL, AV_LOG_ERROR, " %s \n", av_err2str(ret));
-        exit(-1);
+        goto end;
     }
 
     //find the video stream from container
     if((idx = av_find_best_stream(pFmtCtx, AVMEDIA_TYPE_VIDEO, -1, -1, NULL, 0)) < 0){
         av_log(pFmtCtx, AV_LOG_ERROR, "There is no audio stream!\n");
+        ret = idx;
         goto end;
     }
 
@@ -112,6 +112,7 @@ int main(int argc, char *argv[])
     codec = avcodec_find_decoder(inStream->codecpar->codec_id);
     if(!codec){
         av_log(NULL, AV_LOG_ERROR, "Couldn't find codec: libx264 \n");
+        ret = AVERROR_DECODER_NOT_FOUND;
         goto end;
     }
 
@@ -119,13 +120,14 @@ int main(int argc, char *argv[])
     ctx = avcodec_alloc_context3(codec);
     if(!ctx){
         av_log(NULL, AV_LOG_ERROR, "No memory!\n");
+        ret = AVERROR(ENOMEM);
         goto end;
     }
 
     avcodec_parameters_to_context(ctx, inStream->codecpar);
 
-    //bind decoder and decoder context
-    ret = avcodec_open2(ctx, codec, NULL);
+    //bind decoder and decoder context, with as many threads as the codec can use
+    ret = decoder_open(ctx, codec, NULL);
     if(ret < 0){
         av_log(NULL, AV_LOG_ERROR, "Couldn't open the codec: %s\n", av_err2str(ret));
         goto end;
@@ -135,6 +137,7 @@ int main(int argc, char *argv[])
     frame = av_frame_alloc();
     if(!frame){
         av_log(NULL, AV_LOG_ERROR, "No Memory!\n");
+        ret = AVERROR(ENOMEM);
         goto end;
     }
 
@@ -144,12 +147,14 @@ int main(int argc, char *argv[])
     pkt = av_packet_alloc();
     if(!pkt){
         av_log(NULL, AV_LOG_ERROR, "NO Memory!\n");
+        ret = AVERROR(ENOMEM);
         goto end;
     }
 
     
 
     //read video data from multimedia files to write into destination file
+    decoder_usage_start(&usage);
     while(av_read_frame(pFmtCtx, pkt) >= 0){
         if(pkt->stream_index == idx ){
             decode(ctx, frame, pkt, dst);
@@ -157,7 +162,11 @@ int main(int argc, char *argv[])
     }
     //write the buffered frame
     decode(ctx, frame, NULL, dst);
-    
+    decoder_usage_report(&usage, ctx);
+
+    wall = (av_gettime_relative() - usage.wall_start) / 1000000.0;
+    *fps = wall > 0 ? usage.frames / wall : 0;
+    ret = 0;
 
     //free memory
 end:
@@ -177,8 +186,63 @@ end:
         av_packet_free(&pkt);
         pkt = NULL;
     }
-    
-    
+
+    return ret;
+}
+
+int main(int argc, char *argv[])
+{
+    int i, n = 1;
+    int bench = 0;
+    int cores, threads;
+    double fps = 0, base = 0;
+    //deal with arguments
+    char *src;
+    char *dst = NULL;
+
+    av_log_set_level(AV_LOG_DEBUG);
+    argc = decoder_threads_parse(argc, argv);
+    for(i = 1; i < argc; i++){
+        if(!strcmp(argv[i], "-bench")){
+            bench = 1;
+        }else{
+            argv[n++] = argv[i];
+        }
+    }
+    argc = n;
+    if(argc < 2){
+        av_log(NULL, AV_LOG_ERROR, "usage: %s src [dst] [-threads N] [-thread_type auto|frame|slice] [-bench]\n", argv[0]);
+        return -1;
+    }
+
+    src = argv[1];
+    if(argc > 2){
+        dst = argv[2];
+    }
+
+    if(!bench){
+        decode_file(src, dst, &fps);
+        return 0;
+    }
+
+    //-bench: decode the whole file again for 1, 2, 4 ... threads up to the number
+    //of cores, without saving frames, and print how the speed scales
+    av_log_set_level(AV_LOG_INFO);
+    cores = av_cpu_count();
+    for(threads = 1; ; threads = threads * 2 < cores ? threads * 2 : cores){
+        decoder_thread_count = threads;
+        if(decode_file(src, NULL, &fps) < 0){
+            return -1;
+        }
+        if(threads == 1){
+            base = fps;
+        }
+        av_log(NULL, AV_LOG_INFO, "bench: %2d threads %8.1f fps %5.2fx\n",
+               threads, fps, base > 0 ? fps / base : 0);
+        if(threads >= cores){
+            break;
+        }
+    }
 
     return 0;
-}
\ No newline at end of file
+}
@@ -5,6 +5,7 @@
 #include <libavutil/channel_layout.h>
 #include <libavutil/opt.h>
 #include <libavutil/pixdesc.h>
+#include "decoder_threads.h"
 
 // 输入格式上下文
 static AVFormatContext *ifmt_ctx;
@@ -97,8 +98,8 @@ static int open_input_file(const char *filename)
             if (codec_ctx->codec_type == AVMEDIA_TYPE_VIDEO)
                 codec_ctx->framerate = av_guess_frame_rate(ifmt_ctx, stream, NULL);
             
-            // 打开解码器
-            ret = avcodec_open2(codec_ctx, dec, NULL);
+            // 打开解码器，按解码器能力开启帧级/切片级多线程
+            ret = decoder_open(codec_ctx, dec, NULL);
             if (ret < 0) {
                 av_log(NULL, AV_LOG_ERROR, "Failed to open decoder for stream #%u\n", i);
                 return ret;
@@ -558,9 +559,11 @@ int main(int argc, char **argv)
     unsigned int stream_index;
     unsigned int i;
 
-    // 检查命令行参数
+    // 检查命令行参数，先取出 -threads / -thread_type
+    argc = decoder_threads_parse(argc, argv);
     if (argc != 3) {
-        av_log(NULL, AV_LOG_ERROR, "Usage: %s <input file> <output file>\n", argv[0]);
+        av_log(NULL, AV_LOG_ERROR, "Usage: %s <input file> <output file> "
+               "[-threads N] [-thread_type auto|frame|slice]\n", argv[0]);
         return 1;
     }
 